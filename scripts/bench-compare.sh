@@ -0,0 +1,19 @@
+#!/bin/sh
+# Boot the i386 and x86-64 kernels headless with scripts/bench.txt as the
+# boot script and print their serial logs side by side. QEMU is stopped
+# after TIMEOUT seconds, once the script has finished. QEMU_ARGS adds
+# devices to both runs, e.g. the disks for diskbench and vblkbench.
+# Usage: scripts/bench-compare.sh   (or make bench-compare)
+set -e
+TIMEOUT=${TIMEOUT:-120}
+for arch in i386 x86_64; do
+    make -s iso ARCH=$arch SCRIPT=scripts/bench.txt
+done
+timeout "$TIMEOUT" qemu-system-i386 -cdrom kernel.iso -display none \
+    -serial file:bench-i386.log $QEMU_ARGS || true
+timeout "$TIMEOUT" qemu-system-x86_64 -cdrom kernel64.iso -display none \
+    -serial file:bench-x86_64.log $QEMU_ARGS || true
+for log in bench-i386.log bench-x86_64.log; do
+    tr -d '\r' < $log > $log.tmp && mv $log.tmp $log
+done
+pr -m -t -w 160 bench-i386.log bench-x86_64.log
@@ -0,0 +1,16 @@
+#!/bin/sh
+# Emit the kernel symbol table (struct ksym in ksyms.h) as C: every
+# function symbol of a linked kernel in address order, or an empty table
+# when no kernel is given.
+# Usage: scripts/ksyms.sh [kernel] > ksyms_table.c
+set -e
+echo '#include "ksyms.h"'
+echo
+echo 'const struct ksym ksyms_table[] = {'
+if [ $# -eq 1 ]; then
+    nm -n --defined-only "$1" | awk '$2 ~ /^[tT]$/ { printf "    {0x%s, \"%s\"},\n", $1, $3 }'
+fi
+echo '    {0, 0}'
+echo '};'
+echo
+echo 'const u32 ksyms_count = sizeof(ksyms_table) / sizeof(ksyms_table[0]) - 1;'
@@ -0,0 +1,54 @@
+#!/bin/sh
+# Turn the "P <eip> <count>" lines of a "profile dump" captured from the
+# serial console into a function ordering file, hottest function first.
+# Usage: scripts/profile-order.sh build/kernel.bin serial.log > scripts/text-order.txt
+set -e
+if [ $# -ne 2 ]; then
+    echo "usage: $0 <kernel.bin> <serial log>" >&2
+    exit 1
+fi
+
+echo "# Generated by scripts/profile-order.sh from $2"
+nm -n --defined-only "$1" | awk '
+    function hex(s,    i, v) {
+        v = 0
+        s = tolower(s)
+        sub(/^0x/, "", s)
+        for (i = 1; i <= length(s); i++) {
+            v = v * 16 + index("0123456789abcdef", substr(s, i, 1)) - 1
+        }
+        return v
+    }
+    # Function symbols in address order; cold parts stay where gcc put them
+    NR == FNR {
+        if ($2 ~ /^[tT]$/ && $3 !~ /\.cold/) {
+            addr[n] = hex($1)
+            name[n] = $3
+            n++
+        }
+        next
+    }
+    $1 == "P" && NF == 3 {
+        a = hex($2)
+        lo = 0
+        hi = n - 1
+        hit = -1
+        while (lo <= hi) {
+            mid = int((lo + hi) / 2)
+            if (addr[mid] <= a) {
+                hit = mid
+                lo = mid + 1
+            } else {
+                hi = mid - 1
+            }
+        }
+        if (hit >= 0) {
+            samples[name[hit]] += $3
+        }
+    }
+    END {
+        for (f in samples) {
+            print samples[f], f
+        }
+    }
+' - "$2" | tr -d '\r' | sort -k1,1nr -k2 | awk '{ print $2 }'
@@ -12,12 +12,26 @@ multiboot_start:
     dd LENGTH
     dd CHECKSUM
     
+    ; Module alignment tag: load modules on page boundaries
+    dw 6    ; type
+    dw 0    ; flags
+    dd 8    ; size
+    
     ; End tag
     dw 0    ; type
     dw 0    ; flags
     dd 8    ; size
 multiboot_end:
 
+; Warm restart: eax carries this instead of the Multiboot2 magic
+MB2_BOOTLOADER_MAGIC equ 0x36d76289
+WARM_MAGIC           equ 0x5741524D    ; "WARM"
+WARM_MBI_MAX         equ 16384         ; REBOOT_MBI_MAX in reboot.h
+
+; struct reboot_warm_info field offsets
+WARM_SNAPSHOT        equ 0
+WARM_ENTRY           equ 4
+
 ; Stack
 section .bss
 align 16
@@ -25,10 +39,71 @@ stack_bottom:
     resb 16384  ; 16 KiB stack
 stack_top:
 
+; Survives warm restarts (see linker.ld)
+section .warm nobits alloc write align=16
+global reboot_mbi
+global reboot_info
+reboot_mbi:
+    resb WARM_MBI_MAX
+reboot_info:
+    resb 32
+
+extern __data_start
+extern __data_end
+extern __bss_start
+extern __bss_end
+extern __warm_data
+
 ; Entry point
 section .text
 global start
 start:
+    cld
+    cmp eax, WARM_MAGIC
+    je .warm
+
+    ; Cold boot: keep pristine copies of .data/.user and of the boot
+    ; information so a warm restart can start over from them
+    mov dword [reboot_info + WARM_ENTRY], 0
+    mov dword [reboot_info + WARM_SNAPSHOT], 0
+    cmp eax, MB2_BOOTLOADER_MAGIC
+    jne .boot
+    mov ecx, [ebx]
+    cmp ecx, WARM_MBI_MAX
+    ja .boot
+    mov esi, ebx
+    mov edi, reboot_mbi
+    rep movsb
+    mov esi, __data_start
+    mov edi, __warm_data
+    mov ecx, __data_end
+    sub ecx, esi
+    shr ecx, 2
+    rep movsd
+    mov dword [reboot_info + WARM_SNAPSHOT], 1
+    jmp .boot
+
+.warm:
+    ; Warm restart: put .data/.user back as loaded and clear .bss (which
+    ; holds the stack, so nothing here may push), then boot from the copy
+    ; of the boot information
+    mov esi, __warm_data
+    mov edi, __data_start
+    mov ecx, __data_end
+    sub ecx, edi
+    shr ecx, 2
+    rep movsd
+    mov edi, __bss_start
+    mov ecx, __bss_end
+    sub ecx, edi
+    shr ecx, 2
+    xor eax, eax
+    rep stosd
+    mov dword [reboot_info + WARM_ENTRY], 1
+    mov eax, MB2_BOOTLOADER_MAGIC
+    mov ebx, reboot_mbi
+
+.boot:
     ; Set up stack
     mov esp, stack_top
     
@@ -36,7 +111,11 @@ start:
     push 0
     popf
     
-    ; Call kernel main
+    ; Call kernel main with the Multiboot2 magic and info pointer; a null
+    ; frame pointer ends backtraces here
+    xor ebp, ebp
+    push ebx
+    push eax
     extern kernel_main
     call kernel_main
     
@@ -44,4 +123,18 @@ start:
     cli
 .hang:
     hlt
-    jmp .hang
\ No newline at end of file
+    jmp .hang
+
+; Re-enter start without going through firmware. Called with interrupts
+; off and devices quiesced; paging is turned off first (the kernel is
+; identity mapped) so the kernel finds the CPU as the bootloader left it.
+global reboot_warm_jump
+reboot_warm_jump:
+    cli
+    mov eax, cr0
+    and eax, 0x7FFFFFFF
+    mov cr0, eax
+    xor eax, eax
+    mov cr3, eax
+    mov eax, WARM_MAGIC
+    jmp start
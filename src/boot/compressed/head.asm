@@ -0,0 +1,169 @@
+; Decompressor stub for the compressed kernel image (make COMPRESS=1).
+; The bootloader loads this stub and the LZ4 payload above the kernel's
+; footprint (see compressed.ld); the stub unpacks the kernel to its link
+; address and enters it as if the bootloader had loaded it directly.
+
+; Multiboot2 header, with the same tags as boot.asm
+MAGIC    equ 0xe85250d6                ; multiboot2 magic number
+ARCH     equ 0                         ; protected mode i386
+LENGTH   equ multiboot_end - multiboot_start
+CHECKSUM equ -(MAGIC + ARCH + LENGTH)  ; checksum
+
+section .multiboot
+align 8
+multiboot_start:
+    dd MAGIC
+    dd ARCH
+    dd LENGTH
+    dd CHECKSUM
+
+    ; Module alignment tag: load modules on page boundaries
+    dw 6    ; type
+    dw 0    ; flags
+    dd 8    ; size
+
+    ; End tag
+    dw 0    ; type
+    dw 0    ; flags
+    dd 8    ; size
+multiboot_end:
+
+; Payload: `lz4 -l` output, a magic number followed by blocks that each
+; start with their compressed size
+LZ4_LEGACY_MAGIC     equ 0x184C2102
+
+; struct boot_unpack field offsets (boot.h)
+BOOT_UNPACK_MAGIC    equ 0x4B434E55    ; "UNCK"
+UNPACK_MAGIC         equ 0
+UNPACK_PACKED        equ 4
+UNPACK_UNPACKED      equ 8
+UNPACK_ENTRY_TSC     equ 16
+UNPACK_DONE_TSC      equ 24
+
+; From the kernel's symbol table (build/kernel-syms.ld)
+extern KERNEL_START
+extern KERNEL_ENTRY
+extern KERNEL_UNPACK
+
+section .payload progbits alloc noexec nowrite align=4
+align 4
+payload_start:
+    incbin PAYLOAD
+payload_end:
+
+section .bss
+align 16
+stack_bottom:
+    resb 256
+stack_top:
+entry_tsc:
+    resd 2
+
+section .text
+global start
+start:
+    cld
+    mov esp, stack_top
+    push eax                           ; Multiboot2 magic
+    push ebx                           ; Boot information
+    rdtsc
+    mov [entry_tsc], eax
+    mov [entry_tsc + 4], edx
+
+    mov esi, payload_start
+    cmp dword [esi], LZ4_LEGACY_MAGIC
+    jne .bad
+    mov edi, KERNEL_START
+
+    ; One LZ4 block per iteration; another frame's magic may follow
+.block:
+    cmp esi, payload_end
+    jae .done
+    lodsd
+    cmp eax, LZ4_LEGACY_MAGIC
+    je .block
+    lea edx, [esi + eax]
+
+    ; Sequence: token, literal length extension, literals, then (except
+    ; for the last sequence of a block) offset and match length extension.
+    ; rep movsb copies a byte at a time architecturally, so overlapping
+    ; matches come out right, and runs at memcpy speed on fast-string CPUs.
+.sequence:
+    movzx ebx, byte [esi]
+    inc esi
+    mov ecx, ebx
+    shr ecx, 4
+    cmp ecx, 15
+    jne .literals
+.literal_length:
+    movzx eax, byte [esi]
+    inc esi
+    add ecx, eax
+    cmp eax, 255
+    je .literal_length
+.literals:
+    rep movsb
+    cmp esi, edx
+    jae .block
+
+    movzx eax, word [esi]
+    add esi, 2
+    and ebx, 15
+    mov ecx, ebx
+    cmp ecx, 15
+    jne .match
+.match_length:
+    movzx ebx, byte [esi]
+    inc esi
+    add ecx, ebx
+    cmp ebx, 255
+    je .match_length
+.match:
+    add ecx, 4
+    push esi
+    mov esi, edi
+    sub esi, eax
+    rep movsb
+    pop esi
+    jmp .sequence
+
+.done:
+    ; Tell the kernel what the unpacking cost. The record is in the
+    ; kernel's .bss, which lies in the zeroed reserve and is past the
+    ; unpacked image.
+    mov ebx, KERNEL_UNPACK
+    mov dword [ebx + UNPACK_MAGIC], BOOT_UNPACK_MAGIC
+    mov dword [ebx + UNPACK_PACKED], payload_end - payload_start
+    sub edi, KERNEL_START
+    mov [ebx + UNPACK_UNPACKED], edi
+    mov eax, [entry_tsc]
+    mov [ebx + UNPACK_ENTRY_TSC], eax
+    mov eax, [entry_tsc + 4]
+    mov [ebx + UNPACK_ENTRY_TSC + 4], eax
+    rdtsc
+    mov [ebx + UNPACK_DONE_TSC], eax
+    mov [ebx + UNPACK_DONE_TSC + 4], edx
+
+    ; Enter the kernel with the registers the bootloader passed
+    pop ebx
+    pop eax
+    jmp KERNEL_ENTRY
+
+.bad:
+    ; No console yet: leave a message in the VGA text buffer
+    mov esi, bad_message
+    mov edi, 0xB8000
+    mov ah, 0x4F
+.bad_char:
+    lodsb
+    test al, al
+    jz .hang
+    stosw
+    jmp .bad_char
+.hang:
+    cli
+    hlt
+    jmp .hang
+
+bad_message:
+    db "Compressed kernel: bad LZ4 payload", 0
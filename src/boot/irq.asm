@@ -29,6 +29,44 @@ IRQ 13, 45    ; FPU / Coprocessor / Inter-processor
 IRQ 14, 46    ; Primary ATA Hard Disk
 IRQ 15, 47    ; Secondary ATA Hard Disk
 
+; MSI vectors, delivered through the local APIC instead of the PICs
+%macro MSI 2
+global msi%1
+msi%1:
+    cli
+    push byte 0     ; Push dummy error code
+    push byte %2    ; Push vector number
+    jmp irq_common_stub
+%endmacro
+
+MSI 0,  48
+MSI 1,  49
+MSI 2,  50
+MSI 3,  51
+MSI 4,  52
+MSI 5,  53
+MSI 6,  54
+MSI 7,  55
+MSI 8,  56
+MSI 9,  57
+MSI 10, 58
+MSI 11, 59
+MSI 12, 60
+MSI 13, 61
+MSI 14, 62
+MSI 15, 63
+
+; Table of MSI stub addresses for the IDT setup
+global msi_stub_table
+msi_stub_table:
+    dd msi0, msi1, msi2, msi3, msi4, msi5, msi6, msi7
+    dd msi8, msi9, msi10, msi11, msi12, msi13, msi14, msi15
+
+; Local APIC spurious interrupt: no EOI must be sent
+global lapic_spurious_stub
+lapic_spurious_stub:
+    iret
+
 ; Common IRQ stub
 irq_common_stub:
     pusha           ; Push all general purpose registers
@@ -0,0 +1,22 @@
+; Return path of probed functions: kprobe.c swaps a probed call's return
+; address for kprobe_trampoline, which times the call and then returns to
+; the original caller with the function's eax/edx intact.
+
+extern kprobe_return
+
+section .text
+global kprobe_trampoline
+kprobe_trampoline:
+    sub esp, 4                  ; Becomes the original return address
+    push eax
+    push ecx
+    push edx
+    lea eax, [esp + 12]         ; The slot the swapped address was popped from
+    push eax
+    call kprobe_return
+    add esp, 4
+    mov [esp + 12], eax
+    pop edx
+    pop ecx
+    pop eax
+    ret
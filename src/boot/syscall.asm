@@ -0,0 +1,102 @@
+; System call entry points and ring 3 transitions
+extern syscall_dispatch
+
+; The user data segment is flat, so the fast paths below run the C
+; dispatcher with the caller's data segments instead of reloading them.
+
+; int 0x80 entry (DPL 3 interrupt gate)
+global syscall_int80_entry
+syscall_int80_entry:
+    push ecx
+    push edx
+    push edi        ; Argument 3
+    push esi        ; Argument 2
+    push ebx        ; Argument 1
+    push eax        ; System call number
+    sti
+    call syscall_dispatch
+    cli
+    add esp, 4      ; Drop system call number, result stays in eax
+    pop ebx
+    pop esi
+    pop edi
+    pop edx
+    pop ecx
+    iret
+
+; SYSENTER entry: the CPU loads CS/SS/ESP/EIP from the MSRs and clears IF.
+; ecx holds the user stack pointer and edx the return address.
+global syscall_sysenter_entry
+syscall_sysenter_entry:
+    push ecx        ; User stack pointer for SYSEXIT
+    push edx        ; User return address for SYSEXIT
+    push edi        ; Argument 3
+    push esi        ; Argument 2
+    push ebx        ; Argument 1
+    push eax        ; System call number
+    sti
+    call syscall_dispatch
+    cli
+    add esp, 4      ; Drop system call number, result stays in eax
+    pop ebx
+    pop esi
+    pop edi
+    pop edx
+    pop ecx
+    sti             ; IF takes effect after SYSEXIT completes
+    sysexit
+
+; u32 user_enter(u32 eip, u32 esp) - drop to ring 3, returns via user_exit
+; with the caller's EFLAGS (a fault exits from an interrupt gate, IF=0)
+global user_enter
+user_enter:
+    push ebp
+    push ebx
+    push esi
+    push edi
+    pushf
+    mov [user_kernel_esp], esp
+
+    mov ecx, [esp + 24]     ; User entry point
+    mov edx, [esp + 28]     ; User stack pointer
+
+    mov ax, 0x23            ; User data segment, RPL 3
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+
+    push 0x23               ; SS
+    push edx                ; ESP
+    pushf
+    pop eax
+    or eax, 0x200           ; Interrupts enabled in user mode
+    push eax                ; EFLAGS
+    push 0x1B               ; CS, user code segment with RPL 3
+    push ecx                ; EIP
+    iret
+
+; void user_exit(u32 code) - abandon the ring 0 entry stack and return
+; from user_enter with the exit code
+global user_exit
+user_exit:
+    mov eax, [esp + 4]
+
+    mov cx, 0x10            ; Kernel data segment
+    mov ds, cx
+    mov es, cx
+    mov fs, cx
+    mov gs, cx
+
+    mov esp, [user_kernel_esp]
+    popf
+    pop edi
+    pop esi
+    pop ebx
+    pop ebp
+    ret
+
+section .bss
+align 4
+user_kernel_esp:
+    resd 1
\ No newline at end of file
@@ -0,0 +1,735 @@
+#include "ata.h"
+#include "pci.h"
+#include "irq.h"
+#include "timer.h"
+#include "paging.h"
+#include "block.h"
+#include "irqtrace.h"
+#include "dma.h"
+
+// One channel runs one DMA command at a time; everything else waits in its
+// elevator queue, sorted by drive and LBA
+struct ata_channel {
+    u16 io;
+    u16 ctrl;
+    u16 bmide;
+    u8 irq;
+    bool present;
+    struct ata_prd* prdt;
+    struct ata_request* queue;
+    struct ata_request* active;
+    u64 position;               // Elevator key just past the last command
+    u32 deadline;               // Tick at which the active command times out
+};
+
+static struct ata_channel ata_channels[2];
+static struct ata_drive ata_drives[ATA_MAX_DRIVES];
+static struct ata_stats ata_stats;
+
+static const char* ata_errors[] = {
+    "Success",
+    "Invalid request",
+    "No such drive",
+    "I/O error",
+    "Command timed out",
+};
+
+static inline void outb(u16 port, u8 val) {
+    __asm__ volatile ("outb %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline u8 inb(u16 port) {
+    u8 ret;
+    __asm__ volatile ("inb %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static inline u16 inw(u16 port) {
+    u16 ret;
+    __asm__ volatile ("inw %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static inline void outl(u16 port, u32 val) {
+    __asm__ volatile ("outl %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline u64 ata_key(u32 drive, u64 lba) {
+    return ((u64)drive << 48) | lba;
+}
+
+// Reading the alternate status register four times gives the 400ns delay
+// the device needs after a drive select
+static void ata_delay(const struct ata_channel* ch) {
+    for (int i = 0; i < 4; i++) {
+        inb(ch->ctrl);
+    }
+}
+
+static bool ata_wait_not_busy(const struct ata_channel* ch) {
+    for (u32 i = 0; i < ATA_POLL_LIMIT; i++) {
+        if (!(inb(ch->ctrl) & ATA_STATUS_BSY)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Count the PRD entries a buffer needs: one per 64 KiB-bounded piece
+static u32 ata_segments(u32 address, u32 bytes) {
+    u32 segments = 0;
+    while (bytes) {
+        u32 chunk = 0x10000 - (address & 0xFFFF);
+        if (chunk > bytes) chunk = bytes;
+        address += chunk;
+        bytes -= chunk;
+        segments++;
+    }
+    return segments;
+}
+
+// Fold the chain starting at b onto the end of the chain starting at a
+static bool ata_merge(struct ata_request* a, struct ata_request* b) {
+    if (a->drive != b->drive || a->write != b->write ||
+        a->lba + a->total != b->lba ||
+        a->total + b->total > ATA_MAX_SECTORS ||
+        a->segments + b->segments > ATA_PRD_ENTRIES) {
+        return false;
+    }
+
+    struct ata_request* tail = a;
+    while (tail->merged) {
+        tail = tail->merged;
+    }
+    tail->merged = b;
+    a->total += b->total;
+    a->segments += b->segments;
+    ata_stats.merges++;
+    return true;
+}
+
+// Insert in (drive, lba) order, merging with an adjacent neighbour
+static void ata_enqueue(struct ata_channel* ch, struct ata_request* req) {
+    u64 key = ata_key(req->drive, req->lba);
+    struct ata_request** link = &ch->queue;
+
+    while (*link) {
+        struct ata_request* q = *link;
+        if (ata_merge(q, req)) {
+            // The grown command may now touch its successor
+            if (q->next && ata_merge(q, q->next)) {
+                q->next = q->next->next;
+            }
+            return;
+        }
+        if (ata_merge(req, q)) {
+            req->next = q->next;
+            *link = req;
+            return;
+        }
+        if (ata_key(q->drive, q->lba) > key) {
+            break;
+        }
+        link = &q->next;
+    }
+
+    req->next = *link;
+    *link = req;
+}
+
+// C-LOOK: take the first command at or after the current position and
+// wrap to the lowest key once the sweep runs off the end
+static struct ata_request* ata_dequeue(struct ata_channel* ch) {
+    struct ata_request** link = &ch->queue;
+    while (*link && ata_key((*link)->drive, (*link)->lba) < ch->position) {
+        link = &(*link)->next;
+    }
+    if (!*link) {
+        link = &ch->queue;
+    }
+
+    struct ata_request* req = *link;
+    if (req) {
+        *link = req->next;
+        req->next = 0;
+    }
+    return req;
+}
+
+static void ata_complete(struct ata_request* req, int status) {
+    while (req) {
+        struct ata_request* next = req->merged;
+        req->merged = 0;
+        if (status == ATA_OK) {
+            ata_stats.sectors += req->count;
+        }
+        req->status = status;
+        if (req->done) {
+            req->done(req);
+        }
+        req = next;
+    }
+}
+
+static bool ata_issue(struct ata_channel* ch, struct ata_request* req) {
+    const struct ata_drive* drive = &ata_drives[req->drive];
+
+    // Build the scatter/gather list across every merged request
+    u32 entry = 0;
+    for (struct ata_request* r = req; r; r = r->merged) {
+        u32 address = dma_virt_to_phys(r->buffer);
+        u32 bytes = r->count * ATA_SECTOR_SIZE;
+        while (bytes) {
+            u32 chunk = 0x10000 - (address & 0xFFFF);
+            if (chunk > bytes) chunk = bytes;
+            ch->prdt[entry].address = address;
+            ch->prdt[entry].size = (u16)chunk;
+            ch->prdt[entry].flags = 0;
+            entry++;
+            address += chunk;
+            bytes -= chunk;
+        }
+    }
+    ch->prdt[entry - 1].flags = ATA_PRD_EOT;
+
+    u8 direction = req->write ? 0 : ATA_BM_CMD_READ;
+    outb(ch->bmide + ATA_BM_COMMAND, 0);
+    outl(ch->bmide + ATA_BM_PRDT, dma_virt_to_phys(ch->prdt));
+    outb(ch->bmide + ATA_BM_STATUS, ATA_BM_STATUS_IRQ | ATA_BM_STATUS_ERROR);
+    outb(ch->bmide + ATA_BM_COMMAND, direction);
+
+    bool lba48 = drive->lba48 && req->lba + req->total > 0x0FFFFFFF;
+    u8 select = 0xE0 | (drive->slave ? 0x10 : 0);
+    if (!lba48) {
+        select |= (req->lba >> 24) & 0x0F;
+    }
+    outb(ch->io + ATA_REG_DRIVE, select);
+    ata_delay(ch);
+    if (!ata_wait_not_busy(ch)) {
+        return false;
+    }
+
+    // Sector count 0 means 256 (LBA28) or 65536 (LBA48)
+    if (lba48) {
+        outb(ch->io + ATA_REG_SECCOUNT, (req->total >> 8) & 0xFF);
+        outb(ch->io + ATA_REG_LBA0, (req->lba >> 24) & 0xFF);
+        outb(ch->io + ATA_REG_LBA1, (req->lba >> 32) & 0xFF);
+        outb(ch->io + ATA_REG_LBA2, (req->lba >> 40) & 0xFF);
+    }
+    outb(ch->io + ATA_REG_SECCOUNT, req->total & 0xFF);
+    outb(ch->io + ATA_REG_LBA0, req->lba & 0xFF);
+    outb(ch->io + ATA_REG_LBA1, (req->lba >> 8) & 0xFF);
+    outb(ch->io + ATA_REG_LBA2, (req->lba >> 16) & 0xFF);
+
+    u8 command;
+    if (req->write) {
+        command = lba48 ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_WRITE_DMA;
+    } else {
+        command = lba48 ? ATA_CMD_READ_DMA_EXT : ATA_CMD_READ_DMA;
+    }
+    outb(ch->io + ATA_REG_COMMAND, command);
+    outb(ch->bmide + ATA_BM_COMMAND, direction | ATA_BM_CMD_START);
+
+    ch->position = ata_key(req->drive, req->lba + req->total);
+    ch->deadline = timer_get_ticks() + ATA_TIMEOUT_MS * timer_get_frequency() / 1000;
+    ata_stats.commands++;
+    return true;
+}
+
+// Start the next queued command if the channel is idle. Called with
+// interrupts disabled.
+static void ata_start(struct ata_channel* ch) {
+    while (!ch->active) {
+        struct ata_request* req = ata_dequeue(ch);
+        if (!req) {
+            return;
+        }
+        ch->active = req;
+        if (!ata_issue(ch, req)) {
+            ch->active = 0;
+            ata_stats.errors++;
+            ata_complete(req, ATA_ERR_IO);
+        }
+    }
+}
+
+static void ata_channel_interrupt(struct ata_channel* ch) {
+    u8 bm_status = inb(ch->bmide + ATA_BM_STATUS);
+    if (!(bm_status & ATA_BM_STATUS_IRQ)) {
+        return;     // Shared line, not ours
+    }
+
+    outb(ch->bmide + ATA_BM_COMMAND, 0);
+    u8 status = inb(ch->io + ATA_REG_STATUS);    // Deasserts INTRQ
+    outb(ch->bmide + ATA_BM_STATUS, ATA_BM_STATUS_IRQ | ATA_BM_STATUS_ERROR);
+
+    struct ata_request* req = ch->active;
+    ch->active = 0;
+    if (req) {
+        bool failed = (status & (ATA_STATUS_ERR | ATA_STATUS_DF)) || (bm_status & ATA_BM_STATUS_ERROR);
+        if (failed) {
+            ata_stats.errors++;
+        }
+        ata_complete(req, failed ? ATA_ERR_IO : ATA_OK);
+    }
+    ata_start(ch);
+}
+
+static void ata_irq_handler(struct interrupt_context* ctx) {
+    u8 irq = ctx->int_no - 32;
+    for (int i = 0; i < 2; i++) {
+        if (ata_channels[i].present && ata_channels[i].irq == irq) {
+            ata_channel_interrupt(&ata_channels[i]);
+        }
+    }
+}
+
+// Abort a command the device never completed and reset the channel
+static void ata_timeout(struct ata_channel* ch) {
+    outb(ch->bmide + ATA_BM_COMMAND, 0);
+    outb(ch->ctrl, ATA_CTRL_SRST);
+    ata_delay(ch);
+    outb(ch->ctrl, 0);
+    ata_wait_not_busy(ch);
+    inb(ch->io + ATA_REG_STATUS);
+    outb(ch->bmide + ATA_BM_STATUS, ATA_BM_STATUS_IRQ | ATA_BM_STATUS_ERROR);
+
+    struct ata_request* req = ch->active;
+    ch->active = 0;
+    ata_stats.timeouts++;
+    ata_complete(req, ATA_ERR_TIMEOUT);
+    ata_start(ch);
+}
+
+// Submission may happen from a completion callback, so the queue is
+// protected by disabling interrupts rather than assuming they are on
+int ata_submit(u32 drive, struct ata_request* req) {
+    if (drive >= ATA_MAX_DRIVES || !ata_drives[drive].present) {
+        return ATA_ERR_NO_DEVICE;
+    }
+    if (req->count == 0 || req->count > ATA_MAX_SECTORS ||
+        req->lba + req->count > ata_drives[drive].sectors ||
+        ((uptr)req->buffer & 1) ||
+        (uptr)req->buffer + req->count * ATA_SECTOR_SIZE > PAGING_IDENTITY_LIMIT) {
+        return ATA_ERR_INVALID;
+    }
+
+    req->drive = drive;
+    req->total = req->count;
+    req->segments = ata_segments(dma_virt_to_phys(req->buffer), req->count * ATA_SECTOR_SIZE);
+    req->next = 0;
+    req->merged = 0;
+    req->status = ATA_PENDING;
+
+    struct ata_channel* ch = &ata_channels[ata_drives[drive].channel];
+    u32 flags = irq_save();
+    ata_stats.requests++;
+    ata_enqueue(ch, req);
+    ata_start(ch);
+    irq_restore(flags);
+    return ATA_OK;
+}
+
+// Sleep until the request completes
+int ata_wait(struct ata_request* req) {
+    struct ata_channel* ch = &ata_channels[ata_drives[req->drive].channel];
+
+    u32 flags = irq_save();
+    while (req->status == ATA_PENDING) {
+        if (ch->active && timer_get_frequency() && (i32)(timer_get_ticks() - ch->deadline) > 0) {
+            ata_timeout(ch);
+            continue;
+        }
+        irq_wait();
+    }
+    irq_restore(flags);
+    return req->status;
+}
+
+static int ata_transfer(u32 drive, u64 lba, u32 count, void* buffer, bool write) {
+    while (count) {
+        u32 chunk = count > ATA_MAX_SECTORS ? ATA_MAX_SECTORS : count;
+        struct ata_request req;
+        memset(&req, 0, sizeof(req));
+        req.lba = lba;
+        req.count = chunk;
+        req.buffer = buffer;
+        req.write = write;
+
+        int status = ata_submit(drive, &req);
+        if (status == ATA_OK) {
+            status = ata_wait(&req);
+        }
+        if (status != ATA_OK) {
+            return status;
+        }
+
+        lba += chunk;
+        count -= chunk;
+        buffer = (u8*)buffer + chunk * ATA_SECTOR_SIZE;
+    }
+    return ATA_OK;
+}
+
+int ata_read(u32 drive, u64 lba, u32 count, void* buffer) {
+    return ata_transfer(drive, lba, count, buffer, false);
+}
+
+int ata_write(u32 drive, u64 lba, u32 count, const void* buffer) {
+    return ata_transfer(drive, lba, count, (void*)buffer, true);
+}
+
+// IDENTIFY is the only PIO transfer the driver does, with the channel's
+// interrupt disabled
+static void ata_identify(struct ata_channel* ch, u32 index) {
+    struct ata_drive* drive = &ata_drives[index];
+    u16 data[256];
+
+    outb(ch->io + ATA_REG_DRIVE, 0xA0 | ((index & 1) ? 0x10 : 0));
+    ata_delay(ch);
+    outb(ch->io + ATA_REG_SECCOUNT, 0);
+    outb(ch->io + ATA_REG_LBA0, 0);
+    outb(ch->io + ATA_REG_LBA1, 0);
+    outb(ch->io + ATA_REG_LBA2, 0);
+    outb(ch->io + ATA_REG_COMMAND, ATA_CMD_IDENTIFY);
+
+    u8 status = inb(ch->io + ATA_REG_STATUS);
+    if (status == 0 || status == 0xFF || !ata_wait_not_busy(ch)) {
+        return;     // No device or floating bus
+    }
+    if (inb(ch->io + ATA_REG_LBA1) || inb(ch->io + ATA_REG_LBA2)) {
+        return;     // ATAPI or SATA signature, not a plain ATA disk
+    }
+
+    for (u32 i = 0; i < ATA_POLL_LIMIT; i++) {
+        status = inb(ch->io + ATA_REG_STATUS);
+        if (status & (ATA_STATUS_DRQ | ATA_STATUS_ERR)) break;
+    }
+    if (!(status & ATA_STATUS_DRQ) || (status & ATA_STATUS_ERR)) {
+        return;
+    }
+
+    for (int i = 0; i < 256; i++) {
+        data[i] = inw(ch->io + ATA_REG_DATA);
+    }
+
+    // Word 49 bit 8: DMA supported, word 83 bit 10: LBA48 supported
+    if (!(data[49] & (1 << 8))) {
+        return;
+    }
+    drive->lba48 = (data[83] & (1 << 10)) != 0;
+    if (drive->lba48) {
+        drive->sectors = (u64)data[100] | ((u64)data[101] << 16) |
+                         ((u64)data[102] << 32) | ((u64)data[103] << 48);
+    } else {
+        drive->sectors = (u32)data[60] | ((u32)data[61] << 16);
+    }
+
+    // Model string is stored as big-endian character pairs
+    for (int i = 0; i < 20; i++) {
+        drive->model[i * 2] = data[27 + i] >> 8;
+        drive->model[i * 2 + 1] = data[27 + i] & 0xFF;
+    }
+    drive->model[40] = '\0';
+    for (int i = 39; i >= 0 && drive->model[i] == ' '; i--) {
+        drive->model[i] = '\0';
+    }
+
+    drive->channel = index / 2;
+    drive->slave = index & 1;
+    drive->present = drive->sectors != 0;
+}
+
+// Block layer adapter: each present drive is registered as hd<index>.
+// Read-ahead requests borrow an ata_request from a small pool.
+#define ATA_BLOCK_REQUESTS  32
+
+static struct block_device ata_block_devices[ATA_MAX_DRIVES];
+static struct ata_request ata_block_requests[ATA_BLOCK_REQUESTS];
+static u32 ata_block_used = 0;
+
+static int ata_block_status(int status) {
+    switch (status) {
+        case ATA_OK: return BLOCK_OK;
+        case ATA_ERR_INVALID: return BLOCK_ERR_INVALID;
+        case ATA_ERR_NO_DEVICE: return BLOCK_ERR_NO_DEVICE;
+        default: return BLOCK_ERR_IO;
+    }
+}
+
+static int ata_block_read(struct block_device* dev, u64 sector, u32 count, void* buffer) {
+    return ata_block_status(ata_read(dev->unit, sector, count, buffer));
+}
+
+static int ata_block_write(struct block_device* dev, u64 sector, u32 count, const void* buffer) {
+    return ata_block_status(ata_write(dev->unit, sector, count, buffer));
+}
+
+static void ata_block_done(struct ata_request* req) {
+    struct block_request* breq = (struct block_request*)req->context;
+    int status = ata_block_status(req->status);
+    ata_block_used &= ~(1u << (req - ata_block_requests));
+    breq->done(breq, status);
+}
+
+static int ata_block_read_async(struct block_device* dev, struct block_request* breq) {
+    u32 flags = irq_save();
+    u32 slot = 0;
+    while (slot < ATA_BLOCK_REQUESTS && (ata_block_used & (1u << slot))) {
+        slot++;
+    }
+    if (slot == ATA_BLOCK_REQUESTS) {
+        irq_restore(flags);
+        return BLOCK_ERR_NO_BUFFER;
+    }
+    ata_block_used |= 1u << slot;
+    irq_restore(flags);
+
+    struct ata_request* req = &ata_block_requests[slot];
+    memset(req, 0, sizeof(*req));
+    req->lba = breq->sector;
+    req->count = breq->count;
+    req->buffer = breq->buffer;
+    req->done = ata_block_done;
+    req->context = breq;
+
+    int status = ata_submit(dev->unit, req);
+    if (status != ATA_OK) {
+        flags = irq_save();
+        ata_block_used &= ~(1u << slot);
+        irq_restore(flags);
+    }
+    return ata_block_status(status);
+}
+
+static const struct block_ops ata_block_ops = {
+    .read = ata_block_read,
+    .write = ata_block_write,
+    .read_async = ata_block_read_async,
+};
+
+static void ata_register_block(u32 index) {
+    struct block_device* dev = &ata_block_devices[index];
+    memset(dev, 0, sizeof(*dev));
+    memcpy(dev->name, "hd0", 4);
+    dev->name[2] = '0' + index;
+    dev->sectors = ata_drives[index].sectors;
+    dev->ops = &ata_block_ops;
+    dev->unit = index;
+    block_register(dev);
+}
+
+static bool ata_probe(struct pci_device* dev) {
+    // BAR4 holds the bus master registers; without it there is no DMA
+    if (!dev->bars[4].io || !dev->bars[4].size) {
+        return false;
+    }
+    pci_enable_device(dev);
+    pci_enable_bus_master(dev);
+
+    bool found = false;
+    for (int c = 0; c < 2; c++) {
+        struct ata_channel* ch = &ata_channels[c];
+        bool native = dev->prog_if & (c ? 0x04 : 0x01);
+        if (native) {
+            ch->io = (u16)dev->bars[c * 2].base;
+            ch->ctrl = (u16)dev->bars[c * 2 + 1].base + 2;
+            ch->irq = dev->irq_line;
+        } else {
+            ch->io = c ? ATA_SECONDARY_IO : ATA_PRIMARY_IO;
+            ch->ctrl = c ? ATA_SECONDARY_CTRL : ATA_PRIMARY_CTRL;
+            ch->irq = c ? ATA_SECONDARY_IRQ : ATA_PRIMARY_IRQ;
+        }
+        ch->bmide = (u16)dev->bars[4].base + c * 8;
+
+        outb(ch->ctrl, ATA_CTRL_NIEN);
+        ata_identify(ch, c * 2);
+        ata_identify(ch, c * 2 + 1);
+        inb(ch->io + ATA_REG_STATUS);
+        outb(ch->bmide + ATA_BM_STATUS, ATA_BM_STATUS_IRQ | ATA_BM_STATUS_ERROR);
+
+        if (!ata_drives[c * 2].present && !ata_drives[c * 2 + 1].present) {
+            continue;
+        }
+
+        // PRD tables must not cross a 64 KiB boundary; aligning each table
+        // to its own size guarantees that
+        u32 prdt_size = ATA_PRD_ENTRIES * sizeof(struct ata_prd);
+        ch->prdt = dma_alloc(prdt_size, prdt_size);
+        if (!ch->prdt) {
+            ata_drives[c * 2].present = false;
+            ata_drives[c * 2 + 1].present = false;
+            continue;
+        }
+        ch->present = true;
+        found = true;
+        irq_share_handler(ch->irq, ata_irq_handler);
+        irq_clear_mask(ch->irq);
+        outb(ch->ctrl, 0);
+
+        for (u32 i = c * 2; i < (u32)c * 2 + 2; i++) {
+            if (ata_drives[i].present) {
+                ata_register_block(i);
+            }
+        }
+    }
+    return found;
+}
+
+static const struct pci_device_id ata_ids[] = {
+    {PCI_ANY_ID, PCI_ANY_ID, PCI_CLASS_STORAGE, 0x01, PCI_ANY_ID},    // IDE controller
+    {0, 0, 0, 0, 0},
+};
+
+static const struct pci_driver ata_driver = {
+    .name = "ata",
+    .ids = ata_ids,
+    .probe = ata_probe,
+};
+
+void ata_initialize(void) {
+    memset(ata_channels, 0, sizeof(ata_channels));
+    memset(ata_drives, 0, sizeof(ata_drives));
+    memset(&ata_stats, 0, sizeof(ata_stats));
+    pci_register_driver(&ata_driver);
+}
+
+const struct ata_drive* ata_get_drive(u32 index) {
+    if (index < ATA_MAX_DRIVES && ata_drives[index].present) {
+        return &ata_drives[index];
+    }
+    return 0;
+}
+
+const struct ata_stats* ata_get_stats(void) {
+    return &ata_stats;
+}
+
+const char* ata_strerror(int status) {
+    if (status < 0 || status > ATA_ERR_TIMEOUT) {
+        return "Unknown error";
+    }
+    return ata_errors[status];
+}
+
+// Benchmark: keep depth requests in flight for the given number of ticks.
+// Completions resubmit from the interrupt handler, so the queue never
+// drains and the elevator always has work to merge and sort.
+#define ATA_BENCH_MAX_DEPTH     32
+#define ATA_BENCH_MAX_SECTORS   8
+
+static struct {
+    struct ata_request requests[ATA_BENCH_MAX_DEPTH];
+    u32 drive;
+    bool sequential;
+    bool stopping;
+    u32 sectors;
+    u32 span;               // Addressable request slots on the drive
+    u32 next_slot;
+    u32 seed;
+    u32 in_flight;
+    u32 operations;
+    int status;
+} ata_bench_state;
+
+static u8 ata_bench_buffer[ATA_BENCH_MAX_DEPTH][ATA_BENCH_MAX_SECTORS * ATA_SECTOR_SIZE] __attribute__((aligned(4096)));
+
+static u32 ata_bench_slot(void) {
+    if (ata_bench_state.sequential) {
+        u32 slot = ata_bench_state.next_slot++;
+        if (ata_bench_state.next_slot == ata_bench_state.span) {
+            ata_bench_state.next_slot = 0;
+        }
+        return slot;
+    }
+    ata_bench_state.seed = ata_bench_state.seed * 1103515245 + 12345;
+    return (ata_bench_state.seed >> 8) % ata_bench_state.span;
+}
+
+static void ata_bench_done(struct ata_request* req) {
+    ata_bench_state.in_flight--;
+    if (req->status != ATA_OK) {
+        ata_bench_state.status = req->status;
+        return;
+    }
+    ata_bench_state.operations++;
+    if (ata_bench_state.stopping) {
+        return;
+    }
+
+    req->lba = (u64)ata_bench_slot() * ata_bench_state.sectors;
+    ata_bench_state.in_flight++;
+    if (ata_submit(ata_bench_state.drive, req) != ATA_OK) {
+        ata_bench_state.in_flight--;
+    }
+}
+
+int ata_bench(u32 drive, bool sequential, u32 depth, u32 sectors, u32 ticks, struct ata_bench_result* result) {
+    const struct ata_drive* info = ata_get_drive(drive);
+    if (!info) {
+        return ATA_ERR_NO_DEVICE;
+    }
+    if (depth == 0 || depth > ATA_BENCH_MAX_DEPTH || sectors == 0 || sectors > ATA_BENCH_MAX_SECTORS) {
+        return ATA_ERR_INVALID;
+    }
+
+    u64 span = info->sectors;
+    for (u32 s = sectors; s > 1; s >>= 1) {
+        span >>= 1;     // sectors is a power of two for the shell's presets
+    }
+    if (span == 0) {
+        return ATA_ERR_INVALID;
+    }
+
+    memset(&ata_bench_state, 0, sizeof(ata_bench_state));
+    ata_bench_state.drive = drive;
+    ata_bench_state.sequential = sequential;
+    ata_bench_state.sectors = sectors;
+    ata_bench_state.span = span > 0x7FFFFFFF ? 0x7FFFFFFF : (u32)span;
+    ata_bench_state.seed = timer_get_ticks() | 1;
+    ata_bench_state.status = ATA_OK;
+
+    u32 commands = ata_stats.commands;
+    u32 merges = ata_stats.merges;
+    u32 start = timer_get_ticks();
+
+    for (u32 i = 0; i < depth; i++) {
+        struct ata_request* req = &ata_bench_state.requests[i];
+        req->lba = (u64)ata_bench_slot() * sectors;
+        req->count = sectors;
+        req->buffer = ata_bench_buffer[i];
+        req->write = false;
+        req->done = ata_bench_done;
+
+        u32 flags = irq_save();
+        ata_bench_state.in_flight++;
+        if (ata_submit(drive, req) != ATA_OK) {
+            ata_bench_state.in_flight--;
+        }
+        irq_restore(flags);
+    }
+
+    while (timer_get_ticks() - start < ticks && ata_bench_state.status == ATA_OK) {
+        __asm__ volatile ("hlt");
+    }
+    ata_bench_state.stopping = true;
+
+    // Drain whatever is still in flight
+    struct ata_channel* ch = &ata_channels[info->channel];
+    u32 flags = irq_save();
+    while (ata_bench_state.in_flight) {
+        if (ch->active && (i32)(timer_get_ticks() - ch->deadline) > 0) {
+            ata_timeout(ch);
+            continue;
+        }
+        irq_wait();
+    }
+    irq_restore(flags);
+
+    result->ticks = timer_get_ticks() - start;
+    result->operations = ata_bench_state.operations;
+    result->bytes = (u64)ata_bench_state.operations * sectors * ATA_SECTOR_SIZE;
+    result->commands = ata_stats.commands - commands;
+    result->merges = ata_stats.merges - merges;
+    return ata_bench_state.status;
+}
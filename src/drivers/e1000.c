@@ -0,0 +1,364 @@
+#include "e1000.h"
+#include "net.h"
+#include "pci.h"
+#include "irq.h"
+#include "cpu.h"
+#include "paging.h"
+#include "irqtrace.h"
+#include "dma.h"
+
+// One NIC. Receive descriptors always point at pool buffers: a filled one
+// is handed up as is and its slot gets a fresh buffer, so frames are never
+// copied. Under load the interrupt handler masks receive interrupts and
+// leaves the ring to net_poll() until a pass comes up short of the budget.
+struct e1000_device {
+    bool present;
+    volatile u8* mmio;
+    int irq;                            // Legacy line, or -1 with MSI
+    bool polling;
+    u32 itr;
+    u32 rx_next;                        // Next descriptor the NIC will fill
+    u32 tx_tail;                        // Next free transmit descriptor
+    u32 tx_clean;                       // Oldest descriptor not yet reclaimed
+    bool tx_pending;                    // Queued since the last doorbell
+    struct net_buffer* rx_buffers[E1000_RX_DESC];
+    struct net_buffer* tx_buffers[E1000_TX_DESC];
+    struct net_interface iface;
+};
+
+// Descriptor rings live in the DMA pool, 128-byte aligned as the NIC requires
+#define E1000_RX_RING_BYTES     (E1000_RX_DESC * sizeof(struct e1000_rx_desc))
+#define E1000_TX_RING_BYTES     (E1000_TX_DESC * sizeof(struct e1000_tx_desc))
+static struct e1000_rx_desc* e1000_rx_ring = 0;
+static struct e1000_tx_desc* e1000_tx_ring = 0;
+static struct e1000_device e1000_device;
+static struct e1000_stats e1000_stats;
+
+static inline u32 e1000_read(u32 reg) {
+    return *(volatile u32*)(e1000_device.mmio + reg);
+}
+
+static inline void e1000_write(u32 reg, u32 value) {
+    *(volatile u32*)(e1000_device.mmio + reg) = value;
+}
+
+// Free the buffers of transmitted frames
+static void e1000_tx_reclaim(struct e1000_device* dev) {
+    while (dev->tx_clean != dev->tx_tail && (e1000_tx_ring[dev->tx_clean].status & E1000_TXD_STAT_DD)) {
+        net_buffer_free(dev->tx_buffers[dev->tx_clean]);
+        dev->tx_buffers[dev->tx_clean] = 0;
+        e1000_tx_ring[dev->tx_clean].status = 0;
+        dev->tx_clean = (dev->tx_clean + 1) % E1000_TX_DESC;
+    }
+}
+
+static int e1000_transmit(struct net_interface* iface, struct net_buffer* buffer) {
+    struct e1000_device* dev = (struct e1000_device*)iface->private;
+    u32 flags = irq_save();
+    u32 next = (dev->tx_tail + 1) % E1000_TX_DESC;
+    if (next == dev->tx_clean) {
+        e1000_tx_reclaim(dev);
+        if (next == dev->tx_clean) {
+            e1000_stats.tx_full++;
+            irq_restore(flags);
+            return NET_ERR_FULL;
+        }
+    }
+
+    struct e1000_tx_desc* desc = &e1000_tx_ring[dev->tx_tail];
+    desc->addr = dma_virt_to_phys(buffer->data);
+    desc->length = buffer->length;
+    desc->cso = 0;
+    desc->cmd = E1000_TXD_CMD_EOP | E1000_TXD_CMD_IFCS | E1000_TXD_CMD_RS;
+    desc->status = 0;
+    desc->css = 0;
+    desc->special = 0;
+    dev->tx_buffers[dev->tx_tail] = buffer;
+    dev->tx_tail = next;
+    dev->tx_pending = true;
+    irq_restore(flags);
+    return NET_OK;
+}
+
+// One tail write publishes every frame queued since the last flush
+static void e1000_flush(struct net_interface* iface) {
+    struct e1000_device* dev = (struct e1000_device*)iface->private;
+    if (!dev->tx_pending) {
+        return;
+    }
+    __asm__ volatile ("" : : : "memory");
+    e1000_write(E1000_TDT, dev->tx_tail);
+    dev->tx_pending = false;
+    e1000_stats.tx_doorbells++;
+}
+
+// Hand up to budget frames to the stack, refilling each slot from the
+// buffer pool, then return the slots with one tail write and send any
+// replies with one doorbell. Called with interrupts disabled.
+static u32 e1000_rx(struct e1000_device* dev, u32 budget) {
+    u32 count = 0;
+    u64 now = rdtsc();
+
+    while (count < budget && (e1000_rx_ring[dev->rx_next].status & E1000_RXD_STAT_DD)) {
+        struct e1000_rx_desc* desc = &e1000_rx_ring[dev->rx_next];
+        struct net_buffer* buffer = dev->rx_buffers[dev->rx_next];
+        struct net_buffer* replacement = 0;
+
+        if (!(desc->status & E1000_RXD_STAT_EOP) || desc->errors) {
+            e1000_stats.rx_errors++;
+        } else if (!(replacement = net_buffer_alloc())) {
+            e1000_stats.rx_no_buffer++;
+        }
+        if (replacement) {
+            buffer->length = desc->length;
+            buffer->timestamp = now;
+            dev->rx_buffers[dev->rx_next] = replacement;
+            desc->addr = dma_virt_to_phys(replacement->data);
+        }
+        desc->status = 0;
+        dev->rx_next = (dev->rx_next + 1) % E1000_RX_DESC;
+        count++;
+
+        if (replacement) {
+            net_receive(&dev->iface, buffer);
+        }
+    }
+
+    if (count) {
+        e1000_write(E1000_RDT, (dev->rx_next + E1000_RX_DESC - 1) % E1000_RX_DESC);
+        net_flush(&dev->iface);
+    }
+    return count;
+}
+
+static bool e1000_poll(struct net_interface* iface, u32 budget) {
+    struct e1000_device* dev = (struct e1000_device*)iface->private;
+    if (!dev->polling) {
+        return false;
+    }
+
+    u32 flags = irq_save();
+    u32 count = e1000_rx(dev, budget);
+    e1000_stats.rx_polled_packets += count;
+    e1000_tx_reclaim(dev);
+    if (count < budget) {
+        // Drained: back to interrupts. A frame arriving in between has
+        // already latched its cause, so unmasking raises it at once.
+        dev->polling = false;
+        e1000_write(E1000_IMS, E1000_ICR_RX);
+    }
+    irq_restore(flags);
+    return dev->polling;
+}
+
+static void e1000_irq_handler(struct interrupt_context* ctx) {
+    (void)ctx;
+    struct e1000_device* dev = &e1000_device;
+    u32 cause = e1000_read(E1000_ICR);      // Reading clears it
+    if (!cause) {
+        return;     // Shared line, not ours
+    }
+    e1000_stats.interrupts++;
+
+    if (cause & E1000_ICR_LSC) {
+        dev->iface.link_up = (e1000_read(E1000_STATUS) & E1000_STATUS_LU) != 0;
+    }
+    if ((cause & E1000_ICR_RX) && !dev->polling) {
+        u32 count = e1000_rx(dev, NET_POLL_BUDGET);
+        e1000_stats.rx_interrupt_packets += count;
+        if (count == NET_POLL_BUDGET) {
+            dev->polling = true;
+            e1000_stats.poll_entries++;
+            e1000_write(E1000_IMC, E1000_ICR_RX);
+        }
+    }
+    if (cause & E1000_ICR_TXDW) {
+        e1000_tx_reclaim(dev);
+    }
+}
+
+static const struct net_interface_ops e1000_ops = {
+    .transmit = e1000_transmit,
+    .flush = e1000_flush,
+    .poll = e1000_poll,
+};
+
+static u16 e1000_eeprom_read(u8 address) {
+    e1000_write(E1000_EERD, ((u32)address << 8) | E1000_EERD_START);
+    for (u32 i = 0; i < 100000; i++) {
+        u32 value = e1000_read(E1000_EERD);
+        if (value & E1000_EERD_DONE) {
+            return (u16)(value >> 16);
+        }
+    }
+    return 0;
+}
+
+static void e1000_read_mac(struct e1000_device* dev) {
+    u32 high = e1000_read(E1000_RAH);
+    if (high & E1000_RAH_AV) {
+        u32 low = e1000_read(E1000_RAL);
+        for (int i = 0; i < 4; i++) {
+            dev->iface.mac[i] = (u8)(low >> (i * 8));
+        }
+        dev->iface.mac[4] = (u8)high;
+        dev->iface.mac[5] = (u8)(high >> 8);
+        return;
+    }
+    for (u8 i = 0; i < 3; i++) {
+        u16 word = e1000_eeprom_read(i);
+        dev->iface.mac[i * 2] = (u8)word;
+        dev->iface.mac[i * 2 + 1] = (u8)(word >> 8);
+    }
+    e1000_write(E1000_RAL, dev->iface.mac[0] | (dev->iface.mac[1] << 8) |
+                           (dev->iface.mac[2] << 16) | ((u32)dev->iface.mac[3] << 24));
+    e1000_write(E1000_RAH, dev->iface.mac[4] | (dev->iface.mac[5] << 8) | E1000_RAH_AV);
+}
+
+static bool e1000_setup_rings(struct e1000_device* dev) {
+    if (!e1000_rx_ring) {
+        e1000_rx_ring = dma_alloc(E1000_RX_RING_BYTES, 128);
+    }
+    if (!e1000_tx_ring) {
+        e1000_tx_ring = dma_alloc(E1000_TX_RING_BYTES, 128);
+    }
+    if (!e1000_rx_ring || !e1000_tx_ring) {
+        return false;
+    }
+
+    for (u32 i = 0; i < E1000_RX_DESC; i++) {
+        struct net_buffer* buffer = net_buffer_alloc();
+        if (!buffer) {
+            return false;
+        }
+        dev->rx_buffers[i] = buffer;
+        memset(&e1000_rx_ring[i], 0, sizeof(e1000_rx_ring[i]));
+        e1000_rx_ring[i].addr = dma_virt_to_phys(buffer->data);
+    }
+    memset(e1000_tx_ring, 0, E1000_TX_RING_BYTES);
+
+    e1000_write(E1000_RDBAL, dma_virt_to_phys(e1000_rx_ring));
+    e1000_write(E1000_RDBAH, 0);
+    e1000_write(E1000_RDLEN, E1000_RX_RING_BYTES);
+    e1000_write(E1000_RDH, 0);
+    e1000_write(E1000_RDT, E1000_RX_DESC - 1);
+    e1000_write(E1000_RDTR, 0);
+    e1000_write(E1000_RCTL, E1000_RCTL_EN | E1000_RCTL_BAM | E1000_RCTL_SECRC);
+
+    e1000_write(E1000_TDBAL, dma_virt_to_phys(e1000_tx_ring));
+    e1000_write(E1000_TDBAH, 0);
+    e1000_write(E1000_TDLEN, E1000_TX_RING_BYTES);
+    e1000_write(E1000_TDH, 0);
+    e1000_write(E1000_TDT, 0);
+    e1000_write(E1000_TIPG, E1000_TIPG_DEFAULT);
+    e1000_write(E1000_TCTL, E1000_TCTL_EN | E1000_TCTL_PSP | E1000_TCTL_CT | E1000_TCTL_COLD);
+    return true;
+}
+
+// Undo a probe that failed after the device was reset: stop both rings,
+// give back the receive buffers and keep the device off the bus, so a
+// later probe or a warm restart starts from a quiet device
+static bool e1000_probe_failed(struct e1000_device* dev, struct pci_device* pci) {
+    e1000_write(E1000_RCTL, 0);
+    e1000_write(E1000_TCTL, 0);
+    for (u32 i = 0; i < E1000_RX_DESC; i++) {
+        if (dev->rx_buffers[i]) {
+            net_buffer_free(dev->rx_buffers[i]);
+            dev->rx_buffers[i] = 0;
+        }
+    }
+    pci_disable_bus_master(pci);
+    return false;
+}
+
+static bool e1000_probe(struct pci_device* pci) {
+    struct e1000_device* dev = &e1000_device;
+    const struct pci_bar* bar = &pci->bars[0];
+    if (dev->present || bar->io || !bar->size || (bar->base + bar->size) >> 32 ||
+        !paging_map_mmio((u32)bar->base, bar->size)) {
+        return false;
+    }
+    memset(dev, 0, sizeof(*dev));
+    dev->mmio = (volatile u8*)(uptr)bar->base;
+    pci_enable_device(pci);
+    pci_enable_bus_master(pci);
+
+    // Reset, then force link up with speed autodetection
+    e1000_write(E1000_IMC, 0xFFFFFFFF);
+    e1000_write(E1000_CTRL, e1000_read(E1000_CTRL) | E1000_CTRL_RST);
+    for (volatile u32 i = 0; i < 100000 && (e1000_read(E1000_CTRL) & E1000_CTRL_RST); i++) {
+    }
+    e1000_write(E1000_IMC, 0xFFFFFFFF);
+    e1000_read(E1000_ICR);
+    e1000_write(E1000_CTRL, e1000_read(E1000_CTRL) | E1000_CTRL_SLU | E1000_CTRL_ASDE);
+
+    e1000_read_mac(dev);
+    for (u32 i = 0; i < 128; i++) {
+        e1000_write(E1000_MTA + i * 4, 0);
+    }
+    if (!e1000_setup_rings(dev)) {
+        return e1000_probe_failed(dev, pci);
+    }
+
+    memcpy(dev->iface.name, "eth0", 5);
+    dev->iface.ops = &e1000_ops;
+    dev->iface.private = dev;
+    dev->iface.link_up = (e1000_read(E1000_STATUS) & E1000_STATUS_LU) != 0;
+    if (!net_register(&dev->iface)) {
+        return e1000_probe_failed(dev, pci);
+    }
+
+    dev->irq = -1;
+    if (pci_enable_msi(pci, e1000_irq_handler) < 0) {
+        dev->irq = pci->irq_line;
+        irq_share_handler(dev->irq, e1000_irq_handler);
+        irq_clear_mask(dev->irq);
+    }
+    e1000_set_itr(E1000_ITR_DEFAULT);
+    dev->present = true;
+    e1000_write(E1000_IMS, E1000_ICR_RX | E1000_ICR_TXDW | E1000_ICR_LSC);
+    return true;
+}
+
+static const struct pci_device_id e1000_ids[] = {
+    {E1000_VENDOR, E1000_DEV_82540EM, PCI_ANY_ID, PCI_ANY_ID, PCI_ANY_ID},
+    {E1000_VENDOR, E1000_DEV_82545EM, PCI_ANY_ID, PCI_ANY_ID, PCI_ANY_ID},
+    {E1000_VENDOR, E1000_DEV_82543GC, PCI_ANY_ID, PCI_ANY_ID, PCI_ANY_ID},
+    {E1000_VENDOR, E1000_DEV_82540EM_LOM, PCI_ANY_ID, PCI_ANY_ID, PCI_ANY_ID},
+    {0, 0, 0, 0, 0},
+};
+
+static const struct pci_driver e1000_driver = {
+    .name = "e1000",
+    .ids = e1000_ids,
+    .probe = e1000_probe,
+};
+
+void e1000_initialize(void) {
+    memset(&e1000_stats, 0, sizeof(e1000_stats));
+    pci_register_driver(&e1000_driver);
+}
+
+bool e1000_present(void) {
+    return e1000_device.present;
+}
+
+const struct e1000_stats* e1000_get_stats(void) {
+    return &e1000_stats;
+}
+
+void e1000_reset_stats(void) {
+    memset(&e1000_stats, 0, sizeof(e1000_stats));
+}
+
+u32 e1000_get_itr(void) {
+    return e1000_device.itr;
+}
+
+// Minimum gap between interrupts in 256 ns units; 0 disables throttling
+void e1000_set_itr(u32 interval) {
+    e1000_device.itr = interval & 0xFFFF;
+    if (e1000_device.mmio) {
+        e1000_write(E1000_ITR, e1000_device.itr);
+    }
+}
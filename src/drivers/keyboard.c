@@ -1,6 +1,9 @@
 #include "keyboard.h"
 #include "irq.h"
 #include "vga.h"
+#include "tunable.h"
+#include "irqtrace.h"
+#include "cpu.h"
 
 // Port I/O functions
 static inline void outb(u16 port, u8 val) {
@@ -15,10 +18,33 @@ static inline u8 inb(u16 port) {
 
 // Keyboard state
 static u8 keyboard_modifiers = 0;
-static char keyboard_buffer[KEYBOARD_BUFFER_SIZE];
+static char keyboard_buffer[KEYBOARD_BUFFER_MAX];
+static size_t keyboard_buffer_mask = KEYBOARD_BUFFER_SIZE - 1;
 static size_t keyboard_buffer_head = 0;
 static size_t keyboard_buffer_tail = 0;
 
+// TSC at which each queued character's scancode arrived, for
+// injected input only (0 for the controller's), and that of the last
+// character read
+static u64 keyboard_stamps[KEYBOARD_BUFFER_MAX];
+static u64 keyboard_last_stamp = 0;
+static u32 keyboard_dropped = 0;        // Characters lost to a full ring
+static void (*keyboard_monitor)(u8 scancode) = 0;
+
+static bool keyboard_set_ring(u32 size);
+
+static struct tunable keyboard_ring_tunable = {
+    .name = "kbd.ring",
+    .description = "Keyboard input ring size",
+    .unit = "bytes",
+    .type = TUNABLE_U32,
+    .flags = TUNABLE_POWER_OF_TWO,
+    .fallback = KEYBOARD_BUFFER_SIZE,
+    .min = KEYBOARD_BUFFER_MIN,
+    .max = KEYBOARD_BUFFER_MAX,
+    .apply = keyboard_set_ring,
+};
+
 // US QWERTY scancode to ASCII translation table
 static const char scancode_to_ascii[] = {
     0,  0, '1', '2', '3', '4', '5', '6',     // 0x00-0x07
@@ -54,18 +80,25 @@ static const char scancode_to_ascii_shift[] = {
 void keyboard_initialize(void) {
     // Install keyboard interrupt handler
     irq_install_handler(1, keyboard_handler);
+    irq_install_poll(1, keyboard_poll);
     
     // Clear keyboard buffer
+    keyboard_set_ring(tunable_register(&keyboard_ring_tunable));
+    keyboard_modifiers = 0;
+}
+
+// Resize the ring, dropping anything still queued in it
+static bool keyboard_set_ring(u32 size) {
+    u32 flags = irq_save();
+    keyboard_buffer_mask = size - 1;
     keyboard_buffer_head = 0;
     keyboard_buffer_tail = 0;
-    keyboard_modifiers = 0;
+    irq_restore(flags);
+    return true;
 }
 
-void keyboard_handler(struct interrupt_context* ctx) {
-    (void)ctx; // Suppress unused parameter warning
-    
-    u8 scancode = inb(KEYBOARD_DATA_PORT);
-    
+// Decode one scancode, from the controller or keyboard_inject
+static __hot void keyboard_decode(u8 scancode, u64 stamp) {
     // Check if this is a key release (bit 7 set)
     bool key_released = (scancode & 0x80) != 0;
     scancode &= 0x7F; // Remove release bit
@@ -136,24 +169,91 @@ void keyboard_handler(struct interrupt_context* ctx) {
     
     // Add to buffer if it's a valid character
     if (ascii != 0) {
-        size_t next_head = (keyboard_buffer_head + 1) % KEYBOARD_BUFFER_SIZE;
+        size_t next_head = (keyboard_buffer_head + 1) & keyboard_buffer_mask;
         if (next_head != keyboard_buffer_tail) {
             keyboard_buffer[keyboard_buffer_head] = ascii;
+            keyboard_stamps[keyboard_buffer_head] = stamp;
             keyboard_buffer_head = next_head;
+        } else {
+            keyboard_dropped++;
         }
     }
 }
 
+__hot void keyboard_handler(struct interrupt_context* ctx) {
+    (void)ctx; // Suppress unused parameter warning
+    
+    u8 scancode = inb(KEYBOARD_DATA_PORT);
+    if (keyboard_monitor) {
+        keyboard_monitor(scancode);
+    }
+    keyboard_decode(scancode, 0);
+}
+
+// Feed a synthetic scancode through the same decode path as the
+// controller's, stamped with the TSC for scancode-to-echo latency. Called
+// with interrupts disabled, like the handler.
+__hot void keyboard_inject(u8 scancode) {
+    keyboard_decode(scancode, rdtsc());
+}
+
+// See every scancode read from the controller (to record a stream), or
+// stop with 0
+void keyboard_set_monitor(void (*monitor)(u8 scancode)) {
+    keyboard_monitor = monitor;
+}
+
+// Scancode (and whether it needs shift) that types c, false if no key does
+bool keyboard_encode(char c, u8* scancode, bool* shift) {
+    for (u8 i = 0; i < sizeof(scancode_to_ascii); i++) {
+        if (scancode_to_ascii[i] == c) {
+            *scancode = i;
+            *shift = false;
+            return true;
+        }
+    }
+    for (u8 i = 0; i < sizeof(scancode_to_ascii_shift); i++) {
+        if (scancode_to_ascii_shift[i] == c) {
+            *scancode = i;
+            *shift = true;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Drain the controller while IRQ1 is masked by storm control
+void keyboard_poll(void) {
+    for (int i = 0; i < 16; i++) {
+        u8 status = inb(KEYBOARD_STATUS_PORT);
+        if ((status & 0x21) != 0x01) {  // Output full and not mouse data
+            break;
+        }
+        keyboard_handler(0);
+    }
+}
+
 char keyboard_getchar(void) {
     while (!keyboard_haschar()) {
         __asm__ volatile ("hlt"); // Wait for interrupt
     }
     
     char c = keyboard_buffer[keyboard_buffer_tail];
-    keyboard_buffer_tail = (keyboard_buffer_tail + 1) % KEYBOARD_BUFFER_SIZE;
+    keyboard_last_stamp = keyboard_stamps[keyboard_buffer_tail];
+    keyboard_buffer_tail = (keyboard_buffer_tail + 1) & keyboard_buffer_mask;
     return c;
 }
 
+// Injection stamp of the character keyboard_getchar last returned, 0 if it
+// came from the controller
+u64 keyboard_get_stamp(void) {
+    return keyboard_last_stamp;
+}
+
+u32 keyboard_get_dropped(void) {
+    return keyboard_dropped;
+}
+
 bool keyboard_haschar(void) {
     return keyboard_buffer_head != keyboard_buffer_tail;
 }
@@ -0,0 +1,405 @@
+#include "pci.h"
+#include "acpi.h"
+#include "apic.h"
+#include "paging.h"
+
+// Devices found by the boot-time scan; the bus is never walked again
+static struct pci_device pci_devices[PCI_MAX_DEVICES];
+static u32 pci_device_count = 0;
+static u32 pci_scanned_buses[PCI_MAX_BUSES / 32];
+
+// ECAM window from the ACPI MCFG table; each bus is mapped on first use
+static u32 pci_ecam_base = 0;
+static u8 pci_ecam_start_bus = 0;
+static u8 pci_ecam_end_bus = 0;
+static u32 pci_ecam_mapped[PCI_MAX_BUSES / 32];
+static u32 pci_ecam_failed[PCI_MAX_BUSES / 32];
+
+static inline void outl(u16 port, u32 val) {
+    __asm__ volatile ("outl %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline u32 inl(u16 port) {
+    u32 ret;
+    __asm__ volatile ("inl %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static inline void outw(u16 port, u16 val) {
+    __asm__ volatile ("outw %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline u32 pci_port_address(u8 bus, u8 slot, u8 function, u16 offset) {
+    return 0x80000000 | ((u32)bus << 16) | ((u32)slot << 11) | ((u32)function << 8) | (offset & 0xFC);
+}
+
+// Returns the ECAM address of a register, or 0 to fall back to port I/O
+static u32 pci_ecam_address(u8 bus, u8 slot, u8 function, u16 offset) {
+    if (!pci_ecam_base || bus < pci_ecam_start_bus || bus > pci_ecam_end_bus) {
+        return 0;
+    }
+
+    u32 bit = 1u << (bus % 32);
+    u32 bus_base = pci_ecam_base + ((u32)bus << 20);
+    if (!(pci_ecam_mapped[bus / 32] & bit)) {
+        if (pci_ecam_failed[bus / 32] & bit) {
+            return 0;
+        }
+        if (!paging_map_mmio(bus_base, 1 << 20)) {
+            pci_ecam_failed[bus / 32] |= bit;
+            return 0;
+        }
+        pci_ecam_mapped[bus / 32] |= bit;
+    }
+    return bus_base | ((u32)slot << 15) | ((u32)function << 12) | offset;
+}
+
+u32 pci_config_read32(u8 bus, u8 slot, u8 function, u16 offset) {
+    u32 addr = pci_ecam_address(bus, slot, function, offset & ~3);
+    if (addr) {
+        return *(volatile u32*)(uptr)addr;
+    }
+    if (offset >= 0x100) {
+        return 0xFFFFFFFF;  // Extended space needs ECAM
+    }
+    outl(PCI_CONFIG_ADDRESS, pci_port_address(bus, slot, function, offset));
+    return inl(PCI_CONFIG_DATA);
+}
+
+void pci_config_write32(u8 bus, u8 slot, u8 function, u16 offset, u32 value) {
+    u32 addr = pci_ecam_address(bus, slot, function, offset & ~3);
+    if (addr) {
+        *(volatile u32*)(uptr)addr = value;
+        return;
+    }
+    if (offset >= 0x100) {
+        return;
+    }
+    outl(PCI_CONFIG_ADDRESS, pci_port_address(bus, slot, function, offset));
+    outl(PCI_CONFIG_DATA, value);
+}
+
+static u8 pci_config_read8(u8 bus, u8 slot, u8 function, u16 offset) {
+    return (u8)(pci_config_read32(bus, slot, function, offset) >> ((offset & 3) * 8));
+}
+
+static u16 pci_config_read16(u8 bus, u8 slot, u8 function, u16 offset) {
+    return (u16)(pci_config_read32(bus, slot, function, offset) >> ((offset & 2) * 8));
+}
+
+u16 pci_read16(const struct pci_device* dev, u16 offset) {
+    return pci_config_read16(dev->bus, dev->slot, dev->function, offset);
+}
+
+u32 pci_read32(const struct pci_device* dev, u16 offset) {
+    return pci_config_read32(dev->bus, dev->slot, dev->function, offset);
+}
+
+// 16-bit writes must not be widened: the status register next to the
+// command register has write-one-to-clear bits
+void pci_write16(const struct pci_device* dev, u16 offset, u16 value) {
+    u32 addr = pci_ecam_address(dev->bus, dev->slot, dev->function, offset & ~1);
+    if (addr) {
+        *(volatile u16*)(uptr)addr = value;
+        return;
+    }
+    if (offset >= 0x100) {
+        return;
+    }
+    outl(PCI_CONFIG_ADDRESS, pci_port_address(dev->bus, dev->slot, dev->function, offset));
+    outw(PCI_CONFIG_DATA + (offset & 2), value);
+}
+
+void pci_write32(const struct pci_device* dev, u16 offset, u32 value) {
+    pci_config_write32(dev->bus, dev->slot, dev->function, offset, value);
+}
+
+// Walk the capability list, returns the capability offset or 0
+u8 pci_find_capability(const struct pci_device* dev, u8 id) {
+    return pci_find_next_capability(dev, id, 0);
+}
+
+// Continue a capability walk after the capability at start (0 to begin);
+// devices such as virtio carry several capabilities with the same id
+u8 pci_find_next_capability(const struct pci_device* dev, u8 id, u8 start) {
+    if (!(pci_read16(dev, PCI_STATUS) & PCI_STATUS_CAP_LIST)) {
+        return 0;
+    }
+
+    u8 ptr;
+    if (start) {
+        ptr = (pci_read16(dev, start) >> 8) & 0xFC;
+    } else {
+        ptr = pci_config_read8(dev->bus, dev->slot, dev->function, PCI_CAPABILITY_LIST) & 0xFC;
+    }
+    for (int guard = 0; ptr >= 0x40 && guard < 48; guard++) {
+        u16 header = pci_config_read16(dev->bus, dev->slot, dev->function, ptr);
+        if ((header & 0xFF) == id) {
+            return ptr;
+        }
+        ptr = (header >> 8) & 0xFC;
+    }
+    return 0;
+}
+
+void pci_enable_device(const struct pci_device* dev) {
+    u16 command = pci_read16(dev, PCI_COMMAND);
+    for (int i = 0; i < PCI_BAR_COUNT; i++) {
+        if (!dev->bars[i].size) continue;
+        command |= dev->bars[i].io ? PCI_COMMAND_IO : PCI_COMMAND_MEMORY;
+    }
+    pci_write16(dev, PCI_COMMAND, command);
+}
+
+void pci_enable_bus_master(const struct pci_device* dev) {
+    pci_write16(dev, PCI_COMMAND, pci_read16(dev, PCI_COMMAND) | PCI_COMMAND_MASTER);
+}
+
+void pci_disable_bus_master(const struct pci_device* dev) {
+    pci_write16(dev, PCI_COMMAND, pci_read16(dev, PCI_COMMAND) & ~PCI_COMMAND_MASTER);
+}
+
+// Route the device's interrupt to a dedicated vector on this CPU's local
+// APIC. Returns the vector, or -1 if MSI is unavailable and the caller
+// must fall back to the legacy IRQ line.
+int pci_enable_msi(struct pci_device* dev, irq_handler_t handler) {
+    if (dev->msi_vector >= 0) {
+        return dev->msi_vector;
+    }
+    if (!lapic_present()) {
+        return -1;
+    }
+
+    u8 cap = pci_find_capability(dev, PCI_CAP_ID_MSI);
+    if (!cap) {
+        return -1;
+    }
+
+    int vector = irq_alloc_msi(handler);
+    if (vector < 0) {
+        return -1;
+    }
+
+    u16 flags = pci_read16(dev, cap + PCI_MSI_FLAGS);
+    pci_write32(dev, cap + PCI_MSI_ADDRESS_LO, MSI_ADDRESS_BASE | (lapic_get_id() << 12));
+    if (flags & PCI_MSI_FLAGS_64BIT) {
+        pci_write32(dev, cap + PCI_MSI_ADDRESS_HI, 0);
+        pci_write16(dev, cap + PCI_MSI_DATA_64, (u16)vector);
+    } else {
+        pci_write16(dev, cap + PCI_MSI_DATA_32, (u16)vector);
+    }
+
+    // One message, edge triggered, fixed delivery
+    flags &= ~0x0070;
+    pci_write16(dev, cap + PCI_MSI_FLAGS, flags | PCI_MSI_FLAGS_ENABLE);
+    pci_write16(dev, PCI_COMMAND, pci_read16(dev, PCI_COMMAND) | PCI_COMMAND_INTX_DISABLE);
+
+    dev->msi_vector = vector;
+    return vector;
+}
+
+// Stop every function from mastering the bus or sending MSIs, so nothing
+// writes into memory that a warm restart is about to reuse
+void pci_quiesce(void) {
+    for (u32 i = 0; i < pci_device_count; i++) {
+        struct pci_device* dev = &pci_devices[i];
+        pci_disable_bus_master(dev);
+        if (dev->msi_vector >= 0) {
+            u8 cap = pci_find_capability(dev, PCI_CAP_ID_MSI);
+            pci_write16(dev, cap + PCI_MSI_FLAGS, pci_read16(dev, cap + PCI_MSI_FLAGS) & ~PCI_MSI_FLAGS_ENABLE);
+        }
+    }
+}
+
+// Size the BARs by writing all ones; decoding is disabled meanwhile so the
+// probe value never claims an address range
+static void pci_read_bars(struct pci_device* dev) {
+    int count = (dev->header_type & PCI_HEADER_TYPE_MASK) == PCI_HEADER_BRIDGE ? 2 : PCI_BAR_COUNT;
+    u16 command = pci_read16(dev, PCI_COMMAND);
+    pci_write16(dev, PCI_COMMAND, command & ~(PCI_COMMAND_IO | PCI_COMMAND_MEMORY));
+
+    for (int i = 0; i < count; i++) {
+        u16 offset = PCI_BAR0 + i * 4;
+        u32 value = pci_read32(dev, offset);
+        pci_write32(dev, offset, 0xFFFFFFFF);
+        u32 probe = pci_read32(dev, offset);
+        pci_write32(dev, offset, value);
+
+        struct pci_bar* bar = &dev->bars[i];
+        if (probe == 0 || probe == 0xFFFFFFFF) continue;
+
+        if (value & PCI_BAR_IO) {
+            bar->io = true;
+            bar->base = value & PCI_BAR_IO_MASK;
+            bar->size = (~(probe & PCI_BAR_IO_MASK) + 1) & 0xFFFF;
+            continue;
+        }
+
+        bar->base = value & PCI_BAR_MEM_MASK;
+        bar->size = ~(probe & PCI_BAR_MEM_MASK) + 1;
+        bar->prefetchable = (value & PCI_BAR_PREFETCH) != 0;
+        if ((value & 0x6) == PCI_BAR_TYPE_64 && i + 1 < count) {
+            bar->is64 = true;
+            bar->base |= (u64)pci_read32(dev, offset + 4) << 32;
+            i++;    // The upper half occupies the next slot
+        }
+    }
+
+    pci_write16(dev, PCI_COMMAND, command);
+}
+
+static void pci_scan_bus(u8 bus);
+
+static void pci_scan_function(u8 bus, u8 slot, u8 function) {
+    u32 id = pci_config_read32(bus, slot, function, PCI_VENDOR_ID);
+    if ((id & 0xFFFF) == 0xFFFF || pci_device_count == PCI_MAX_DEVICES) {
+        return;
+    }
+
+    struct pci_device* dev = &pci_devices[pci_device_count++];
+    memset(dev, 0, sizeof(*dev));
+    dev->bus = bus;
+    dev->slot = slot;
+    dev->function = function;
+    dev->vendor_id = id & 0xFFFF;
+    dev->device_id = id >> 16;
+
+    u32 class_reg = pci_read32(dev, PCI_REVISION_ID);
+    dev->revision = class_reg & 0xFF;
+    dev->prog_if = (class_reg >> 8) & 0xFF;
+    dev->subclass = (class_reg >> 16) & 0xFF;
+    dev->class_code = class_reg >> 24;
+    dev->header_type = pci_config_read8(bus, slot, function, PCI_HEADER_TYPE);
+    dev->irq_line = pci_config_read8(bus, slot, function, PCI_INTERRUPT_LINE);
+    dev->irq_pin = pci_config_read8(bus, slot, function, PCI_INTERRUPT_PIN);
+    dev->msi_vector = -1;
+    pci_read_bars(dev);
+
+    if (dev->class_code == PCI_CLASS_BRIDGE && dev->subclass == PCI_SUBCLASS_PCI_BRIDGE &&
+        (dev->header_type & PCI_HEADER_TYPE_MASK) == PCI_HEADER_BRIDGE) {
+        u8 secondary = pci_config_read8(bus, slot, function, PCI_SECONDARY_BUS);
+        if (secondary) {
+            pci_scan_bus(secondary);
+        }
+    }
+}
+
+static void pci_scan_bus(u8 bus) {
+    if (pci_scanned_buses[bus / 32] & (1u << (bus % 32))) {
+        return;
+    }
+    pci_scanned_buses[bus / 32] |= 1u << (bus % 32);
+
+    for (u8 slot = 0; slot < PCI_MAX_SLOTS; slot++) {
+        if ((pci_config_read32(bus, slot, 0, PCI_VENDOR_ID) & 0xFFFF) == 0xFFFF) continue;
+
+        u8 functions = (pci_config_read8(bus, slot, 0, PCI_HEADER_TYPE) & PCI_HEADER_MULTIFUNC) ? PCI_MAX_FUNCTIONS : 1;
+        for (u8 function = 0; function < functions; function++) {
+            pci_scan_function(bus, slot, function);
+        }
+    }
+}
+
+u32 pci_initialize(void) {
+    pci_device_count = 0;
+    memset(pci_scanned_buses, 0, sizeof(pci_scanned_buses));
+
+    // Prefer ECAM for the first segment group when ACPI describes one
+    const struct acpi_mcfg* mcfg = (const struct acpi_mcfg*)acpi_find_table("MCFG");
+    if (mcfg && mcfg->header.length >= sizeof(struct acpi_mcfg) + sizeof(struct acpi_mcfg_entry)) {
+        const struct acpi_mcfg_entry* entry = &mcfg->entries[0];
+        if (entry->segment == 0 && (entry->base_address >> 32) == 0) {
+            // The base address corresponds to bus 0 even if start_bus is higher
+            pci_ecam_base = (u32)entry->base_address;
+            pci_ecam_start_bus = entry->start_bus;
+            pci_ecam_end_bus = entry->end_bus;
+        }
+    }
+
+    // A multi-function host bridge means one root bus per function
+    if (pci_config_read8(0, 0, 0, PCI_HEADER_TYPE) & PCI_HEADER_MULTIFUNC) {
+        for (u8 function = 0; function < PCI_MAX_FUNCTIONS; function++) {
+            if ((pci_config_read32(0, 0, function, PCI_VENDOR_ID) & 0xFFFF) == 0xFFFF) continue;
+            pci_scan_bus(function);
+        }
+    } else {
+        pci_scan_bus(0);
+    }
+
+    return pci_device_count;
+}
+
+bool pci_ecam_enabled(void) {
+    return pci_ecam_base != 0;
+}
+
+static bool pci_match(const struct pci_device_id* id, const struct pci_device* dev) {
+    return (id->vendor_id == PCI_ANY_ID || id->vendor_id == dev->vendor_id) &&
+           (id->device_id == PCI_ANY_ID || id->device_id == dev->device_id) &&
+           (id->class_code == PCI_ANY_ID || id->class_code == dev->class_code) &&
+           (id->subclass == PCI_ANY_ID || id->subclass == dev->subclass) &&
+           (id->prog_if == PCI_ANY_ID || id->prog_if == dev->prog_if);
+}
+
+// Bind the driver to every unclaimed device matching its table. Drivers
+// register after the scan, so binding happens here rather than at probe time.
+bool pci_register_driver(const struct pci_driver* driver) {
+    bool bound = false;
+    for (u32 i = 0; i < pci_device_count; i++) {
+        struct pci_device* dev = &pci_devices[i];
+        if (dev->driver) continue;
+
+        for (const struct pci_device_id* id = driver->ids; id->vendor_id || id->class_code; id++) {
+            if (pci_match(id, dev)) {
+                if (driver->probe(dev)) {
+                    dev->driver = driver;
+                    bound = true;
+                }
+                break;
+            }
+        }
+    }
+    return bound;
+}
+
+u32 pci_get_device_count(void) {
+    return pci_device_count;
+}
+
+struct pci_device* pci_get_device(u32 index) {
+    if (index < pci_device_count) {
+        return &pci_devices[index];
+    }
+    return 0;
+}
+
+const char* pci_class_name(u8 class_code, u8 subclass) {
+    switch (class_code) {
+        case 0x00: return "Unclassified device";
+        case PCI_CLASS_STORAGE:
+            switch (subclass) {
+                case 0x00: return "SCSI controller";
+                case 0x01: return "IDE controller";
+                case 0x05: return "ATA controller";
+                case 0x06: return "SATA controller";
+                case 0x08: return "NVMe controller";
+                default: return "Storage controller";
+            }
+        case PCI_CLASS_NETWORK: return subclass == 0 ? "Ethernet controller" : "Network controller";
+        case PCI_CLASS_DISPLAY: return subclass == 0 ? "VGA controller" : "Display controller";
+        case 0x04: return "Multimedia controller";
+        case 0x05: return "Memory controller";
+        case PCI_CLASS_BRIDGE:
+            switch (subclass) {
+                case 0x00: return "Host bridge";
+                case 0x01: return "ISA bridge";
+                case 0x04: return "PCI bridge";
+                case 0x80: return "Bridge";
+                default: return "Bridge device";
+            }
+        case 0x07: return "Communication controller";
+        case 0x08: return "System peripheral";
+        case 0x0C: return subclass == 0x03 ? "USB controller" : (subclass == 0x05 ? "SMBus" : "Serial bus controller");
+        default: return "Device";
+    }
+}
@@ -0,0 +1,48 @@
+#include "ramdisk.h"
+#include "block.h"
+#include "multiboot.h"
+#include "paging.h"
+
+// The module is identity mapped and writable, so every transfer is a copy
+static struct block_device ramdisk_device;
+static u8* ramdisk_base = 0;
+
+static int ramdisk_read(struct block_device* dev, u64 sector, u32 count, void* buffer) {
+    (void)dev;
+    memcpy(buffer, ramdisk_base + (u32)sector * BLOCK_SECTOR_SIZE, count * BLOCK_SECTOR_SIZE);
+    return BLOCK_OK;
+}
+
+static int ramdisk_write(struct block_device* dev, u64 sector, u32 count, const void* buffer) {
+    (void)dev;
+    memcpy(ramdisk_base + (u32)sector * BLOCK_SECTOR_SIZE, buffer, count * BLOCK_SECTOR_SIZE);
+    return BLOCK_OK;
+}
+
+// Completes before returning; it exists so the cache's read-ahead path
+// can be exercised without real hardware
+static int ramdisk_read_async(struct block_device* dev, struct block_request* req) {
+    int status = ramdisk_read(dev, req->sector, req->count, req->buffer);
+    req->done(req, status);
+    return BLOCK_OK;
+}
+
+static const struct block_ops ramdisk_ops = {
+    .read = ramdisk_read,
+    .write = ramdisk_write,
+    .read_async = ramdisk_read_async,
+};
+
+bool ramdisk_initialize(void) {
+    const struct multiboot_module* module = multiboot_find_module(RAMDISK_MODULE);
+    if (!module || module->end > PAGING_IDENTITY_LIMIT || module->end <= module->start) {
+        return false;
+    }
+
+    ramdisk_base = (u8*)(uptr)module->start;
+    memset(&ramdisk_device, 0, sizeof(ramdisk_device));
+    memcpy(ramdisk_device.name, RAMDISK_NAME, sizeof(RAMDISK_NAME));
+    ramdisk_device.sectors = (module->end - module->start) / BLOCK_SECTOR_SIZE;
+    ramdisk_device.ops = &ramdisk_ops;
+    return ramdisk_device.sectors && block_register(&ramdisk_device);
+}
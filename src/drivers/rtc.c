@@ -0,0 +1,79 @@
+#include "rtc.h"
+#include "irq.h"
+#include "irqtrace.h"
+
+// Periodic interrupt state
+static rtc_callback_t rtc_callback = 0;
+static volatile u32 rtc_periodic_count = 0;
+
+// Port I/O functions
+static inline void outb(u16 port, u8 val) {
+    __asm__ volatile ("outb %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline u8 inb(u16 port) {
+    u8 ret;
+    __asm__ volatile ("inb %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+// Registers are selected with NMI held off; the index written when the
+// interrupt is acknowledged turns NMI back on
+static u8 rtc_read(u8 reg) {
+    outb(RTC_INDEX, RTC_NMI_DISABLE | reg);
+    return inb(RTC_DATA);
+}
+
+static void rtc_write(u8 reg, u8 value) {
+    outb(RTC_INDEX, RTC_NMI_DISABLE | reg);
+    outb(RTC_DATA, value);
+}
+
+static void rtc_acknowledge(void) {
+    outb(RTC_INDEX, RTC_REG_C);
+    inb(RTC_DATA);
+}
+
+static void rtc_irq_handler(struct interrupt_context* ctx) {
+    rtc_acknowledge();
+    rtc_periodic_count++;
+    if (rtc_callback) {
+        rtc_callback(ctx);
+    }
+}
+
+// Call callback from IRQ 8 at hz, a power of two
+bool rtc_start_periodic(u32 hz, rtc_callback_t callback) {
+    if (hz < RTC_MIN_HZ || hz > RTC_MAX_HZ || (hz & (hz - 1))) {
+        return false;
+    }
+    u8 rate = 1;
+    while ((u32)(RTC_BASE_HZ >> (rate - 1)) != hz) {
+        rate++;
+    }
+
+    u32 flags = irq_save();
+    rtc_callback = callback;
+    rtc_periodic_count = 0;
+    irq_install_handler(RTC_IRQ, rtc_irq_handler);
+    rtc_write(RTC_REG_A, (rtc_read(RTC_REG_A) & 0xF0) | rate);
+    rtc_write(RTC_REG_B, rtc_read(RTC_REG_B) | RTC_B_PIE);
+    rtc_acknowledge();
+    irq_restore(flags);
+    irq_clear_mask(RTC_IRQ);
+    return true;
+}
+
+void rtc_stop_periodic(void) {
+    irq_set_mask(RTC_IRQ);
+    u32 flags = irq_save();
+    rtc_write(RTC_REG_B, rtc_read(RTC_REG_B) & ~RTC_B_PIE);
+    rtc_acknowledge();
+    irq_uninstall_handler(RTC_IRQ);
+    rtc_callback = 0;
+    irq_restore(flags);
+}
+
+u32 rtc_get_periodic_count(void) {
+    return rtc_periodic_count;
+}
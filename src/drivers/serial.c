@@ -0,0 +1,66 @@
+#include "serial.h"
+
+// Serial state
+static bool serial_ok = false;
+
+// Port I/O functions
+static inline void outb(u16 port, u8 val) {
+    __asm__ volatile ("outb %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline u8 inb(u16 port) {
+    u8 ret;
+    __asm__ volatile ("inb %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+// Program COM1 for 115200 8N1 without interrupts. The UART is checked in
+// loopback mode first so a missing port never stalls output.
+bool serial_initialize(void) {
+    u16 base = SERIAL_COM1;
+    u16 divisor = 115200 / SERIAL_BAUD;
+
+    serial_ok = false;
+    outb(base + SERIAL_IER, 0x00);
+    outb(base + SERIAL_LCR, SERIAL_LCR_DLAB);
+    outb(base + SERIAL_DIVISOR_LO, divisor & 0xFF);
+    outb(base + SERIAL_DIVISOR_HI, divisor >> 8);
+    outb(base + SERIAL_LCR, SERIAL_LCR_8N1);
+    outb(base + SERIAL_FCR, 0xC7);      // Enable and clear FIFOs, 14-byte threshold
+
+    outb(base + SERIAL_MCR, SERIAL_MCR_LOOPBACK | 0x0F);
+    outb(base + SERIAL_DATA, 0xAE);
+    if (inb(base + SERIAL_DATA) != 0xAE) {
+        return false;
+    }
+
+    outb(base + SERIAL_MCR, 0x0F);      // DTR, RTS, OUT1, OUT2
+    serial_ok = true;
+    return true;
+}
+
+bool serial_present(void) {
+    return serial_ok;
+}
+
+static void serial_write_byte(u8 byte) {
+    for (u32 i = 0; i < 100000 && !(inb(SERIAL_COM1 + SERIAL_LSR) & SERIAL_LSR_THRE); i++) {}
+    outb(SERIAL_COM1 + SERIAL_DATA, byte);
+}
+
+// Terminal-style output: newlines become CRLF and backspace erases
+__hot void serial_putchar(char c) {
+    if (!serial_ok) {
+        return;
+    }
+    if (c == '\n') {
+        serial_write_byte('\r');
+        serial_write_byte('\n');
+    } else if (c == '\b') {
+        serial_write_byte('\b');
+        serial_write_byte(' ');
+        serial_write_byte('\b');
+    } else {
+        serial_write_byte((u8)c);
+    }
+}
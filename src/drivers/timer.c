@@ -1,18 +1,41 @@
 #include "timer.h"
 #include "irq.h"
+#include "cpu.h"
+#include "irqtrace.h"
+#include "tunable.h"
 
 // Timer state
-static u32 timer_ticks = 0;
+static volatile u32 timer_ticks = 0;
 static u32 timer_frequency = 0;
+static u64 timer_tsc_hz = 0;
+
+// Tick-to-tick intervals, measured against the calibrated period
+static u64 timer_last_tsc = 0;
+static u64 timer_period = 0;
+static struct timer_jitter timer_jitter;
+
+// Fixed after boot: tick counts already computed into deadlines and
+// windows would be off
+static struct tunable timer_hz_tunable = {
+    .name = "timer.hz",
+    .description = "Timer interrupt rate",
+    .unit = "Hz",
+    .type = TUNABLE_U32,
+    .fallback = TIMER_DEFAULT_HZ,
+    .min = TIMER_MIN_HZ,
+    .max = TIMER_MAX_HZ,
+};
 
 // Port I/O functions
 static inline void outb(u16 port, u8 val) {
     __asm__ volatile ("outb %0, %1" : : "a"(val), "Nd"(port));
 }
 
-void timer_initialize(u32 frequency) {
+void timer_initialize(void) {
+    u32 frequency = tunable_register(&timer_hz_tunable);
     timer_frequency = frequency;
     timer_ticks = 0;
+    timer_reset_jitter();
     
     // Install timer interrupt handler
     irq_install_handler(0, timer_handler);
@@ -28,9 +51,26 @@ void timer_initialize(u32 frequency) {
     outb(PIT_DATA0, (divisor >> 8) & 0xFF); // High byte
 }
 
-void timer_handler(struct interrupt_context* ctx) {
+__hot void timer_handler(struct interrupt_context* ctx) {
     (void)ctx; // Suppress unused parameter warning
+    u64 now = rdtsc();
     timer_ticks++;
+
+    // A tick held up by another handler shows as one long interval
+    // followed by a short one
+    if (timer_last_tsc) {
+        u64 interval = now - timer_last_tsc;
+        timer_jitter.samples++;
+        timer_jitter.interval_total += interval;
+        if (interval < timer_jitter.interval_min) timer_jitter.interval_min = interval;
+        if (interval > timer_jitter.interval_max) timer_jitter.interval_max = interval;
+        if (timer_period) {
+            u64 deviation = interval > timer_period ? interval - timer_period : timer_period - interval;
+            timer_jitter.deviation_total += deviation;
+            if (deviation > timer_jitter.deviation_max) timer_jitter.deviation_max = deviation;
+        }
+    }
+    timer_last_tsc = now;
 }
 
 u32 timer_get_ticks(void) {
@@ -39,4 +79,56 @@ u32 timer_get_ticks(void) {
 
 u32 timer_get_seconds(void) {
     return timer_ticks / timer_frequency;
-}
\ No newline at end of file
+}
+
+u32 timer_get_frequency(void) {
+    return timer_frequency;
+}
+// Count TSC cycles across TIMER_CALIBRATE_TICKS timer ticks, starting on a
+// tick edge. Needs interrupts enabled and the timer running.
+static u64 timer_calibrate_tsc(void) {
+    u32 start = timer_ticks;
+    while (timer_ticks == start) {
+        __asm__ volatile ("hlt");
+    }
+    start = timer_ticks;
+    u64 tsc_start = rdtsc();
+    while (timer_ticks - start < TIMER_CALIBRATE_TICKS) {
+        __asm__ volatile ("hlt");
+    }
+    u64 cycles = rdtsc() - tsc_start;
+    return div_u64_rem(cycles * timer_frequency, TIMER_CALIBRATE_TICKS, 0);
+}
+
+// TSC frequency, measured on first use
+u64 timer_get_tsc_hz(void) {
+    if (!timer_tsc_hz && timer_frequency) {
+        timer_tsc_hz = timer_calibrate_tsc();
+        u64 period = div_u64_rem(timer_tsc_hz, timer_frequency, 0);
+        u32 flags = irq_save();
+        timer_period = period;
+        irq_restore(flags);
+    }
+    return timer_tsc_hz;
+}
+
+// Deviations are only measured once the TSC has been calibrated
+void timer_get_jitter(struct timer_jitter* jitter) {
+    u32 flags = irq_save();
+    *jitter = timer_jitter;
+    jitter->period = timer_period;
+    irq_restore(flags);
+}
+
+void timer_reset_jitter(void) {
+    u32 flags = irq_save();
+    memset(&timer_jitter, 0, sizeof(timer_jitter));
+    timer_jitter.interval_min = (u64)-1;
+    timer_last_tsc = 0;
+    irq_restore(flags);
+}
+
+u64 timer_tsc_to_us(u64 cycles) {
+    u32 mhz = (u32)div_u64_rem(timer_get_tsc_hz(), 1000000, 0);
+    return mhz ? div_u64_rem(cycles, mhz, 0) : 0;
+}
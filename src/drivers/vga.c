@@ -5,6 +5,9 @@ static size_t vga_row;
 static size_t vga_column;
 static u8 vga_color;
 static u16* vga_buffer;
+static void (*vga_mirror)(char c) = 0;
+static void (*vga_tee)(char c) = 0;     // Streams output off the machine
+static bool vga_screen = true;          // Off when only the mirror shows output
 
 // Port I/O functions
 static inline void outb(u16 port, u8 val) {
@@ -51,7 +54,31 @@ void vga_scroll(void) {
     }
 }
 
-void vga_putchar(char c) {
+void vga_set_mirror(void (*mirror)(char c)) {
+    vga_mirror = mirror;
+}
+
+void vga_set_tee(void (*tee)(char c)) {
+    vga_tee = tee;
+}
+
+// With the screen off, output only goes to the mirror and tee, sparing
+// the character cell writes, scrolling and cursor port I/O
+void vga_set_screen(bool on) {
+    vga_screen = on;
+}
+
+__hot void vga_putchar(char c) {
+    if (vga_mirror) {
+        vga_mirror(c);
+    }
+    if (vga_tee) {
+        vga_tee(c);
+    }
+    if (!vga_screen) {
+        return;
+    }
+    
     if (c == '\n') {
         vga_column = 0;
         if (++vga_row == VGA_HEIGHT) {
@@ -98,6 +125,44 @@ void vga_writestring(const char* data) {
     vga_write(data, strlen(data));
 }
 
+void vga_write_dec(u32 value) {
+    char digits[10];
+    int n = 0;
+    
+    do {
+        digits[n++] = '0' + (value % 10);
+        value /= 10;
+    } while (value);
+    
+    while (n > 0) {
+        vga_putchar(digits[--n]);
+    }
+}
+
+void vga_write_dec64(u64 value) {
+    char digits[20];
+    int n = 0;
+    
+    do {
+        u32 digit;
+        value = div_u64_rem(value, 10, &digit);
+        digits[n++] = '0' + digit;
+    } while (value);
+    
+    while (n > 0) {
+        vga_putchar(digits[--n]);
+    }
+}
+
+void vga_write_hex(u32 value) {
+    vga_putchar('0');
+    vga_putchar('x');
+    for (int i = 28; i >= 0; i -= 4) {
+        u8 nibble = (value >> i) & 0xF;
+        vga_putchar(nibble < 10 ? '0' + nibble : 'A' + nibble - 10);
+    }
+}
+
 void vga_clear(void) {
     for (size_t y = 0; y < VGA_HEIGHT; y++) {
         for (size_t x = 0; x < VGA_WIDTH; x++) {
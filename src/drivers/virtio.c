@@ -0,0 +1,386 @@
+#include "virtio.h"
+#include "paging.h"
+#include "dma.h"
+
+static inline void outb(u16 port, u8 val) {
+    __asm__ volatile ("outb %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline u8 inb(u16 port) {
+    u8 ret;
+    __asm__ volatile ("inb %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static inline void outw(u16 port, u16 val) {
+    __asm__ volatile ("outw %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline u16 inw(u16 port) {
+    u16 ret;
+    __asm__ volatile ("inw %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+static inline void outl(u16 port, u32 val) {
+    __asm__ volatile ("outl %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline u32 inl(u16 port) {
+    u32 ret;
+    __asm__ volatile ("inl %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+// x86 keeps stores ordered, but a store followed by a load of another
+// location (publishing avail->idx, then reading used->flags) needs a full
+// barrier. A locked add works on every i386-class CPU, unlike mfence; it
+// targets a stack slot so the same code serves both builds.
+static inline void virtio_mb(void) {
+    u32 slot = 0;
+    __asm__ volatile ("lock; addl $0, %0" : "+m"(slot) : : "memory", "cc");
+}
+
+static inline void virtio_wmb(void) {
+    __asm__ volatile ("" : : : "memory");
+}
+
+// Loads are not reordered with other loads on x86; the compiler must not
+// move the used-ring entry reads above the used->idx load either
+static inline void virtio_rmb(void) {
+    __asm__ volatile ("" : : : "memory");
+}
+
+static inline void mmio_write8(volatile u8* base, u32 offset, u8 value) {
+    *(volatile u8*)(base + offset) = value;
+}
+
+static inline u8 mmio_read8(volatile u8* base, u32 offset) {
+    return *(volatile u8*)(base + offset);
+}
+
+static inline void mmio_write16(volatile u8* base, u32 offset, u16 value) {
+    *(volatile u16*)(base + offset) = value;
+}
+
+static inline u16 mmio_read16(volatile u8* base, u32 offset) {
+    return *(volatile u16*)(base + offset);
+}
+
+static inline void mmio_write32(volatile u8* base, u32 offset, u32 value) {
+    *(volatile u32*)(base + offset) = value;
+}
+
+static inline u32 mmio_read32(volatile u8* base, u32 offset) {
+    return *(volatile u32*)(base + offset);
+}
+
+static u8 virtio_get_status(struct virtio_device* dev) {
+    if (dev->modern) {
+        return mmio_read8(dev->common, VIRTIO_COMMON_STATUS);
+    }
+    return inb(dev->io + VIRTIO_LEGACY_STATUS);
+}
+
+static void virtio_set_status(struct virtio_device* dev, u8 status) {
+    if (dev->modern) {
+        mmio_write8(dev->common, VIRTIO_COMMON_STATUS, status);
+    } else {
+        outb(dev->io + VIRTIO_LEGACY_STATUS, status);
+    }
+}
+
+// Map the part of a memory BAR a modern capability points at
+static volatile u8* virtio_map_window(struct pci_device* pci, u8 bar, u32 offset, u32 length) {
+    if (bar >= PCI_BAR_COUNT || pci->bars[bar].io || !pci->bars[bar].size) {
+        return 0;
+    }
+    u64 base = pci->bars[bar].base + offset;
+    if ((base + length) >> 32 || !paging_map_mmio((u32)base, length)) {
+        return 0;
+    }
+    return (volatile u8*)(uptr)base;
+}
+
+// Modern devices describe their register windows with vendor capabilities;
+// the first capability of each type is the one to use
+static bool virtio_find_modern(struct virtio_device* dev) {
+    struct pci_device* pci = dev->pci;
+
+    for (u8 cap = pci_find_next_capability(pci, PCI_CAP_ID_VENDOR, 0); cap;
+         cap = pci_find_next_capability(pci, PCI_CAP_ID_VENDOR, cap)) {
+        u8 type = pci_read32(pci, cap) >> 24;
+        u8 bar = pci_read32(pci, cap + 4) & 0xFF;
+        u32 offset = pci_read32(pci, cap + 8);
+        u32 length = pci_read32(pci, cap + 12);
+
+        switch (type) {
+            case VIRTIO_PCI_CAP_COMMON_CFG:
+                if (!dev->common) dev->common = virtio_map_window(pci, bar, offset, length);
+                break;
+            case VIRTIO_PCI_CAP_NOTIFY_CFG:
+                if (!dev->notify) {
+                    dev->notify = virtio_map_window(pci, bar, offset, length);
+                    dev->notify_multiplier = pci_read32(pci, cap + 16);
+                }
+                break;
+            case VIRTIO_PCI_CAP_ISR_CFG:
+                if (!dev->isr) dev->isr = virtio_map_window(pci, bar, offset, length);
+                break;
+            case VIRTIO_PCI_CAP_DEVICE_CFG:
+                if (!dev->config) dev->config = virtio_map_window(pci, bar, offset, length);
+                break;
+        }
+    }
+
+    return dev->common && dev->notify && dev->isr && dev->config;
+}
+
+// Pick a transport, reset the device and announce the driver. Transitional
+// devices whose modern BARs cannot be mapped fall back to the legacy ports.
+bool virtio_init_device(struct virtio_device* dev, struct pci_device* pci) {
+    memset(dev, 0, sizeof(*dev));
+    dev->pci = pci;
+    pci_enable_device(pci);
+    pci_enable_bus_master(pci);
+
+    dev->modern = virtio_find_modern(dev);
+    if (!dev->modern) {
+        if (!pci->bars[0].io || !pci->bars[0].size) {
+            return false;
+        }
+        dev->io = (u16)pci->bars[0].base;
+    }
+
+    virtio_set_status(dev, 0);
+    for (u32 i = 0; i < 100000 && virtio_get_status(dev) != 0; i++) {
+        // A modern device finishes its reset asynchronously
+    }
+    virtio_set_status(dev, VIRTIO_STATUS_ACKNOWLEDGE);
+    virtio_set_status(dev, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+    return true;
+}
+
+// Accept the intersection of the device's low feature word and features.
+// Modern devices must also offer VERSION_1, which is always accepted.
+bool virtio_negotiate(struct virtio_device* dev, u32 features, u32* accepted) {
+    u32 offered;
+    if (dev->modern) {
+        mmio_write32(dev->common, VIRTIO_COMMON_DFSELECT, 1);
+        if (!(mmio_read32(dev->common, VIRTIO_COMMON_DF) & VIRTIO_F_VERSION_1)) {
+            virtio_fail(dev);
+            return false;
+        }
+        mmio_write32(dev->common, VIRTIO_COMMON_DFSELECT, 0);
+        offered = mmio_read32(dev->common, VIRTIO_COMMON_DF);
+
+        mmio_write32(dev->common, VIRTIO_COMMON_GFSELECT, 0);
+        mmio_write32(dev->common, VIRTIO_COMMON_GF, offered & features);
+        mmio_write32(dev->common, VIRTIO_COMMON_GFSELECT, 1);
+        mmio_write32(dev->common, VIRTIO_COMMON_GF, VIRTIO_F_VERSION_1);
+    } else {
+        offered = inl(dev->io + VIRTIO_LEGACY_DEVICE_FEATURES);
+        outl(dev->io + VIRTIO_LEGACY_GUEST_FEATURES, offered & features);
+    }
+
+    if (accepted) {
+        *accepted = offered & features;
+    }
+    if (!dev->modern) {
+        return true;    // Legacy devices have no FEATURES_OK handshake
+    }
+
+    u8 status = virtio_get_status(dev) | VIRTIO_STATUS_FEATURES_OK;
+    virtio_set_status(dev, status);
+    if (!(virtio_get_status(dev) & VIRTIO_STATUS_FEATURES_OK)) {
+        virtio_fail(dev);
+        return false;
+    }
+    return true;
+}
+
+// Lay the queue out in caller-provided, page-aligned, identity-mapped
+// memory using the legacy layout, which modern devices accept as well
+bool virtio_setup_queue(struct virtio_device* dev, struct virtqueue* vq, u16 index, void* memory, u32 memory_size) {
+    u16 size;
+    if (dev->modern) {
+        mmio_write16(dev->common, VIRTIO_COMMON_Q_SELECT, index);
+        size = mmio_read16(dev->common, VIRTIO_COMMON_Q_SIZE);
+        if (size > VIRTQ_MAX_SIZE) {
+            size = VIRTQ_MAX_SIZE;
+        }
+        while (size > 1 && VIRTQ_RING_SIZE(size) > memory_size) {
+            size >>= 1;
+        }
+    } else {
+        outw(dev->io + VIRTIO_LEGACY_QUEUE_SELECT, index);
+        size = inw(dev->io + VIRTIO_LEGACY_QUEUE_SIZE);
+        if (size > VIRTQ_MAX_SIZE) {
+            return false;   // Legacy queue sizes are fixed by the device
+        }
+    }
+    if (size == 0 || VIRTQ_RING_SIZE(size) > memory_size || ((uptr)memory & (VIRTQ_ALIGN - 1))) {
+        return false;
+    }
+
+    memset(memory, 0, VIRTQ_RING_SIZE(size));
+    memset(vq, 0, sizeof(*vq));
+    vq->dev = dev;
+    vq->index = index;
+    vq->size = size;
+    vq->desc = (struct virtq_desc*)memory;
+    vq->avail = (struct virtq_avail*)((uptr)memory + VIRTQ_AVAIL_OFFSET(size));
+    vq->used = (volatile struct virtq_used*)((uptr)memory + VIRTQ_USED_OFFSET(size));
+    vq->free_count = size;
+    for (u16 i = 0; i + 1 < size; i++) {
+        vq->desc[i].next = i + 1;
+    }
+
+    if (dev->modern) {
+        mmio_write16(dev->common, VIRTIO_COMMON_Q_SIZE, size);
+        mmio_write32(dev->common, VIRTIO_COMMON_Q_DESCLO, dma_virt_to_phys(vq->desc));
+        mmio_write32(dev->common, VIRTIO_COMMON_Q_DESCHI, 0);
+        mmio_write32(dev->common, VIRTIO_COMMON_Q_AVAILLO, dma_virt_to_phys(vq->avail));
+        mmio_write32(dev->common, VIRTIO_COMMON_Q_AVAILHI, 0);
+        mmio_write32(dev->common, VIRTIO_COMMON_Q_USEDLO, dma_virt_to_phys((const void*)vq->used));
+        mmio_write32(dev->common, VIRTIO_COMMON_Q_USEDHI, 0);
+        vq->notify_offset = mmio_read16(dev->common, VIRTIO_COMMON_Q_NOFF);
+        mmio_write16(dev->common, VIRTIO_COMMON_Q_ENABLE, 1);
+    } else {
+        outl(dev->io + VIRTIO_LEGACY_QUEUE_PFN, dma_virt_to_phys(memory) >> 12);
+    }
+    return true;
+}
+
+void virtio_driver_ok(struct virtio_device* dev) {
+    virtio_set_status(dev, virtio_get_status(dev) | VIRTIO_STATUS_DRIVER_OK);
+}
+
+void virtio_fail(struct virtio_device* dev) {
+    virtio_set_status(dev, virtio_get_status(dev) | VIRTIO_STATUS_FAILED);
+}
+
+// Reading the ISR status acknowledges the interrupt
+u8 virtio_read_isr(struct virtio_device* dev) {
+    if (dev->modern) {
+        return mmio_read8(dev->isr, 0);
+    }
+    return inb(dev->io + VIRTIO_LEGACY_ISR);
+}
+
+u8 virtio_config_read8(struct virtio_device* dev, u32 offset) {
+    if (dev->modern) {
+        return mmio_read8(dev->config, offset);
+    }
+    return inb(dev->io + VIRTIO_LEGACY_CONFIG + offset);
+}
+
+u32 virtio_config_read32(struct virtio_device* dev, u32 offset) {
+    if (dev->modern) {
+        return mmio_read32(dev->config, offset);
+    }
+    return inl(dev->io + VIRTIO_LEGACY_CONFIG + offset);
+}
+
+u64 virtio_config_read64(struct virtio_device* dev, u32 offset) {
+    return virtio_config_read32(dev, offset) | ((u64)virtio_config_read32(dev, offset + 4) << 32);
+}
+
+// Chain out device-readable then in device-writable buffers onto free
+// descriptors and stage the head in the avail ring. Nothing is visible to
+// the device until virtq_kick(). Returns the head index or -1 when full.
+int virtq_add(struct virtqueue* vq, const struct virtq_buffer* buffers, u32 out, u32 in, void* token) {
+    u32 count = out + in;
+    if (count == 0 || count > vq->free_count) {
+        return -1;
+    }
+
+    u16 head = vq->free_head;
+    u16 index = head;
+    for (u32 i = 0; i < count; i++) {
+        struct virtq_desc* desc = &vq->desc[index];
+        desc->addr = dma_virt_to_phys(buffers[i].data);
+        desc->len = buffers[i].length;
+        desc->flags = (i >= out ? VIRTQ_DESC_F_WRITE : 0) | (i + 1 < count ? VIRTQ_DESC_F_NEXT : 0);
+        index = desc->next;     // Free descriptors are already linked
+    }
+    vq->free_head = index;
+    vq->free_count -= count;
+
+    vq->tokens[head] = token;
+    vq->avail->ring[vq->avail_idx % vq->size] = head;
+    vq->avail_idx++;
+    vq->pending++;
+    return head;
+}
+
+// Publish everything added since the last kick with one doorbell write,
+// skipped when the device asked not to be notified. Returns true if the
+// doorbell was rung.
+bool virtq_kick(struct virtqueue* vq) {
+    if (vq->pending == 0) {
+        return false;
+    }
+    vq->pending = 0;
+
+    virtio_wmb();
+    vq->avail->idx = vq->avail_idx;
+    virtio_mb();
+    if (vq->used->flags & VIRTQ_USED_F_NO_NOTIFY) {
+        return false;
+    }
+
+    struct virtio_device* dev = vq->dev;
+    if (dev->modern) {
+        mmio_write16(dev->notify, vq->notify_offset * dev->notify_multiplier, vq->index);
+    } else {
+        outw(dev->io + VIRTIO_LEGACY_QUEUE_NOTIFY, vq->index);
+    }
+    return true;
+}
+
+bool virtq_has_used(struct virtqueue* vq) {
+    return vq->last_used != vq->used->idx;
+}
+
+// Take one completed chain off the used ring and return its descriptors
+// to the free list. Returns the token given to virtq_add, or 0.
+void* virtq_get_used(struct virtqueue* vq, u32* length) {
+    if (!virtq_has_used(vq)) {
+        return 0;
+    }
+    virtio_rmb();
+
+    volatile struct virtq_used_elem* elem = &vq->used->ring[vq->last_used % vq->size];
+    u16 head = (u16)elem->id;
+    if (length) {
+        *length = elem->len;
+    }
+    vq->last_used++;
+
+    u16 tail = head;
+    u16 count = 1;
+    while (vq->desc[tail].flags & VIRTQ_DESC_F_NEXT) {
+        tail = vq->desc[tail].next;
+        count++;
+    }
+    vq->desc[tail].next = vq->free_head;
+    vq->free_head = head;
+    vq->free_count += count;
+
+    void* token = vq->tokens[head];
+    vq->tokens[head] = 0;
+    return token;
+}
+
+void virtq_disable_interrupts(struct virtqueue* vq) {
+    vq->avail->flags |= VIRTQ_AVAIL_F_NO_INTERRUPT;
+}
+
+// Re-arm interrupts. Returns true if completions slipped in while they
+// were off, in which case the caller must reap them itself.
+bool virtq_enable_interrupts(struct virtqueue* vq) {
+    vq->avail->flags &= ~VIRTQ_AVAIL_F_NO_INTERRUPT;
+    virtio_mb();
+    return virtq_has_used(vq);
+}
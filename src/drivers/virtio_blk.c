@@ -0,0 +1,499 @@
+#include "virtio_blk.h"
+#include "virtio.h"
+#include "pci.h"
+#include "irq.h"
+#include "timer.h"
+#include "paging.h"
+#include "block.h"
+#include "irqtrace.h"
+#include "dma.h"
+
+// A single request queue per device. Requests are staged with
+// virtio_blk_queue() and published in batches by virtio_blk_kick().
+struct virtio_blk_device {
+    bool present;
+    bool readonly;
+    u8 irq;
+    u64 capacity;
+    u32 in_flight;
+    struct virtio_device transport;
+    struct virtqueue queue;
+};
+
+static struct virtio_blk_device virtio_blk_devices[VIRTIO_BLK_MAX_DEVICES];
+static u8* virtio_blk_rings[VIRTIO_BLK_MAX_DEVICES];     // In the DMA pool, kept if a probe fails
+static u32 virtio_blk_count = 0;
+static struct virtio_blk_stats virtio_blk_stats;
+
+static const char* virtio_blk_errors[] = {
+    "Success",
+    "Invalid request",
+    "No such device",
+    "I/O error",
+    "Queue full",
+    "Device is read-only",
+};
+
+// Complete every finished request on the used ring. Called with
+// interrupts disabled, from the interrupt handler or a polling waiter.
+static u32 virtio_blk_reap(struct virtio_blk_device* dev, bool polled) {
+    u32 count = 0;
+    struct virtio_blk_request* req;
+
+    while ((req = (struct virtio_blk_request*)virtq_get_used(&dev->queue, 0))) {
+        dev->in_flight--;
+        count++;
+        if (polled) {
+            virtio_blk_stats.polled_completions++;
+        } else {
+            virtio_blk_stats.irq_completions++;
+        }
+
+        if (req->device_status == VIRTIO_BLK_S_OK) {
+            virtio_blk_stats.sectors += req->count;
+            req->status = VIRTIO_BLK_OK;
+        } else {
+            virtio_blk_stats.errors++;
+            req->status = VIRTIO_BLK_ERR_IO;
+        }
+        if (req->done) {
+            req->done(req);
+        }
+    }
+    return count;
+}
+
+static void virtio_blk_irq_handler(struct interrupt_context* ctx) {
+    u8 irq = ctx->int_no - 32;
+    for (u32 i = 0; i < virtio_blk_count; i++) {
+        struct virtio_blk_device* dev = &virtio_blk_devices[i];
+        if (dev->irq != irq || !(virtio_read_isr(&dev->transport) & 1)) {
+            continue;   // Not ours, or a configuration change
+        }
+        virtio_blk_stats.interrupts++;
+        virtio_blk_reap(dev, false);
+    }
+}
+
+int virtio_blk_queue(u32 device, struct virtio_blk_request* req) {
+    if (!virtio_blk_present(device)) {
+        return VIRTIO_BLK_ERR_NO_DEVICE;
+    }
+    struct virtio_blk_device* dev = &virtio_blk_devices[device];
+    u32 bytes = req->count * VIRTIO_BLK_SECTOR_SIZE;
+
+    if (req->write && dev->readonly) {
+        return VIRTIO_BLK_ERR_READ_ONLY;
+    }
+    if (req->count == 0 || req->count > VIRTIO_BLK_MAX_SECTORS ||
+        req->sector + req->count > dev->capacity ||
+        (uptr)req->buffer + bytes > PAGING_IDENTITY_LIMIT ||
+        (uptr)req + sizeof(*req) > PAGING_IDENTITY_LIMIT) {
+        return VIRTIO_BLK_ERR_INVALID;
+    }
+
+    req->device = device;
+    req->header.type = req->write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+    req->header.reserved = 0;
+    req->header.sector = req->sector;
+    req->device_status = 0xFF;
+    req->status = VIRTIO_BLK_PENDING;
+
+    // Header, data and status byte form one three-descriptor chain
+    struct virtq_buffer buffers[3] = {
+        {&req->header, sizeof(req->header)},
+        {req->buffer, bytes},
+        {(const void*)&req->device_status, 1},
+    };
+
+    u32 flags = irq_save();
+    int head = virtq_add(&dev->queue, buffers, req->write ? 2 : 1, req->write ? 1 : 2, req);
+    if (head >= 0) {
+        dev->in_flight++;
+        virtio_blk_stats.requests++;
+    }
+    irq_restore(flags);
+    return head >= 0 ? VIRTIO_BLK_OK : VIRTIO_BLK_ERR_FULL;
+}
+
+// One doorbell for everything queued since the last kick
+void virtio_blk_kick(u32 device) {
+    if (!virtio_blk_present(device)) {
+        return;
+    }
+    struct virtio_blk_device* dev = &virtio_blk_devices[device];
+
+    u32 flags = irq_save();
+    if (dev->queue.pending) {
+        virtio_blk_stats.kicks++;
+        if (virtq_kick(&dev->queue)) {
+            virtio_blk_stats.notifications++;
+        }
+    }
+    irq_restore(flags);
+}
+
+int virtio_blk_submit(u32 device, struct virtio_blk_request* req) {
+    int status = virtio_blk_queue(device, req);
+    if (status == VIRTIO_BLK_OK) {
+        virtio_blk_kick(device);
+    }
+    return status;
+}
+
+u32 virtio_blk_poll(u32 device) {
+    if (!virtio_blk_present(device)) {
+        return 0;
+    }
+    u32 flags = irq_save();
+    u32 count = virtio_blk_reap(&virtio_blk_devices[device], true);
+    irq_restore(flags);
+    return count;
+}
+
+// With few requests in flight the waiter sleeps until the interrupt. Once
+// VIRTIO_BLK_POLL_DEPTH requests are outstanding, completions arrive so
+// often that taking an interrupt for each costs more than spinning, so the
+// device's interrupts are suppressed and the used ring is polled instead.
+static void virtio_blk_wait_step(struct virtio_blk_device* dev) {
+    if (dev->in_flight >= VIRTIO_BLK_POLL_DEPTH) {
+        virtq_disable_interrupts(&dev->queue);
+        if (!virtio_blk_reap(dev, true)) {
+            irq_pause();
+        }
+        return;
+    }
+    if (virtq_enable_interrupts(&dev->queue)) {
+        virtio_blk_reap(dev, true);     // Completed while interrupts were off
+        return;
+    }
+    irq_wait();
+}
+
+int virtio_blk_wait(struct virtio_blk_request* req) {
+    struct virtio_blk_device* dev = &virtio_blk_devices[req->device];
+
+    u32 flags = irq_save();
+    while (req->status == VIRTIO_BLK_PENDING) {
+        virtio_blk_wait_step(dev);
+    }
+    if (virtq_enable_interrupts(&dev->queue)) {
+        virtio_blk_reap(dev, true);
+    }
+    irq_restore(flags);
+    return req->status;
+}
+
+static int virtio_blk_transfer(u32 device, u64 sector, u32 count, void* buffer, bool write) {
+    while (count) {
+        u32 chunk = count > VIRTIO_BLK_MAX_SECTORS ? VIRTIO_BLK_MAX_SECTORS : count;
+        struct virtio_blk_request req;
+        memset(&req, 0, sizeof(req));
+        req.sector = sector;
+        req.count = chunk;
+        req.buffer = buffer;
+        req.write = write;
+
+        int status = virtio_blk_submit(device, &req);
+        if (status == VIRTIO_BLK_OK) {
+            status = virtio_blk_wait(&req);
+        }
+        if (status != VIRTIO_BLK_OK) {
+            return status;
+        }
+
+        sector += chunk;
+        count -= chunk;
+        buffer = (u8*)buffer + chunk * VIRTIO_BLK_SECTOR_SIZE;
+    }
+    return VIRTIO_BLK_OK;
+}
+
+int virtio_blk_read(u32 device, u64 sector, u32 count, void* buffer) {
+    return virtio_blk_transfer(device, sector, count, buffer, false);
+}
+
+int virtio_blk_write(u32 device, u64 sector, u32 count, const void* buffer) {
+    return virtio_blk_transfer(device, sector, count, (void*)buffer, true);
+}
+
+// Block layer adapter: each device is registered as vd<index>, with
+// read-ahead requests borrowed from a small pool
+#define VIRTIO_BLK_BLOCK_REQUESTS   32
+
+static struct block_device virtio_blk_block_devices[VIRTIO_BLK_MAX_DEVICES];
+static struct virtio_blk_request virtio_blk_block_requests[VIRTIO_BLK_BLOCK_REQUESTS];
+static u32 virtio_blk_block_used = 0;
+
+static int virtio_blk_block_status(int status) {
+    switch (status) {
+        case VIRTIO_BLK_OK: return BLOCK_OK;
+        case VIRTIO_BLK_ERR_INVALID: return BLOCK_ERR_INVALID;
+        case VIRTIO_BLK_ERR_NO_DEVICE: return BLOCK_ERR_NO_DEVICE;
+        case VIRTIO_BLK_ERR_FULL: return BLOCK_ERR_NO_BUFFER;
+        case VIRTIO_BLK_ERR_READ_ONLY: return BLOCK_ERR_READ_ONLY;
+        default: return BLOCK_ERR_IO;
+    }
+}
+
+static int virtio_blk_block_read(struct block_device* dev, u64 sector, u32 count, void* buffer) {
+    return virtio_blk_block_status(virtio_blk_read(dev->unit, sector, count, buffer));
+}
+
+static int virtio_blk_block_write(struct block_device* dev, u64 sector, u32 count, const void* buffer) {
+    return virtio_blk_block_status(virtio_blk_write(dev->unit, sector, count, buffer));
+}
+
+static void virtio_blk_block_done(struct virtio_blk_request* req) {
+    struct block_request* breq = (struct block_request*)req->context;
+    int status = virtio_blk_block_status(req->status);
+    virtio_blk_block_used &= ~(1u << (req - virtio_blk_block_requests));
+    breq->done(breq, status);
+}
+
+static int virtio_blk_block_read_async(struct block_device* dev, struct block_request* breq) {
+    u32 flags = irq_save();
+    u32 slot = 0;
+    while (slot < VIRTIO_BLK_BLOCK_REQUESTS && (virtio_blk_block_used & (1u << slot))) {
+        slot++;
+    }
+    if (slot == VIRTIO_BLK_BLOCK_REQUESTS) {
+        irq_restore(flags);
+        return BLOCK_ERR_NO_BUFFER;
+    }
+    virtio_blk_block_used |= 1u << slot;
+    irq_restore(flags);
+
+    struct virtio_blk_request* req = &virtio_blk_block_requests[slot];
+    memset(req, 0, sizeof(*req));
+    req->sector = breq->sector;
+    req->count = breq->count;
+    req->buffer = breq->buffer;
+    req->done = virtio_blk_block_done;
+    req->context = breq;
+
+    int status = virtio_blk_submit(dev->unit, req);
+    if (status != VIRTIO_BLK_OK) {
+        flags = irq_save();
+        virtio_blk_block_used &= ~(1u << slot);
+        irq_restore(flags);
+    }
+    return virtio_blk_block_status(status);
+}
+
+static const struct block_ops virtio_blk_block_ops = {
+    .read = virtio_blk_block_read,
+    .write = virtio_blk_block_write,
+    .read_async = virtio_blk_block_read_async,
+};
+
+static void virtio_blk_register_block(u32 index) {
+    struct block_device* dev = &virtio_blk_block_devices[index];
+    memset(dev, 0, sizeof(*dev));
+    memcpy(dev->name, "vd0", 4);
+    dev->name[2] = '0' + index;
+    dev->sectors = virtio_blk_devices[index].capacity;
+    dev->readonly = virtio_blk_devices[index].readonly;
+    dev->ops = &virtio_blk_block_ops;
+    dev->unit = index;
+    block_register(dev);
+}
+
+static bool virtio_blk_probe(struct pci_device* pci) {
+    if (virtio_blk_count == VIRTIO_BLK_MAX_DEVICES) {
+        return false;
+    }
+    struct virtio_blk_device* dev = &virtio_blk_devices[virtio_blk_count];
+    memset(dev, 0, sizeof(*dev));
+
+    u32 features = 0;
+    if (!virtio_init_device(&dev->transport, pci) ||
+        !virtio_negotiate(&dev->transport, VIRTIO_BLK_F_RO, &features)) {
+        return false;
+    }
+    u8** ring = &virtio_blk_rings[virtio_blk_count];
+    if (!*ring) {
+        *ring = dma_alloc(VIRTQ_RING_SIZE(VIRTQ_MAX_SIZE), VIRTQ_ALIGN);
+    }
+    if (!*ring || !virtio_setup_queue(&dev->transport, &dev->queue, 0, *ring, VIRTQ_RING_SIZE(VIRTQ_MAX_SIZE))) {
+        virtio_fail(&dev->transport);
+        return false;
+    }
+
+    dev->capacity = virtio_config_read64(&dev->transport, VIRTIO_BLK_CFG_CAPACITY);
+    dev->readonly = (features & VIRTIO_BLK_F_RO) != 0;
+
+    // Virtio signals through MSI-X, which the PCI layer does not program,
+    // so completions arrive on the legacy INTx line
+    dev->irq = pci->irq_line;
+    irq_share_handler(dev->irq, virtio_blk_irq_handler);
+    irq_clear_mask(dev->irq);
+
+    virtio_driver_ok(&dev->transport);
+    dev->present = true;
+    virtio_blk_register_block(virtio_blk_count);
+    virtio_blk_count++;
+    return true;
+}
+
+static const struct pci_device_id virtio_blk_ids[] = {
+    {VIRTIO_PCI_VENDOR, VIRTIO_BLK_DEVICE_LEGACY, PCI_ANY_ID, PCI_ANY_ID, PCI_ANY_ID},
+    {VIRTIO_PCI_VENDOR, VIRTIO_BLK_DEVICE_MODERN, PCI_ANY_ID, PCI_ANY_ID, PCI_ANY_ID},
+    {0, 0, 0, 0, 0},
+};
+
+static const struct pci_driver virtio_blk_driver = {
+    .name = "virtio-blk",
+    .ids = virtio_blk_ids,
+    .probe = virtio_blk_probe,
+};
+
+void virtio_blk_initialize(void) {
+    virtio_blk_count = 0;
+    memset(&virtio_blk_stats, 0, sizeof(virtio_blk_stats));
+    pci_register_driver(&virtio_blk_driver);
+}
+
+bool virtio_blk_present(u32 device) {
+    return device < virtio_blk_count && virtio_blk_devices[device].present;
+}
+
+u64 virtio_blk_get_capacity(u32 device) {
+    return virtio_blk_present(device) ? virtio_blk_devices[device].capacity : 0;
+}
+
+bool virtio_blk_is_modern(u32 device) {
+    return virtio_blk_present(device) && virtio_blk_devices[device].transport.modern;
+}
+
+bool virtio_blk_is_readonly(u32 device) {
+    return virtio_blk_present(device) && virtio_blk_devices[device].readonly;
+}
+
+const struct virtio_blk_stats* virtio_blk_get_stats(void) {
+    return &virtio_blk_stats;
+}
+
+const char* virtio_blk_strerror(int status) {
+    if (status < 0 || status > VIRTIO_BLK_ERR_READ_ONLY) {
+        return "Unknown error";
+    }
+    return virtio_blk_errors[status];
+}
+
+// Benchmark: keep depth requests in flight for the given number of ticks.
+// Completions only mark their request ready; the loop below resubmits all
+// ready requests as one batch behind a single doorbell.
+#define VIRTIO_BLK_BENCH_MAX_DEPTH      32
+#define VIRTIO_BLK_BENCH_MAX_SECTORS    8
+
+static struct {
+    struct virtio_blk_request requests[VIRTIO_BLK_BENCH_MAX_DEPTH];
+    struct virtio_blk_request* ready[VIRTIO_BLK_BENCH_MAX_DEPTH];
+    u32 ready_count;
+    bool sequential;
+    u32 sectors;
+    u32 span;
+    u32 next_slot;
+    u32 seed;
+    u32 operations;
+    int status;
+} virtio_blk_bench_state;
+
+static u8 virtio_blk_bench_buffer[VIRTIO_BLK_BENCH_MAX_DEPTH][VIRTIO_BLK_BENCH_MAX_SECTORS * VIRTIO_BLK_SECTOR_SIZE] __attribute__((aligned(4096)));
+
+static u32 virtio_blk_bench_slot(void) {
+    if (virtio_blk_bench_state.sequential) {
+        u32 slot = virtio_blk_bench_state.next_slot++;
+        if (virtio_blk_bench_state.next_slot == virtio_blk_bench_state.span) {
+            virtio_blk_bench_state.next_slot = 0;
+        }
+        return slot;
+    }
+    virtio_blk_bench_state.seed = virtio_blk_bench_state.seed * 1103515245 + 12345;
+    return (virtio_blk_bench_state.seed >> 8) % virtio_blk_bench_state.span;
+}
+
+static void virtio_blk_bench_done(struct virtio_blk_request* req) {
+    if (req->status != VIRTIO_BLK_OK) {
+        virtio_blk_bench_state.status = req->status;
+    } else {
+        virtio_blk_bench_state.operations++;
+    }
+    virtio_blk_bench_state.ready[virtio_blk_bench_state.ready_count++] = req;
+}
+
+// Requeue every ready request and publish them with one kick
+static void virtio_blk_bench_resubmit(u32 device) {
+    while (virtio_blk_bench_state.ready_count) {
+        struct virtio_blk_request* req = virtio_blk_bench_state.ready[--virtio_blk_bench_state.ready_count];
+        req->sector = (u64)virtio_blk_bench_slot() * virtio_blk_bench_state.sectors;
+        if (virtio_blk_queue(device, req) != VIRTIO_BLK_OK) {
+            virtio_blk_bench_state.status = VIRTIO_BLK_ERR_FULL;
+        }
+    }
+    virtio_blk_kick(device);
+}
+
+int virtio_blk_bench(u32 device, bool sequential, u32 depth, u32 sectors, u32 ticks, struct virtio_blk_bench_result* result) {
+    if (!virtio_blk_present(device)) {
+        return VIRTIO_BLK_ERR_NO_DEVICE;
+    }
+    if (depth == 0 || depth > VIRTIO_BLK_BENCH_MAX_DEPTH || sectors == 0 || sectors > VIRTIO_BLK_BENCH_MAX_SECTORS) {
+        return VIRTIO_BLK_ERR_INVALID;
+    }
+    struct virtio_blk_device* dev = &virtio_blk_devices[device];
+
+    u64 span = dev->capacity;
+    for (u32 s = sectors; s > 1; s >>= 1) {
+        span >>= 1;     // sectors is a power of two for the shell's presets
+    }
+    if (span == 0) {
+        return VIRTIO_BLK_ERR_INVALID;
+    }
+
+    memset(&virtio_blk_bench_state, 0, sizeof(virtio_blk_bench_state));
+    virtio_blk_bench_state.sequential = sequential;
+    virtio_blk_bench_state.sectors = sectors;
+    virtio_blk_bench_state.span = span > 0x7FFFFFFF ? 0x7FFFFFFF : (u32)span;
+    virtio_blk_bench_state.seed = timer_get_ticks() | 1;
+    virtio_blk_bench_state.status = VIRTIO_BLK_OK;
+
+    struct virtio_blk_stats before = virtio_blk_stats;
+    u32 start = timer_get_ticks();
+
+    u32 flags = irq_save();
+    for (u32 i = 0; i < depth; i++) {
+        struct virtio_blk_request* req = &virtio_blk_bench_state.requests[i];
+        req->count = sectors;
+        req->buffer = virtio_blk_bench_buffer[i];
+        req->write = false;
+        req->done = virtio_blk_bench_done;
+        virtio_blk_bench_state.ready[virtio_blk_bench_state.ready_count++] = req;
+    }
+    virtio_blk_bench_resubmit(device);
+
+    while (timer_get_ticks() - start < ticks && virtio_blk_bench_state.status == VIRTIO_BLK_OK) {
+        virtio_blk_wait_step(dev);
+        if (virtio_blk_bench_state.ready_count) {
+            virtio_blk_bench_resubmit(device);
+        }
+    }
+
+    // Drain whatever is still in flight
+    while (dev->in_flight) {
+        virtio_blk_wait_step(dev);
+    }
+    if (virtq_enable_interrupts(&dev->queue)) {
+        virtio_blk_reap(dev, true);
+    }
+    irq_restore(flags);
+
+    result->ticks = timer_get_ticks() - start;
+    result->operations = virtio_blk_bench_state.operations;
+    result->bytes = (u64)virtio_blk_bench_state.operations * sectors * VIRTIO_BLK_SECTOR_SIZE;
+    result->notifications = virtio_blk_stats.notifications - before.notifications;
+    result->interrupts = virtio_blk_stats.interrupts - before.interrupts;
+    result->polled = virtio_blk_stats.polled_completions - before.polled_completions;
+    return virtio_blk_bench_state.status;
+}
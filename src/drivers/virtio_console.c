@@ -0,0 +1,515 @@
+#include "virtio_console.h"
+#include "virtio.h"
+#include "pci.h"
+#include "irq.h"
+#include "timer.h"
+#include "cpu.h"
+#include "irqtrace.h"
+#include "dma.h"
+
+// One device; its ports are the unit callers address. Every port streams
+// out through its own transmit queue from a small set of DMA buffers.
+static struct virtio_device virtio_console_transport;
+static struct virtio_console_port virtio_console_ports[VIRTIO_CONSOLE_MAX_PORTS];
+static u32 virtio_console_port_count = 0;
+static bool virtio_console_found = false;
+static bool virtio_console_multiport = false;
+static u8 virtio_console_irq = 0;
+static u32 virtio_console_log_port = VIRTIO_CONSOLE_NO_PORT;
+
+// VIRTIO_CONSOLE_WAIT_US in TSC cycles, converted at initialization. Writes
+// also come from the console tee with interrupts off, where calibrating
+// the TSC (it sleeps on timer ticks) would never finish.
+static u64 virtio_console_wait_cycles = 0;
+
+static struct virtqueue virtio_console_control_rx;
+static struct virtqueue virtio_console_control_tx;
+static u32 virtio_console_control_free = 0;     // Control transmit buffers not on the queue
+
+// In the DMA pool, kept if a probe fails: rings for the two control
+// queues and each port's transmit queue, control messages, port buffers
+static u8* virtio_console_rings[2 + VIRTIO_CONSOLE_MAX_PORTS];
+static u8* virtio_console_control_buffers[2][VIRTIO_CONSOLE_CONTROL_BUFFERS];
+static u8* virtio_console_buffers[VIRTIO_CONSOLE_MAX_PORTS][VIRTIO_CONSOLE_TX_BUFFERS];
+
+static const char* virtio_console_errors[] = {
+    "Success",
+    "Invalid request",
+    "No such port",
+    "Port not connected on the host",
+    "Timed out waiting for the device",
+};
+
+static u8* virtio_console_ring(u32 slot) {
+    if (!virtio_console_rings[slot]) {
+        virtio_console_rings[slot] = dma_alloc(VIRTQ_RING_SIZE(VIRTQ_MAX_SIZE), VIRTQ_ALIGN);
+    }
+    return virtio_console_rings[slot];
+}
+
+static bool virtio_console_alloc_buffers(u32 port) {
+    for (u32 i = 0; i < VIRTIO_CONSOLE_TX_BUFFERS; i++) {
+        if (!virtio_console_buffers[port][i]) {
+            virtio_console_buffers[port][i] = dma_alloc(VIRTIO_CONSOLE_BUFFER_SIZE, 0);
+        }
+        if (!virtio_console_buffers[port][i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// The functions below run with interrupts disabled
+
+// Take back the buffers the device has finished with
+static void virtio_console_reap(struct virtio_console_port* port) {
+    void* token;
+    while ((token = virtq_get_used(&port->tx, 0))) {
+        port->free_mask |= 1u << ((uptr)token - 1);
+    }
+}
+
+// True once the device has handed back every buffer
+static bool virtio_console_drained(struct virtio_console_port* port) {
+    virtio_console_reap(port);
+    u32 held = port->current >= 0 ? 1u << port->current : 0;
+    return (port->free_mask | held) == (1u << VIRTIO_CONSOLE_TX_BUFFERS) - 1;
+}
+
+static bool virtio_console_take_buffer(struct virtio_console_port* port) {
+    virtio_console_reap(port);
+    if (!port->free_mask) {
+        return false;
+    }
+    u32 index = __builtin_ctz(port->free_mask);
+    port->free_mask &= ~(1u << index);
+    port->current = index;
+    port->fill = 0;
+    return true;
+}
+
+// Stage the buffer being filled; it is not visible until the next kick
+static void virtio_console_queue_current(struct virtio_console_port* port) {
+    if (port->current < 0 || port->fill == 0) {
+        return;
+    }
+    u32 index = (u32)port->current;
+    struct virtq_buffer buffer = {virtio_console_buffers[port - virtio_console_ports][index], port->fill};
+    virtq_add(&port->tx, &buffer, 1, 0, (void*)(uptr)(index + 1));
+    port->stats.bytes += port->fill;
+    port->stats.buffers++;
+    port->queued++;
+    port->current = -1;
+    port->fill = 0;
+}
+
+static void virtio_console_kick(struct virtio_console_port* port) {
+    if (!port->queued) {
+        return;
+    }
+    port->queued = 0;
+    port->stats.kicks++;
+    if (virtq_kick(&port->tx)) {
+        port->stats.notifications++;
+    }
+}
+
+static void virtio_console_send_control(u32 id, u16 event, u16 value) {
+    void* token;
+    while ((token = virtq_get_used(&virtio_console_control_tx, 0))) {
+        virtio_console_control_free |= 1u << ((uptr)token - 1);
+    }
+    if (!virtio_console_control_free) {
+        return;
+    }
+    u32 index = __builtin_ctz(virtio_console_control_free);
+    virtio_console_control_free &= ~(1u << index);
+
+    struct virtio_console_control* msg = (struct virtio_console_control*)virtio_console_control_buffers[1][index];
+    msg->id = id;
+    msg->event = event;
+    msg->value = value;
+    struct virtq_buffer buffer = {msg, sizeof(*msg)};
+    virtq_add(&virtio_console_control_tx, &buffer, 1, 0, (void*)(uptr)(index + 1));
+    virtq_kick(&virtio_console_control_tx);
+}
+
+static void virtio_console_post_control(u32 index) {
+    struct virtq_buffer buffer = {virtio_console_control_buffers[0][index], VIRTIO_CONSOLE_CONTROL_SIZE};
+    virtq_add(&virtio_console_control_rx, &buffer, 0, 1, (void*)(uptr)(index + 1));
+}
+
+// Ports the device adds beyond the ones with a transmit queue are refused.
+// Accepted ports are opened on the guest side straight away.
+static void virtio_console_handle_control(const struct virtio_console_control* msg, u32 length) {
+    if (length < sizeof(*msg)) {
+        return;
+    }
+    if (msg->event == VIRTIO_CONSOLE_DEVICE_ADD) {
+        bool ok = msg->id < virtio_console_port_count && virtio_console_alloc_buffers(msg->id);
+        virtio_console_send_control(msg->id, VIRTIO_CONSOLE_PORT_READY, ok);
+        if (ok) {
+            virtio_console_ports[msg->id].present = true;
+            virtio_console_send_control(msg->id, VIRTIO_CONSOLE_PORT_OPEN, 1);
+        }
+        return;
+    }
+    if (msg->id >= virtio_console_port_count) {
+        return;
+    }
+
+    struct virtio_console_port* port = &virtio_console_ports[msg->id];
+    switch (msg->event) {
+        case VIRTIO_CONSOLE_DEVICE_REMOVE:
+            port->present = false;
+            port->host_open = false;
+            break;
+        case VIRTIO_CONSOLE_CONSOLE_PORT:
+            port->console = true;
+            break;
+        case VIRTIO_CONSOLE_PORT_OPEN:
+            port->host_open = msg->value != 0;
+            break;
+        case VIRTIO_CONSOLE_PORT_NAME: {
+            u32 name_length = length - sizeof(*msg);
+            if (name_length >= VIRTIO_CONSOLE_NAME_MAX) {
+                name_length = VIRTIO_CONSOLE_NAME_MAX - 1;
+            }
+            memcpy(port->name, msg + 1, name_length);
+            port->name[name_length] = '\0';
+            break;
+        }
+    }
+}
+
+static void virtio_console_process_control(void) {
+    void* token;
+    u32 length;
+    while ((token = virtq_get_used(&virtio_console_control_rx, &length))) {
+        u32 index = (uptr)token - 1;
+        virtio_console_handle_control((const struct virtio_console_control*)virtio_console_control_buffers[0][index], length);
+        virtio_console_post_control(index);
+    }
+    virtq_kick(&virtio_console_control_rx);
+}
+
+// Only the control receive queue interrupts; transmit completions are
+// reaped when a port needs a buffer
+static void virtio_console_irq_handler(struct interrupt_context* ctx) {
+    u8 irq = ctx->int_no - 32;
+    if (!virtio_console_found || irq != virtio_console_irq ||
+        !(virtio_read_isr(&virtio_console_transport) & 1)) {
+        return;
+    }
+    if (virtio_console_multiport) {
+        virtio_console_process_control();
+    }
+}
+
+static struct virtio_console_port* virtio_console_usable(u32 port) {
+    if (port >= virtio_console_port_count || !virtio_console_ports[port].present) {
+        return 0;
+    }
+    return &virtio_console_ports[port];
+}
+
+// Copy data into the port's buffers, queueing each one as it fills and
+// ringing the doorbell once per batch. When every buffer is on the queue
+// the writer waits for one to come back, with interrupts as the caller had
+// them, and gives up on the rest after VIRTIO_CONSOLE_WAIT_US.
+int virtio_console_write(u32 port_index, const void* data, u32 length) {
+    struct virtio_console_port* port = virtio_console_usable(port_index);
+    if (!port) {
+        return VIRTIO_CONSOLE_ERR_NO_PORT;
+    }
+    if (!port->host_open) {
+        return VIRTIO_CONSOLE_ERR_CLOSED;   // The device would discard it
+    }
+
+    const u8* bytes = (const u8*)data;
+    u32 flags = irq_save();
+    while (length) {
+        if (port->current < 0 && !virtio_console_take_buffer(port)) {
+            virtio_console_kick(port);
+            port->stats.waits++;
+            u64 start = rdtsc();
+            while (port->current < 0 && !virtio_console_take_buffer(port) &&
+                   rdtsc() - start < virtio_console_wait_cycles) {
+                irq_restore(flags);
+                __asm__ volatile ("pause");
+                flags = irq_save();
+            }
+            if (port->current < 0) {
+                port->stats.dropped += length;
+                irq_restore(flags);
+                return VIRTIO_CONSOLE_ERR_TIMEOUT;
+            }
+        }
+
+        u32 chunk = VIRTIO_CONSOLE_BUFFER_SIZE - port->fill;
+        if (chunk > length) {
+            chunk = length;
+        }
+        memcpy(virtio_console_buffers[port_index][port->current] + port->fill, bytes, chunk);
+        port->fill += chunk;
+        bytes += chunk;
+        length -= chunk;
+        if (port->fill == VIRTIO_CONSOLE_BUFFER_SIZE) {
+            virtio_console_queue_current(port);
+            if (port->queued >= VIRTIO_CONSOLE_BATCH) {
+                virtio_console_kick(port);
+            }
+        }
+    }
+    irq_restore(flags);
+    return VIRTIO_CONSOLE_OK;
+}
+
+// Send whatever the port holds, including a partly filled buffer
+void virtio_console_flush(u32 port_index) {
+    struct virtio_console_port* port = virtio_console_usable(port_index);
+    if (!port) {
+        return;
+    }
+    u32 flags = irq_save();
+    virtio_console_queue_current(port);
+    virtio_console_kick(port);
+    irq_restore(flags);
+}
+
+// Called from the idle loop, so output trickling in is sent once the
+// system has nothing better to do
+void virtio_console_flush_all(void) {
+    for (u32 i = 0; i < virtio_console_port_count; i++) {
+        if (virtio_console_ports[i].fill || virtio_console_ports[i].queued) {
+            virtio_console_flush(i);
+        }
+    }
+}
+
+// Console output tee: everything written to the screen also goes to the
+// log port while one is set
+void virtio_console_set_log(u32 port) {
+    virtio_console_log_port = port;
+}
+
+u32 virtio_console_get_log(void) {
+    return virtio_console_log_port;
+}
+
+void virtio_console_putchar(char c) {
+    if (virtio_console_log_port != VIRTIO_CONSOLE_NO_PORT) {
+        virtio_console_write(virtio_console_log_port, &c, 1);
+    }
+}
+
+static bool virtio_console_probe(struct pci_device* pci) {
+    if (virtio_console_found) {
+        return false;
+    }
+    struct virtio_device* dev = &virtio_console_transport;
+
+    u32 features = 0;
+    if (!virtio_init_device(dev, pci) ||
+        !virtio_negotiate(dev, VIRTIO_CONSOLE_F_MULTIPORT, &features)) {
+        return false;
+    }
+    virtio_console_multiport = (features & VIRTIO_CONSOLE_F_MULTIPORT) != 0;
+
+    u32 ports = 1;
+    if (virtio_console_multiport) {
+        ports = virtio_config_read32(dev, VIRTIO_CONSOLE_CFG_MAX_PORTS);
+        if (ports == 0) ports = 1;
+        if (ports > VIRTIO_CONSOLE_MAX_PORTS) ports = VIRTIO_CONSOLE_MAX_PORTS;
+
+        for (u32 i = 0; i < VIRTIO_CONSOLE_CONTROL_BUFFERS; i++) {
+            for (u32 dir = 0; dir < 2; dir++) {
+                u8** buffer = &virtio_console_control_buffers[dir][i];
+                if (!*buffer) {
+                    *buffer = dma_alloc(VIRTIO_CONSOLE_CONTROL_SIZE, 0);
+                }
+                if (!*buffer) {
+                    virtio_fail(dev);
+                    return false;
+                }
+            }
+        }
+        u8* rx_ring = virtio_console_ring(0);
+        u8* tx_ring = virtio_console_ring(1);
+        if (!rx_ring || !tx_ring ||
+            !virtio_setup_queue(dev, &virtio_console_control_rx, VIRTIO_CONSOLE_CONTROL_RX, rx_ring, VIRTQ_RING_SIZE(VIRTQ_MAX_SIZE)) ||
+            !virtio_setup_queue(dev, &virtio_console_control_tx, VIRTIO_CONSOLE_CONTROL_TX, tx_ring, VIRTQ_RING_SIZE(VIRTQ_MAX_SIZE)) ||
+            virtio_console_control_rx.size < VIRTIO_CONSOLE_CONTROL_BUFFERS ||
+            virtio_console_control_tx.size < VIRTIO_CONSOLE_CONTROL_BUFFERS) {
+            virtio_fail(dev);
+            return false;
+        }
+    }
+
+    // Later ports without a queue are refused when the device adds them
+    memset(virtio_console_ports, 0, sizeof(virtio_console_ports));
+    virtio_console_port_count = 0;
+    for (u32 n = 0; n < ports; n++) {
+        struct virtio_console_port* port = &virtio_console_ports[n];
+        u8* ring = virtio_console_ring(2 + n);
+        if (!ring || !virtio_setup_queue(dev, &port->tx, VIRTIO_CONSOLE_PORT_TX(n), ring, VIRTQ_RING_SIZE(VIRTQ_MAX_SIZE)) ||
+            port->tx.size < VIRTIO_CONSOLE_TX_BUFFERS) {
+            break;
+        }
+        virtq_disable_interrupts(&port->tx);
+        port->configured = true;
+        port->current = -1;
+        port->free_mask = (1u << VIRTIO_CONSOLE_TX_BUFFERS) - 1;
+        virtio_console_port_count++;
+    }
+    if (virtio_console_port_count == 0) {
+        virtio_fail(dev);
+        return false;
+    }
+
+    // Virtio signals through MSI-X, which the PCI layer does not program,
+    // so control messages arrive on the legacy INTx line
+    virtio_console_irq = pci->irq_line;
+    irq_share_handler(virtio_console_irq, virtio_console_irq_handler);
+    irq_clear_mask(virtio_console_irq);
+
+    virtio_driver_ok(dev);
+    virtio_console_found = true;
+
+    u32 flags = irq_save();
+    if (virtio_console_multiport) {
+        // The device answers DEVICE_READY with a DEVICE_ADD per port,
+        // followed by their names and open state; take what is already there
+        for (u32 i = 0; i < VIRTIO_CONSOLE_CONTROL_BUFFERS; i++) {
+            virtio_console_post_control(i);
+        }
+        virtq_kick(&virtio_console_control_rx);
+        virtio_console_control_free = (1u << VIRTIO_CONSOLE_CONTROL_BUFFERS) - 1;
+        virtio_console_send_control(0, VIRTIO_CONSOLE_DEVICE_READY, 1);
+        virtio_console_process_control();
+    } else if (virtio_console_alloc_buffers(0)) {
+        // Without multiport the single port is always there and connected
+        virtio_console_ports[0].present = true;
+        virtio_console_ports[0].host_open = true;
+        virtio_console_ports[0].console = true;
+    }
+    irq_restore(flags);
+    return true;
+}
+
+static const struct pci_device_id virtio_console_ids[] = {
+    {VIRTIO_PCI_VENDOR, VIRTIO_CONSOLE_DEVICE_LEGACY, PCI_ANY_ID, PCI_ANY_ID, PCI_ANY_ID},
+    {VIRTIO_PCI_VENDOR, VIRTIO_CONSOLE_DEVICE_MODERN, PCI_ANY_ID, PCI_ANY_ID, PCI_ANY_ID},
+    {0, 0, 0, 0, 0},
+};
+
+static const struct pci_driver virtio_console_driver = {
+    .name = "virtio-console",
+    .ids = virtio_console_ids,
+    .probe = virtio_console_probe,
+};
+
+void virtio_console_initialize(void) {
+    virtio_console_found = false;
+    virtio_console_port_count = 0;
+    virtio_console_log_port = VIRTIO_CONSOLE_NO_PORT;
+
+    // Runs as a deferred initcall, with interrupts on; 1 GHz is assumed
+    // if there is no timer to calibrate against
+    u64 mhz = div_u64_rem(timer_get_tsc_hz(), 1000000, 0);
+    virtio_console_wait_cycles = (mhz ? mhz : 1000) * VIRTIO_CONSOLE_WAIT_US;
+    pci_register_driver(&virtio_console_driver);
+}
+
+bool virtio_console_present(void) {
+    return virtio_console_found;
+}
+
+bool virtio_console_is_modern(void) {
+    return virtio_console_found && virtio_console_transport.modern;
+}
+
+bool virtio_console_is_multiport(void) {
+    return virtio_console_found && virtio_console_multiport;
+}
+
+u32 virtio_console_get_port_count(void) {
+    return virtio_console_port_count;
+}
+
+const struct virtio_console_port* virtio_console_get_port(u32 port) {
+    return port < virtio_console_port_count ? &virtio_console_ports[port] : 0;
+}
+
+// Port with the name the host gave it (virtserialport name=...)
+u32 virtio_console_find(const char* name) {
+    for (u32 i = 0; i < virtio_console_port_count; i++) {
+        if (virtio_console_ports[i].present && strcmp(virtio_console_ports[i].name, name) == 0) {
+            return i;
+        }
+    }
+    return VIRTIO_CONSOLE_NO_PORT;
+}
+
+void virtio_console_reset_stats(void) {
+    u32 flags = irq_save();
+    for (u32 i = 0; i < virtio_console_port_count; i++) {
+        memset(&virtio_console_ports[i].stats, 0, sizeof(virtio_console_ports[i].stats));
+    }
+    irq_restore(flags);
+}
+
+const char* virtio_console_strerror(int status) {
+    if (status < 0 || status > VIRTIO_CONSOLE_ERR_TIMEOUT) {
+        return "Unknown error";
+    }
+    return virtio_console_errors[status];
+}
+
+// Benchmark: stream bytes of text to a port and wait until the device has
+// handed every buffer back, so the rate is what the host side absorbed
+#define VIRTIO_CONSOLE_BENCH_CHUNK      4096
+
+static char virtio_console_bench_pattern[VIRTIO_CONSOLE_BENCH_CHUNK];
+
+int virtio_console_bench(u32 port_index, u32 bytes, struct virtio_console_bench_result* result) {
+    struct virtio_console_port* port = virtio_console_usable(port_index);
+    if (!port) {
+        return VIRTIO_CONSOLE_ERR_NO_PORT;
+    }
+    if (bytes == 0) {
+        return VIRTIO_CONSOLE_ERR_INVALID;
+    }
+    for (u32 i = 0; i < VIRTIO_CONSOLE_BENCH_CHUNK; i++) {
+        virtio_console_bench_pattern[i] = (i % 64 == 63) ? '\n' : 'a' + i % 26;
+    }
+
+    struct virtio_console_port_stats before = port->stats;
+    u32 start = timer_get_ticks();
+    int status = VIRTIO_CONSOLE_OK;
+    while (bytes && status == VIRTIO_CONSOLE_OK) {
+        u32 chunk = bytes > VIRTIO_CONSOLE_BENCH_CHUNK ? VIRTIO_CONSOLE_BENCH_CHUNK : bytes;
+        status = virtio_console_write(port_index, virtio_console_bench_pattern, chunk);
+        bytes -= chunk;
+    }
+    virtio_console_flush(port_index);
+
+    u64 wait = rdtsc();
+    u32 flags = irq_save();
+    while (!virtio_console_drained(port) && rdtsc() - wait < virtio_console_wait_cycles) {
+        irq_restore(flags);
+        __asm__ volatile ("pause");
+        flags = irq_save();
+    }
+    if (status == VIRTIO_CONSOLE_OK && !virtio_console_drained(port)) {
+        status = VIRTIO_CONSOLE_ERR_TIMEOUT;
+    }
+    irq_restore(flags);
+
+    result->ticks = timer_get_ticks() - start;
+    result->bytes = port->stats.bytes - before.bytes;
+    result->kicks = port->stats.kicks - before.kicks;
+    result->notifications = port->stats.notifications - before.notifications;
+    result->waits = port->stats.waits - before.waits;
+    return status;
+}
@@ -0,0 +1,79 @@
+#ifndef ACPI_H
+#define ACPI_H
+
+#include "kernel.h"
+
+#define ACPI_MAX_TABLES 32
+
+// Root system description pointer (ACPI 2.0 layout)
+struct acpi_rsdp {
+    char signature[8];      // "RSD PTR "
+    u8  checksum;
+    char oem_id[6];
+    u8  revision;
+    u32 rsdt_address;
+    u32 length;             // ACPI 2.0+ fields
+    u64 xsdt_address;
+    u8  extended_checksum;
+    u8  reserved[3];
+} __attribute__((packed));
+
+// Common header of every system description table
+struct acpi_sdt_header {
+    char signature[4];
+    u32 length;
+    u8  revision;
+    u8  checksum;
+    char oem_id[6];
+    char oem_table_id[8];
+    u32 oem_revision;
+    u32 creator_id;
+    u32 creator_revision;
+} __attribute__((packed));
+
+// PCI Express memory mapped configuration space table
+struct acpi_mcfg_entry {
+    u64 base_address;
+    u16 segment;
+    u8  start_bus;
+    u8  end_bus;
+    u32 reserved;
+} __attribute__((packed));
+
+struct acpi_mcfg {
+    struct acpi_sdt_header header;
+    u64 reserved;
+    struct acpi_mcfg_entry entries[];
+} __attribute__((packed));
+
+// Generic address structure
+#define ACPI_GAS_MEMORY         0
+#define ACPI_GAS_IO             1
+#define ACPI_GAS_PCI            2
+
+struct acpi_gas {
+    u8  space_id;
+    u8  bit_width;
+    u8  bit_offset;
+    u8  access_size;
+    u64 address;
+} __attribute__((packed));
+
+// Fixed ACPI description table ("FACP"), up to the reset register
+#define ACPI_FADT_RESET_REG_SUP (1 << 10)
+
+struct acpi_fadt {
+    struct acpi_sdt_header header;
+    u32 firmware_ctrl;
+    u32 dsdt;
+    u8  reserved[68];       // Power management blocks and legacy fields
+    u32 flags;
+    struct acpi_gas reset_reg;
+    u8  reset_value;
+} __attribute__((packed));
+
+// ACPI functions
+bool acpi_initialize(void);
+const struct acpi_sdt_header* acpi_find_table(const char* signature);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,36 @@
+#ifndef APIC_H
+#define APIC_H
+
+#include "kernel.h"
+
+// Local APIC
+#define MSR_APIC_BASE           0x1B
+#define LAPIC_BASE_MASK         0xFFFFF000
+#define LAPIC_BASE_ENABLE       0x800
+#define LAPIC_MMIO_SIZE         0x1000
+
+// Local APIC registers (offsets from the base)
+#define LAPIC_REG_ID            0x020
+#define LAPIC_REG_TPR           0x080
+#define LAPIC_REG_EOI           0x0B0
+#define LAPIC_REG_SVR           0x0F0
+#define LAPIC_REG_ICR_LOW       0x300
+
+// Interrupt command: fixed delivery to this CPU only
+#define LAPIC_ICR_PENDING       0x1000
+#define LAPIC_ICR_SELF          0x40000
+
+#define LAPIC_SVR_ENABLE        0x100
+#define LAPIC_SPURIOUS_VECTOR   0xFF
+
+// MSI message address for the local APIC
+#define MSI_ADDRESS_BASE        0xFEE00000
+
+// Local APIC functions
+bool lapic_initialize(void);
+bool lapic_present(void);
+u32 lapic_get_id(void);
+void lapic_eoi(void);
+void lapic_send_self(u8 vector);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,135 @@
+#ifndef ATA_H
+#define ATA_H
+
+#include "kernel.h"
+
+// Legacy (compatibility mode) channel resources
+#define ATA_PRIMARY_IO          0x1F0
+#define ATA_PRIMARY_CTRL        0x3F6
+#define ATA_PRIMARY_IRQ         14
+#define ATA_SECONDARY_IO        0x170
+#define ATA_SECONDARY_CTRL      0x376
+#define ATA_SECONDARY_IRQ       15
+
+// Task file registers (offsets from the I/O base)
+#define ATA_REG_DATA            0
+#define ATA_REG_ERROR           1
+#define ATA_REG_FEATURES        1
+#define ATA_REG_SECCOUNT        2
+#define ATA_REG_LBA0            3
+#define ATA_REG_LBA1            4
+#define ATA_REG_LBA2            5
+#define ATA_REG_DRIVE           6
+#define ATA_REG_STATUS          7
+#define ATA_REG_COMMAND         7
+
+// Device control register bits
+#define ATA_CTRL_NIEN           0x02
+#define ATA_CTRL_SRST           0x04
+
+// Status register bits
+#define ATA_STATUS_ERR          0x01
+#define ATA_STATUS_DRQ          0x08
+#define ATA_STATUS_DF           0x20
+#define ATA_STATUS_DRDY         0x40
+#define ATA_STATUS_BSY          0x80
+
+// Commands
+#define ATA_CMD_READ_DMA        0xC8
+#define ATA_CMD_READ_DMA_EXT    0x25
+#define ATA_CMD_WRITE_DMA       0xCA
+#define ATA_CMD_WRITE_DMA_EXT   0x35
+#define ATA_CMD_IDENTIFY        0xEC
+
+// Bus master IDE registers (offsets from BAR4, secondary channel at +8)
+#define ATA_BM_COMMAND          0
+#define ATA_BM_STATUS           2
+#define ATA_BM_PRDT             4
+#define ATA_BM_CMD_START        0x01
+#define ATA_BM_CMD_READ         0x08    // Device to memory
+#define ATA_BM_STATUS_ACTIVE    0x01
+#define ATA_BM_STATUS_ERROR     0x02
+#define ATA_BM_STATUS_IRQ       0x04
+
+// Limits
+#define ATA_SECTOR_SIZE         512
+#define ATA_MAX_DRIVES          4       // Two channels, master and slave
+#define ATA_PRD_ENTRIES         64      // Scatter/gather entries per command
+#define ATA_PRD_EOT             0x8000
+#define ATA_MAX_SECTORS         256     // Per command after merging (128 KiB)
+#define ATA_TIMEOUT_MS          3000
+#define ATA_POLL_LIMIT          100000
+
+// Request status
+#define ATA_PENDING             (-1)
+#define ATA_OK                  0
+#define ATA_ERR_INVALID         1
+#define ATA_ERR_NO_DEVICE       2
+#define ATA_ERR_IO              3
+#define ATA_ERR_TIMEOUT         4
+
+// Physical region descriptor
+struct ata_prd {
+    u32 address;
+    u16 size;           // Bytes, 0 means 64 KiB
+    u16 flags;
+} __attribute__((packed));
+
+struct ata_drive {
+    bool present;
+    bool lba48;
+    u8 channel;
+    bool slave;
+    u64 sectors;
+    char model[41];
+};
+
+// Asynchronous transfer. The buffer must be identity mapped, 2-byte
+// aligned and stay valid until the request completes. done is called
+// from the interrupt handler once status leaves ATA_PENDING.
+struct ata_request {
+    u64 lba;
+    u32 count;                          // Sectors
+    void* buffer;
+    bool write;
+    volatile int status;
+    void (*done)(struct ata_request* req);
+    void* context;
+
+    // Elevator bookkeeping, owned by the driver while pending
+    u32 drive;
+    u32 total;                          // Sectors in the merged chain
+    u32 segments;                       // PRD entries the chain needs
+    struct ata_request* next;           // Next command in the queue
+    struct ata_request* merged;         // Next request sharing this command
+};
+
+struct ata_stats {
+    u32 requests;       // Requests submitted
+    u32 merges;         // Requests folded into an adjacent command
+    u32 commands;       // DMA commands issued to the devices
+    u64 sectors;        // Sectors transferred
+    u32 errors;
+    u32 timeouts;
+};
+
+struct ata_bench_result {
+    u32 operations;
+    u64 bytes;
+    u32 ticks;
+    u32 commands;
+    u32 merges;
+};
+
+// ATA functions
+void ata_initialize(void);
+const struct ata_drive* ata_get_drive(u32 index);
+int ata_submit(u32 drive, struct ata_request* req);
+int ata_wait(struct ata_request* req);
+int ata_read(u32 drive, u64 lba, u32 count, void* buffer);
+int ata_write(u32 drive, u64 lba, u32 count, const void* buffer);
+const struct ata_stats* ata_get_stats(void);
+const char* ata_strerror(int status);
+int ata_bench(u32 drive, bool sequential, u32 depth, u32 sectors, u32 ticks, struct ata_bench_result* result);
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include "kernel.h"
+
+#define BLOCK_SECTOR_SIZE       512
+#define BLOCK_MAX_DEVICES       8
+#define BLOCK_NAME_MAX          8
+
+// Buffer cache geometry
+#define BCACHE_BUFFERS          256
+#define BCACHE_MAX_BLOCK_SIZE   4096
+#define BCACHE_DEFAULT_BLOCK    1024
+#define BCACHE_HASH_SIZE        512     // Power of two
+#define BCACHE_READAHEAD_MIN    4       // Blocks prefetched when a sequential run starts
+#define BCACHE_READAHEAD_MAX    32      // Window doubles up to this many blocks (bcache.readahead)
+#define BCACHE_READAHEAD_LIMIT  (BCACHE_BUFFERS / 4)
+
+// Block layer status
+#define BLOCK_OK                0
+#define BLOCK_ERR_INVALID       1
+#define BLOCK_ERR_NO_DEVICE     2
+#define BLOCK_ERR_IO            3
+#define BLOCK_ERR_READ_ONLY     4
+#define BLOCK_ERR_NO_BUFFER     5
+
+// Buffer flags
+#define BCACHE_VALID            0x01
+#define BCACHE_DIRTY            0x02
+#define BCACHE_LOCKED           0x04    // Read in flight
+#define BCACHE_READAHEAD        0x08    // Prefetched and not yet used
+
+struct block_device;
+
+// Asynchronous read used for read-ahead; done may run in interrupt context
+struct block_request {
+    u64 sector;
+    u32 count;
+    void* buffer;
+    void (*done)(struct block_request* req, int status);
+    void* context;
+};
+
+struct block_ops {
+    int (*read)(struct block_device* dev, u64 sector, u32 count, void* buffer);
+    int (*write)(struct block_device* dev, u64 sector, u32 count, const void* buffer);
+    int (*read_async)(struct block_device* dev, struct block_request* req);    // Optional
+};
+
+struct block_device {
+    char name[BLOCK_NAME_MAX];
+    u64 sectors;
+    bool readonly;
+    const struct block_ops* ops;
+    void* private;
+    u32 unit;                   // Driver-specific index
+
+    // Maintained by the block layer
+    u32 block_size;             // Cache block size in bytes
+    u64 sectors_read;
+    u64 sectors_written;
+    u64 last_block;             // Sequential read detection
+    u64 readahead_next;         // First block not yet prefetched
+    u32 readahead_window;
+};
+
+struct bcache_buffer {
+    struct block_device* dev;
+    u64 block;
+    volatile u32 flags;
+    u32 refcount;
+    u8* data;
+    struct bcache_buffer* hash_next;
+    struct bcache_buffer* lru_prev;
+    struct bcache_buffer* lru_next;
+    struct block_request request;
+};
+
+struct bcache_stats {
+    u32 lookups;
+    u32 hits;
+    u32 misses;
+    u32 evictions;
+    u32 writebacks;
+    u32 readahead_issued;
+    u32 readahead_hits;     // Prefetched blocks later read
+    u32 readahead_waits;    // Reads that waited on an in-flight prefetch
+    u32 io_errors;
+};
+
+// Block device registry
+void block_initialize(void);
+bool block_register(struct block_device* dev);
+u32 block_get_count(void);
+struct block_device* block_get(u32 index);
+struct block_device* block_find(const char* name);
+int block_read(struct block_device* dev, u64 sector, u32 count, void* buffer);
+int block_read_async(struct block_device* dev, struct block_request* req);
+int block_write(struct block_device* dev, u64 sector, u32 count, const void* buffer);
+const char* block_strerror(int status);
+
+// Buffer cache
+int bcache_set_block_size(struct block_device* dev, u32 size);
+struct bcache_buffer* bcache_read(struct block_device* dev, u64 block);
+struct bcache_buffer* bcache_get(struct block_device* dev, u64 block);
+void bcache_release(struct bcache_buffer* buffer);
+void bcache_mark_dirty(struct bcache_buffer* buffer);
+int bcache_sync(struct block_device* dev);
+const struct bcache_stats* bcache_get_stats(void);
+u32 bcache_count_buffers(u32 flags);
+
+#endif
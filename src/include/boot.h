@@ -0,0 +1,64 @@
+#ifndef BOOT_H
+#define BOOT_H
+
+#include "kernel.h"
+
+#define BOOT_MAX_MARKS          32
+#define BOOT_MAX_INITCALLS      16
+
+// When an initcall runs: from the idle loop once the prompt is up, or
+// only when something first needs it
+#define BOOT_INIT_DEFERRED      1
+#define BOOT_INIT_LAZY          2
+
+// Initcall state
+#define BOOT_INIT_PENDING       0
+#define BOOT_INIT_RUNNING       1
+#define BOOT_INIT_DONE          2
+#define BOOT_INIT_FAILED        3
+
+typedef bool (*boot_initcall_t)(void);
+
+// Timeline entry: TSC at the end of a boot phase
+struct boot_mark {
+    const char* name;
+    u64 tsc;
+};
+
+// Filled in by the compressed image's decompressor stub before it enters
+// the kernel (offsets in src/boot/compressed/head.asm)
+#define BOOT_UNPACK_MAGIC       0x4B434E55
+
+struct boot_unpack {
+    u32 magic;                  // BOOT_UNPACK_MAGIC when the stub ran
+    u32 packed_size;            // LZ4 payload bytes
+    u32 unpacked_size;          // Kernel image bytes written
+    u32 reserved;
+    u64 entry_tsc;              // Stub entered
+    u64 done_tsc;               // Image unpacked, jumping to the kernel
+};
+
+struct boot_initcall {
+    const char* name;
+    boot_initcall_t function;
+    u32 level;
+    u32 state;
+    bool on_demand;             // Run by boot_require rather than the idle loop
+    u64 start;
+    u64 end;
+};
+
+// Boot timeline and initcall functions
+void boot_start(void);
+void boot_mark(const char* name);
+u64 boot_get_start(void);
+const struct boot_unpack* boot_get_unpack(void);
+u32 boot_get_mark_count(void);
+const struct boot_mark* boot_get_mark(u32 index);
+bool boot_initcall(const char* name, boot_initcall_t function, u32 level);
+bool boot_run_deferred(void);
+bool boot_require(const char* name);
+u32 boot_get_initcall_count(void);
+const struct boot_initcall* boot_get_initcall(u32 index);
+
+#endif
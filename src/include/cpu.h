@@ -0,0 +1,47 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include "kernel.h"
+
+// CPUID leaf 1 EDX feature bits
+#define CPUID_FEAT_EDX_PSE    (1 << 3)
+#define CPUID_FEAT_EDX_TSC    (1 << 4)
+#define CPUID_FEAT_EDX_MSR    (1 << 5)
+#define CPUID_FEAT_EDX_APIC   (1 << 9)
+#define CPUID_FEAT_EDX_SEP    (1 << 11)
+
+// Model specific registers
+#define MSR_SYSENTER_CS       0x174
+#define MSR_SYSENTER_ESP      0x175
+#define MSR_SYSENTER_EIP      0x176
+
+// Read the time stamp counter
+static inline u64 rdtsc(void) {
+    u32 lo, hi;
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((u64)hi << 32) | lo;
+}
+
+static inline void cpuid(u32 leaf, u32* eax, u32* ebx, u32* ecx, u32* edx) {
+    __asm__ volatile ("cpuid"
+                      : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx)
+                      : "a"(leaf), "c"(0));
+}
+
+static inline u64 rdmsr(u32 msr) {
+    u32 lo, hi;
+    __asm__ volatile ("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((u64)hi << 32) | lo;
+}
+
+static inline void wrmsr(u32 msr, u64 value) {
+    __asm__ volatile ("wrmsr" : : "c"(msr), "a"((u32)value), "d"((u32)(value >> 32)));
+}
+
+static inline bool cpu_has_feature_edx(u32 feature) {
+    u32 eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    return (edx & feature) != 0;
+}
+
+#endif
\ No newline at end of file
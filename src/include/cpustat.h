@@ -0,0 +1,49 @@
+#ifndef CPUSTAT_H
+#define CPUSTAT_H
+
+#include "kernel.h"
+#include "irq.h"
+
+// What the CPU is doing; time is charged to one context at a time
+#define CPUSTAT_IDLE            0   // Halted waiting for an interrupt
+#define CPUSTAT_IRQ             1   // Hardware interrupt handlers
+#define CPUSTAT_DEFERRED        2   // NIC polling and deferred initcalls from the idle loop
+#define CPUSTAT_COMMAND         3   // Shell input and the foreground command
+#define CPUSTAT_CONTEXTS        4
+
+// Interrupt sources: PIC lines 0-15, then the MSI vectors
+#define CPUSTAT_SOURCES         (16 + IRQ_MSI_COUNT)
+
+// Totals are sampled every CPUSTAT_WINDOW_MS (in whole timer ticks, see
+// cpustat_window_ticks) into a ring of CPUSTAT_WINDOWS samples, from which
+// sliding windows are computed
+#define CPUSTAT_WINDOW_MS       100
+#define CPUSTAT_WINDOWS         64
+
+// Cumulative TSC cycles at a window boundary
+struct cpustat_sample {
+    u64 tsc;
+    u64 contexts[CPUSTAT_CONTEXTS];
+    u64 sources[CPUSTAT_SOURCES];
+};
+
+// Cycles spent over a sliding window
+struct cpustat_usage {
+    u64 total;
+    u32 windows;
+    u64 contexts[CPUSTAT_CONTEXTS];
+    u64 sources[CPUSTAT_SOURCES];
+};
+
+// CPU accounting functions
+void cpustat_initialize(void);
+u32 cpustat_enter(u32 context);
+u32 cpustat_irq_enter(u32 source);
+void cpustat_irq_exit(u32 previous);
+void cpustat_tick(void);
+void cpustat_halt(void);
+bool cpustat_get_usage(u32 windows, struct cpustat_usage* usage);
+u32 cpustat_window_ticks(void);
+const char* cpustat_context_name(u32 context);
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef DMA_H
+#define DMA_H
+
+#include "kernel.h"
+
+// Pool reserved at boot; both can be overridden on the kernel command
+// line, in MiB, with dma.pool= and dma.limit=
+#define DMA_POOL_SIZE           0x400000
+#define DMA_POOL_LIMIT          0x1000000   // Reachable by 24-bit bus masters
+#define DMA_POOL_MIN            0x40000     // Smallest pool worth falling back to
+#define DMA_POOL_MAX            0x1000000
+
+// Allocations up to DMA_CLASS_MAX come from per-size free lists of
+// naturally aligned objects carved out of pool pages; larger ones take
+// whole contiguous pages
+#define DMA_CLASS_MIN           64
+#define DMA_CLASS_MAX           2048
+#define DMA_CLASSES             6
+
+struct dma_class_stats {
+    u32 size;
+    u32 objects;                // Carved so far
+    u32 in_use;
+    u32 allocs;
+    u32 frees;
+};
+
+struct dma_stats {
+    u32 base;                   // Physical base of the pool
+    u32 limit;                  // The pool ends at or below this address
+    u32 pages;
+    u32 pages_used;             // Page allocations and class pages together
+    u32 pages_peak;
+    u32 class_pages;
+    u32 page_allocs;
+    u32 page_frees;
+    u32 failures;
+    struct dma_class_stats classes[DMA_CLASSES];
+};
+
+// DMA pool functions
+bool dma_initialize(void);
+void* dma_alloc(u32 size, u32 align);
+void dma_free(void* ptr, u32 size);
+u32 dma_virt_to_phys(const void* ptr);
+bool dma_owns(const void* ptr);
+const struct dma_stats* dma_get_stats(void);
+
+#endif
@@ -0,0 +1,117 @@
+#ifndef E1000_H
+#define E1000_H
+
+#include "kernel.h"
+
+// Intel 8254x PCI IDs (QEMU's e1000 is the 82540EM)
+#define E1000_VENDOR            0x8086
+#define E1000_DEV_82540EM       0x100E
+#define E1000_DEV_82545EM       0x100F
+#define E1000_DEV_82543GC       0x1004
+#define E1000_DEV_82540EM_LOM   0x1015
+
+// Registers
+#define E1000_CTRL              0x0000
+#define E1000_STATUS            0x0008
+#define E1000_EERD              0x0014
+#define E1000_ICR               0x00C0
+#define E1000_ITR               0x00C4
+#define E1000_IMS               0x00D0
+#define E1000_IMC               0x00D8
+#define E1000_RCTL              0x0100
+#define E1000_TCTL              0x0400
+#define E1000_TIPG              0x0410
+#define E1000_RDBAL             0x2800
+#define E1000_RDBAH             0x2804
+#define E1000_RDLEN             0x2808
+#define E1000_RDH               0x2810
+#define E1000_RDT               0x2818
+#define E1000_RDTR              0x2820
+#define E1000_TDBAL             0x3800
+#define E1000_TDBAH             0x3804
+#define E1000_TDLEN             0x3808
+#define E1000_TDH               0x3810
+#define E1000_TDT               0x3818
+#define E1000_MTA               0x5200
+#define E1000_RAL               0x5400
+#define E1000_RAH               0x5404
+
+// Register bits
+#define E1000_CTRL_ASDE         (1 << 5)
+#define E1000_CTRL_SLU          (1 << 6)
+#define E1000_CTRL_RST          (1 << 26)
+#define E1000_STATUS_LU         (1 << 1)
+#define E1000_EERD_START        (1 << 0)
+#define E1000_EERD_DONE         (1 << 4)
+#define E1000_RAH_AV            (1u << 31)
+#define E1000_RCTL_EN           (1 << 1)
+#define E1000_RCTL_BAM          (1 << 15)
+#define E1000_RCTL_SECRC        (1 << 26)   // 2048-byte buffers with BSIZE 0
+#define E1000_TCTL_EN           (1 << 1)
+#define E1000_TCTL_PSP          (1 << 3)
+#define E1000_TCTL_CT           (0x10 << 4)
+#define E1000_TCTL_COLD         (0x40 << 12)
+#define E1000_TIPG_DEFAULT      (10 | (8 << 10) | (6 << 20))
+
+// Interrupt causes
+#define E1000_ICR_TXDW          (1 << 0)
+#define E1000_ICR_LSC           (1 << 2)
+#define E1000_ICR_RXDMT0        (1 << 4)
+#define E1000_ICR_RXO           (1 << 6)
+#define E1000_ICR_RXT0          (1 << 7)
+#define E1000_ICR_RX            (E1000_ICR_RXDMT0 | E1000_ICR_RXO | E1000_ICR_RXT0)
+
+// Descriptor bits
+#define E1000_RXD_STAT_DD       (1 << 0)
+#define E1000_RXD_STAT_EOP      (1 << 1)
+#define E1000_TXD_CMD_EOP       (1 << 0)
+#define E1000_TXD_CMD_IFCS      (1 << 1)
+#define E1000_TXD_CMD_RS        (1 << 3)
+#define E1000_TXD_STAT_DD       (1 << 0)
+
+// Rings (multiples of 8 descriptors)
+#define E1000_RX_DESC           128
+#define E1000_TX_DESC           128
+
+// Interrupt throttling in 256 ns units: at most about 8000 interrupts/s
+#define E1000_ITR_DEFAULT       488
+
+struct e1000_rx_desc {
+    u64 addr;
+    u16 length;
+    u16 checksum;
+    u8 status;
+    u8 errors;
+    u16 special;
+} __attribute__((packed));
+
+struct e1000_tx_desc {
+    u64 addr;
+    u16 length;
+    u8 cso;
+    u8 cmd;
+    u8 status;
+    u8 css;
+    u16 special;
+} __attribute__((packed));
+
+struct e1000_stats {
+    u32 interrupts;
+    u32 rx_interrupt_packets;   // Received from the interrupt handler
+    u32 rx_polled_packets;      // Received by poll passes
+    u32 poll_entries;           // Switches into polling mode
+    u32 rx_no_buffer;           // Frames dropped for lack of a replacement buffer
+    u32 rx_errors;
+    u32 tx_doorbells;           // Tail register writes
+    u32 tx_full;
+};
+
+// e1000 functions
+void e1000_initialize(void);
+bool e1000_present(void);
+const struct e1000_stats* e1000_get_stats(void);
+void e1000_reset_stats(void);
+u32 e1000_get_itr(void);
+void e1000_set_itr(u32 interval);
+
+#endif
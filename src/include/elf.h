@@ -0,0 +1,92 @@
+#ifndef ELF_H
+#define ELF_H
+
+#include "kernel.h"
+#include "paging.h"
+
+// ELF identification
+#define ELF_MAGIC           0x464C457F  // "\x7FELF"
+#define ELFCLASS32          1
+#define ELFDATA2LSB         1
+#define ET_EXEC             2
+#define EM_386              3
+
+// Program header types and flags
+#define PT_LOAD             1
+#define PF_X                0x1
+#define PF_W                0x2
+#define PF_R                0x4
+
+// Loader limits
+#define ELF_MAX_SEGMENTS    8
+#define ELF_MAX_ARGS        16
+#define ELF_STACK_TOP       USER_SPACE_END
+#define ELF_STACK_SIZE      0x100000    // Grows on demand up to 1 MiB
+
+// Loader status codes
+#define ELF_OK              0
+#define ELF_ERR_NOT_FOUND   1
+#define ELF_ERR_FORMAT      2
+#define ELF_ERR_SEGMENT     3
+#define ELF_ERR_NO_MEMORY   4
+
+struct elf_header {
+    u32 e_magic;
+    u8  e_class;
+    u8  e_data;
+    u8  e_version_ident;
+    u8  e_pad[9];
+    u16 e_type;
+    u16 e_machine;
+    u32 e_version;
+    u32 e_entry;
+    u32 e_phoff;
+    u32 e_shoff;
+    u32 e_flags;
+    u16 e_ehsize;
+    u16 e_phentsize;
+    u16 e_phnum;
+    u16 e_shentsize;
+    u16 e_shnum;
+    u16 e_shstrndx;
+} __attribute__((packed));
+
+struct elf_program_header {
+    u32 p_type;
+    u32 p_offset;
+    u32 p_vaddr;
+    u32 p_paddr;
+    u32 p_filesz;
+    u32 p_memsz;
+    u32 p_flags;
+    u32 p_align;
+} __attribute__((packed));
+
+// Loadable segment of the running program, resolved on page faults
+struct elf_segment {
+    u32 vaddr;
+    u32 memsz;
+    u32 filesz;
+    u32 offset;         // Offset of the segment data in the module
+    u32 flags;
+};
+
+// Page fault and startup statistics for one exec
+struct elf_exec_stats {
+    u32 file_size;          // Size of the executable module
+    u32 mapped_size;        // Bytes of address space covered by segments
+    u32 faults;             // Page faults resolved by the loader
+    u32 zero_copy_pages;    // Pages mapped directly from module memory
+    u32 copied_pages;       // Pages copied from the module
+    u32 zero_pages;         // .bss and stack pages zero-filled on first touch
+    u64 startup_cycles;     // exec to first user instruction
+    u64 run_cycles;         // first user instruction to exit
+};
+
+// ELF loader functions
+void elf_initialize(void);
+int elf_exec(const char* module_name, int argc, char* argv[], u32* exit_code);
+const struct elf_exec_stats* elf_get_stats(void);
+const char* elf_strerror(int status);
+
+#endif
\ No newline at end of file
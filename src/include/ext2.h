@@ -0,0 +1,156 @@
+#ifndef EXT2_H
+#define EXT2_H
+
+#include "kernel.h"
+#include "block.h"
+
+#define EXT2_SUPER_MAGIC        0xEF53
+#define EXT2_SUPERBLOCK_OFFSET  1024
+#define EXT2_ROOT_INO           2
+#define EXT2_NDIR_BLOCKS        12
+#define EXT2_IND_BLOCK          12
+#define EXT2_DIND_BLOCK         13
+#define EXT2_TIND_BLOCK         14
+#define EXT2_N_BLOCKS           15
+#define EXT2_NAME_MAX           255
+#define EXT2_PATH_MAX           256
+
+// Incompatible features; only the directory entry file type is understood
+#define EXT2_FEATURE_INCOMPAT_FILETYPE  0x0002
+
+// Inode mode
+#define EXT2_S_IFMT             0xF000
+#define EXT2_S_IFREG            0x8000
+#define EXT2_S_IFDIR            0x4000
+#define EXT2_S_IFLNK            0xA000
+
+// Cache geometry
+#define EXT2_ICACHE_SIZE        128
+#define EXT2_ICACHE_HASH        256     // Power of two
+#define EXT2_DCACHE_SIZE        256
+#define EXT2_DCACHE_HASH        512     // Power of two
+#define EXT2_DCACHE_NAME_MAX    32      // Longer names are looked up uncached
+#define EXT2_MAX_RUN            64      // Blocks per multi-block read
+
+// Filesystem status
+#define EXT2_OK                 0
+#define EXT2_ERR_NOT_MOUNTED    1
+#define EXT2_ERR_BAD_FS         2
+#define EXT2_ERR_UNSUPPORTED    3
+#define EXT2_ERR_NOT_FOUND      4
+#define EXT2_ERR_NOT_DIR        5
+#define EXT2_ERR_IS_DIR         6
+#define EXT2_ERR_INVALID        7
+#define EXT2_ERR_IO             8
+
+struct ext2_superblock {
+    u32 inodes_count;
+    u32 blocks_count;
+    u32 r_blocks_count;
+    u32 free_blocks_count;
+    u32 free_inodes_count;
+    u32 first_data_block;
+    u32 log_block_size;
+    u32 log_frag_size;
+    u32 blocks_per_group;
+    u32 frags_per_group;
+    u32 inodes_per_group;
+    u32 mtime;
+    u32 wtime;
+    u16 mnt_count;
+    u16 max_mnt_count;
+    u16 magic;
+    u16 state;
+    u16 errors;
+    u16 minor_rev_level;
+    u32 lastcheck;
+    u32 checkinterval;
+    u32 creator_os;
+    u32 rev_level;
+    u16 def_resuid;
+    u16 def_resgid;
+    u32 first_ino;
+    u16 inode_size;
+    u16 block_group_nr;
+    u32 feature_compat;
+    u32 feature_incompat;
+    u32 feature_ro_compat;
+    u8 uuid[16];
+    char volume_name[16];
+} __attribute__((packed));
+
+struct ext2_group_desc {
+    u32 block_bitmap;
+    u32 inode_bitmap;
+    u32 inode_table;
+    u16 free_blocks_count;
+    u16 free_inodes_count;
+    u16 used_dirs_count;
+    u16 pad;
+    u32 reserved[3];
+} __attribute__((packed));
+
+struct ext2_inode {
+    u16 mode;
+    u16 uid;
+    u32 size;
+    u32 atime;
+    u32 ctime;
+    u32 mtime;
+    u32 dtime;
+    u16 gid;
+    u16 links_count;
+    u32 blocks;                 // 512-byte units
+    u32 flags;
+    u32 osd1;
+    u32 block[EXT2_N_BLOCKS];
+    u32 generation;
+    u32 file_acl;
+    u32 dir_acl;
+    u32 faddr;
+    u8 osd2[12];
+} __attribute__((packed));
+
+struct ext2_dir_entry {
+    u32 inode;
+    u16 rec_len;
+    u8 name_len;
+    u8 file_type;
+    char name[];
+} __attribute__((packed));
+
+// Directory entry returned by ext2_readdir
+struct ext2_dirent {
+    u32 ino;
+    u8 file_type;
+    char name[EXT2_NAME_MAX + 1];
+};
+
+struct ext2_stats {
+    u32 inode_lookups;
+    u32 inode_hits;
+    u32 dentry_lookups;
+    u32 dentry_hits;
+    u32 dentry_negative_hits;   // Cached "no such entry"
+    u32 dir_scans;              // Lookups that had to read the directory
+    u32 runs;                   // Multi-block data reads
+    u32 run_blocks;
+    u32 cached_blocks;          // Data blocks read through the buffer cache
+};
+
+// ext2 functions
+int ext2_mount(struct block_device* dev);
+void ext2_unmount(void);
+struct block_device* ext2_get_device(void);
+const struct ext2_superblock* ext2_get_superblock(void);
+u32 ext2_get_block_size(void);
+int ext2_lookup(const char* path, u32* ino);
+int ext2_get_inode(u32 ino, struct ext2_inode* inode);
+int ext2_read(u32 ino, u32 offset, void* buffer, u32 size, u32* bytes_read);
+int ext2_readdir(u32 ino, u32* cookie, struct ext2_dirent* entry);
+const struct ext2_stats* ext2_get_stats(void);
+void ext2_reset_stats(void);
+void ext2_drop_caches(void);
+const char* ext2_strerror(int status);
+
+#endif
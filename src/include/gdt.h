@@ -16,9 +16,35 @@ struct gdt_entry {
 // GDT pointer structure
 struct gdt_ptr {
     u16 limit;          // Size of GDT - 1
-    u32 base;           // Address of GDT
+    uptr base;          // Address of GDT
 } __attribute__((packed));
 
+// Task state segment, only ss0/esp0 and the I/O map base are used
+struct tss_entry {
+    u32 prev_tss;
+    u32 esp0;           // Stack pointer loaded on entry to ring 0
+    u32 ss0;            // Stack segment loaded on entry to ring 0
+    u32 esp1, ss1, esp2, ss2;
+    u32 cr3, eip, eflags;
+    u32 eax, ecx, edx, ebx, esp, ebp, esi, edi;
+    u32 es, cs, ss, ds, fs, gs;
+    u32 ldt;
+    u16 trap;
+    u16 iomap_base;     // Offset of the I/O permission bitmap
+} __attribute__((packed));
+
+// Segment selectors
+#define GDT_KERNEL_CODE       0x08
+#define GDT_KERNEL_DATA       0x10
+#define GDT_USER_CODE         0x18
+#define GDT_USER_DATA         0x20
+#define GDT_TSS               0x28
+#define GDT_RPL3              0x03
+
+// The x86-64 kernel has no ring 3. The slot after its data segment holds a
+// 32-bit code segment that warm restarts leave long mode through.
+#define GDT_KERNEL_CODE32     0x18
+
 // Access byte flags
 #define GDT_ACCESS_PRESENT    0x80
 #define GDT_ACCESS_RING0      0x00
@@ -30,15 +56,18 @@ struct gdt_ptr {
 #define GDT_ACCESS_DC         0x04
 #define GDT_ACCESS_RW         0x02
 #define GDT_ACCESS_ACCESSED   0x01
+#define GDT_ACCESS_TSS32      0x09
 
 // Granularity byte flags
 #define GDT_GRAN_4K           0x80
 #define GDT_GRAN_32BIT        0x40
+#define GDT_GRAN_LONG         0x20    // 64-bit code segment
 #define GDT_GRAN_16BIT        0x00
 
 // GDT functions
 void gdt_initialize(void);
 void gdt_set_gate(int num, u32 base, u32 limit, u8 access, u8 gran);
-void gdt_flush(u32 gdt_ptr);
+void gdt_flush(const struct gdt_ptr* gdt_ptr);
+void gdt_set_kernel_stack(u32 esp0);
 
 #endif
\ No newline at end of file
@@ -3,6 +3,18 @@
 
 #include "kernel.h"
 
+#ifdef __x86_64__
+// IDT entry structure (long mode gates are 16 bytes)
+struct idt_entry {
+    u16 base_lo;        // Lower 16 bits of handler address
+    u16 sel;            // Kernel segment selector
+    u8  always0;        // Interrupt stack table index, unused
+    u8  flags;          // Flags
+    u16 base_hi;        // Bits 16-31 of handler address
+    u32 base_upper;     // Upper 32 bits of handler address
+    u32 reserved;
+} __attribute__((packed));
+#else
 // IDT entry structure
 struct idt_entry {
     u16 base_lo;        // Lower 16 bits of handler address
@@ -11,13 +23,32 @@ struct idt_entry {
     u8  flags;          // Flags
     u16 base_hi;        // Upper 16 bits of handler address
 } __attribute__((packed));
+#endif
 
 // IDT pointer structure
 struct idt_ptr {
     u16 limit;          // Size of IDT - 1
-    u32 base;           // Address of IDT
+    uptr base;          // Address of IDT
 } __attribute__((packed));
 
+#ifdef __x86_64__
+// Interrupt context structure, as built by src/x86_64/isr.asm and irq.asm
+struct interrupt_context {
+    u64 r15, r14, r13, r12, r11, r10, r9, r8;  // Pushed by the stub
+    u64 rbp, rdi, rsi, rdx, rcx, rbx, rax;
+    u64 int_no, err_code;                       // Interrupt number and error code
+    u64 rip, cs, rflags, rsp, ss;               // Pushed by processor
+};
+
+// Interrupted instruction and frame pointer, for code shared by both builds
+static inline u32 interrupt_ip(const struct interrupt_context* ctx) {
+    return ctx->rip;
+}
+
+static inline u32 interrupt_frame(const struct interrupt_context* ctx) {
+    return ctx->rbp;
+}
+#else
 // Interrupt context structure
 struct interrupt_context {
     u32 ds;                                     // Data segment selector
@@ -26,15 +57,28 @@ struct interrupt_context {
     u32 eip, cs, eflags, useresp, ss;           // Pushed by processor
 };
 
+// Interrupted instruction and frame pointer, for code shared by both builds
+static inline u32 interrupt_ip(const struct interrupt_context* ctx) {
+    return ctx->eip;
+}
+
+static inline u32 interrupt_frame(const struct interrupt_context* ctx) {
+    return ctx->ebp;
+}
+#endif
+
 // IDT flags
 #define IDT_FLAG_PRESENT   0x80
 #define IDT_FLAG_RING0     0x00
 #define IDT_FLAG_RING1     0x20
 #define IDT_FLAG_RING2     0x40
 #define IDT_FLAG_RING3     0x60
-#define IDT_FLAG_GATE_32   0x0E
+#define IDT_FLAG_GATE_32   0x0E    // 64-bit interrupt gate in long mode
 #define IDT_FLAG_GATE_16   0x06
 
+// Exception handler function type, returns true if the fault was resolved
+typedef bool (*exception_handler_t)(struct interrupt_context* ctx);
+
 // Exception handlers
 void divide_error_handler(struct interrupt_context* ctx);
 void debug_handler(struct interrupt_context* ctx);
@@ -57,8 +101,9 @@ void simd_exception_handler(struct interrupt_context* ctx);
 
 // IDT functions
 void idt_initialize(void);
-void idt_set_gate(u8 num, u32 base, u16 sel, u8 flags);
+void idt_set_gate(u8 num, uptr base, u16 sel, u8 flags);
 void interrupt_handler(struct interrupt_context* ctx);
+void idt_install_exception_handler(u8 vector, exception_handler_t handler);
 
 // Assembly interrupt stubs
 extern void isr0(void);
@@ -0,0 +1,57 @@
+#ifndef INITRAMFS_H
+#define INITRAMFS_H
+
+#include "kernel.h"
+
+// Boot module holding the ustar archive
+#define INITRAMFS_MODULE      "initramfs"
+
+// Index limits
+#define INITRAMFS_MAX_FILES   256
+#define INITRAMFS_HASH_SIZE   512     // Power of two, at least 2x the files
+#define INITRAMFS_PATH_MAX    128
+
+// ustar layout
+#define USTAR_BLOCK_SIZE      512
+#define USTAR_TYPE_FILE       '0'
+#define USTAR_TYPE_FILE_OLD   '\0'
+#define USTAR_TYPE_DIR        '5'
+
+struct ustar_header {
+    char name[100];
+    char mode[8];
+    char uid[8];
+    char gid[8];
+    char size[12];
+    char mtime[12];
+    char checksum[8];
+    char typeflag;
+    char linkname[100];
+    char magic[6];
+    char version[2];
+    char uname[32];
+    char gname[32];
+    char devmajor[8];
+    char devminor[8];
+    char prefix[155];
+    char pad[12];
+} __attribute__((packed));
+
+// Indexed archive entry; data points straight into module memory
+struct initramfs_file {
+    char path[INITRAMFS_PATH_MAX];  // Absolute path without trailing slash
+    const u8* data;
+    u32 size;
+    u32 mode;
+    u32 mtime;
+    u32 hash;
+    bool is_dir;
+};
+
+// Initramfs functions
+u32 initramfs_initialize(void);
+const struct initramfs_file* initramfs_lookup(const char* path);
+u32 initramfs_get_count(void);
+const struct initramfs_file* initramfs_get(u32 index);
+
+#endif
\ No newline at end of file
@@ -11,20 +11,93 @@
 #define PIC2_DATA       0xA1
 
 #define PIC_EOI         0x20
+#define PIC_READ_ISR    0x0B
+
+// IRQ storm detection (rates are counted per IRQ_STORM_WINDOW timer ticks)
+#define IRQ_STORM_WINDOW       10
+#define IRQ_STORM_THRESHOLD    2000
+#define IRQ_STORM_BACKOFF_MIN  10
+#define IRQ_STORM_BACKOFF_MAX  1000
+#define IRQ_STORM_LOG_SIZE     8
 
 // IRQ numbers
 #define IRQ0_TIMER      32
 #define IRQ1_KEYBOARD   33
 #define IRQ12_MOUSE     44
 
+// MSI vectors, routed through the local APIC
+#define IRQ_MSI_BASE    48
+#define IRQ_MSI_COUNT   16
+
+// Additional handlers on one shared PCI line
+#define IRQ_SHARED_MAX  3
+
+// Priority levels for nesting, 0 the most urgent. A handler runs with
+// interrupts enabled and lines at its own level or below masked, so only
+// more urgent lines preempt it. The timer alone is at level 0 by default.
+#define IRQ_PRIORITY_LEVELS     4
+#define IRQ_PRIORITY_DEFAULT    1
+
+// Handler entries are counted by nesting depth up to this many levels
+#define IRQ_NEST_DEPTHS         8
+
 // IRQ handler function type
 typedef void (*irq_handler_t)(struct interrupt_context* ctx);
 
+// Poll function used to service a line while it is masked by storm control
+typedef void (*irq_poll_t)(void);
+
+// Per-line interrupt statistics
+struct irq_stats {
+    u32 count;          // Interrupts delivered to the handler
+    u32 spurious;       // Spurious interrupts (no EOI sent)
+    u32 window_count;   // Interrupts in the current rate window
+    u32 storms;         // Times the line was masked for storming
+    u32 polls;          // Poll calls made while the line was masked
+    u32 backoff;        // Current mask duration in ticks
+    u32 masked_until;   // Tick at which a masked line is re-enabled
+    u32 masked_ticks;   // Total ticks spent masked by storm control
+    u32 preempted;      // Times the handler was interrupted by a more urgent line
+    u32 preemptions;    // Times the line interrupted another handler
+    bool masked;        // Currently masked by storm control
+};
+
+// Nesting statistics over all handlers, MSI included
+struct irq_nest_stats {
+    u32 entries;
+    u32 preemptions;                // Entries that interrupted another handler
+    u32 max_depth;
+    u32 depths[IRQ_NEST_DEPTHS];    // Entries by depth, the last also counting deeper ones
+};
+
+// Storm event log entry
+struct irq_storm_event {
+    u32 tick;           // Tick at which the storm was detected
+    u32 irq;            // Offending line
+    u32 rate;           // Interrupts seen in the window
+    u32 backoff;        // Mask duration applied in ticks
+};
+
 // IRQ functions
 void irq_initialize(void);
 void irq_install_handler(int irq, irq_handler_t handler);
+bool irq_share_handler(int irq, irq_handler_t handler);
 void irq_uninstall_handler(int irq);
 void irq_handler(struct interrupt_context* ctx);
+void irq_install_poll(int irq, irq_poll_t poll);
+void irq_set_mask(int irq);
+void irq_clear_mask(int irq);
+const struct irq_stats* irq_get_stats(int irq);
+u32 irq_get_storm_events(struct irq_storm_event* events, u32 max);
+int irq_alloc_msi(irq_handler_t handler);
+void irq_free_msi(int vector);
+u32 irq_get_msi_count(int vector);
+void irq_set_nesting(bool enable);
+bool irq_get_nesting(void);
+bool irq_set_priority(int irq, u32 level);
+u32 irq_get_priority(int irq);
+const struct irq_nest_stats* irq_get_nest_stats(void);
+void irq_reset_nest_stats(void);
 
 // Assembly IRQ stubs
 extern void irq0(void);
@@ -43,5 +116,7 @@ extern void irq12(void);
 extern void irq13(void);
 extern void irq14(void);
 extern void irq15(void);
+extern uptr msi_stub_table[IRQ_MSI_COUNT];
+extern void lapic_spurious_stub(void);
 
 #endif
\ No newline at end of file
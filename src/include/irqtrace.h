@@ -0,0 +1,113 @@
+#ifndef IRQTRACE_H
+#define IRQTRACE_H
+
+#include "kernel.h"
+
+#define EFLAGS_IF               0x200
+
+// Return addresses kept per window, longest windows kept, threshold
+// violations logged, and log2(cycles) histogram buckets
+#define IRQTRACE_DEPTH          4
+#define IRQTRACE_TOP            8
+#define IRQTRACE_LOG_SIZE       8
+#define IRQTRACE_BUCKETS        32
+
+// One interrupts-off window
+struct irqtrace_record {
+    u64 cycles;
+    u64 tsc;                    // When interrupts came back on
+    u32 off_eip;                // Where they were disabled (or the interrupted EIP)
+    u32 on_eip;                 // Where they were enabled again
+    u32 backtrace[IRQTRACE_DEPTH];  // Callers at the point they were disabled
+};
+
+struct irqtrace_stats {
+    u32 windows;
+    u32 violations;
+    u64 total_cycles;
+    u64 threshold;              // Cycles; 0 when no limit is set
+    u32 histogram[IRQTRACE_BUCKETS];
+};
+
+// Tracer hooks, called by the helpers below when tracing is on
+extern bool irqtrace_enabled;
+void irqtrace_off(u32 eip, u32 frame);
+void irqtrace_on(u32 eip);
+
+// Tracer control and results
+void irqtrace_enable(bool enable);
+void irqtrace_reset(void);
+void irqtrace_set_threshold(u64 cycles);
+const struct irqtrace_stats* irqtrace_get_stats(void);
+u32 irqtrace_get_longest(struct irqtrace_record* records, u32 max);
+u32 irqtrace_get_violations(struct irqtrace_record* records, u32 max);
+
+static inline u32 irqtrace_eip(void) {
+    uptr eip;
+    __asm__ volatile ("call 1f\n1: pop %0" : "=r"(eip));
+    return eip;
+}
+
+// Interrupt enable/disable helpers. Every IF=0 window opened and closed
+// through them is measured while the tracer is on.
+static inline u32 irq_save(void) {
+    uptr flags;
+    __asm__ volatile ("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    if ((flags & EFLAGS_IF) && irqtrace_enabled) {
+        irqtrace_off(irqtrace_eip(), (uptr)__builtin_frame_address(0));
+    }
+    return flags;
+}
+
+// Current EFLAGS for a later irq_restore, leaving interrupts as they are
+static inline u32 irq_flags(void) {
+    uptr flags;
+    __asm__ volatile ("pushf; pop %0" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void irq_restore(u32 flags) {
+    if ((flags & EFLAGS_IF) && irqtrace_enabled) {
+        irqtrace_on(irqtrace_eip());
+    }
+    __asm__ volatile ("push %0; popf" : : "r"((uptr)flags) : "memory", "cc");
+}
+
+static inline void irq_disable(void) {
+    __asm__ volatile ("cli" : : : "memory");
+    if (irqtrace_enabled) {
+        irqtrace_off(irqtrace_eip(), (uptr)__builtin_frame_address(0));
+    }
+}
+
+static inline void irq_enable(void) {
+    if (irqtrace_enabled) {
+        irqtrace_on(irqtrace_eip());
+    }
+    __asm__ volatile ("sti" : : : "memory");
+}
+
+// Sleep until an interrupt has been handled. "sti; hlt" cannot lose a
+// wakeup because the interrupt shadow of sti covers the hlt.
+static inline void irq_wait(void) {
+    if (irqtrace_enabled) {
+        irqtrace_on(irqtrace_eip());
+    }
+    __asm__ volatile ("sti; hlt; cli" : : : "memory");
+    if (irqtrace_enabled) {
+        irqtrace_off(irqtrace_eip(), (uptr)__builtin_frame_address(0));
+    }
+}
+
+// Let pending interrupts in without sleeping
+static inline void irq_pause(void) {
+    if (irqtrace_enabled) {
+        irqtrace_on(irqtrace_eip());
+    }
+    __asm__ volatile ("sti; pause; cli" : : : "memory");
+    if (irqtrace_enabled) {
+        irqtrace_off(irqtrace_eip(), (uptr)__builtin_frame_address(0));
+    }
+}
+
+#endif
@@ -16,14 +16,37 @@ typedef int16_t  i16;
 typedef int32_t  i32;
 typedef int64_t  i64;
 
+// Pointer-sized integer: 32 bits on i386, 64 on x86-64. Both kernels live
+// in the identity-mapped low 4 GiB, so kernel addresses fit in a u32.
+typedef uintptr_t uptr;
+
+// Build target (`make ARCH=x86_64` for the long mode kernel)
+#ifdef __x86_64__
+#define KERNEL_ARCH     "x86_64"
+#define KERNEL_MODE     "Long Mode"
+#else
+#define KERNEL_ARCH     "i386"
+#define KERNEL_MODE     "Protected Mode"
+#endif
+
+// Code layout hints. Hot functions are packed together near the start of
+// .text, cold ones (error reporting, help text) are kept apart from them;
+// see linker.ld.
+#define __hot   __attribute__((hot))
+#define __cold  __attribute__((cold))
+
 // Kernel main function
-void kernel_main(void);
+void kernel_main(u32 multiboot_magic, u32 multiboot_info);
 
 // Utility functions
-void kernel_panic(const char* message);
+__cold void kernel_panic(const char* message);
 void* memset(void* dest, int c, size_t n);
 void* memcpy(void* dest, const void* src, size_t n);
+int memcmp(const void* s1, const void* s2, size_t n);
 int strcmp(const char* s1, const char* s2);
+int strncmp(const char* s1, const char* s2, size_t n);
+u32 strtoul(const char* str, char** endptr, int base);
 size_t strlen(const char* str);
+u64 div_u64_rem(u64 dividend, u32 divisor, u32* remainder);
 
 #endif
\ No newline at end of file
@@ -55,14 +55,23 @@
 #define KEY_F11           0x57
 #define KEY_F12           0x58
 
-// Keyboard buffer size
+// Keyboard ring size: KEYBOARD_BUFFER_SIZE unless kbd.ring on the kernel
+// command line or sysctl picks another power of two up to the maximum
 #define KEYBOARD_BUFFER_SIZE 256
+#define KEYBOARD_BUFFER_MIN  16
+#define KEYBOARD_BUFFER_MAX  4096
 
 // Keyboard functions
 void keyboard_initialize(void);
 void keyboard_handler(struct interrupt_context* ctx);
+void keyboard_poll(void);
 char keyboard_getchar(void);
 bool keyboard_haschar(void);
 void keyboard_wait_for_key(void);
+void keyboard_inject(u8 scancode);
+void keyboard_set_monitor(void (*monitor)(u8 scancode));
+bool keyboard_encode(char c, u8* scancode, bool* shift);
+u64 keyboard_get_stamp(void);
+u32 keyboard_get_dropped(void);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,61 @@
+#ifndef KEYGEN_H
+#define KEYGEN_H
+
+#include "kernel.h"
+
+// Scancode stream injected into the keyboard decode path, built from
+// text, recorded from the controller or loaded from an initramfs file
+#define KEYGEN_STREAM_MAX       4096
+#define KEYGEN_RATE_MAX         1000000 // Scancodes per second
+
+// Scancode-to-echo latency histogram: KEYGEN_SUB_BUCKETS linear buckets
+// per power of two of TSC cycles, so percentiles are within 1/8
+#define KEYGEN_SUB_BITS         3
+#define KEYGEN_SUB_BUCKETS      (1 << KEYGEN_SUB_BITS)
+#define KEYGEN_BUCKETS          (32 * KEYGEN_SUB_BUCKETS)
+
+// Injection drivers: scancodes due on a tick are injected from the timer
+// interrupt, or each through its own self-IPI delivered back to back
+#define KEYGEN_TIMER            0
+#define KEYGEN_IPI              1
+
+// Status codes
+#define KEYGEN_OK               0
+#define KEYGEN_ERR_BUSY         1
+#define KEYGEN_ERR_EMPTY        2
+#define KEYGEN_ERR_TOO_LONG     3
+#define KEYGEN_ERR_UNTYPABLE    4
+#define KEYGEN_ERR_NO_IPI       5
+#define KEYGEN_ERR_INVALID      6
+
+struct keygen_stats {
+    bool running;
+    bool recording;
+    u32 mode;
+    u32 rate;
+    u32 length;                 // Scancodes in the stream
+    u32 passes;                 // Times the stream is injected per run
+    u32 injected;               // Scancodes injected
+    u32 ipis;                   // Self-IPIs taken
+    u32 dropped;                // Characters lost to a full keyboard ring
+    u32 echoed;                 // Injected characters the shell echoed
+    u64 start;                  // TSC at the first injection
+    u64 last_echo;
+    u64 latency_total;
+    u64 latency_max;
+    u32 histogram[KEYGEN_BUCKETS];
+};
+
+// Input generator functions
+int keygen_set_text(const char* text);
+int keygen_set_scancodes(const u8* scancodes, u32 length);
+int keygen_record(void);
+void keygen_stop(void);
+int keygen_run(u32 rate, u32 passes, u32 mode);
+void keygen_echoed(void);
+void keygen_reset(void);
+const struct keygen_stats* keygen_get_stats(void);
+u64 keygen_percentile(u32 permille);
+const char* keygen_strerror(int status);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef KPROBE_H
+#define KPROBE_H
+
+#include "kernel.h"
+
+#define KPROBE_MAX              16
+#define KPROBE_DEPTH            64      // Probed calls in progress at once
+#define KPROBE_NAME_MAX         32
+#define KPROBE_INT3             0xCC
+
+// Status codes
+#define KPROBE_OK               0
+#define KPROBE_ERR_NO_SYMBOL    1
+#define KPROBE_ERR_EXISTS       2
+#define KPROBE_ERR_FULL         3
+#define KPROBE_ERR_REFUSED      4       // On the probe path, or an unsteppable first instruction
+#define KPROBE_ERR_NOT_FOUND    5
+
+// A function entry patched with int3. The call's cycles run from the
+// single-stepped first instruction to the return, caught by swapping the
+// return address for kprobe_trampoline.
+struct kprobe {
+    bool active;
+    char name[KPROBE_NAME_MAX];
+    u32 address;
+    u8 saved;                   // Original first byte
+    u32 hits;
+    u32 returns;                // Calls timed to their return
+    u32 missed;                 // Calls not timed: too many in progress
+    u64 cycles;
+    u64 cycles_max;
+};
+
+// Called by kprobe_trampoline (kprobe.asm) with the stack slot that held
+// the return address; returns the original return address
+u32 kprobe_return(u32 slot);
+extern void kprobe_trampoline(void);
+
+// Kernel probe functions
+void kprobe_initialize(void);
+int kprobe_add(const char* name);
+int kprobe_remove(const char* name);
+void kprobe_remove_all(void);
+void kprobe_reset(void);
+const struct kprobe* kprobe_get(u32 index);
+const char* kprobe_strerror(int status);
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef KSYMS_H
+#define KSYMS_H
+
+#include "kernel.h"
+
+// Function symbols of the kernel itself, in address order. The table is
+// generated from a first link by scripts/ksyms.sh and linked into the
+// second (see the Makefile).
+struct ksym {
+    u32 address;
+    const char* name;
+};
+
+extern const struct ksym ksyms_table[];
+extern const u32 ksyms_count;
+
+// Symbol table functions
+u32 ksyms_lookup(const char* name);
+const char* ksyms_find(u32 address, u32* offset);
+
+#endif
@@ -0,0 +1,93 @@
+#ifndef MULTIBOOT_H
+#define MULTIBOOT_H
+
+#include "kernel.h"
+
+// Multiboot2 constants
+#define MULTIBOOT2_BOOTLOADER_MAGIC  0x36D76289
+
+// Boot information tag types
+#define MULTIBOOT_TAG_END            0
+#define MULTIBOOT_TAG_CMDLINE        1
+#define MULTIBOOT_TAG_BOOTLOADER     2
+#define MULTIBOOT_TAG_MODULE         3
+#define MULTIBOOT_TAG_BASIC_MEMINFO  4
+#define MULTIBOOT_TAG_MMAP           6
+#define MULTIBOOT_TAG_ACPI_OLD       14
+#define MULTIBOOT_TAG_ACPI_NEW       15
+
+// Memory map entry types
+#define MULTIBOOT_MEMORY_AVAILABLE   1
+
+// Maximum number of modules tracked
+#define MULTIBOOT_MAX_MODULES        16
+
+// Boot information header
+struct multiboot_info {
+    u32 total_size;
+    u32 reserved;
+} __attribute__((packed));
+
+// Generic tag header
+struct multiboot_tag {
+    u32 type;
+    u32 size;
+} __attribute__((packed));
+
+struct multiboot_tag_string {
+    u32 type;
+    u32 size;
+    char string[];
+} __attribute__((packed));
+
+struct multiboot_tag_module {
+    u32 type;
+    u32 size;
+    u32 mod_start;
+    u32 mod_end;
+    char cmdline[];
+} __attribute__((packed));
+
+struct multiboot_tag_basic_meminfo {
+    u32 type;
+    u32 size;
+    u32 mem_lower;      // KiB below 1 MiB
+    u32 mem_upper;      // KiB above 1 MiB
+} __attribute__((packed));
+
+struct multiboot_mmap_entry {
+    u64 addr;
+    u64 len;
+    u32 type;
+    u32 zero;
+} __attribute__((packed));
+
+struct multiboot_tag_mmap {
+    u32 type;
+    u32 size;
+    u32 entry_size;
+    u32 entry_version;
+    struct multiboot_mmap_entry entries[];
+} __attribute__((packed));
+
+// Boot module loaded by the bootloader
+struct multiboot_module {
+    u32 start;          // Physical start address
+    u32 end;            // Physical end address (exclusive)
+    const char* cmdline;
+};
+
+// Multiboot functions
+bool multiboot_initialize(u32 magic, u32 info_addr);
+bool multiboot_present(void);
+u32 multiboot_get_info_addr(void);
+u32 multiboot_get_info_size(void);
+const char* multiboot_get_cmdline(void);
+const struct multiboot_tag_mmap* multiboot_get_mmap(void);
+u32 multiboot_get_mem_upper(void);
+const void* multiboot_get_acpi_rsdp(void);
+u32 multiboot_get_module_count(void);
+const struct multiboot_module* multiboot_get_module(u32 index);
+const struct multiboot_module* multiboot_find_module(const char* name);
+
+#endif
\ No newline at end of file
@@ -0,0 +1,153 @@
+#ifndef NET_H
+#define NET_H
+
+#include "kernel.h"
+
+#define NET_MAX_INTERFACES      2
+#define NET_NAME_MAX            8
+#define NET_BUFFERS             256
+#define NET_BUFFER_SIZE         2048
+#define NET_POLL_BUDGET         32      // Packets per interrupt or poll pass
+#define NET_LATENCY_BATCH       64      // Echo replies timed per flush
+
+// Default address, matching QEMU's user-mode network
+#define NET_DEFAULT_ADDRESS     NET_IPV4(10, 0, 2, 15)
+#define NET_ECHO_PORT           7
+
+#define NET_IPV4(a, b, c, d)    (((u32)(a) << 24) | ((u32)(b) << 16) | ((u32)(c) << 8) | (u32)(d))
+
+// Ethernet, ARP, IPv4 and UDP
+#define ETH_ALEN                6
+#define ETH_HLEN                14
+#define ETH_ZLEN                60      // Minimum frame without FCS
+#define ETH_TYPE_IPV4           0x0800
+#define ETH_TYPE_ARP            0x0806
+#define ARP_HTYPE_ETHERNET      1
+#define ARP_OP_REQUEST          1
+#define ARP_OP_REPLY            2
+#define IP_PROTO_UDP            17
+#define IP_TTL_DEFAULT          64
+
+// Transmit status
+#define NET_OK                  0
+#define NET_ERR_INVALID         1
+#define NET_ERR_FULL            2
+#define NET_ERR_NO_DEVICE       3
+
+struct eth_header {
+    u8 dest[ETH_ALEN];
+    u8 source[ETH_ALEN];
+    u16 type;
+} __attribute__((packed));
+
+struct arp_packet {
+    u16 htype;
+    u16 ptype;
+    u8 hlen;
+    u8 plen;
+    u16 op;
+    u8 sha[ETH_ALEN];
+    u32 spa;
+    u8 tha[ETH_ALEN];
+    u32 tpa;
+} __attribute__((packed));
+
+struct ipv4_header {
+    u8 version_ihl;
+    u8 tos;
+    u16 length;
+    u16 id;
+    u16 fragment;
+    u8 ttl;
+    u8 protocol;
+    u16 checksum;
+    u32 source;
+    u32 dest;
+} __attribute__((packed));
+
+struct udp_header {
+    u16 source;
+    u16 dest;
+    u16 length;
+    u16 checksum;
+} __attribute__((packed));
+
+// Packet buffer. Storage is identity mapped, so data doubles as the DMA
+// address. Received frames are handed up in the buffer the NIC wrote;
+// whoever holds a buffer either frees it or passes it to net_transmit.
+struct net_buffer {
+    u8* data;
+    u32 length;
+    u64 timestamp;              // TSC when the driver picked the frame up
+    struct net_buffer* next;
+};
+
+struct net_stats {
+    u32 rx_packets;
+    u32 tx_packets;
+    u64 rx_bytes;
+    u64 tx_bytes;
+    u32 rx_dropped;             // Malformed, not for us or unhandled
+    u32 tx_dropped;             // Transmit ring full
+    u32 arp_replies;
+    u32 udp_echoes;
+    u32 flushes;                // Batches published to the NIC
+    u64 latency_total;          // Receive to doorbell, in TSC cycles
+    u64 latency_min;
+    u64 latency_max;
+    u32 latency_samples;
+};
+
+struct net_interface;
+
+// transmit queues a frame without notifying the NIC; flush publishes
+// everything queued with one doorbell. poll services a device whose
+// receive interrupt is masked and returns true while it stays in
+// polling mode.
+struct net_interface_ops {
+    int (*transmit)(struct net_interface* iface, struct net_buffer* buffer);
+    void (*flush)(struct net_interface* iface);
+    bool (*poll)(struct net_interface* iface, u32 budget);
+};
+
+struct net_interface {
+    char name[NET_NAME_MAX];
+    u8 mac[ETH_ALEN];
+    u32 address;                // IPv4, host byte order
+    bool link_up;
+    const struct net_interface_ops* ops;
+    void* private;
+    struct net_stats stats;
+
+    // Echo replies queued since the last flush
+    u64 pending_stamps[NET_LATENCY_BATCH];
+    u32 pending_count;
+};
+
+static inline u16 net_htons(u16 value) {
+    return (u16)((value >> 8) | (value << 8));
+}
+
+static inline u32 net_htonl(u32 value) {
+    return (value >> 24) | ((value >> 8) & 0xFF00) | ((value << 8) & 0xFF0000) | (value << 24);
+}
+
+#define net_ntohs net_htons
+#define net_ntohl net_htonl
+
+// Network functions
+void net_initialize(void);
+bool net_register(struct net_interface* iface);
+u32 net_get_count(void);
+struct net_interface* net_get(u32 index);
+struct net_buffer* net_buffer_alloc(void);
+void net_buffer_free(struct net_buffer* buffer);
+u32 net_buffer_available(void);
+void net_receive(struct net_interface* iface, struct net_buffer* buffer);
+int net_transmit(struct net_interface* iface, struct net_buffer* buffer);
+void net_flush(struct net_interface* iface);
+bool net_poll(void);
+void net_reset_stats(struct net_interface* iface);
+u16 net_checksum(const void* data, u32 length);
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef PAGING_H
+#define PAGING_H
+
+#include "kernel.h"
+
+#define PAGE_SIZE             4096
+#define PAGE_MASK             0xFFFFF000
+#define PAGE_ALIGN_UP(x)      (((x) + PAGE_SIZE - 1) & PAGE_MASK)
+#define PAGE_ALIGN_DOWN(x)    ((x) & PAGE_MASK)
+#ifdef __x86_64__
+#define LARGE_PAGE_SIZE       0x200000  // 2 MiB pages of the long mode tables
+#else
+#define LARGE_PAGE_SIZE       0x400000
+#endif
+
+// Page table entry flags
+#define PAGE_PRESENT          0x001
+#define PAGE_WRITE            0x002
+#define PAGE_USER             0x004
+#define PAGE_WRITETHROUGH     0x008
+#define PAGE_NOCACHE          0x010
+#define PAGE_LARGE            0x080
+#define PAGE_OWNED            0x200     // Frame allocated for this mapping
+
+// Page fault error code bits
+#define PAGE_FAULT_PRESENT    0x01
+#define PAGE_FAULT_WRITE      0x02
+#define PAGE_FAULT_USER       0x04
+
+// Physical memory is identity mapped up to this limit; user programs
+// live above it in the range [USER_SPACE_START, USER_SPACE_END)
+#define PAGING_IDENTITY_LIMIT 0x08000000
+#define USER_SPACE_START      0x08000000
+#define USER_SPACE_END        0x40000000
+
+// Paging functions
+void paging_initialize(void);
+bool paging_map_page(u32 virt, u32 phys, u32 flags);
+u32 paging_unmap_page(u32 virt);
+u32 paging_get_entry(u32 virt);
+void paging_unmap_user(void);
+bool paging_map_mmio(u32 phys, u32 size);
+
+static inline u32 paging_read_cr2(void) {
+    uptr value;
+    __asm__ volatile ("mov %%cr2, %0" : "=r"(value));
+    return value;
+}
+
+static inline void paging_invalidate(u32 virt) {
+    __asm__ volatile ("invlpg (%0)" : : "r"((uptr)virt) : "memory");
+}
+
+#endif
\ No newline at end of file
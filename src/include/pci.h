@@ -0,0 +1,140 @@
+#ifndef PCI_H
+#define PCI_H
+
+#include "kernel.h"
+#include "irq.h"
+
+// Configuration mechanism #1 ports
+#define PCI_CONFIG_ADDRESS      0xCF8
+#define PCI_CONFIG_DATA         0xCFC
+
+// Configuration space header offsets
+#define PCI_VENDOR_ID           0x00
+#define PCI_DEVICE_ID           0x02
+#define PCI_COMMAND             0x04
+#define PCI_STATUS              0x06
+#define PCI_REVISION_ID         0x08
+#define PCI_PROG_IF             0x09
+#define PCI_SUBCLASS            0x0A
+#define PCI_CLASS               0x0B
+#define PCI_HEADER_TYPE         0x0E
+#define PCI_BAR0                0x10
+#define PCI_SECONDARY_BUS       0x19
+#define PCI_CAPABILITY_LIST     0x34
+#define PCI_INTERRUPT_LINE      0x3C
+#define PCI_INTERRUPT_PIN       0x3D
+
+// Command register bits
+#define PCI_COMMAND_IO          0x0001
+#define PCI_COMMAND_MEMORY      0x0002
+#define PCI_COMMAND_MASTER      0x0004
+#define PCI_COMMAND_INTX_DISABLE 0x0400
+
+#define PCI_STATUS_CAP_LIST     0x0010
+
+// Header types
+#define PCI_HEADER_TYPE_MASK    0x7F
+#define PCI_HEADER_MULTIFUNC    0x80
+#define PCI_HEADER_BRIDGE       0x01
+
+// Base address register bits
+#define PCI_BAR_IO              0x01
+#define PCI_BAR_TYPE_64         0x04
+#define PCI_BAR_PREFETCH        0x08
+#define PCI_BAR_IO_MASK         0xFFFFFFFC
+#define PCI_BAR_MEM_MASK        0xFFFFFFF0
+
+// Capabilities
+#define PCI_CAP_ID_MSI          0x05
+#define PCI_CAP_ID_VENDOR       0x09
+#define PCI_MSI_FLAGS           0x02
+#define PCI_MSI_FLAGS_ENABLE    0x0001
+#define PCI_MSI_FLAGS_64BIT     0x0080
+#define PCI_MSI_ADDRESS_LO      0x04
+#define PCI_MSI_ADDRESS_HI      0x08
+#define PCI_MSI_DATA_32         0x08
+#define PCI_MSI_DATA_64         0x0C
+
+// Classes
+#define PCI_CLASS_STORAGE       0x01
+#define PCI_CLASS_NETWORK       0x02
+#define PCI_CLASS_DISPLAY       0x03
+#define PCI_CLASS_BRIDGE        0x06
+#define PCI_SUBCLASS_PCI_BRIDGE 0x04
+
+// Limits
+#define PCI_MAX_BUSES           256
+#define PCI_MAX_SLOTS           32
+#define PCI_MAX_FUNCTIONS       8
+#define PCI_MAX_DEVICES         64
+#define PCI_BAR_COUNT           6
+
+// Wildcard for driver match tables
+#define PCI_ANY_ID              0xFFFF
+
+struct pci_bar {
+    u64 base;
+    u32 size;
+    bool io;
+    bool prefetchable;
+    bool is64;
+};
+
+struct pci_driver;
+
+// Function found during the boot-time bus scan
+struct pci_device {
+    u8 bus;
+    u8 slot;
+    u8 function;
+    u16 vendor_id;
+    u16 device_id;
+    u8 class_code;
+    u8 subclass;
+    u8 prog_if;
+    u8 revision;
+    u8 header_type;
+    u8 irq_line;
+    u8 irq_pin;
+    struct pci_bar bars[PCI_BAR_COUNT];
+    int msi_vector;                     // -1 unless MSI was enabled
+    const struct pci_driver* driver;
+};
+
+// Match table entry; a table ends with an all-zero entry
+struct pci_device_id {
+    u16 vendor_id;
+    u16 device_id;
+    u16 class_code;
+    u16 subclass;
+    u16 prog_if;
+};
+
+struct pci_driver {
+    const char* name;
+    const struct pci_device_id* ids;
+    bool (*probe)(struct pci_device* dev);  // Returns true when it claims the device
+};
+
+// PCI functions
+u32 pci_initialize(void);
+bool pci_ecam_enabled(void);
+u32 pci_config_read32(u8 bus, u8 slot, u8 function, u16 offset);
+void pci_config_write32(u8 bus, u8 slot, u8 function, u16 offset, u32 value);
+u16 pci_read16(const struct pci_device* dev, u16 offset);
+u32 pci_read32(const struct pci_device* dev, u16 offset);
+void pci_write16(const struct pci_device* dev, u16 offset, u16 value);
+void pci_write32(const struct pci_device* dev, u16 offset, u32 value);
+u8 pci_find_capability(const struct pci_device* dev, u8 id);
+u8 pci_find_next_capability(const struct pci_device* dev, u8 id, u8 start);
+void pci_enable_device(const struct pci_device* dev);
+void pci_enable_bus_master(const struct pci_device* dev);
+void pci_disable_bus_master(const struct pci_device* dev);
+int pci_enable_msi(struct pci_device* dev, irq_handler_t handler);
+void pci_quiesce(void);
+bool pci_register_driver(const struct pci_driver* driver);
+u32 pci_get_device_count(void);
+struct pci_device* pci_get_device(u32 index);
+const char* pci_class_name(u8 class_code, u8 subclass);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef PMM_H
+#define PMM_H
+
+#include "kernel.h"
+#include "paging.h"
+
+// Frames tracked by the allocator (identity mapped memory only)
+#define PMM_MAX_FRAMES (PAGING_IDENTITY_LIMIT / PAGE_SIZE)
+
+// Linker symbols bounding the kernel image
+extern char __kernel_start[];
+extern char __kernel_end[];
+
+// Physical memory manager functions
+void pmm_initialize(void);
+u32 pmm_alloc_frame(void);
+u32 pmm_alloc_range(u32 frames, u32 limit);
+void pmm_free_frame(u32 frame);
+void pmm_reserve_range(u32 start, u32 end);
+u32 pmm_get_total_frames(void);
+u32 pmm_get_free_frames(void);
+
+#endif
\ No newline at end of file
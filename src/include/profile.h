@@ -0,0 +1,52 @@
+#ifndef PROFILE_H
+#define PROFILE_H
+
+#include "kernel.h"
+
+// Sampled kernel EIPs, hashed into PROFILE_SLOTS slots with at most
+// PROFILE_PROBES probes before a sample is dropped
+#define PROFILE_SLOT_BITS       12
+#define PROFILE_SLOTS           (1 << PROFILE_SLOT_BITS)
+#define PROFILE_PROBES          16
+#define PROFILE_HZ_DEFAULT      1024
+
+// Footprint granularity: i-cache lines and iTLB pages
+#define PROFILE_LINE_SIZE       64
+#define PROFILE_TEXT_MAX        0x200000
+
+// Linker symbols bounding .text and the hot code packed at its start
+extern char __text_start[];
+extern char __text_hot_start[];
+extern char __text_hot_end[];
+extern char __text_end[];
+
+struct profile_entry {
+    u32 eip;
+    u32 count;
+};
+
+struct profile_stats {
+    bool running;
+    u32 hz;
+    u32 samples;                // Kernel samples recorded
+    u32 user;                   // Samples that interrupted ring 3
+    u32 dropped;                // Kernel samples with no free slot
+    u32 eips;                   // Distinct EIPs
+};
+
+// Where the recorded samples landed
+struct profile_footprint {
+    u32 lines;                  // Distinct cache lines
+    u32 pages;                  // Distinct pages
+    u32 hot_samples;            // Samples inside the hot region
+};
+
+// Profiler functions
+bool profile_start(u32 hz);
+void profile_stop(void);
+void profile_reset(void);
+const struct profile_stats* profile_get_stats(void);
+const struct profile_entry* profile_get_entry(u32 slot);
+void profile_get_footprint(struct profile_footprint* footprint);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+#include "kernel.h"
+
+// Boot module served as block device rd0
+#define RAMDISK_MODULE      "ramdisk"
+#define RAMDISK_NAME        "rd0"
+
+// RAM disk functions
+bool ramdisk_initialize(void);
+
+#endif
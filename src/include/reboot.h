@@ -0,0 +1,32 @@
+#ifndef REBOOT_H
+#define REBOOT_H
+
+#include "kernel.h"
+
+// Largest Multiboot2 information structure kept for warm restarts
+// (WARM_MBI_MAX in boot.asm)
+#define REBOOT_MBI_MAX          16384
+
+// Reset methods; REBOOT_ANY tries them in this order
+#define REBOOT_ANY              0
+#define REBOOT_ACPI             1
+#define REBOOT_KEYBOARD         2
+#define REBOOT_TRIPLE_FAULT     3
+
+// Restart state in the .warm section, which warm restarts leave alone.
+// The first two fields are written by boot.asm.
+struct reboot_warm_info {
+    u32 snapshot;               // .data and the boot information were saved at cold boot
+    u32 warm_entry;             // This boot came through reboot_warm
+    u32 restarts;               // Warm restarts since the last cold boot
+    u32 reserved;
+    u64 restart_tsc;            // TSC when the last warm restart began
+    u64 reserved2;
+};
+
+// Reboot functions
+void reboot_cold(u32 method);
+bool reboot_warm(void);
+const struct reboot_warm_info* reboot_get_warm_info(void);
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef RTC_H
+#define RTC_H
+
+#include "kernel.h"
+#include "idt.h"
+
+// CMOS real-time clock, used here only for its periodic interrupt
+#define RTC_INDEX               0x70
+#define RTC_DATA                0x71
+#define RTC_NMI_DISABLE         0x80
+#define RTC_IRQ                 8
+
+#define RTC_REG_A               0x0A    // Rate select in the low nibble
+#define RTC_REG_B               0x0B
+#define RTC_REG_C               0x0C    // Interrupt causes, cleared by reading
+#define RTC_B_PIE               0x40    // Periodic interrupt enable
+
+// Periodic rates are 32768 >> (rate - 1) Hz for rates 3 to 15
+#define RTC_BASE_HZ             32768
+#define RTC_MIN_HZ              2
+#define RTC_MAX_HZ              8192
+
+// Called from the interrupt with the interrupted context
+typedef void (*rtc_callback_t)(struct interrupt_context* ctx);
+
+// RTC functions
+bool rtc_start_periodic(u32 hz, rtc_callback_t callback);
+void rtc_stop_periodic(void);
+u32 rtc_get_periodic_count(void);
+
+#endif
@@ -0,0 +1,30 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include "kernel.h"
+
+// 16550 UART on COM1
+#define SERIAL_COM1             0x3F8
+#define SERIAL_BAUD             115200
+
+// Register offsets from the base port
+#define SERIAL_DATA             0
+#define SERIAL_IER              1
+#define SERIAL_DIVISOR_LO       0       // With DLAB set
+#define SERIAL_DIVISOR_HI       1
+#define SERIAL_FCR              2
+#define SERIAL_LCR              3
+#define SERIAL_MCR              4
+#define SERIAL_LSR              5
+
+#define SERIAL_LCR_8N1          0x03
+#define SERIAL_LCR_DLAB         0x80
+#define SERIAL_MCR_LOOPBACK     0x10
+#define SERIAL_LSR_THRE         0x20    // Transmit holding register empty
+
+// Serial functions
+bool serial_initialize(void);
+bool serial_present(void);
+void serial_putchar(char c);
+
+#endif
@@ -8,6 +8,11 @@
 #define SHELL_MAX_ARGS 16
 #define SHELL_PROMPT "kernel> "
 
+// Boot scripts: a module with this name, then "run=" on the kernel command
+// line (commands separated by ';', up to the end of the line)
+#define SHELL_SCRIPT_MODULE "script"
+#define SHELL_SCRIPT_OPTION "run="
+
 // Shell command structure
 struct shell_command {
     const char* name;
@@ -21,6 +26,7 @@ void shell_run(void);
 void shell_process_input(char c);
 void shell_execute_command(const char* command_line);
 void shell_print_prompt(void);
+void shell_run_script(const char* script, size_t length);
 
 // Built-in commands
 void cmd_help(int argc, char* argv[]);
@@ -32,5 +38,37 @@ void cmd_reboot(int argc, char* argv[]);
 void cmd_halt(int argc, char* argv[]);
 void cmd_cpuinfo(int argc, char* argv[]);
 void cmd_meminfo(int argc, char* argv[]);
+void cmd_dmastat(int argc, char* argv[]);
+void cmd_irqstat(int argc, char* argv[]);
+void cmd_sysbench(int argc, char* argv[]);
+void cmd_exec(int argc, char* argv[]);
+void cmd_modules(int argc, char* argv[]);
+void cmd_ls(int argc, char* argv[]);
+void cmd_cat(int argc, char* argv[]);
+void cmd_stat(int argc, char* argv[]);
+void cmd_lspci(int argc, char* argv[]);
+void cmd_disks(int argc, char* argv[]);
+void cmd_diskbench(int argc, char* argv[]);
+void cmd_vblkbench(int argc, char* argv[]);
+void cmd_bcache(int argc, char* argv[]);
+void cmd_blkread(int argc, char* argv[]);
+void cmd_mount(int argc, char* argv[]);
+void cmd_fsls(int argc, char* argv[]);
+void cmd_fscat(int argc, char* argv[]);
+void cmd_fsbench(int argc, char* argv[]);
+void cmd_ifconfig(int argc, char* argv[]);
+void cmd_boottime(int argc, char* argv[]);
+void cmd_netstat(int argc, char* argv[]);
+void cmd_repeat(int argc, char* argv[]);
+void cmd_time(int argc, char* argv[]);
+void cmd_top(int argc, char* argv[]);
+void cmd_irqsoff(int argc, char* argv[]);
+void cmd_irqnest(int argc, char* argv[]);
+void cmd_profile(int argc, char* argv[]);
+void cmd_vcon(int argc, char* argv[]);
+void cmd_probe(int argc, char* argv[]);
+void cmd_sysctl(int argc, char* argv[]);
+void cmd_keygen(int argc, char* argv[]);
+void cmd_taskbench(int argc, char* argv[]);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,61 @@
+#ifndef SYSCALL_H
+#define SYSCALL_H
+
+#include "kernel.h"
+
+// System call ABI (both entry paths):
+//   eax = system call number, ebx/esi/edi = arguments 1-3, result in eax.
+// SYSENTER additionally takes the user stack pointer in ecx and the
+// return address in edx; both are clobbered by either path.
+#define SYSCALL_VECTOR     0x80
+
+// System call numbers
+#define SYS_NULL           0
+#define SYS_EXIT           1
+#define SYS_WRITE          2
+#define SYS_GETTICKS       3
+#define SYS_GETCHAR        4
+#define SYSCALL_COUNT      5
+
+#define SYSCALL_ERROR      0xFFFFFFFF
+
+// Size of the ring 0 stack used for user mode entries (TSS esp0 / SYSENTER)
+#define SYSCALL_STACK_SIZE 8192
+
+// Size of the ring 3 stack used by built-in user programs
+#define USER_STACK_SIZE    4096
+
+// Section attributes for code and data that must be reachable from ring 3
+#define __user_text __attribute__((section(".user_text")))
+#define __user_data __attribute__((section(".user_data")))
+
+// System call handler function type
+typedef u32 (*syscall_fn_t)(u32 arg1, u32 arg2, u32 arg3);
+
+// Null system call benchmark results, filled in by the ring 3 benchmark
+struct syscall_bench {
+    u32 iterations;
+    u32 sysenter_cycles;    // Total cycles for all SYSENTER calls
+    u32 int80_cycles;       // Total cycles for all int 0x80 calls
+    bool sysenter_used;
+};
+
+// System call functions
+void syscall_initialize(void);
+bool syscall_sysenter_supported(void);
+u32 syscall_dispatch(u32 num, u32 arg1, u32 arg2, u32 arg3);
+
+// Run a built-in function in ring 3 until it calls SYS_EXIT; returns the exit code
+u32 user_run(void (*entry)(void));
+
+// Ring 3 programs linked into the kernel image
+void user_syscall_bench(void);
+extern struct syscall_bench user_bench_result;
+
+// Assembly entry points
+extern void syscall_int80_entry(void);
+extern void syscall_sysenter_entry(void);
+extern u32 user_enter(u32 eip, u32 esp);
+extern void user_exit(u32 code);
+
+#endif
\ No newline at end of file
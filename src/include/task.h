@@ -0,0 +1,81 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include "kernel.h"
+
+// Tasks polled per task_run pass before the idle loop regains control
+#define TASK_RUN_BUDGET         64
+
+// Poll results
+#define TASK_PENDING            0   // Waiting for a wake
+#define TASK_DONE               1
+
+// Task flags
+#define TASK_QUEUED             0x01    // On the ready queue
+#define TASK_RUNNING            0x02
+#define TASK_WOKEN              0x04    // Woken while running: poll again
+#define TASK_FINISHED           0x08
+
+struct task;
+
+// The continuation: advances the task's state machine from task->step
+// until it has to wait, and never blocks
+typedef int (*task_poll_t)(struct task* task);
+
+// A task is only this struct; it has no stack of its own, so whatever must
+// survive a wait lives in the struct or in what context points to
+struct task {
+    const char* name;
+    task_poll_t poll;
+    void* context;
+    u32 step;                   // State-machine position, owned by poll
+    volatile u32 flags;
+    u64 wake_tsc;               // When the pending wake was requested
+    struct task* next;          // Ready queue link
+    struct task* wait_next;     // Wait queue link, kept apart so a parked task can still be readied
+    struct task_queue* queue;   // Wait queue the task is parked on, if any
+};
+
+// One-shot wake handle given to whatever completes the wait, e.g. an IRQ
+// handler; carries the completion status back to the task
+struct task_waker {
+    struct task* task;
+    volatile int status;
+};
+
+// Tasks waiting for a shared resource, woken in FIFO order
+struct task_queue {
+    struct task* head;
+    struct task* tail;
+};
+
+struct task_stats {
+    u32 spawned;
+    u32 completed;
+    u32 wakes;                  // Wakes that made a task runnable
+    u32 polls;
+    u32 runs;                   // task_run passes that polled something
+    u64 poll_cycles;            // Spent inside poll functions
+    u64 run_cycles;             // Spent in task_run, polls included
+    u64 latency_total;          // Wake to start of the next poll
+    u64 latency_min;
+    u64 latency_max;
+    u32 latency_samples;
+};
+
+// Executor functions
+void task_initialize(void);
+void task_init(struct task* task, const char* name, task_poll_t poll, void* context);
+void task_spawn(struct task* task);
+void task_wake(struct task* task);
+bool task_run(void);
+bool task_pending(void);
+void task_waker_init(struct task_waker* waker, struct task* task);
+void task_waker_wake(struct task_waker* waker, int status);
+void task_queue_init(struct task_queue* queue);
+void task_queue_wait(struct task_queue* queue, struct task* task);
+void task_queue_wake_one(struct task_queue* queue);
+const struct task_stats* task_get_stats(void);
+void task_reset_stats(void);
+
+#endif
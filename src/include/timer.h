@@ -9,10 +9,35 @@
 #define PIT_COMMAND     0x43
 #define PIT_DATA0       0x40
 
+// Tick rate: TIMER_DEFAULT_HZ unless timer.hz on the kernel command line
+// says otherwise. The PIT divisor is 16 bits, so nothing below 19 Hz.
+#define TIMER_DEFAULT_HZ        100
+#define TIMER_MIN_HZ            19
+#define TIMER_MAX_HZ            10000
+
+// Ticks the TSC is measured across on first use
+#define TIMER_CALIBRATE_TICKS   10
+
+// Intervals between timer interrupts in TSC cycles
+struct timer_jitter {
+    u32 samples;
+    u64 period;                 // Nominal cycles per tick, 0 before calibration
+    u64 interval_min;
+    u64 interval_max;
+    u64 interval_total;
+    u64 deviation_total;        // Sum of |interval - period|
+    u64 deviation_max;
+};
+
 // Timer functions
-void timer_initialize(u32 frequency);
+void timer_initialize(void);
 void timer_handler(struct interrupt_context* ctx);
 u32 timer_get_ticks(void);
 u32 timer_get_seconds(void);
+u32 timer_get_frequency(void);
+u64 timer_get_tsc_hz(void);
+u64 timer_tsc_to_us(u64 cycles);
+void timer_get_jitter(struct timer_jitter* jitter);
+void timer_reset_jitter(void);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,61 @@
+#ifndef TUNABLE_H
+#define TUNABLE_H
+
+#include "kernel.h"
+
+#define TUNABLE_MAX             32
+
+// Value types: a number in [min, max], or an index into a list of names
+#define TUNABLE_U32             0
+#define TUNABLE_CHOICE          1
+
+// Flags
+#define TUNABLE_POWER_OF_TWO    0x01
+
+// Where the current value came from
+#define TUNABLE_DEFAULT         0
+#define TUNABLE_CMDLINE         1
+#define TUNABLE_SYSCTL          2
+
+// Status codes
+#define TUNABLE_OK              0
+#define TUNABLE_ERR_NOT_FOUND   1
+#define TUNABLE_ERR_INVALID     2
+#define TUNABLE_ERR_RANGE       3
+#define TUNABLE_ERR_READ_ONLY   4
+
+// Called with a validated value when sysctl changes it at runtime;
+// returns false to refuse. Tunables without one are fixed after boot.
+typedef bool (*tunable_apply_t)(u32 value);
+
+// Declared statically by the subsystem that reads it, then registered
+// during its initialization, which picks up `name=value` from the kernel
+// command line
+struct tunable {
+    const char* name;           // "subsystem.parameter"
+    const char* description;
+    const char* unit;           // Shown after numeric values, or 0
+    u32 type;
+    u32 flags;
+    u32 fallback;               // Compiled-in value
+    u32 min;
+    u32 max;
+    const char* const* choices; // TUNABLE_CHOICE: names of values 0..max
+    tunable_apply_t apply;
+
+    // Registry state
+    u32 value;
+    u32 source;
+    bool rejected;              // The command line gave a bad value
+};
+
+// Tunable functions
+u32 tunable_register(struct tunable* tunable);
+int tunable_set(const char* name, const char* value);
+const struct tunable* tunable_find(const char* name);
+u32 tunable_get_count(void);
+const struct tunable* tunable_get(u32 index);
+const char* tunable_value_name(const struct tunable* tunable);
+const char* tunable_strerror(int status);
+
+#endif
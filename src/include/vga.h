@@ -42,8 +42,14 @@ void vga_initialize(void);
 void vga_setcolor(u8 color);
 void vga_putentryat(char c, u8 color, size_t x, size_t y);
 void vga_putchar(char c);
+void vga_set_mirror(void (*mirror)(char c));
+void vga_set_tee(void (*tee)(char c));
+void vga_set_screen(bool on);
 void vga_write(const char* data, size_t size);
 void vga_writestring(const char* data);
+void vga_write_dec(u32 value);
+void vga_write_dec64(u64 value);
+void vga_write_hex(u32 value);
 void vga_clear(void);
 void vga_scroll(void);
 void vga_set_cursor(size_t x, size_t y);
@@ -0,0 +1,144 @@
+#ifndef VIRTIO_H
+#define VIRTIO_H
+
+#include "kernel.h"
+#include "pci.h"
+
+#define VIRTIO_PCI_VENDOR           0x1AF4
+
+// Device status bits
+#define VIRTIO_STATUS_ACKNOWLEDGE   0x01
+#define VIRTIO_STATUS_DRIVER        0x02
+#define VIRTIO_STATUS_DRIVER_OK     0x04
+#define VIRTIO_STATUS_FEATURES_OK   0x08
+#define VIRTIO_STATUS_FAILED        0x80
+
+// Feature bits common to all devices (high word)
+#define VIRTIO_F_VERSION_1          (1 << 0)    // Bit 32
+
+// Legacy I/O port register layout (without MSI-X)
+#define VIRTIO_LEGACY_DEVICE_FEATURES   0x00
+#define VIRTIO_LEGACY_GUEST_FEATURES    0x04
+#define VIRTIO_LEGACY_QUEUE_PFN         0x08
+#define VIRTIO_LEGACY_QUEUE_SIZE        0x0C
+#define VIRTIO_LEGACY_QUEUE_SELECT      0x0E
+#define VIRTIO_LEGACY_QUEUE_NOTIFY      0x10
+#define VIRTIO_LEGACY_STATUS            0x12
+#define VIRTIO_LEGACY_ISR               0x13
+#define VIRTIO_LEGACY_CONFIG            0x14
+
+// Modern PCI capability types
+#define VIRTIO_PCI_CAP_COMMON_CFG   1
+#define VIRTIO_PCI_CAP_NOTIFY_CFG   2
+#define VIRTIO_PCI_CAP_ISR_CFG      3
+#define VIRTIO_PCI_CAP_DEVICE_CFG   4
+
+// Modern common configuration layout
+#define VIRTIO_COMMON_DFSELECT      0x00
+#define VIRTIO_COMMON_DF            0x04
+#define VIRTIO_COMMON_GFSELECT      0x08
+#define VIRTIO_COMMON_GF            0x0C
+#define VIRTIO_COMMON_NUM_QUEUES    0x12
+#define VIRTIO_COMMON_STATUS        0x14
+#define VIRTIO_COMMON_Q_SELECT      0x16
+#define VIRTIO_COMMON_Q_SIZE        0x18
+#define VIRTIO_COMMON_Q_ENABLE      0x1C
+#define VIRTIO_COMMON_Q_NOFF        0x1E
+#define VIRTIO_COMMON_Q_DESCLO      0x20
+#define VIRTIO_COMMON_Q_DESCHI      0x24
+#define VIRTIO_COMMON_Q_AVAILLO     0x28
+#define VIRTIO_COMMON_Q_AVAILHI     0x2C
+#define VIRTIO_COMMON_Q_USEDLO      0x30
+#define VIRTIO_COMMON_Q_USEDHI      0x34
+
+// Split virtqueue layout
+#define VIRTQ_DESC_F_NEXT           1
+#define VIRTQ_DESC_F_WRITE          2
+#define VIRTQ_AVAIL_F_NO_INTERRUPT  1
+#define VIRTQ_USED_F_NO_NOTIFY      1
+#define VIRTQ_MAX_SIZE              256
+#define VIRTQ_ALIGN                 4096
+
+// Bytes of physically contiguous memory a queue of n entries needs
+#define VIRTQ_AVAIL_OFFSET(n)       ((u32)(n) * 16)
+#define VIRTQ_USED_OFFSET(n)        (((u32)(n) * 18 + 6 + VIRTQ_ALIGN - 1) & ~(VIRTQ_ALIGN - 1))
+#define VIRTQ_RING_SIZE(n)          (VIRTQ_USED_OFFSET(n) + (((u32)(n) * 8 + 6 + VIRTQ_ALIGN - 1) & ~(VIRTQ_ALIGN - 1)))
+
+struct virtq_desc {
+    u64 addr;
+    u32 len;
+    u16 flags;
+    u16 next;
+} __attribute__((packed));
+
+struct virtq_avail {
+    u16 flags;
+    u16 idx;
+    u16 ring[];
+} __attribute__((packed));
+
+struct virtq_used_elem {
+    u32 id;
+    u32 len;
+} __attribute__((packed));
+
+struct virtq_used {
+    u16 flags;
+    u16 idx;
+    struct virtq_used_elem ring[];
+} __attribute__((packed));
+
+// Transport state for one virtio PCI function
+struct virtio_device {
+    struct pci_device* pci;
+    bool modern;
+    u16 io;                         // Legacy register block
+    volatile u8* common;            // Modern capability windows
+    volatile u8* notify;
+    u32 notify_multiplier;
+    volatile u8* isr;
+    volatile u8* config;
+};
+
+struct virtqueue {
+    struct virtio_device* dev;
+    u16 index;
+    u16 size;
+    struct virtq_desc* desc;
+    struct virtq_avail* avail;
+    volatile struct virtq_used* used;
+    u16 free_head;
+    u16 free_count;
+    u16 avail_idx;                  // Shadow of avail->idx, published on kick
+    u16 last_used;
+    u16 pending;                    // Chains added since the last kick
+    u16 notify_offset;
+    void* tokens[VIRTQ_MAX_SIZE];
+};
+
+// Buffer handed to virtq_add; device-readable entries come first
+struct virtq_buffer {
+    const void* data;
+    u32 length;
+};
+
+// Virtio transport functions
+bool virtio_init_device(struct virtio_device* dev, struct pci_device* pci);
+bool virtio_negotiate(struct virtio_device* dev, u32 features, u32* accepted);
+bool virtio_setup_queue(struct virtio_device* dev, struct virtqueue* vq, u16 index, void* memory, u32 memory_size);
+void virtio_driver_ok(struct virtio_device* dev);
+void virtio_fail(struct virtio_device* dev);
+u8 virtio_read_isr(struct virtio_device* dev);
+u8 virtio_config_read8(struct virtio_device* dev, u32 offset);
+u32 virtio_config_read32(struct virtio_device* dev, u32 offset);
+u64 virtio_config_read64(struct virtio_device* dev, u32 offset);
+
+// Virtqueue functions
+int virtq_add(struct virtqueue* vq, const struct virtq_buffer* buffers, u32 out, u32 in, void* token);
+bool virtq_kick(struct virtqueue* vq);
+void* virtq_get_used(struct virtqueue* vq, u32* length);
+bool virtq_has_used(struct virtqueue* vq);
+void virtq_disable_interrupts(struct virtqueue* vq);
+bool virtq_enable_interrupts(struct virtqueue* vq);
+
+#endif
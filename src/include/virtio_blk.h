@@ -0,0 +1,93 @@
+#ifndef VIRTIO_BLK_H
+#define VIRTIO_BLK_H
+
+#include "kernel.h"
+
+// PCI device IDs (transitional and modern-only)
+#define VIRTIO_BLK_DEVICE_LEGACY    0x1001
+#define VIRTIO_BLK_DEVICE_MODERN    0x1042
+
+// Request types and device status values
+#define VIRTIO_BLK_T_IN             0
+#define VIRTIO_BLK_T_OUT            1
+#define VIRTIO_BLK_S_OK             0
+
+// Device configuration
+#define VIRTIO_BLK_CFG_CAPACITY     0x00
+#define VIRTIO_BLK_F_RO             (1 << 5)
+
+#define VIRTIO_BLK_MAX_DEVICES      2
+#define VIRTIO_BLK_SECTOR_SIZE      512
+#define VIRTIO_BLK_MAX_SECTORS      2048    // Per request (1 MiB)
+#define VIRTIO_BLK_POLL_DEPTH       8       // In-flight requests at which waiters poll
+
+// Request status
+#define VIRTIO_BLK_PENDING          (-1)
+#define VIRTIO_BLK_OK               0
+#define VIRTIO_BLK_ERR_INVALID      1
+#define VIRTIO_BLK_ERR_NO_DEVICE    2
+#define VIRTIO_BLK_ERR_IO           3
+#define VIRTIO_BLK_ERR_FULL         4
+#define VIRTIO_BLK_ERR_READ_ONLY    5
+
+struct virtio_blk_outhdr {
+    u32 type;
+    u32 reserved;
+    u64 sector;
+} __attribute__((packed));
+
+// Asynchronous transfer; the request itself and the buffer must be
+// identity mapped and stay valid until the request completes
+struct virtio_blk_request {
+    u64 sector;
+    u32 count;                          // Sectors
+    void* buffer;
+    bool write;
+    volatile int status;
+    void (*done)(struct virtio_blk_request* req);
+    void* context;
+
+    // Owned by the driver while pending
+    u32 device;
+    struct virtio_blk_outhdr header;
+    volatile u8 device_status;
+};
+
+struct virtio_blk_stats {
+    u32 requests;
+    u32 kicks;              // Batches published to the device
+    u32 notifications;      // Doorbell writes actually made
+    u32 interrupts;
+    u32 irq_completions;    // Requests reaped by the interrupt handler
+    u32 polled_completions; // Requests reaped by polling with interrupts off
+    u32 errors;
+    u64 sectors;
+};
+
+struct virtio_blk_bench_result {
+    u32 operations;
+    u64 bytes;
+    u32 ticks;
+    u32 notifications;
+    u32 interrupts;
+    u32 polled;
+};
+
+// virtio-blk functions
+void virtio_blk_initialize(void);
+bool virtio_blk_present(u32 device);
+u64 virtio_blk_get_capacity(u32 device);
+bool virtio_blk_is_modern(u32 device);
+bool virtio_blk_is_readonly(u32 device);
+int virtio_blk_queue(u32 device, struct virtio_blk_request* req);
+void virtio_blk_kick(u32 device);
+int virtio_blk_submit(u32 device, struct virtio_blk_request* req);
+u32 virtio_blk_poll(u32 device);
+int virtio_blk_wait(struct virtio_blk_request* req);
+int virtio_blk_read(u32 device, u64 sector, u32 count, void* buffer);
+int virtio_blk_write(u32 device, u64 sector, u32 count, const void* buffer);
+const struct virtio_blk_stats* virtio_blk_get_stats(void);
+const char* virtio_blk_strerror(int status);
+int virtio_blk_bench(u32 device, bool sequential, u32 depth, u32 sectors, u32 ticks, struct virtio_blk_bench_result* result);
+
+#endif
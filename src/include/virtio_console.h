@@ -0,0 +1,111 @@
+#ifndef VIRTIO_CONSOLE_H
+#define VIRTIO_CONSOLE_H
+
+#include "kernel.h"
+#include "virtio.h"
+
+// PCI device IDs (transitional and modern-only)
+#define VIRTIO_CONSOLE_DEVICE_LEGACY    0x1003
+#define VIRTIO_CONSOLE_DEVICE_MODERN    0x1043
+
+// Feature bits and device configuration
+#define VIRTIO_CONSOLE_F_MULTIPORT      (1 << 1)
+#define VIRTIO_CONSOLE_CFG_MAX_PORTS    0x04
+
+// Control messages exchanged on the control queues (multiport only)
+#define VIRTIO_CONSOLE_DEVICE_READY     0
+#define VIRTIO_CONSOLE_DEVICE_ADD       1
+#define VIRTIO_CONSOLE_DEVICE_REMOVE    2
+#define VIRTIO_CONSOLE_PORT_READY       3
+#define VIRTIO_CONSOLE_CONSOLE_PORT     4
+#define VIRTIO_CONSOLE_RESIZE           5
+#define VIRTIO_CONSOLE_PORT_OPEN        6
+#define VIRTIO_CONSOLE_PORT_NAME        7
+
+// Queue indexes: port 0 receives on 0 and transmits on 1, the control
+// queues are 2/3, and every later port n uses 2n+2/2n+3. Only transmit
+// queues are set up; the ports are output only.
+#define VIRTIO_CONSOLE_CONTROL_RX       2
+#define VIRTIO_CONSOLE_CONTROL_TX       3
+#define VIRTIO_CONSOLE_PORT_TX(n)       ((n) == 0 ? 1 : 2 * (n) + 3)
+
+#define VIRTIO_CONSOLE_MAX_PORTS        4
+#define VIRTIO_CONSOLE_NAME_MAX         32
+#define VIRTIO_CONSOLE_CONTROL_BUFFERS  16
+#define VIRTIO_CONSOLE_CONTROL_SIZE     64      // Header plus a port name
+
+// Writes are copied into per-port buffers. A full buffer is queued at
+// once but the doorbell only rings every VIRTIO_CONSOLE_BATCH buffers, or
+// on a flush.
+#define VIRTIO_CONSOLE_BUFFER_SIZE      16384
+#define VIRTIO_CONSOLE_TX_BUFFERS       8
+#define VIRTIO_CONSOLE_BATCH            4
+#define VIRTIO_CONSOLE_WAIT_US          100000  // For a free buffer before dropping data
+
+#define VIRTIO_CONSOLE_NO_PORT          0xFFFFFFFF
+
+// Status codes
+#define VIRTIO_CONSOLE_OK               0
+#define VIRTIO_CONSOLE_ERR_INVALID      1
+#define VIRTIO_CONSOLE_ERR_NO_PORT      2
+#define VIRTIO_CONSOLE_ERR_CLOSED       3
+#define VIRTIO_CONSOLE_ERR_TIMEOUT      4
+
+struct virtio_console_control {
+    u32 id;
+    u16 event;
+    u16 value;
+} __attribute__((packed));
+
+struct virtio_console_port_stats {
+    u64 bytes;                  // Queued to the device
+    u32 buffers;
+    u32 kicks;                  // Batches published to the device
+    u32 notifications;          // Doorbell writes actually made
+    u32 waits;                  // Writes that waited for a free buffer
+    u64 dropped;                // Bytes given up on after VIRTIO_CONSOLE_WAIT_US
+};
+
+struct virtio_console_port {
+    bool present;               // Announced by the device
+    bool host_open;             // A host-side chardev is connected
+    bool console;               // The device marked it as a console port
+    char name[VIRTIO_CONSOLE_NAME_MAX];
+    struct virtio_console_port_stats stats;
+
+    // Driver state
+    bool configured;            // Transmit queue set up
+    struct virtqueue tx;
+    u32 free_mask;              // Buffers not on the queue
+    int current;                // Buffer being filled, or -1
+    u32 fill;
+    u32 queued;                 // Buffers queued since the last kick
+};
+
+struct virtio_console_bench_result {
+    u64 bytes;
+    u32 ticks;
+    u32 kicks;
+    u32 notifications;
+    u32 waits;
+};
+
+// virtio-console functions
+void virtio_console_initialize(void);
+bool virtio_console_present(void);
+bool virtio_console_is_modern(void);
+bool virtio_console_is_multiport(void);
+u32 virtio_console_get_port_count(void);
+const struct virtio_console_port* virtio_console_get_port(u32 port);
+u32 virtio_console_find(const char* name);
+int virtio_console_write(u32 port, const void* data, u32 length);
+void virtio_console_flush(u32 port);
+void virtio_console_flush_all(void);
+void virtio_console_set_log(u32 port);
+u32 virtio_console_get_log(void);
+void virtio_console_putchar(char c);
+void virtio_console_reset_stats(void);
+const char* virtio_console_strerror(int status);
+int virtio_console_bench(u32 port, u32 bytes, struct virtio_console_bench_result* result);
+
+#endif
@@ -0,0 +1,90 @@
+#include "acpi.h"
+#include "multiboot.h"
+#include "paging.h"
+
+// Tables listed by the RSDT/XSDT that could be mapped and validated
+static const struct acpi_sdt_header* acpi_tables[ACPI_MAX_TABLES];
+static u32 acpi_table_count = 0;
+
+static bool acpi_checksum(const void* data, u32 length) {
+    const u8* bytes = (const u8*)data;
+    u8 sum = 0;
+    for (u32 i = 0; i < length; i++) {
+        sum += bytes[i];
+    }
+    return sum == 0;
+}
+
+// Scan a physical range on 16-byte boundaries for the RSDP signature
+static const struct acpi_rsdp* acpi_scan_rsdp(u32 start, u32 end) {
+    for (u32 addr = start; addr + 20 <= end; addr += 16) {
+        const struct acpi_rsdp* rsdp = (const struct acpi_rsdp*)(uptr)addr;
+        if (strncmp(rsdp->signature, "RSD PTR ", 8) == 0 && acpi_checksum(rsdp, 20)) {
+            return rsdp;
+        }
+    }
+    return 0;
+}
+
+static const struct acpi_rsdp* acpi_find_rsdp(void) {
+    const struct acpi_rsdp* rsdp = (const struct acpi_rsdp*)multiboot_get_acpi_rsdp();
+    if (rsdp) {
+        return rsdp;
+    }
+
+    // The EBDA pointer lives in the unmapped first page, so only the BIOS
+    // read-only area is searched; GRUB normally provides the RSDP anyway
+    return acpi_scan_rsdp(0xE0000, 0x100000);
+}
+
+// Tables above the identity map are mapped on demand; tables that would
+// land in the user address space are skipped
+static const struct acpi_sdt_header* acpi_map_table(u32 addr) {
+    if (!paging_map_mmio(addr, sizeof(struct acpi_sdt_header))) {
+        return 0;
+    }
+    const struct acpi_sdt_header* header = (const struct acpi_sdt_header*)(uptr)addr;
+    if (!paging_map_mmio(addr, header->length) || !acpi_checksum(header, header->length)) {
+        return 0;
+    }
+    return header;
+}
+
+bool acpi_initialize(void) {
+    acpi_table_count = 0;
+
+    const struct acpi_rsdp* rsdp = acpi_find_rsdp();
+    if (!rsdp) {
+        return false;
+    }
+
+    // Use the XSDT when it is present and addressable, the RSDT otherwise
+    bool xsdt = rsdp->revision >= 2 && rsdp->xsdt_address && (rsdp->xsdt_address >> 32) == 0;
+    const struct acpi_sdt_header* root = acpi_map_table(xsdt ? (u32)rsdp->xsdt_address : rsdp->rsdt_address);
+    if (!root) {
+        return false;
+    }
+
+    u32 entry_size = xsdt ? 8 : 4;
+    u32 count = (root->length - sizeof(struct acpi_sdt_header)) / entry_size;
+    const u8* entries = (const u8*)root + sizeof(struct acpi_sdt_header);
+    for (u32 i = 0; i < count && acpi_table_count < ACPI_MAX_TABLES; i++) {
+        const u32* entry = (const u32*)(entries + i * entry_size);
+        if (xsdt && entry[1] != 0) continue;  // Above 4 GiB
+
+        const struct acpi_sdt_header* table = acpi_map_table(entry[0]);
+        if (table) {
+            acpi_tables[acpi_table_count++] = table;
+        }
+    }
+    return true;
+}
+
+const struct acpi_sdt_header* acpi_find_table(const char* signature) {
+    for (u32 i = 0; i < acpi_table_count; i++) {
+        if (strncmp(acpi_tables[i]->signature, signature, 4) == 0) {
+            return acpi_tables[i];
+        }
+    }
+    return 0;
+}
\ No newline at end of file
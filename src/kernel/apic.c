@@ -0,0 +1,55 @@
+#include "apic.h"
+#include "cpu.h"
+#include "paging.h"
+
+// The 8259 PICs keep routing the legacy lines through LINT0; the local
+// APIC is only software-enabled so that it accepts MSI messages
+static volatile u32* lapic_base = 0;
+
+static inline u32 lapic_read(u32 reg) {
+    return lapic_base[reg / 4];
+}
+
+static inline void lapic_write(u32 reg, u32 value) {
+    lapic_base[reg / 4] = value;
+}
+
+bool lapic_initialize(void) {
+    if (!cpu_has_feature_edx(CPUID_FEAT_EDX_APIC) || !cpu_has_feature_edx(CPUID_FEAT_EDX_MSR)) {
+        return false;
+    }
+
+    u64 base_msr = rdmsr(MSR_APIC_BASE);
+    if (!(base_msr & LAPIC_BASE_ENABLE)) {
+        return false;   // Globally disabled by firmware
+    }
+
+    u32 base = (u32)base_msr & LAPIC_BASE_MASK;
+    if (!paging_map_mmio(base, LAPIC_MMIO_SIZE)) {
+        return false;
+    }
+    lapic_base = (volatile u32*)(uptr)base;
+
+    lapic_write(LAPIC_REG_TPR, 0);
+    lapic_write(LAPIC_REG_SVR, LAPIC_SVR_ENABLE | LAPIC_SPURIOUS_VECTOR);
+    return true;
+}
+
+bool lapic_present(void) {
+    return lapic_base != 0;
+}
+
+u32 lapic_get_id(void) {
+    return lapic_base ? lapic_read(LAPIC_REG_ID) >> 24 : 0;
+}
+
+void lapic_eoi(void) {
+    lapic_write(LAPIC_REG_EOI, 0);
+}
+
+// Raise vector on this CPU. Until the handler's EOI, another one for the
+// same vector only sets its request bit again, so several collapse into one.
+void lapic_send_self(u8 vector) {
+    while (lapic_read(LAPIC_REG_ICR_LOW) & LAPIC_ICR_PENDING) {}
+    lapic_write(LAPIC_REG_ICR_LOW, LAPIC_ICR_SELF | vector);
+}
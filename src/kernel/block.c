@@ -0,0 +1,494 @@
+#include "block.h"
+#include "irqtrace.h"
+#include "paging.h"
+#include "dma.h"
+#include "tunable.h"
+
+// Registered devices
+static struct block_device* block_devices[BLOCK_MAX_DEVICES];
+static u32 block_count = 0;
+
+// Buffer cache: fixed buffers, chained hash on (device, block) and an LRU
+// list through a sentinel (lru_next is the most recently used end)
+static struct bcache_buffer bcache_buffers[BCACHE_BUFFERS];
+static struct bcache_buffer* bcache_hash[BCACHE_HASH_SIZE];
+static struct bcache_buffer bcache_lru;
+static struct bcache_stats bcache_stats;
+
+// Largest read-ahead window in blocks, 0 to turn read-ahead off
+static u32 bcache_readahead_max = BCACHE_READAHEAD_MAX;
+
+static bool bcache_set_readahead(u32 blocks);
+
+static struct tunable bcache_readahead_tunable = {
+    .name = "bcache.readahead",
+    .description = "Largest buffer cache read-ahead window",
+    .unit = "blocks",
+    .type = TUNABLE_U32,
+    .flags = TUNABLE_POWER_OF_TWO,
+    .fallback = BCACHE_READAHEAD_MAX,
+    .min = 0,
+    .max = BCACHE_READAHEAD_LIMIT,
+    .apply = bcache_set_readahead,
+};
+
+static const char* block_errors[] = {
+    "Success",
+    "Invalid request",
+    "No such device",
+    "I/O error",
+    "Device is read-only",
+    "No free buffer",
+};
+
+static inline u32 bcache_slot(const struct block_device* dev, u64 block) {
+    u32 key = ((uptr)dev >> 4) ^ (u32)block ^ (u32)(block >> 32);
+    return ((key * 2654435761u) >> 16) & (BCACHE_HASH_SIZE - 1);
+}
+
+static void bcache_lru_remove(struct bcache_buffer* buffer) {
+    buffer->lru_prev->lru_next = buffer->lru_next;
+    buffer->lru_next->lru_prev = buffer->lru_prev;
+}
+
+static void bcache_lru_push(struct bcache_buffer* buffer) {
+    buffer->lru_next = bcache_lru.lru_next;
+    buffer->lru_prev = &bcache_lru;
+    bcache_lru.lru_next->lru_prev = buffer;
+    bcache_lru.lru_next = buffer;
+}
+
+static void bcache_touch(struct bcache_buffer* buffer) {
+    bcache_lru_remove(buffer);
+    bcache_lru_push(buffer);
+}
+
+static struct bcache_buffer* bcache_lookup(struct block_device* dev, u64 block) {
+    for (struct bcache_buffer* buffer = bcache_hash[bcache_slot(dev, block)]; buffer; buffer = buffer->hash_next) {
+        if (buffer->dev == dev && buffer->block == block) {
+            return buffer;
+        }
+    }
+    return 0;
+}
+
+static void bcache_hash_insert(struct bcache_buffer* buffer) {
+    u32 slot = bcache_slot(buffer->dev, buffer->block);
+    buffer->hash_next = bcache_hash[slot];
+    bcache_hash[slot] = buffer;
+}
+
+static void bcache_hash_remove(struct bcache_buffer* buffer) {
+    struct bcache_buffer** link = &bcache_hash[bcache_slot(buffer->dev, buffer->block)];
+    while (*link && *link != buffer) {
+        link = &(*link)->hash_next;
+    }
+    if (*link) {
+        *link = buffer->hash_next;
+    }
+    buffer->hash_next = 0;
+    buffer->dev = 0;
+    buffer->flags = 0;
+}
+
+static u32 bcache_sectors_per_block(const struct block_device* dev) {
+    return dev->block_size / BLOCK_SECTOR_SIZE;
+}
+
+// Block sizes are powers of two, so the count is a shift and needs no
+// 64-bit division
+static u64 bcache_block_count(const struct block_device* dev) {
+    u64 blocks = dev->sectors;
+    for (u32 size = dev->block_size; size > BLOCK_SECTOR_SIZE; size >>= 1) {
+        blocks >>= 1;
+    }
+    return blocks;
+}
+
+static int bcache_write_back(struct bcache_buffer* buffer) {
+    u32 count = bcache_sectors_per_block(buffer->dev);
+    int status = block_write(buffer->dev, buffer->block * count, count, buffer->data);
+    if (status != BLOCK_OK) {
+        bcache_stats.io_errors++;
+        return status;
+    }
+    buffer->flags &= ~BCACHE_DIRTY;
+    bcache_stats.writebacks++;
+    return BLOCK_OK;
+}
+
+// Reclaim the least recently used buffer nobody holds, writing it back
+// first if it is dirty
+static struct bcache_buffer* bcache_evict(void) {
+    for (struct bcache_buffer* buffer = bcache_lru.lru_prev; buffer != &bcache_lru; buffer = buffer->lru_prev) {
+        if (buffer->refcount || (buffer->flags & BCACHE_LOCKED)) continue;
+        if ((buffer->flags & BCACHE_DIRTY) && bcache_write_back(buffer) != BLOCK_OK) continue;
+
+        if (buffer->dev) {
+            if (buffer->flags & BCACHE_VALID) {
+                bcache_stats.evictions++;
+            }
+            bcache_hash_remove(buffer);
+        }
+        return buffer;
+    }
+    return 0;
+}
+
+// Claim a buffer for (dev, block) without reading it
+static struct bcache_buffer* bcache_claim(struct block_device* dev, u64 block) {
+    struct bcache_buffer* buffer = bcache_evict();
+    if (!buffer) {
+        return 0;
+    }
+    buffer->dev = dev;
+    buffer->block = block;
+    buffer->flags = 0;
+    buffer->refcount = 0;
+    bcache_hash_insert(buffer);
+    bcache_touch(buffer);
+    return buffer;
+}
+
+// Windows already wider than the new maximum keep their size until the
+// reader's sequential run ends
+static bool bcache_set_readahead(u32 blocks) {
+    bcache_readahead_max = blocks;
+    return true;
+}
+
+void block_initialize(void) {
+    block_count = 0;
+    bcache_set_readahead(tunable_register(&bcache_readahead_tunable));
+    memset(bcache_hash, 0, sizeof(bcache_hash));
+    memset(&bcache_stats, 0, sizeof(bcache_stats));
+
+    bcache_lru.lru_next = &bcache_lru;
+    bcache_lru.lru_prev = &bcache_lru;
+    // Block data lives in the DMA pool so drivers transfer straight into
+    // the cache; a buffer that gets no memory stays off the LRU list
+    for (u32 i = 0; i < BCACHE_BUFFERS; i++) {
+        u8* data = bcache_buffers[i].data;
+        memset(&bcache_buffers[i], 0, sizeof(bcache_buffers[i]));
+        bcache_buffers[i].data = data ? data : dma_alloc(BCACHE_MAX_BLOCK_SIZE, PAGE_SIZE);
+        if (bcache_buffers[i].data) {
+            bcache_lru_push(&bcache_buffers[i]);
+        }
+    }
+}
+
+bool block_register(struct block_device* dev) {
+    if (block_count == BLOCK_MAX_DEVICES) {
+        return false;
+    }
+    dev->block_size = BCACHE_DEFAULT_BLOCK;
+    dev->sectors_read = 0;
+    dev->sectors_written = 0;
+    dev->last_block = (u64)-1;
+    dev->readahead_next = 0;
+    dev->readahead_window = 0;
+    block_devices[block_count++] = dev;
+    return true;
+}
+
+u32 block_get_count(void) {
+    return block_count;
+}
+
+struct block_device* block_get(u32 index) {
+    if (index < block_count) {
+        return block_devices[index];
+    }
+    return 0;
+}
+
+struct block_device* block_find(const char* name) {
+    for (u32 i = 0; i < block_count; i++) {
+        if (strcmp(block_devices[i]->name, name) == 0) {
+            return block_devices[i];
+        }
+    }
+    return 0;
+}
+
+int block_read(struct block_device* dev, u64 sector, u32 count, void* buffer) {
+    if (!dev) {
+        return BLOCK_ERR_NO_DEVICE;
+    }
+    if (count == 0 || sector + count > dev->sectors) {
+        return BLOCK_ERR_INVALID;
+    }
+    int status = dev->ops->read(dev, sector, count, buffer);
+    if (status == BLOCK_OK) {
+        dev->sectors_read += count;
+    }
+    return status;
+}
+
+// Start a read that finishes through req->done, possibly in interrupt
+// context. Devices without asynchronous reads complete it before this
+// returns. Sectors are counted at submission.
+int block_read_async(struct block_device* dev, struct block_request* req) {
+    if (!dev) {
+        return BLOCK_ERR_NO_DEVICE;
+    }
+    if (req->count == 0 || req->sector + req->count > dev->sectors) {
+        return BLOCK_ERR_INVALID;
+    }
+    if (!dev->ops->read_async) {
+        int status = block_read(dev, req->sector, req->count, req->buffer);
+        req->done(req, status);
+        return BLOCK_OK;
+    }
+    int status = dev->ops->read_async(dev, req);
+    if (status == BLOCK_OK) {
+        dev->sectors_read += req->count;
+    }
+    return status;
+}
+
+int block_write(struct block_device* dev, u64 sector, u32 count, const void* buffer) {
+    if (!dev) {
+        return BLOCK_ERR_NO_DEVICE;
+    }
+    if (dev->readonly || !dev->ops->write) {
+        return BLOCK_ERR_READ_ONLY;
+    }
+    if (count == 0 || sector + count > dev->sectors) {
+        return BLOCK_ERR_INVALID;
+    }
+    int status = dev->ops->write(dev, sector, count, buffer);
+    if (status == BLOCK_OK) {
+        dev->sectors_written += count;
+    }
+    return status;
+}
+
+const char* block_strerror(int status) {
+    if (status < 0 || status > BLOCK_ERR_NO_BUFFER) {
+        return "Unknown error";
+    }
+    return block_errors[status];
+}
+
+// Changing the block size drops every cached block of the device, so it
+// fails while any of them is held or still being read
+int bcache_set_block_size(struct block_device* dev, u32 size) {
+    if (size < BLOCK_SECTOR_SIZE || size > BCACHE_MAX_BLOCK_SIZE || (size & (size - 1))) {
+        return BLOCK_ERR_INVALID;
+    }
+    if (size == dev->block_size) {
+        return BLOCK_OK;
+    }
+
+    int status = bcache_sync(dev);
+    if (status != BLOCK_OK) {
+        return status;
+    }
+    for (u32 i = 0; i < BCACHE_BUFFERS; i++) {
+        struct bcache_buffer* buffer = &bcache_buffers[i];
+        if (buffer->dev == dev && (buffer->refcount || (buffer->flags & BCACHE_LOCKED))) {
+            return BLOCK_ERR_INVALID;
+        }
+    }
+    for (u32 i = 0; i < BCACHE_BUFFERS; i++) {
+        if (bcache_buffers[i].dev == dev) {
+            bcache_hash_remove(&bcache_buffers[i]);
+        }
+    }
+
+    dev->block_size = size;
+    dev->last_block = (u64)-1;
+    dev->readahead_window = 0;
+    return BLOCK_OK;
+}
+
+// Completion of a prefetch, possibly in interrupt context: only this
+// buffer's flags change here
+static void bcache_readahead_done(struct block_request* req, int status) {
+    struct bcache_buffer* buffer = (struct bcache_buffer*)req->context;
+    if (status == BLOCK_OK) {
+        buffer->dev->sectors_read += req->count;
+        buffer->flags = (buffer->flags & ~BCACHE_LOCKED) | BCACHE_VALID;
+    } else {
+        bcache_stats.io_errors++;
+        buffer->flags &= ~(BCACHE_LOCKED | BCACHE_READAHEAD);
+    }
+}
+
+static void bcache_prefetch(struct block_device* dev, u64 first, u64 end) {
+    u32 count = bcache_sectors_per_block(dev);
+    u64 blocks = bcache_block_count(dev);
+    if (end > blocks) {
+        end = blocks;
+    }
+
+    for (u64 block = first; block < end; block++) {
+        if (bcache_lookup(dev, block)) continue;
+
+        struct bcache_buffer* buffer = bcache_claim(dev, block);
+        if (!buffer) {
+            return;
+        }
+        buffer->flags = BCACHE_LOCKED | BCACHE_READAHEAD;
+        buffer->request.sector = block * count;
+        buffer->request.count = count;
+        buffer->request.buffer = buffer->data;
+        buffer->request.done = bcache_readahead_done;
+        buffer->request.context = buffer;
+
+        bcache_stats.readahead_issued++;
+        if (dev->ops->read_async(dev, &buffer->request) != BLOCK_OK) {
+            bcache_stats.readahead_issued--;
+            bcache_hash_remove(buffer);
+            return;
+        }
+    }
+}
+
+// Sequential detection: a read of the block after the previous one opens
+// a read-ahead window of BCACHE_READAHEAD_MIN blocks. Each time the reader
+// gets within half a window of the prefetched edge, the window doubles (up
+// to bcache.readahead) and the next stretch is requested asynchronously.
+static void bcache_readahead(struct block_device* dev, u64 block) {
+    if (!dev->ops->read_async || !bcache_readahead_max) {
+        return;
+    }
+    if (block != dev->last_block + 1) {
+        if (block != dev->last_block) {
+            dev->readahead_window = 0;
+        }
+        dev->last_block = block;
+        return;
+    }
+    dev->last_block = block;
+
+    if (dev->readahead_window == 0) {
+        dev->readahead_window = BCACHE_READAHEAD_MIN < bcache_readahead_max ? BCACHE_READAHEAD_MIN : bcache_readahead_max;
+        dev->readahead_next = block + 1;
+    } else if (dev->readahead_next > block + dev->readahead_window / 2) {
+        return;     // Still comfortably inside the prefetched stretch
+    } else if (dev->readahead_window < bcache_readahead_max) {
+        dev->readahead_window *= 2;
+    }
+
+    if (dev->readahead_next <= block) {
+        dev->readahead_next = block + 1;
+    }
+    u64 end = block + 1 + dev->readahead_window;
+    bcache_prefetch(dev, dev->readahead_next, end);
+    dev->readahead_next = end;
+}
+
+static void bcache_wait_unlocked(struct bcache_buffer* buffer) {
+    u32 flags = irq_save();
+    while (buffer->flags & BCACHE_LOCKED) {
+        irq_wait();
+    }
+    irq_restore(flags);
+}
+
+// Return the block held and up to date, or 0 on error
+struct bcache_buffer* bcache_read(struct block_device* dev, u64 block) {
+    u32 count = bcache_sectors_per_block(dev);
+    if (block >= bcache_block_count(dev)) {
+        return 0;
+    }
+
+    bcache_stats.lookups++;
+    struct bcache_buffer* buffer = bcache_lookup(dev, block);
+    if (buffer && (buffer->flags & BCACHE_LOCKED)) {
+        bcache_stats.readahead_waits++;
+        bcache_wait_unlocked(buffer);
+    }
+
+    if (buffer && (buffer->flags & BCACHE_VALID)) {
+        bcache_stats.hits++;
+        if (buffer->flags & BCACHE_READAHEAD) {
+            bcache_stats.readahead_hits++;
+            buffer->flags &= ~BCACHE_READAHEAD;
+        }
+    } else {
+        bcache_stats.misses++;
+        if (!buffer) {
+            buffer = bcache_claim(dev, block);
+            if (!buffer) {
+                return 0;
+            }
+        }
+        if (block_read(dev, block * count, count, buffer->data) != BLOCK_OK) {
+            bcache_stats.io_errors++;
+            if (!buffer->refcount) {
+                bcache_hash_remove(buffer);
+            }
+            return 0;
+        }
+        buffer->flags |= BCACHE_VALID;
+    }
+
+    buffer->refcount++;
+    bcache_touch(buffer);
+    bcache_readahead(dev, block);
+    return buffer;
+}
+
+// Return the block held without reading it, for callers that overwrite
+// it completely and then mark it dirty
+struct bcache_buffer* bcache_get(struct block_device* dev, u64 block) {
+    if (block >= bcache_block_count(dev)) {
+        return 0;
+    }
+    struct bcache_buffer* buffer = bcache_lookup(dev, block);
+    if (buffer) {
+        bcache_wait_unlocked(buffer);
+    } else {
+        buffer = bcache_claim(dev, block);
+        if (!buffer) {
+            return 0;
+        }
+    }
+    buffer->refcount++;
+    bcache_touch(buffer);
+    return buffer;
+}
+
+void bcache_release(struct bcache_buffer* buffer) {
+    if (buffer && buffer->refcount) {
+        buffer->refcount--;
+    }
+}
+
+void bcache_mark_dirty(struct bcache_buffer* buffer) {
+    buffer->flags |= BCACHE_VALID | BCACHE_DIRTY;
+}
+
+// Write back dirty buffers of one device, or of every device when dev is 0
+int bcache_sync(struct block_device* dev) {
+    int result = BLOCK_OK;
+    for (u32 i = 0; i < BCACHE_BUFFERS; i++) {
+        struct bcache_buffer* buffer = &bcache_buffers[i];
+        if (!buffer->dev || !(buffer->flags & BCACHE_DIRTY)) continue;
+        if (dev && buffer->dev != dev) continue;
+
+        int status = bcache_write_back(buffer);
+        if (status != BLOCK_OK && result == BLOCK_OK) {
+            result = status;
+        }
+    }
+    return result;
+}
+
+const struct bcache_stats* bcache_get_stats(void) {
+    return &bcache_stats;
+}
+
+// Count buffers in use whose flags include all of the given ones
+u32 bcache_count_buffers(u32 flags) {
+    u32 count = 0;
+    for (u32 i = 0; i < BCACHE_BUFFERS; i++) {
+        if (bcache_buffers[i].dev && (bcache_buffers[i].flags & flags) == flags) {
+            count++;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,109 @@
+#include "boot.h"
+#include "cpu.h"
+
+// Phase timeline, stamped with the raw TSC and converted only when shown
+static u64 boot_start_tsc = 0;
+static struct boot_mark boot_marks[BOOT_MAX_MARKS];
+static u32 boot_mark_count = 0;
+
+// Written by the decompressor stub through its address in the kernel's
+// symbol table, so not static. It is in .bss, which warm restarts clear.
+struct boot_unpack boot_unpack;
+
+// Initcalls in registration order, which is also dependency order
+static struct boot_initcall boot_initcalls[BOOT_MAX_INITCALLS];
+static u32 boot_initcall_count = 0;
+
+void boot_start(void) {
+    boot_start_tsc = rdtsc();
+    boot_mark_count = 0;
+    boot_initcall_count = 0;
+}
+
+void boot_mark(const char* name) {
+    if (boot_mark_count < BOOT_MAX_MARKS) {
+        boot_marks[boot_mark_count].name = name;
+        boot_marks[boot_mark_count].tsc = rdtsc();
+        boot_mark_count++;
+    }
+}
+
+u64 boot_get_start(void) {
+    return boot_start_tsc;
+}
+
+// Only set when this boot went through the compressed image's stub
+const struct boot_unpack* boot_get_unpack(void) {
+    return boot_unpack.magic == BOOT_UNPACK_MAGIC ? &boot_unpack : 0;
+}
+
+u32 boot_get_mark_count(void) {
+    return boot_mark_count;
+}
+
+const struct boot_mark* boot_get_mark(u32 index) {
+    return index < boot_mark_count ? &boot_marks[index] : 0;
+}
+
+bool boot_initcall(const char* name, boot_initcall_t function, u32 level) {
+    if (boot_initcall_count == BOOT_MAX_INITCALLS) {
+        return false;
+    }
+    struct boot_initcall* call = &boot_initcalls[boot_initcall_count++];
+    call->name = name;
+    call->function = function;
+    call->level = level;
+    call->state = BOOT_INIT_PENDING;
+    call->on_demand = false;
+    call->start = 0;
+    call->end = 0;
+    return true;
+}
+
+static bool boot_run(struct boot_initcall* call, bool on_demand) {
+    call->state = BOOT_INIT_RUNNING;
+    call->on_demand = on_demand;
+    call->start = rdtsc();
+    bool ok = call->function();
+    call->end = rdtsc();
+    call->state = ok ? BOOT_INIT_DONE : BOOT_INIT_FAILED;
+    return ok;
+}
+
+// Run the next pending deferred initcall. Called from the idle loop, so
+// each step is one initcall and input stays responsive in between.
+bool boot_run_deferred(void) {
+    for (u32 i = 0; i < boot_initcall_count; i++) {
+        struct boot_initcall* call = &boot_initcalls[i];
+        if (call->state == BOOT_INIT_PENDING && call->level == BOOT_INIT_DEFERRED) {
+            boot_run(call, false);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Make sure an initcall has run, first running the deferred initcalls
+// registered before it (lazy ones only run when named). Returns whether
+// it succeeded.
+bool boot_require(const char* name) {
+    for (u32 i = 0; i < boot_initcall_count; i++) {
+        struct boot_initcall* call = &boot_initcalls[i];
+        bool target = strcmp(call->name, name) == 0;
+        if (call->state == BOOT_INIT_PENDING && (target || call->level == BOOT_INIT_DEFERRED)) {
+            boot_run(call, true);
+        }
+        if (target) {
+            return call->state == BOOT_INIT_DONE;
+        }
+    }
+    return false;
+}
+
+u32 boot_get_initcall_count(void) {
+    return boot_initcall_count;
+}
+
+const struct boot_initcall* boot_get_initcall(u32 index) {
+    return index < boot_initcall_count ? &boot_initcalls[index] : 0;
+}
@@ -0,0 +1,129 @@
+#include "cpustat.h"
+#include "cpu.h"
+#include "irqtrace.h"
+#include "timer.h"
+
+// Running totals; the elapsed time since cpustat_last belongs to
+// cpustat_current, and in interrupt context also to cpustat_source, the
+// innermost of possibly nested handlers
+static u32 cpustat_current = CPUSTAT_COMMAND;
+static u32 cpustat_source = CPUSTAT_SOURCES;
+static u64 cpustat_last = 0;
+static struct cpustat_sample cpustat_totals;
+
+// Ring of window samples
+static struct cpustat_sample cpustat_samples[CPUSTAT_WINDOWS];
+static u32 cpustat_sample_count = 0;
+static u32 cpustat_ticks = 0;
+static u32 cpustat_window = 0;         // In ticks, set on the first tick
+
+static const char* cpustat_names[CPUSTAT_CONTEXTS] = {"idle", "irq", "deferred", "command"};
+
+void cpustat_initialize(void) {
+    memset(&cpustat_totals, 0, sizeof(cpustat_totals));
+    cpustat_sample_count = 0;
+    cpustat_ticks = 0;
+    cpustat_window = 0;
+    cpustat_current = CPUSTAT_COMMAND;
+    cpustat_source = CPUSTAT_SOURCES;
+    cpustat_last = rdtsc();
+}
+
+// Charge the time since the last transition to the current context
+static u64 cpustat_charge(void) {
+    u64 now = rdtsc();
+    cpustat_totals.contexts[cpustat_current] += now - cpustat_last;
+    if (cpustat_current == CPUSTAT_IRQ && cpustat_source < CPUSTAT_SOURCES) {
+        cpustat_totals.sources[cpustat_source] += now - cpustat_last;
+    }
+    cpustat_last = now;
+    return now;
+}
+
+// Switch contexts, returning the one to go back to
+u32 cpustat_enter(u32 context) {
+    u32 flags = irq_save();
+    cpustat_charge();
+    u32 previous = cpustat_current;
+    cpustat_current = context;
+    irq_restore(flags);
+    return previous;
+}
+
+// Enter a handler for source from an interrupt gate (interrupts off). The
+// context and source to go back to are packed into the return value, as
+// the handler may have preempted another.
+__hot u32 cpustat_irq_enter(u32 source) {
+    cpustat_charge();
+    u32 previous = cpustat_current | (cpustat_source << 8);
+    cpustat_current = CPUSTAT_IRQ;
+    cpustat_source = source;
+    return previous;
+}
+
+// Leave the handler, with interrupts off again
+__hot void cpustat_irq_exit(u32 previous) {
+    cpustat_charge();
+    cpustat_current = previous & 0xFF;
+    cpustat_source = previous >> 8;
+}
+
+// Timer ticks per window, whatever rate timer.hz set
+u32 cpustat_window_ticks(void) {
+    u32 ticks = timer_get_frequency() * CPUSTAT_WINDOW_MS / 1000;
+    return ticks ? ticks : 1;
+}
+
+// Called from the timer interrupt: close a window every
+// cpustat_window_ticks() ticks
+void cpustat_tick(void) {
+    if (!cpustat_window) {
+        cpustat_window = cpustat_window_ticks();
+    }
+    if (++cpustat_ticks < cpustat_window) {
+        return;
+    }
+    cpustat_ticks = 0;
+    cpustat_totals.tsc = cpustat_charge();
+    cpustat_samples[cpustat_sample_count % CPUSTAT_WINDOWS] = cpustat_totals;
+    cpustat_sample_count++;
+}
+
+// Halt until the next interrupt with the wait charged as idle. Called with
+// interrupts disabled after the caller's last check for work, so a wakeup
+// that arrives in between still ends the halt; returns with them disabled.
+void cpustat_halt(void) {
+    u32 previous = cpustat_enter(CPUSTAT_IDLE);
+    irq_wait();
+    cpustat_enter(previous);
+}
+
+// Usage over the last windows (at most CPUSTAT_WINDOWS - 1). Returns false
+// until a full window has been sampled.
+bool cpustat_get_usage(u32 windows, struct cpustat_usage* usage) {
+    u32 flags = irq_save();
+    u32 count = cpustat_sample_count;
+    if (count < 2) {
+        irq_restore(flags);
+        return false;
+    }
+    if (windows > count - 1) windows = count - 1;
+    if (windows > CPUSTAT_WINDOWS - 1) windows = CPUSTAT_WINDOWS - 1;
+    const struct cpustat_sample* last = &cpustat_samples[(count - 1) % CPUSTAT_WINDOWS];
+    const struct cpustat_sample* first = &cpustat_samples[(count - 1 - windows) % CPUSTAT_WINDOWS];
+
+    usage->total = last->tsc - first->tsc;
+    usage->windows = windows;
+    for (u32 i = 0; i < CPUSTAT_CONTEXTS; i++) {
+        usage->contexts[i] = last->contexts[i] - first->contexts[i];
+    }
+    for (u32 i = 0; i < CPUSTAT_SOURCES; i++) {
+        usage->sources[i] = last->sources[i] - first->sources[i];
+    }
+    irq_restore(flags);
+    return true;
+}
+
+const char* cpustat_context_name(u32 context) {
+    return context < CPUSTAT_CONTEXTS ? cpustat_names[context] : "?";
+}
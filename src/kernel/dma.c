@@ -0,0 +1,222 @@
+#include "dma.h"
+#include "pmm.h"
+#include "paging.h"
+#include "tunable.h"
+#include "irqtrace.h"
+
+// The pool is one physically contiguous run of frames. It happens to sit
+// in the identity map, but drivers ask dma_virt_to_phys for bus addresses
+// rather than casting pointers, so nothing else depends on that.
+static u8* dma_base = 0;
+static u32 dma_phys = 0;
+static u32 dma_pages = 0;
+
+// One bit per pool page, set when the page is allocated; pages carved
+// into size class objects record their class + 1
+static u32 dma_bitmap[DMA_POOL_MAX / PAGE_SIZE / 32];
+static u8 dma_page_class[DMA_POOL_MAX / PAGE_SIZE];
+
+// Free objects of each size class, linked through their first word
+static void* dma_free_lists[DMA_CLASSES];
+
+static struct dma_stats dma_stats;
+
+// Both fixed once the pool is reserved
+static struct tunable dma_pool_tunable = {
+    .name = "dma.pool",
+    .description = "DMA pool size reserved at boot",
+    .unit = "MiB",
+    .type = TUNABLE_U32,
+    .fallback = DMA_POOL_SIZE >> 20,
+    .min = 1,
+    .max = DMA_POOL_MAX >> 20,
+};
+
+static struct tunable dma_limit_tunable = {
+    .name = "dma.limit",
+    .description = "Physical address the DMA pool must end below",
+    .unit = "MiB",
+    .type = TUNABLE_U32,
+    .fallback = DMA_POOL_LIMIT >> 20,
+    .min = 1,
+    .max = 4095,
+};
+
+// Reserve the pool from the frame allocator. Called once paging is up and
+// before any driver initializes.
+bool dma_initialize(void) {
+    dma_base = 0;
+    dma_phys = 0;
+    dma_pages = 0;
+    memset(dma_bitmap, 0, sizeof(dma_bitmap));
+    memset(dma_page_class, 0, sizeof(dma_page_class));
+    memset(dma_free_lists, 0, sizeof(dma_free_lists));
+    memset(&dma_stats, 0, sizeof(dma_stats));
+    for (u32 i = 0; i < DMA_CLASSES; i++) {
+        dma_stats.classes[i].size = DMA_CLASS_MIN << i;
+    }
+
+    u32 size = tunable_register(&dma_pool_tunable) << 20;
+    u32 limit = tunable_register(&dma_limit_tunable) << 20;
+    dma_stats.limit = limit;
+
+    // Settle for a smaller pool rather than none when memory below the
+    // limit is short
+    for (; size >= DMA_POOL_MIN; size >>= 1) {
+        dma_phys = pmm_alloc_range(size / PAGE_SIZE, limit);
+        if (dma_phys) break;
+    }
+    if (!dma_phys) {
+        return false;
+    }
+    dma_base = (u8*)(uptr)dma_phys;
+    dma_pages = size / PAGE_SIZE;
+    dma_stats.base = dma_phys;
+    dma_stats.pages = dma_pages;
+    return true;
+}
+
+static inline bool dma_page_used(u32 page) {
+    return (dma_bitmap[page / 32] >> (page % 32)) & 1;
+}
+
+static void dma_mark_pages(u32 first, u32 count, bool used) {
+    for (u32 page = first; page < first + count; page++) {
+        if (used) {
+            dma_bitmap[page / 32] |= 1u << (page % 32);
+        } else {
+            dma_bitmap[page / 32] &= ~(1u << (page % 32));
+        }
+    }
+    if (used) {
+        dma_stats.pages_used += count;
+        if (dma_stats.pages_used > dma_stats.pages_peak) {
+            dma_stats.pages_peak = dma_stats.pages_used;
+        }
+    } else {
+        dma_stats.pages_used -= count;
+    }
+}
+
+// First fit for count pages whose physical start is a multiple of align
+// (a power of two, at least a page)
+static void* dma_alloc_pages(u32 count, u32 align) {
+    u32 step = align / PAGE_SIZE;
+    u32 page = (((dma_phys + align - 1) & ~(align - 1)) - dma_phys) / PAGE_SIZE;
+    while (page + count <= dma_pages) {
+        u32 busy = page;
+        while (busy < page + count && !dma_page_used(busy)) {
+            busy++;
+        }
+        if (busy == page + count) {
+            dma_mark_pages(page, count, true);
+            return dma_base + page * PAGE_SIZE;
+        }
+        // Resume at the first aligned start past the page in use
+        page += ((busy - page) / step + 1) * step;
+    }
+    return 0;
+}
+
+// Carve a fresh page into objects of one class. Class pages stay with
+// their class once carved.
+static bool dma_refill(u32 class) {
+    u8* page = dma_alloc_pages(1, PAGE_SIZE);
+    if (!page) {
+        return false;
+    }
+    struct dma_class_stats* stats = &dma_stats.classes[class];
+    dma_page_class[(page - dma_base) / PAGE_SIZE] = (u8)(class + 1);
+    dma_stats.class_pages++;
+    for (u32 offset = 0; offset < PAGE_SIZE; offset += stats->size) {
+        *(void**)(page + offset) = dma_free_lists[class];
+        dma_free_lists[class] = page + offset;
+        stats->objects++;
+    }
+    return true;
+}
+
+// Zeroed, physically contiguous memory aligned to align (a power of two,
+// or 0 for the natural alignment of its size class or a page)
+void* dma_alloc(u32 size, u32 align) {
+    if (size == 0 || size > dma_pages * PAGE_SIZE || (align & (align - 1))) {
+        return 0;
+    }
+
+    u32 flags = irq_save();
+    void* ptr = 0;
+    u32 want = size > align ? size : align;
+    if (want <= DMA_CLASS_MAX) {
+        u32 class = 0;
+        while ((u32)(DMA_CLASS_MIN << class) < want) {
+            class++;
+        }
+        if (dma_free_lists[class] || dma_refill(class)) {
+            ptr = dma_free_lists[class];
+            dma_free_lists[class] = *(void**)ptr;
+            dma_stats.classes[class].in_use++;
+            dma_stats.classes[class].allocs++;
+        }
+    } else {
+        ptr = dma_alloc_pages(PAGE_ALIGN_UP(size) / PAGE_SIZE, align > PAGE_SIZE ? align : PAGE_SIZE);
+        if (ptr) {
+            dma_stats.page_allocs++;
+        }
+    }
+    if (!ptr) {
+        dma_stats.failures++;
+    }
+    irq_restore(flags);
+
+    if (ptr) {
+        memset(ptr, 0, size);
+    }
+    return ptr;
+}
+
+// size must be the size passed to dma_alloc
+void dma_free(void* ptr, u32 size) {
+    if (!ptr || !dma_owns(ptr)) {
+        return;
+    }
+    u32 page = ((u8*)ptr - dma_base) / PAGE_SIZE;
+
+    u32 flags = irq_save();
+    if (dma_page_class[page]) {
+        u32 class = dma_page_class[page] - 1;
+        *(void**)ptr = dma_free_lists[class];
+        dma_free_lists[class] = ptr;
+        dma_stats.classes[class].in_use--;
+        dma_stats.classes[class].frees++;
+    } else {
+        dma_mark_pages(page, PAGE_ALIGN_UP(size) / PAGE_SIZE, false);
+        dma_stats.page_frees++;
+    }
+    irq_restore(flags);
+}
+
+bool dma_owns(const void* ptr) {
+    return (const u8*)ptr >= dma_base && (const u8*)ptr < dma_base + dma_pages * PAGE_SIZE;
+}
+
+// Bus address of a kernel pointer, or 0 if it is not mapped. Outside the
+// pool a buffer is only contiguous past its first page if it lies in the
+// identity map.
+u32 dma_virt_to_phys(const void* ptr) {
+    u32 virt = (uptr)ptr;
+    if (dma_owns(ptr)) {
+        return dma_phys + (virt - (uptr)dma_base);
+    }
+    u32 entry = paging_get_entry(virt);
+    if (!(entry & PAGE_PRESENT)) {
+        return 0;
+    }
+    if (entry & PAGE_LARGE) {
+        return (entry & ~(LARGE_PAGE_SIZE - 1)) | (virt & (LARGE_PAGE_SIZE - 1));
+    }
+    return (entry & PAGE_MASK) | (virt & ~PAGE_MASK);
+}
+
+const struct dma_stats* dma_get_stats(void) {
+    return &dma_stats;
+}
@@ -0,0 +1,258 @@
+#include "elf.h"
+#include "pmm.h"
+#include "multiboot.h"
+#include "syscall.h"
+#include "idt.h"
+#include "cpu.h"
+#include "irqtrace.h"
+
+// Program currently running in user space. Nothing is mapped up front:
+// every page of a segment or of the stack is resolved on its first fault.
+static struct elf_segment elf_segments[ELF_MAX_SEGMENTS];
+static u32 elf_segment_count = 0;
+static u32 elf_module_start = 0;
+static u32 elf_module_size = 0;
+static bool elf_active = false;
+static struct elf_exec_stats elf_stats;
+
+static const char* elf_errors[] = {
+    "Success",
+    "Module not found",
+    "Not a valid i386 ELF executable",
+    "Invalid program segment layout",
+    "Out of memory",
+};
+
+static u32 elf_alloc_zeroed(void) {
+    u32 frame = pmm_alloc_frame();
+    if (frame) {
+        memset((void*)frame, 0, PAGE_SIZE);
+    }
+    return frame;
+}
+
+// Read-only pages whose contents lie entirely in the module are mapped
+// straight from module memory. Writable pages, pages shared by several
+// segments and pages ending in .bss get a private frame.
+static bool elf_can_share(const struct elf_segment* segment, u32 page) {
+    if (segment->flags & PF_W) return false;
+    if (elf_module_start % PAGE_SIZE) return false;
+    if ((segment->vaddr - segment->offset) % PAGE_SIZE) return false;
+
+    u32 file_offset = segment->offset + (page - segment->vaddr);
+    if (file_offset + PAGE_SIZE > elf_module_size) return false;
+
+    return page + PAGE_SIZE <= segment->vaddr + segment->filesz ||
+           segment->filesz == segment->memsz;
+}
+
+static bool elf_map_private(u32 page, u32 frame, u32 flags) {
+    if (!paging_map_page(page, frame, flags | PAGE_USER | PAGE_OWNED)) {
+        pmm_free_frame(frame);
+        return false;
+    }
+    return true;
+}
+
+static bool elf_resolve(u32 page) {
+    const struct elf_segment* overlap = 0;
+    u32 overlaps = 0;
+    u32 flags = 0;
+
+    for (u32 i = 0; i < elf_segment_count; i++) {
+        const struct elf_segment* segment = &elf_segments[i];
+        if (page + PAGE_SIZE <= segment->vaddr || page >= segment->vaddr + segment->memsz) continue;
+        overlap = segment;
+        overlaps++;
+        if (segment->flags & PF_W) flags |= PAGE_WRITE;
+    }
+
+    if (overlaps == 0) {
+        // Anonymous stack pages
+        if (page < ELF_STACK_TOP - ELF_STACK_SIZE || page >= ELF_STACK_TOP) {
+            return false;
+        }
+        u32 frame = elf_alloc_zeroed();
+        if (!frame) return false;
+        elf_stats.zero_pages++;
+        return elf_map_private(page, frame, PAGE_WRITE);
+    }
+
+    if (overlaps == 1 && elf_can_share(overlap, page)) {
+        u32 file_offset = overlap->offset + (page - overlap->vaddr);
+        elf_stats.zero_copy_pages++;
+        return paging_map_page(page, elf_module_start + file_offset, PAGE_USER);
+    }
+
+    u32 frame = elf_alloc_zeroed();
+    if (!frame) return false;
+
+    // Copy the file-backed bytes of every segment touching this page
+    bool copied = false;
+    for (u32 i = 0; i < elf_segment_count; i++) {
+        const struct elf_segment* segment = &elf_segments[i];
+        u32 start = page > segment->vaddr ? page : segment->vaddr;
+        u32 end = segment->vaddr + segment->filesz;
+        if (end > page + PAGE_SIZE) end = page + PAGE_SIZE;
+        if (start >= end) continue;
+
+        memcpy((void*)(frame + (start - page)),
+               (const void*)(elf_module_start + segment->offset + (start - segment->vaddr)),
+               end - start);
+        copied = true;
+    }
+
+    if (copied) {
+        elf_stats.copied_pages++;
+    } else {
+        elf_stats.zero_pages++;
+    }
+    return elf_map_private(page, frame, flags);
+}
+
+static bool elf_page_fault(struct interrupt_context* ctx) {
+    u32 addr = paging_read_cr2();
+
+    if (!elf_active || addr < USER_SPACE_START || addr >= USER_SPACE_END) {
+        return false;
+    }
+    if (ctx->err_code & PAGE_FAULT_PRESENT) {
+        return false;   // Protection violation, not a missing page
+    }
+    if (!elf_resolve(PAGE_ALIGN_DOWN(addr))) {
+        return false;
+    }
+
+    elf_stats.faults++;
+    return true;
+}
+
+void elf_initialize(void) {
+    idt_install_exception_handler(14, elf_page_fault);
+}
+
+static int elf_load_segments(const struct elf_header* header, u32 size) {
+    if (size < sizeof(struct elf_header) ||
+        header->e_magic != ELF_MAGIC ||
+        header->e_class != ELFCLASS32 ||
+        header->e_data != ELFDATA2LSB ||
+        header->e_type != ET_EXEC ||
+        header->e_machine != EM_386 ||
+        header->e_phentsize != sizeof(struct elf_program_header) ||
+        header->e_phoff > size ||
+        header->e_phnum > (size - header->e_phoff) / sizeof(struct elf_program_header)) {
+        return ELF_ERR_FORMAT;
+    }
+
+    const struct elf_program_header* phdrs =
+        (const struct elf_program_header*)((u32)header + header->e_phoff);
+
+    elf_segment_count = 0;
+    for (u32 i = 0; i < header->e_phnum; i++) {
+        const struct elf_program_header* phdr = &phdrs[i];
+        if (phdr->p_type != PT_LOAD || phdr->p_memsz == 0) continue;
+
+        if (elf_segment_count == ELF_MAX_SEGMENTS ||
+            phdr->p_filesz > phdr->p_memsz ||
+            phdr->p_offset > size ||
+            phdr->p_filesz > size - phdr->p_offset ||
+            phdr->p_vaddr < USER_SPACE_START ||
+            phdr->p_memsz > ELF_STACK_TOP - ELF_STACK_SIZE - phdr->p_vaddr) {
+            return ELF_ERR_SEGMENT;
+        }
+
+        struct elf_segment* segment = &elf_segments[elf_segment_count++];
+        segment->vaddr = phdr->p_vaddr;
+        segment->memsz = phdr->p_memsz;
+        segment->filesz = phdr->p_filesz;
+        segment->offset = phdr->p_offset;
+        segment->flags = phdr->p_flags;
+        elf_stats.mapped_size += phdr->p_memsz;
+    }
+
+    return elf_segment_count ? ELF_OK : ELF_ERR_SEGMENT;
+}
+
+// Build the initial stack: argc, argv[], NULL, envp NULL, then the strings
+static u32 elf_setup_stack(int argc, char* argv[]) {
+    u32 top = ELF_STACK_TOP;
+    u32 arg_ptrs[ELF_MAX_ARGS];
+    int count = 0;
+
+    if (!elf_resolve(top - PAGE_SIZE)) {
+        return 0;
+    }
+
+    u32 sp = top;
+    for (int i = 0; i < argc && count < ELF_MAX_ARGS; i++) {
+        u32 len = strlen(argv[i]) + 1;
+        if (sp - len < top - PAGE_SIZE / 2) break;  // Leave room for the pointers
+        sp -= len;
+        memcpy((void*)sp, argv[i], len);
+        arg_ptrs[count++] = sp;
+    }
+
+    sp &= ~3;
+    sp -= 4; *(u32*)sp = 0;     // End of envp
+    sp -= 4; *(u32*)sp = 0;     // End of argv
+    for (int i = count - 1; i >= 0; i--) {
+        sp -= 4;
+        *(u32*)sp = arg_ptrs[i];
+    }
+    sp -= 4; *(u32*)sp = count;
+    return sp;
+}
+
+int elf_exec(const char* module_name, int argc, char* argv[], u32* exit_code) {
+    u64 start = rdtsc();
+
+    const struct multiboot_module* module = multiboot_find_module(module_name);
+    if (!module) {
+        return ELF_ERR_NOT_FOUND;
+    }
+    if (module->end > PAGING_IDENTITY_LIMIT || module->end < module->start) {
+        return ELF_ERR_FORMAT;
+    }
+
+    memset(&elf_stats, 0, sizeof(elf_stats));
+    elf_stats.file_size = module->end - module->start;
+
+    const struct elf_header* header = (const struct elf_header*)module->start;
+    int status = elf_load_segments(header, elf_stats.file_size);
+    if (status != ELF_OK) {
+        elf_segment_count = 0;
+        return status;
+    }
+
+    elf_module_start = module->start;
+    elf_module_size = elf_stats.file_size;
+    elf_active = true;
+
+    u32 sp = elf_setup_stack(argc, argv);
+    if (sp) {
+        elf_stats.startup_cycles = rdtsc() - start;
+        u64 run_start = rdtsc();
+        // A fault exits from an interrupt gate: come back with the
+        // caller's interrupt state, closing any irqsoff window it opened
+        u32 flags = irq_flags();
+        *exit_code = user_enter(header->e_entry, sp);
+        irq_restore(flags);
+        elf_stats.run_cycles = rdtsc() - run_start;
+    }
+
+    elf_active = false;
+    elf_segment_count = 0;
+    paging_unmap_user();
+    return sp ? ELF_OK : ELF_ERR_NO_MEMORY;
+}
+
+const struct elf_exec_stats* elf_get_stats(void) {
+    return &elf_stats;
+}
+
+const char* elf_strerror(int status) {
+    if (status < 0 || status > ELF_ERR_NO_MEMORY) {
+        return "Unknown error";
+    }
+    return elf_errors[status];
+}
\ No newline at end of file
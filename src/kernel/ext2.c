@@ -0,0 +1,576 @@
+#include "ext2.h"
+
+// Shared LRU link; the caches embed it as their first member so a list
+// node converts straight back to its entry
+struct ext2_lru {
+    struct ext2_lru* prev;
+    struct ext2_lru* next;
+};
+
+struct ext2_icache_entry {
+    struct ext2_lru lru;
+    u32 ino;                    // 0 when unused
+    struct ext2_inode inode;
+    struct ext2_icache_entry* hash_next;
+};
+
+// A dentry maps (parent, name) to an inode; ino 0 records a name that
+// does not exist, so repeated misses are answered from the cache too
+struct ext2_dcache_entry {
+    struct ext2_lru lru;
+    bool used;
+    u32 parent;
+    u32 ino;
+    u32 hash;
+    u8 length;
+    char name[EXT2_DCACHE_NAME_MAX];
+    struct ext2_dcache_entry* hash_next;
+};
+
+// Mounted filesystem (one at a time)
+static struct block_device* ext2_device = 0;
+static struct ext2_superblock ext2_super;
+static u32 ext2_block_size = 0;
+static u32 ext2_block_shift = 0;
+static u32 ext2_inode_size = 0;
+static u32 ext2_group_count = 0;
+
+static struct ext2_icache_entry ext2_icache[EXT2_ICACHE_SIZE];
+static struct ext2_icache_entry* ext2_icache_hash[EXT2_ICACHE_HASH];
+static struct ext2_lru ext2_icache_lru;
+static struct ext2_dcache_entry ext2_dcache[EXT2_DCACHE_SIZE];
+static struct ext2_dcache_entry* ext2_dcache_hash[EXT2_DCACHE_HASH];
+static struct ext2_lru ext2_dcache_lru;
+static struct ext2_stats ext2_stats;
+
+static const char* ext2_errors[] = {
+    "Success",
+    "No filesystem mounted",
+    "Not an ext2 filesystem",
+    "Unsupported filesystem features",
+    "No such file or directory",
+    "Not a directory",
+    "Is a directory",
+    "Invalid argument",
+    "I/O error",
+};
+
+// LRU lists run from the sentinel's next (most recent) to its prev
+static void ext2_lru_init(struct ext2_lru* head) {
+    head->prev = head;
+    head->next = head;
+}
+
+static void ext2_lru_remove(struct ext2_lru* node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+}
+
+static void ext2_lru_push(struct ext2_lru* head, struct ext2_lru* node) {
+    node->next = head->next;
+    node->prev = head;
+    head->next->prev = node;
+    head->next = node;
+}
+
+static void ext2_lru_touch(struct ext2_lru* head, struct ext2_lru* node) {
+    ext2_lru_remove(node);
+    ext2_lru_push(head, node);
+}
+
+// FNV-1a over the name, seeded with the parent inode
+static u32 ext2_name_hash(u32 parent, const char* name, u32 length) {
+    u32 hash = 2166136261u ^ parent;
+    for (u32 i = 0; i < length; i++) {
+        hash ^= (u8)name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static int ext2_block_status(int status) {
+    return status == BLOCK_OK ? EXT2_OK : EXT2_ERR_IO;
+}
+
+static int ext2_read_block(u32 block, u32 offset, void* out, u32 length) {
+    if (block >= ext2_super.blocks_count) {
+        return EXT2_ERR_BAD_FS;
+    }
+    struct bcache_buffer* buffer = bcache_read(ext2_device, block);
+    if (!buffer) {
+        return EXT2_ERR_IO;
+    }
+    memcpy(out, buffer->data + offset, length);
+    bcache_release(buffer);
+    return EXT2_OK;
+}
+
+static void ext2_icache_clear(void) {
+    memset(ext2_icache, 0, sizeof(ext2_icache));
+    memset(ext2_icache_hash, 0, sizeof(ext2_icache_hash));
+    ext2_lru_init(&ext2_icache_lru);
+    for (u32 i = 0; i < EXT2_ICACHE_SIZE; i++) {
+        ext2_lru_push(&ext2_icache_lru, &ext2_icache[i].lru);
+    }
+}
+
+static void ext2_dcache_clear(void) {
+    memset(ext2_dcache, 0, sizeof(ext2_dcache));
+    memset(ext2_dcache_hash, 0, sizeof(ext2_dcache_hash));
+    ext2_lru_init(&ext2_dcache_lru);
+    for (u32 i = 0; i < EXT2_DCACHE_SIZE; i++) {
+        ext2_lru_push(&ext2_dcache_lru, &ext2_dcache[i].lru);
+    }
+}
+
+static struct ext2_icache_entry** ext2_icache_slot(u32 ino) {
+    return &ext2_icache_hash[((ino * 2654435761u) >> 16) & (EXT2_ICACHE_HASH - 1)];
+}
+
+static void ext2_icache_insert(u32 ino, const struct ext2_inode* inode) {
+    struct ext2_icache_entry* entry = (struct ext2_icache_entry*)ext2_icache_lru.prev;
+    if (entry->ino) {
+        struct ext2_icache_entry** link = ext2_icache_slot(entry->ino);
+        while (*link != entry) {
+            link = &(*link)->hash_next;
+        }
+        *link = entry->hash_next;
+    }
+
+    entry->ino = ino;
+    entry->inode = *inode;
+    struct ext2_icache_entry** slot = ext2_icache_slot(ino);
+    entry->hash_next = *slot;
+    *slot = entry;
+    ext2_lru_touch(&ext2_icache_lru, &entry->lru);
+}
+
+int ext2_get_inode(u32 ino, struct ext2_inode* inode) {
+    if (!ext2_device) {
+        return EXT2_ERR_NOT_MOUNTED;
+    }
+    if (ino == 0 || ino > ext2_super.inodes_count) {
+        return EXT2_ERR_INVALID;
+    }
+
+    ext2_stats.inode_lookups++;
+    for (struct ext2_icache_entry* entry = *ext2_icache_slot(ino); entry; entry = entry->hash_next) {
+        if (entry->ino == ino) {
+            ext2_stats.inode_hits++;
+            *inode = entry->inode;
+            ext2_lru_touch(&ext2_icache_lru, &entry->lru);
+            return EXT2_OK;
+        }
+    }
+
+    u32 group = (ino - 1) / ext2_super.inodes_per_group;
+    u32 index = (ino - 1) % ext2_super.inodes_per_group;
+    if (group >= ext2_group_count) {
+        return EXT2_ERR_BAD_FS;
+    }
+
+    // Group descriptors start in the block after the superblock
+    struct ext2_group_desc desc;
+    u32 desc_offset = group * sizeof(struct ext2_group_desc);
+    int status = ext2_read_block(ext2_super.first_data_block + 1 + (desc_offset >> ext2_block_shift),
+                                 desc_offset & (ext2_block_size - 1), &desc, sizeof(desc));
+    if (status != EXT2_OK) {
+        return status;
+    }
+
+    u32 offset = index * ext2_inode_size;
+    status = ext2_read_block(desc.inode_table + (offset >> ext2_block_shift),
+                             offset & (ext2_block_size - 1), inode, sizeof(*inode));
+    if (status != EXT2_OK) {
+        return status;
+    }
+    ext2_icache_insert(ino, inode);
+    return EXT2_OK;
+}
+
+// Entry index within an indirect block
+static int ext2_indirect(u32 table, u32 index, u32* block) {
+    if (table == 0) {
+        *block = 0;
+        return EXT2_OK;
+    }
+    return ext2_read_block(table, index * sizeof(u32), block, sizeof(u32));
+}
+
+// Map a file block to a filesystem block; 0 means a hole
+static int ext2_bmap(const struct ext2_inode* inode, u32 file_block, u32* block) {
+    u32 shift = ext2_block_shift - 2;      // Block numbers per indirect block
+    u32 per_block = 1u << shift;
+    u32 mask = per_block - 1;
+
+    if (file_block < EXT2_NDIR_BLOCKS) {
+        *block = inode->block[file_block];
+        return EXT2_OK;
+    }
+    file_block -= EXT2_NDIR_BLOCKS;
+    if (file_block < per_block) {
+        return ext2_indirect(inode->block[EXT2_IND_BLOCK], file_block, block);
+    }
+    file_block -= per_block;
+
+    u32 table;
+    int status;
+    if (file_block < (per_block << shift)) {
+        status = ext2_indirect(inode->block[EXT2_DIND_BLOCK], file_block >> shift, &table);
+        return status != EXT2_OK ? status : ext2_indirect(table, file_block & mask, block);
+    }
+    file_block -= per_block << shift;
+
+    status = ext2_indirect(inode->block[EXT2_TIND_BLOCK], file_block >> (shift * 2), &table);
+    if (status == EXT2_OK) {
+        status = ext2_indirect(table, (file_block >> shift) & mask, &table);
+    }
+    return status != EXT2_OK ? status : ext2_indirect(table, file_block & mask, block);
+}
+
+static bool ext2_is_dir(const struct ext2_inode* inode) {
+    return (inode->mode & EXT2_S_IFMT) == EXT2_S_IFDIR;
+}
+
+// Search one directory for a name by reading it block by block
+static int ext2_find_entry(const struct ext2_inode* dir, const char* name, u32 length, u32* ino) {
+    ext2_stats.dir_scans++;
+    for (u32 offset = 0; offset < dir->size; offset += ext2_block_size) {
+        u32 block;
+        int status = ext2_bmap(dir, offset >> ext2_block_shift, &block);
+        if (status != EXT2_OK) {
+            return status;
+        }
+        if (block == 0) continue;
+
+        struct bcache_buffer* buffer = bcache_read(ext2_device, block);
+        if (!buffer) {
+            return EXT2_ERR_IO;
+        }
+        u32 position = 0;
+        while (position + 8 <= ext2_block_size) {
+            const struct ext2_dir_entry* entry = (const struct ext2_dir_entry*)(buffer->data + position);
+            // The record, and the name inside it, must stay in the block
+            if (entry->rec_len < 8 + entry->name_len || position + entry->rec_len > ext2_block_size) {
+                bcache_release(buffer);
+                return EXT2_ERR_BAD_FS;
+            }
+            if (entry->inode && entry->name_len == length && memcmp(entry->name, name, length) == 0) {
+                *ino = entry->inode;
+                bcache_release(buffer);
+                return EXT2_OK;
+            }
+            position += entry->rec_len;
+        }
+        bcache_release(buffer);
+    }
+    return EXT2_ERR_NOT_FOUND;
+}
+
+static struct ext2_dcache_entry* ext2_dcache_find(u32 parent, const char* name, u32 length, u32 hash) {
+    for (struct ext2_dcache_entry* entry = ext2_dcache_hash[hash & (EXT2_DCACHE_HASH - 1)]; entry; entry = entry->hash_next) {
+        if (entry->hash == hash && entry->parent == parent && entry->length == length &&
+            memcmp(entry->name, name, length) == 0) {
+            return entry;
+        }
+    }
+    return 0;
+}
+
+static void ext2_dcache_insert(u32 parent, const char* name, u32 length, u32 hash, u32 ino) {
+    struct ext2_dcache_entry* entry = (struct ext2_dcache_entry*)ext2_dcache_lru.prev;
+    if (entry->used) {
+        struct ext2_dcache_entry** link = &ext2_dcache_hash[entry->hash & (EXT2_DCACHE_HASH - 1)];
+        while (*link != entry) {
+            link = &(*link)->hash_next;
+        }
+        *link = entry->hash_next;
+    }
+
+    entry->used = true;
+    entry->parent = parent;
+    entry->ino = ino;
+    entry->hash = hash;
+    entry->length = length;
+    memcpy(entry->name, name, length);
+    struct ext2_dcache_entry** slot = &ext2_dcache_hash[hash & (EXT2_DCACHE_HASH - 1)];
+    entry->hash_next = *slot;
+    *slot = entry;
+    ext2_lru_touch(&ext2_dcache_lru, &entry->lru);
+}
+
+// Resolve one path component, through the dentry cache when the name fits
+static int ext2_lookup_child(u32 parent, const struct ext2_inode* dir, const char* name, u32 length, u32* ino) {
+    ext2_stats.dentry_lookups++;
+    if (length > EXT2_DCACHE_NAME_MAX) {
+        return ext2_find_entry(dir, name, length, ino);
+    }
+
+    u32 hash = ext2_name_hash(parent, name, length);
+    struct ext2_dcache_entry* entry = ext2_dcache_find(parent, name, length, hash);
+    if (entry) {
+        ext2_lru_touch(&ext2_dcache_lru, &entry->lru);
+        if (!entry->ino) {
+            ext2_stats.dentry_negative_hits++;
+            return EXT2_ERR_NOT_FOUND;
+        }
+        ext2_stats.dentry_hits++;
+        *ino = entry->ino;
+        return EXT2_OK;
+    }
+
+    int status = ext2_find_entry(dir, name, length, ino);
+    if (status == EXT2_OK) {
+        ext2_dcache_insert(parent, name, length, hash, *ino);
+    } else if (status == EXT2_ERR_NOT_FOUND) {
+        ext2_dcache_insert(parent, name, length, hash, 0);
+    }
+    return status;
+}
+
+int ext2_lookup(const char* path, u32* ino) {
+    if (!ext2_device) {
+        return EXT2_ERR_NOT_MOUNTED;
+    }
+
+    u32 current = EXT2_ROOT_INO;
+    struct ext2_inode inode;
+    while (*path) {
+        while (*path == '/') path++;
+        if (!*path) break;
+
+        const char* name = path;
+        while (*path && *path != '/') path++;
+        u32 length = path - name;
+        if (length > EXT2_NAME_MAX) {
+            return EXT2_ERR_INVALID;
+        }
+
+        int status = ext2_get_inode(current, &inode);
+        if (status != EXT2_OK) {
+            return status;
+        }
+        if (!ext2_is_dir(&inode)) {
+            return EXT2_ERR_NOT_DIR;
+        }
+        status = ext2_lookup_child(current, &inode, name, length, &current);
+        if (status != EXT2_OK) {
+            return status;
+        }
+    }
+
+    *ino = current;
+    return EXT2_OK;
+}
+
+// Copy file data. Whole blocks that are contiguous on disk are read as
+// one multi-block request straight into the caller's buffer (which must
+// be identity mapped), so a large sequential read does not flush the
+// metadata the lookups depend on out of the buffer cache. Partial and
+// isolated blocks go through the cache.
+int ext2_read(u32 ino, u32 offset, void* buffer, u32 size, u32* bytes_read) {
+    struct ext2_inode inode;
+    *bytes_read = 0;
+    int status = ext2_get_inode(ino, &inode);
+    if (status != EXT2_OK) {
+        return status;
+    }
+    if (ext2_is_dir(&inode)) {
+        return EXT2_ERR_IS_DIR;
+    }
+    if (offset >= inode.size) {
+        return EXT2_OK;
+    }
+    if (size > inode.size - offset) {
+        size = inode.size - offset;
+    }
+
+    u8* out = (u8*)buffer;
+    u32 sectors_per_block = ext2_block_size / BLOCK_SECTOR_SIZE;
+    while (size) {
+        u32 file_block = offset >> ext2_block_shift;
+        u32 within = offset & (ext2_block_size - 1);
+        u32 block;
+        status = ext2_bmap(&inode, file_block, &block);
+        if (status != EXT2_OK) {
+            return status;
+        }
+
+        if (block && within == 0 && size >= ext2_block_size * 2 && !((uptr)out & 1)) {
+            u32 run = 1;
+            while (run < EXT2_MAX_RUN && size >= (run + 1) * ext2_block_size) {
+                u32 next;
+                status = ext2_bmap(&inode, file_block + run, &next);
+                if (status != EXT2_OK) {
+                    return status;
+                }
+                if (next != block + run) break;
+                run++;
+            }
+            if (run > 1) {
+                if (block + run > ext2_super.blocks_count) {
+                    return EXT2_ERR_BAD_FS;
+                }
+                status = ext2_block_status(block_read(ext2_device, (u64)block * sectors_per_block,
+                                                      run * sectors_per_block, out));
+                if (status != EXT2_OK) {
+                    return status;
+                }
+                ext2_stats.runs++;
+                ext2_stats.run_blocks += run;
+                u32 bytes = run * ext2_block_size;
+                out += bytes;
+                offset += bytes;
+                size -= bytes;
+                *bytes_read += bytes;
+                continue;
+            }
+        }
+
+        u32 chunk = ext2_block_size - within;
+        if (chunk > size) {
+            chunk = size;
+        }
+        if (block) {
+            status = ext2_read_block(block, within, out, chunk);
+            if (status != EXT2_OK) {
+                return status;
+            }
+            ext2_stats.cached_blocks++;
+        } else {
+            memset(out, 0, chunk);
+        }
+        out += chunk;
+        offset += chunk;
+        size -= chunk;
+        *bytes_read += chunk;
+    }
+    return EXT2_OK;
+}
+
+// Return the entry at *cookie (a byte offset into the directory) and
+// advance past it; EXT2_ERR_NOT_FOUND marks the end
+int ext2_readdir(u32 ino, u32* cookie, struct ext2_dirent* result) {
+    struct ext2_inode inode;
+    int status = ext2_get_inode(ino, &inode);
+    if (status != EXT2_OK) {
+        return status;
+    }
+    if (!ext2_is_dir(&inode)) {
+        return EXT2_ERR_NOT_DIR;
+    }
+
+    while (*cookie < inode.size) {
+        u32 block;
+        u32 within = *cookie & (ext2_block_size - 1);
+        status = ext2_bmap(&inode, *cookie >> ext2_block_shift, &block);
+        if (status != EXT2_OK) {
+            return status;
+        }
+        if (block == 0) {
+            *cookie += ext2_block_size - within;
+            continue;
+        }
+
+        struct bcache_buffer* buffer = bcache_read(ext2_device, block);
+        if (!buffer) {
+            return EXT2_ERR_IO;
+        }
+        const struct ext2_dir_entry* entry = (const struct ext2_dir_entry*)(buffer->data + within);
+        if (within + 8 > ext2_block_size || entry->rec_len < 8 + entry->name_len ||
+            within + entry->rec_len > ext2_block_size) {
+            bcache_release(buffer);
+            return EXT2_ERR_BAD_FS;
+        }
+        *cookie += entry->rec_len;
+        if (entry->inode) {
+            result->ino = entry->inode;
+            result->file_type = entry->file_type;
+            memcpy(result->name, entry->name, entry->name_len);
+            result->name[entry->name_len] = '\0';
+            bcache_release(buffer);
+            return EXT2_OK;
+        }
+        bcache_release(buffer);
+    }
+    return EXT2_ERR_NOT_FOUND;
+}
+
+int ext2_mount(struct block_device* dev) {
+    ext2_unmount();
+    if (!dev) {
+        return EXT2_ERR_INVALID;
+    }
+
+    // The superblock sits 1 KiB into the device whatever the block size
+    u8 sector[BLOCK_SECTOR_SIZE];
+    int status = ext2_block_status(block_read(dev, EXT2_SUPERBLOCK_OFFSET / BLOCK_SECTOR_SIZE, 1, sector));
+    if (status != EXT2_OK) {
+        return status;
+    }
+    memcpy(&ext2_super, sector, sizeof(ext2_super));
+
+    if (ext2_super.magic != EXT2_SUPER_MAGIC || ext2_super.inodes_per_group == 0 ||
+        ext2_super.blocks_per_group == 0 || ext2_super.log_block_size > 2) {
+        return EXT2_ERR_BAD_FS;
+    }
+    if (ext2_super.rev_level > 0 && (ext2_super.feature_incompat & ~EXT2_FEATURE_INCOMPAT_FILETYPE)) {
+        return EXT2_ERR_UNSUPPORTED;
+    }
+
+    ext2_block_shift = 10 + ext2_super.log_block_size;
+    ext2_block_size = 1u << ext2_block_shift;
+    ext2_inode_size = ext2_super.rev_level > 0 ? ext2_super.inode_size : sizeof(struct ext2_inode);
+    if (ext2_inode_size < sizeof(struct ext2_inode) || ext2_inode_size > ext2_block_size ||
+        (ext2_inode_size & (ext2_inode_size - 1))) {
+        return EXT2_ERR_BAD_FS;
+    }
+    ext2_group_count = (ext2_super.blocks_count - ext2_super.first_data_block +
+                        ext2_super.blocks_per_group - 1) / ext2_super.blocks_per_group;
+
+    if (bcache_set_block_size(dev, ext2_block_size) != BLOCK_OK) {
+        return EXT2_ERR_IO;
+    }
+
+    ext2_icache_clear();
+    ext2_dcache_clear();
+    ext2_device = dev;
+    return EXT2_OK;
+}
+
+void ext2_unmount(void) {
+    ext2_device = 0;
+}
+
+struct block_device* ext2_get_device(void) {
+    return ext2_device;
+}
+
+const struct ext2_superblock* ext2_get_superblock(void) {
+    return ext2_device ? &ext2_super : 0;
+}
+
+u32 ext2_get_block_size(void) {
+    return ext2_block_size;
+}
+
+const struct ext2_stats* ext2_get_stats(void) {
+    return &ext2_stats;
+}
+
+void ext2_reset_stats(void) {
+    memset(&ext2_stats, 0, sizeof(ext2_stats));
+}
+
+// Forget cached inodes and dentries; the buffer cache keeps its blocks
+void ext2_drop_caches(void) {
+    ext2_icache_clear();
+    ext2_dcache_clear();
+}
+
+const char* ext2_strerror(int status) {
+    if (status < 0 || status > EXT2_ERR_IO) {
+        return "Unknown error";
+    }
+    return ext2_errors[status];
+}
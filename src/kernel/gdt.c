@@ -1,14 +1,15 @@
 #include "gdt.h"
 
-// GDT with 5 entries: null, kernel code, kernel data, user code, user data
-static struct gdt_entry gdt_entries[5];
+// GDT with 6 entries: null, kernel code, kernel data, user code, user data, TSS
+static struct gdt_entry gdt_entries[6];
 static struct gdt_ptr gdt_pointer;
+static struct tss_entry tss;
 
 // Assembly function to flush GDT
-extern void gdt_flush_asm(u32 gdt_ptr);
+extern void gdt_flush_asm(const struct gdt_ptr* gdt_ptr);
 
 void gdt_initialize(void) {
-    gdt_pointer.limit = (sizeof(struct gdt_entry) * 5) - 1;
+    gdt_pointer.limit = (sizeof(struct gdt_entry) * 6) - 1;
     gdt_pointer.base = (u32)&gdt_entries;
 
     // NULL descriptor
@@ -34,7 +35,18 @@ void gdt_initialize(void) {
                  GDT_ACCESS_PRESENT | GDT_ACCESS_RING3 | GDT_ACCESS_SEGMENT | GDT_ACCESS_RW,
                  GDT_GRAN_4K | GDT_GRAN_32BIT | 0x0F);
 
-    gdt_flush((u32)&gdt_pointer);
+    // Task state segment (byte granular, no I/O bitmap so ring 3 port I/O faults)
+    memset(&tss, 0, sizeof(tss));
+    tss.ss0 = GDT_KERNEL_DATA;
+    tss.iomap_base = sizeof(tss);
+    gdt_set_gate(5, (u32)&tss, sizeof(tss) - 1,
+                 GDT_ACCESS_PRESENT | GDT_ACCESS_RING0 | GDT_ACCESS_TSS32,
+                 0x00);
+
+    gdt_flush(&gdt_pointer);
+
+    // Load task register
+    __asm__ volatile ("ltr %0" : : "r"((u16)GDT_TSS));
 }
 
 void gdt_set_gate(int num, u32 base, u32 limit, u8 access, u8 gran) {
@@ -49,6 +61,10 @@ void gdt_set_gate(int num, u32 base, u32 limit, u8 access, u8 gran) {
     gdt_entries[num].access = access;
 }
 
-void gdt_flush(u32 gdt_ptr) {
+void gdt_flush(const struct gdt_ptr* gdt_ptr) {
     gdt_flush_asm(gdt_ptr);
+}
+
+void gdt_set_kernel_stack(u32 esp0) {
+    tss.esp0 = esp0;
 }
\ No newline at end of file
@@ -1,11 +1,16 @@
 #include "idt.h"
 #include "irq.h"
 #include "vga.h"
+#include "gdt.h"
+#include "syscall.h"
 
 // IDT with 256 entries
 static struct idt_entry idt_entries[256];
 static struct idt_ptr idt_pointer;
 
+// Handlers that may resolve an exception before it is reported
+static exception_handler_t exception_handlers[32];
+
 // Exception names for debugging
 static const char* exception_messages[] = {
     "Division By Zero",
@@ -44,44 +49,44 @@ static const char* exception_messages[] = {
 
 void idt_initialize(void) {
     idt_pointer.limit = sizeof(struct idt_entry) * 256 - 1;
-    idt_pointer.base = (u32)&idt_entries;
+    idt_pointer.base = (uptr)&idt_entries;
 
     // Clear IDT
     memset(&idt_entries, 0, sizeof(struct idt_entry) * 256);
 
     // Set up exception handlers (ISRs 0-31)
-    idt_set_gate(0, (u32)isr0, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(1, (u32)isr1, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(2, (u32)isr2, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(3, (u32)isr3, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(4, (u32)isr4, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(5, (u32)isr5, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(6, (u32)isr6, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(7, (u32)isr7, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(8, (u32)isr8, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(9, (u32)isr9, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(10, (u32)isr10, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(11, (u32)isr11, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(12, (u32)isr12, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(13, (u32)isr13, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(14, (u32)isr14, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(15, (u32)isr15, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(16, (u32)isr16, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(17, (u32)isr17, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(18, (u32)isr18, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(19, (u32)isr19, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(20, (u32)isr20, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(21, (u32)isr21, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(22, (u32)isr22, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(23, (u32)isr23, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(24, (u32)isr24, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(25, (u32)isr25, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(26, (u32)isr26, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(27, (u32)isr27, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(28, (u32)isr28, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(29, (u32)isr29, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(30, (u32)isr30, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(31, (u32)isr31, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(0, (uptr)isr0, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(1, (uptr)isr1, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(2, (uptr)isr2, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(3, (uptr)isr3, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(4, (uptr)isr4, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(5, (uptr)isr5, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(6, (uptr)isr6, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(7, (uptr)isr7, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(8, (uptr)isr8, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(9, (uptr)isr9, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(10, (uptr)isr10, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(11, (uptr)isr11, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(12, (uptr)isr12, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(13, (uptr)isr13, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(14, (uptr)isr14, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(15, (uptr)isr15, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(16, (uptr)isr16, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(17, (uptr)isr17, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(18, (uptr)isr18, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(19, (uptr)isr19, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(20, (uptr)isr20, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(21, (uptr)isr21, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(22, (uptr)isr22, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(23, (uptr)isr23, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(24, (uptr)isr24, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(25, (uptr)isr25, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(26, (uptr)isr26, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(27, (uptr)isr27, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(28, (uptr)isr28, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(29, (uptr)isr29, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(30, (uptr)isr30, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(31, (uptr)isr31, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
 
     // Load IDT
     __asm__ volatile ("lidt %0" : : "m" (idt_pointer));
@@ -90,16 +95,38 @@ void idt_initialize(void) {
     __asm__ volatile ("sti");
 }
 
-void idt_set_gate(u8 num, u32 base, u16 sel, u8 flags) {
+void idt_set_gate(u8 num, uptr base, u16 sel, u8 flags) {
     idt_entries[num].base_lo = base & 0xFFFF;
     idt_entries[num].base_hi = (base >> 16) & 0xFFFF;
+#ifdef __x86_64__
+    idt_entries[num].base_upper = base >> 32;
+    idt_entries[num].reserved = 0;
+#endif
     idt_entries[num].sel = sel;
     idt_entries[num].always0 = 0;
     idt_entries[num].flags = flags;
 }
 
-void interrupt_handler(struct interrupt_context* ctx) {
-    if (ctx->int_no < 32) {
+void idt_install_exception_handler(u8 vector, exception_handler_t handler) {
+    if (vector < 32) {
+        exception_handlers[vector] = handler;
+    }
+}
+
+// Report an exception no handler claimed: a user program is terminated, a
+// kernel fault halts the system
+static __cold void exception_report(struct interrupt_context* ctx) {
+    if ((ctx->cs & GDT_RPL3) == GDT_RPL3) {
+        // Exceptions raised in ring 3 terminate the user program only
+        vga_setcolor(vga_entry_color(VGA_COLOR_LIGHT_RED, VGA_COLOR_BLACK));
+        vga_writestring("\nUser program terminated: ");
+        vga_writestring(exception_messages[ctx->int_no]);
+        vga_writestring(" at EIP ");
+        vga_write_hex(interrupt_ip(ctx));
+        vga_putchar('\n');
+        vga_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+        user_exit(SYSCALL_ERROR);
+    } else {
         // Handle exceptions
         vga_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_RED));
         vga_writestring("\nEXCEPTION: ");
@@ -125,7 +152,7 @@ void interrupt_handler(struct interrupt_context* ctx) {
         vga_putchar('0');
         vga_putchar('x');
         for (int i = 28; i >= 0; i -= 4) {
-            u8 nibble = (ctx->eip >> i) & 0xF;
+            u8 nibble = (interrupt_ip(ctx) >> i) & 0xF;
             if (nibble < 10) {
                 vga_putchar('0' + nibble);
             } else {
@@ -136,8 +163,18 @@ void interrupt_handler(struct interrupt_context* ctx) {
         
         vga_writestring("System halted.\n");
         __asm__ volatile ("cli; hlt");
-    } else if (ctx->int_no >= 32 && ctx->int_no < 48) {
+    }
+}
+
+void interrupt_handler(struct interrupt_context* ctx) {
+    if (ctx->int_no < 32 && exception_handlers[ctx->int_no] && exception_handlers[ctx->int_no](ctx)) {
+        return;
+    }
+    
+    if (ctx->int_no < 32) {
+        exception_report(ctx);
+    } else if (ctx->int_no < 48) {
         // Handle IRQs
         irq_handler(ctx);
     }
-}
\ No newline at end of file
+}
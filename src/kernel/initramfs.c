@@ -0,0 +1,147 @@
+#include "initramfs.h"
+#include "multiboot.h"
+
+// Files indexed from the archive and an open-addressing hash table of
+// their paths (slot value is index + 1, 0 means empty)
+static struct initramfs_file initramfs_files[INITRAMFS_MAX_FILES];
+static u16 initramfs_table[INITRAMFS_HASH_SIZE];
+static u32 initramfs_count = 0;
+
+// FNV-1a
+static u32 initramfs_hash(const char* path) {
+    u32 hash = 2166136261u;
+    while (*path) {
+        hash ^= (u8)*path++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+// Parse a NUL or space terminated octal field
+static u32 initramfs_octal(const char* field, u32 len) {
+    u32 value = 0;
+    for (u32 i = 0; i < len && field[i] >= '0' && field[i] <= '7'; i++) {
+        value = (value << 3) | (field[i] - '0');
+    }
+    return value;
+}
+
+// Append len bytes of a path to out as clean components: no empty, "."
+// or ".." components, a leading slash and no trailing slash
+static bool initramfs_append_path(char* out, u32* pos, const char* path, u32 len) {
+    u32 i = 0;
+    while (i < len && path[i]) {
+        while (i < len && path[i] == '/') i++;
+        u32 start = i;
+        while (i < len && path[i] && path[i] != '/') i++;
+        u32 part = i - start;
+
+        if (part == 0 || (part == 1 && path[start] == '.')) continue;
+        if (part == 2 && path[start] == '.' && path[start + 1] == '.') {
+            while (*pos > 0 && out[*pos - 1] != '/') (*pos)--;
+            if (*pos > 0) (*pos)--;
+            continue;
+        }
+        if (*pos + part + 2 > INITRAMFS_PATH_MAX) return false;
+
+        out[(*pos)++] = '/';
+        memcpy(&out[*pos], &path[start], part);
+        *pos += part;
+    }
+    out[*pos] = '\0';
+    return true;
+}
+
+static bool initramfs_normalize(const char* path, char* out) {
+    u32 pos = 0;
+    if (!initramfs_append_path(out, &pos, path, INITRAMFS_PATH_MAX)) return false;
+    if (pos == 0) {
+        out[0] = '/';
+        out[1] = '\0';
+    }
+    return true;
+}
+
+static void initramfs_insert(u32 index) {
+    u32 slot = initramfs_files[index].hash & (INITRAMFS_HASH_SIZE - 1);
+    while (initramfs_table[slot]) {
+        slot = (slot + 1) & (INITRAMFS_HASH_SIZE - 1);
+    }
+    initramfs_table[slot] = index + 1;
+}
+
+u32 initramfs_initialize(void) {
+    initramfs_count = 0;
+    memset(initramfs_table, 0, sizeof(initramfs_table));
+
+    const struct multiboot_module* module = multiboot_find_module(INITRAMFS_MODULE);
+    if (!module) {
+        return 0;
+    }
+
+    u32 offset = 0;
+    u32 size = module->end - module->start;
+    while (offset + USTAR_BLOCK_SIZE <= size && initramfs_count < INITRAMFS_MAX_FILES) {
+        const struct ustar_header* header = (const struct ustar_header*)(uptr)(module->start + offset);
+        if (header->name[0] == '\0' || strncmp(header->magic, "ustar", 5) != 0) {
+            break;  // End-of-archive zero blocks
+        }
+
+        u32 file_size = initramfs_octal(header->size, sizeof(header->size));
+        u32 data = offset + USTAR_BLOCK_SIZE;
+        if (file_size > size - data) {
+            break;  // Truncated archive
+        }
+
+        bool is_dir = header->typeflag == USTAR_TYPE_DIR;
+        bool is_file = header->typeflag == USTAR_TYPE_FILE || header->typeflag == USTAR_TYPE_FILE_OLD;
+        struct initramfs_file* file = &initramfs_files[initramfs_count];
+        u32 pos = 0;
+
+        if ((is_dir || is_file) &&
+            initramfs_append_path(file->path, &pos, header->prefix, sizeof(header->prefix)) &&
+            initramfs_append_path(file->path, &pos, header->name, sizeof(header->name)) &&
+            pos > 0 && !initramfs_lookup(file->path)) {
+            file->data = (const u8*)(uptr)(module->start + data);
+            file->size = is_dir ? 0 : file_size;
+            file->mode = initramfs_octal(header->mode, sizeof(header->mode));
+            file->mtime = initramfs_octal(header->mtime, sizeof(header->mtime));
+            file->hash = initramfs_hash(file->path);
+            file->is_dir = is_dir;
+            initramfs_insert(initramfs_count++);
+        }
+
+        offset = data + ((file_size + USTAR_BLOCK_SIZE - 1) & ~(USTAR_BLOCK_SIZE - 1));
+    }
+
+    return initramfs_count;
+}
+
+const struct initramfs_file* initramfs_lookup(const char* path) {
+    char normalized[INITRAMFS_PATH_MAX];
+    if (!initramfs_normalize(path, normalized)) {
+        return 0;
+    }
+
+    u32 hash = initramfs_hash(normalized);
+    u32 slot = hash & (INITRAMFS_HASH_SIZE - 1);
+    while (initramfs_table[slot]) {
+        const struct initramfs_file* file = &initramfs_files[initramfs_table[slot] - 1];
+        if (file->hash == hash && strcmp(file->path, normalized) == 0) {
+            return file;
+        }
+        slot = (slot + 1) & (INITRAMFS_HASH_SIZE - 1);
+    }
+    return 0;
+}
+
+u32 initramfs_get_count(void) {
+    return initramfs_count;
+}
+
+const struct initramfs_file* initramfs_get(u32 index) {
+    if (index < initramfs_count) {
+        return &initramfs_files[index];
+    }
+    return 0;
+}
\ No newline at end of file
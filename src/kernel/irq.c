@@ -1,8 +1,38 @@
 #include "irq.h"
 #include "idt.h"
+#include "apic.h"
+#include "cpustat.h"
+#include "irqtrace.h"
 
 // IRQ handler array
 static irq_handler_t irq_handlers[16];
+static irq_handler_t irq_shared[16][IRQ_SHARED_MAX];
+static irq_poll_t irq_polls[16];
+
+// Per-line statistics and storm control state
+static struct irq_stats irq_stats[16];
+static struct irq_storm_event irq_storm_log[IRQ_STORM_LOG_SIZE];
+static u32 irq_storm_log_count = 0;
+static u32 irq_ticks = 0;
+
+// PIC mask requested by drivers, the extra mask applied by storm control
+// and the lines held off by the handlers currently running
+static u16 irq_mask = 0xFFFF;
+static u16 irq_storm_mask = 0;
+static u16 irq_level_mask = 0;
+
+// Nesting: each line's priority level, the lines each level masks, the
+// source whose handler is innermost (-1 outside handlers) and its depth
+static bool irq_nesting = true;
+static u8 irq_priority[16];
+static u16 irq_level_masks[IRQ_PRIORITY_LEVELS];
+static int irq_current = -1;
+static u32 irq_depth = 0;
+static struct irq_nest_stats irq_nest_stats;
+
+// MSI vector handlers and counters
+static irq_handler_t msi_handlers[IRQ_MSI_COUNT];
+static u32 msi_counts[IRQ_MSI_COUNT];
 
 // Port I/O functions
 static inline void outb(u16 port, u8 val) {
@@ -15,11 +45,57 @@ static inline u8 inb(u16 port) {
     return ret;
 }
 
+static void pic_write_mask(void) {
+    u16 mask = irq_mask | irq_storm_mask | irq_level_mask;
+    outb(PIC1_DATA, mask & 0xFF);
+    outb(PIC2_DATA, (mask >> 8) & 0xFF);
+}
+
+// Read the in-service registers of both PICs (slave in the high byte)
+static u16 pic_read_isr(void) {
+    outb(PIC1_COMMAND, PIC_READ_ISR);
+    outb(PIC2_COMMAND, PIC_READ_ISR);
+    return ((u16)inb(PIC2_COMMAND) << 8) | inb(PIC1_COMMAND);
+}
+
+// Lines masked while a handler at each level runs: that level and every
+// less urgent one. The cascade stays open while any slave line is not.
+static void irq_update_level_masks(void) {
+    for (u32 level = 0; level < IRQ_PRIORITY_LEVELS; level++) {
+        u16 mask = 0;
+        for (int irq = 0; irq < 16; irq++) {
+            if (irq_priority[irq] >= level) {
+                mask |= 1 << irq;
+            }
+        }
+        if ((mask & 0xFF00) == 0xFF00) {
+            mask |= 1 << 2;
+        } else {
+            mask &= ~(1 << 2);
+        }
+        irq_level_masks[level] = mask;
+    }
+}
+
 void irq_initialize(void) {
     // Clear IRQ handlers
     for (int i = 0; i < 16; i++) {
         irq_handlers[i] = 0;
+        irq_polls[i] = 0;
+        irq_priority[i] = IRQ_PRIORITY_DEFAULT;
     }
+    memset(irq_shared, 0, sizeof(irq_shared));
+    memset(irq_stats, 0, sizeof(irq_stats));
+    irq_storm_log_count = 0;
+    irq_ticks = 0;
+
+    // The timer preempts every other handler so ticks are never held up
+    irq_priority[0] = 0;
+    irq_update_level_masks();
+    irq_level_mask = 0;
+    irq_current = -1;
+    irq_depth = 0;
+    irq_reset_nest_stats();
 
     // Remap PIC interrupts
     // ICW1 - Initialize PICs
@@ -38,27 +114,36 @@ void irq_initialize(void) {
     outb(PIC1_DATA, 0x01);  // 8086 mode
     outb(PIC2_DATA, 0x01);  // 8086 mode
 
-    // Mask all interrupts except cascade
-    outb(PIC1_DATA, 0xFC);  // Enable timer and keyboard
-    outb(PIC2_DATA, 0xFF);  // Mask all PIC2 interrupts
+    // Mask all interrupts except timer and keyboard
+    irq_mask = 0xFFFC;
+    irq_storm_mask = 0;
+    pic_write_mask();
 
     // Install IRQ handlers in IDT
-    idt_set_gate(32, (u32)irq0, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(33, (u32)irq1, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(34, (u32)irq2, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(35, (u32)irq3, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(36, (u32)irq4, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(37, (u32)irq5, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(38, (u32)irq6, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(39, (u32)irq7, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(40, (u32)irq8, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(41, (u32)irq9, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(42, (u32)irq10, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(43, (u32)irq11, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(44, (u32)irq12, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(45, (u32)irq13, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(46, (u32)irq14, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
-    idt_set_gate(47, (u32)irq15, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(32, (uptr)irq0, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(33, (uptr)irq1, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(34, (uptr)irq2, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(35, (uptr)irq3, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(36, (uptr)irq4, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(37, (uptr)irq5, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(38, (uptr)irq6, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(39, (uptr)irq7, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(40, (uptr)irq8, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(41, (uptr)irq9, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(42, (uptr)irq10, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(43, (uptr)irq11, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(44, (uptr)irq12, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(45, (uptr)irq13, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(46, (uptr)irq14, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    idt_set_gate(47, (uptr)irq15, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+
+    // MSI vectors and the local APIC spurious vector
+    for (int i = 0; i < IRQ_MSI_COUNT; i++) {
+        msi_handlers[i] = 0;
+        msi_counts[i] = 0;
+        idt_set_gate(IRQ_MSI_BASE + i, msi_stub_table[i], 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
+    }
+    idt_set_gate(LAPIC_SPURIOUS_VECTOR, (uptr)lapic_spurious_stub, 0x08, IDT_FLAG_PRESENT | IDT_FLAG_RING0 | IDT_FLAG_GATE_32);
 }
 
 void irq_install_handler(int irq, irq_handler_t handler) {
@@ -67,23 +152,340 @@ void irq_install_handler(int irq, irq_handler_t handler) {
     }
 }
 
+// PCI INTx lines are level triggered and may be wired to several devices;
+// every handler on the line runs and checks its own device's status
+bool irq_share_handler(int irq, irq_handler_t handler) {
+    if (irq < 0 || irq >= 16) {
+        return false;
+    }
+    if (!irq_handlers[irq] || irq_handlers[irq] == handler) {
+        irq_handlers[irq] = handler;
+        return true;
+    }
+    for (int i = 0; i < IRQ_SHARED_MAX; i++) {
+        if (irq_shared[irq][i] == handler) {
+            return true;
+        }
+        if (!irq_shared[irq][i]) {
+            irq_shared[irq][i] = handler;
+            return true;
+        }
+    }
+    return false;
+}
+
 void irq_uninstall_handler(int irq) {
     if (irq >= 0 && irq < 16) {
         irq_handlers[irq] = 0;
+        memset(irq_shared[irq], 0, sizeof(irq_shared[irq]));
+    }
+}
+
+void irq_install_poll(int irq, irq_poll_t poll) {
+    if (irq >= 0 && irq < 16) {
+        irq_polls[irq] = poll;
+    }
+}
+
+// Handlers run with interrupts enabled and may change masks too, so the
+// update and both PIC writes happen with interrupts off
+void irq_set_mask(int irq) {
+    if (irq >= 0 && irq < 16) {
+        u32 flags = irq_save();
+        irq_mask |= (1 << irq);
+        pic_write_mask();
+        irq_restore(flags);
+    }
+}
+
+void irq_clear_mask(int irq) {
+    if (irq >= 0 && irq < 16) {
+        u32 flags = irq_save();
+        irq_mask &= ~(1 << irq);
+        if (irq >= 8) {
+            irq_mask &= ~(1 << 2);  // Slave lines need the cascade
+        }
+        pic_write_mask();
+        irq_restore(flags);
+    }
+}
+
+const struct irq_stats* irq_get_stats(int irq) {
+    if (irq >= 0 && irq < 16) {
+        return &irq_stats[irq];
+    }
+    return 0;
+}
+
+u32 irq_get_storm_events(struct irq_storm_event* events, u32 max) {
+    u32 count = irq_storm_log_count < IRQ_STORM_LOG_SIZE ? irq_storm_log_count : IRQ_STORM_LOG_SIZE;
+    if (count > max) count = max;
+
+    // Copy the most recent events, oldest first
+    u32 first = irq_storm_log_count - count;
+    for (u32 i = 0; i < count; i++) {
+        events[i] = irq_storm_log[(first + i) % IRQ_STORM_LOG_SIZE];
+    }
+    return count;
+}
+
+void irq_set_nesting(bool enable) {
+    irq_nesting = enable;
+}
+
+bool irq_get_nesting(void) {
+    return irq_nesting;
+}
+
+// The cascade line has no handler of its own and takes no priority
+bool irq_set_priority(int irq, u32 level) {
+    if (irq < 0 || irq >= 16 || irq == 2 || level >= IRQ_PRIORITY_LEVELS) {
+        return false;
+    }
+    u32 flags = irq_save();
+    irq_priority[irq] = (u8)level;
+    irq_update_level_masks();
+    irq_restore(flags);
+    return true;
+}
+
+u32 irq_get_priority(int irq) {
+    return irq >= 0 && irq < 16 ? irq_priority[irq] : 0;
+}
+
+const struct irq_nest_stats* irq_get_nest_stats(void) {
+    return &irq_nest_stats;
+}
+
+void irq_reset_nest_stats(void) {
+    u32 flags = irq_save();
+    memset(&irq_nest_stats, 0, sizeof(irq_nest_stats));
+    for (int irq = 0; irq < 16; irq++) {
+        irq_stats[irq].preempted = 0;
+        irq_stats[irq].preemptions = 0;
+    }
+    irq_restore(flags);
+}
+
+// Allocate an MSI vector for a handler, returns -1 when none is free
+int irq_alloc_msi(irq_handler_t handler) {
+    for (int i = 0; i < IRQ_MSI_COUNT; i++) {
+        if (!msi_handlers[i]) {
+            msi_handlers[i] = handler;
+            msi_counts[i] = 0;
+            return IRQ_MSI_BASE + i;
+        }
+    }
+    return -1;
+}
+
+void irq_free_msi(int vector) {
+    if (vector >= IRQ_MSI_BASE && vector < IRQ_MSI_BASE + IRQ_MSI_COUNT) {
+        msi_handlers[vector - IRQ_MSI_BASE] = 0;
+    }
+}
+
+u32 irq_get_msi_count(int vector) {
+    if (vector >= IRQ_MSI_BASE && vector < IRQ_MSI_BASE + IRQ_MSI_COUNT) {
+        return msi_counts[vector - IRQ_MSI_BASE];
+    }
+    return 0;
+}
+
+// Mask a line that exceeded the storm threshold. Lines that storm again
+// before their backoff has decayed are masked for twice as long.
+static void irq_storm_begin(int irq) {
+    struct irq_stats* stats = &irq_stats[irq];
+
+    if (stats->backoff == 0) {
+        stats->backoff = IRQ_STORM_BACKOFF_MIN;
+    } else if (stats->backoff < IRQ_STORM_BACKOFF_MAX) {
+        stats->backoff *= 2;
+        if (stats->backoff > IRQ_STORM_BACKOFF_MAX) {
+            stats->backoff = IRQ_STORM_BACKOFF_MAX;
+        }
+    }
+
+    stats->masked = true;
+    stats->storms++;
+    stats->masked_until = irq_ticks + stats->backoff;
+
+    struct irq_storm_event* event = &irq_storm_log[irq_storm_log_count % IRQ_STORM_LOG_SIZE];
+    event->tick = irq_ticks;
+    event->irq = irq;
+    event->rate = stats->window_count;
+    event->backoff = stats->backoff;
+    irq_storm_log_count++;
+
+    irq_storm_mask |= (1 << irq);
+    pic_write_mask();
+}
+
+// Called on every timer interrupt: services masked lines by polling,
+// re-enables them when their backoff expires and rolls the rate window.
+static void irq_storm_tick(void) {
+    irq_ticks++;
+
+    // Polls wait for a tick that did not preempt another handler, since
+    // drivers do not expect their poll inside someone else's handler
+    bool preempting = irq_depth > 1;
+
+    for (int irq = 1; irq < 16; irq++) {
+        struct irq_stats* stats = &irq_stats[irq];
+        if (!stats->masked) continue;
+
+        stats->masked_ticks++;
+        if (irq_polls[irq] && !preempting) {
+            irq_polls[irq]();
+            stats->polls++;
+        }
+
+        if ((i32)(irq_ticks - stats->masked_until) >= 0) {
+            stats->masked = false;
+            stats->window_count = 0;
+            irq_storm_mask &= ~(1 << irq);
+            pic_write_mask();
+        }
+    }
+
+    if (irq_ticks % IRQ_STORM_WINDOW == 0) {
+        for (int irq = 0; irq < 16; irq++) {
+            struct irq_stats* stats = &irq_stats[irq];
+
+            // A quiet window halves the backoff of a previously storming line
+            if (!stats->masked && stats->backoff && stats->window_count < IRQ_STORM_THRESHOLD / 2) {
+                stats->backoff /= 2;
+                if (stats->backoff < IRQ_STORM_BACKOFF_MIN) {
+                    stats->backoff = 0;
+                }
+            }
+            stats->window_count = 0;
+        }
     }
 }
 
-void irq_handler(struct interrupt_context* ctx) {
+static __hot void irq_dispatch(struct interrupt_context* ctx) {
+    // MSI vectors bypass the PICs and are acknowledged at the local APIC
+    if (ctx->int_no >= IRQ_MSI_BASE) {
+        int index = ctx->int_no - IRQ_MSI_BASE;
+        msi_counts[index]++;
+        if (msi_handlers[index]) {
+            msi_handlers[index](ctx);
+        }
+        lapic_eoi();
+        return;
+    }
+    
     int irq = ctx->int_no - 32;
+    struct irq_stats* stats = &irq_stats[irq];
+
+    // IRQ7 and IRQ15 can be spurious: the request was withdrawn before the
+    // CPU acknowledged it, so the PIC never set the in-service bit. Such an
+    // interrupt must not be EOI'd on its own PIC, but a spurious IRQ15 was
+    // still delivered through the cascade and the master needs its EOI.
+    if ((irq == 7 || irq == 15) && !(pic_read_isr() & (1 << irq))) {
+        stats->spurious++;
+        if (irq == 15) {
+            outb(PIC1_COMMAND, PIC_EOI);
+        }
+        return;
+    }
+
+    stats->count++;
+    stats->window_count++;
+
+    // A line that something can preempt masks its own level and the ones
+    // below, then takes its EOI early so the PICs' fixed priorities do not
+    // hold back the lines left open, and runs with interrupts enabled
+    u16 outer_mask = irq_level_mask;
+    u16 level_mask = irq_level_masks[irq_priority[irq]];
+    bool nest = irq_nesting && level_mask != 0xFFFF;
+    if (nest) {
+        irq_level_mask |= level_mask;
+        pic_write_mask();
+        if (irq >= 8) {
+            outb(PIC2_COMMAND, PIC_EOI);
+        }
+        outb(PIC1_COMMAND, PIC_EOI);
+        irq_enable();
+    }
     
     // Call handler if one is installed
     if (irq_handlers[irq]) {
         irq_handlers[irq](ctx);
     }
+    for (int i = 0; i < IRQ_SHARED_MAX && irq_shared[irq][i]; i++) {
+        irq_shared[irq][i](ctx);
+    }
+
+    if (nest) {
+        irq_disable();
+    }
+
+    // The timer drives the rate window and is never throttled
+    if (irq != 0 && !stats->masked && stats->window_count > IRQ_STORM_THRESHOLD) {
+        irq_storm_begin(irq);
+    }
     
-    // Send EOI (End of Interrupt) to PICs
-    if (irq >= 8) {
-        outb(PIC2_COMMAND, PIC_EOI);  // Send EOI to slave PIC
+    // Send EOI (End of Interrupt) to PICs, or reopen the lines held off
+    // while the handler ran
+    if (nest) {
+        irq_level_mask = outer_mask;
+        pic_write_mask();
+    } else {
+        if (irq >= 8) {
+            outb(PIC2_COMMAND, PIC_EOI);  // Send EOI to slave PIC
+        }
+        outb(PIC1_COMMAND, PIC_EOI);      // Send EOI to master PIC
+    }
+
+    if (irq == 0) {
+        irq_storm_tick();
+        cpustat_tick();
+    }
+}
+
+// Count the entry by depth, and as a preemption if another handler was
+// running
+static void irq_nest_enter(int source, int outer) {
+    irq_depth++;
+    irq_nest_stats.entries++;
+    irq_nest_stats.depths[(irq_depth < IRQ_NEST_DEPTHS ? irq_depth : IRQ_NEST_DEPTHS) - 1]++;
+    if (irq_depth > irq_nest_stats.max_depth) {
+        irq_nest_stats.max_depth = irq_depth;
+    }
+    if (outer >= 0) {
+        irq_nest_stats.preemptions++;
+        if (outer < 16) {
+            irq_stats[outer].preempted++;
+        }
+        if (source < 16) {
+            irq_stats[source].preemptions++;
+        }
+    }
+}
+
+// Handler time is charged to interrupt context and to its source, minus
+// whatever nested handlers take. The interrupt gate cleared IF, so the
+// handler is also an interrupts-off window (until it nests), traced from
+// the interrupted code (whose frames are only walked when it ran in the
+// kernel).
+__hot void irq_handler(struct interrupt_context* ctx) {
+    if (irqtrace_enabled) {
+        irqtrace_off(interrupt_ip(ctx), (ctx->cs & 3) ? 0 : interrupt_frame(ctx));
+    }
+    int source = ctx->int_no >= IRQ_MSI_BASE ? 16 + ctx->int_no - IRQ_MSI_BASE : ctx->int_no - 32;
+    u32 previous = cpustat_irq_enter(source);
+    int outer = irq_current;
+    irq_current = source;
+    irq_nest_enter(source, outer);
+
+    irq_dispatch(ctx);
+
+    irq_depth--;
+    irq_current = outer;
+    cpustat_irq_exit(previous);
+    if (irqtrace_enabled) {
+        irqtrace_on(irqtrace_eip());
     }
-    outb(PIC1_COMMAND, PIC_EOI);      // Send EOI to master PIC
 }
\ No newline at end of file
@@ -0,0 +1,150 @@
+#include "irqtrace.h"
+#include "cpu.h"
+#include "paging.h"
+
+bool irqtrace_enabled = false;
+
+// The open window, if any
+static bool irqtrace_active = false;
+static u64 irqtrace_start = 0;
+static struct irqtrace_record irqtrace_current;
+
+static struct irqtrace_stats irqtrace_stats;
+static struct irqtrace_record irqtrace_longest[IRQTRACE_TOP];     // Longest first
+static u32 irqtrace_longest_count = 0;
+static struct irqtrace_record irqtrace_log[IRQTRACE_LOG_SIZE];
+static u32 irqtrace_log_count = 0;
+
+// The tracer's own critical sections use cli directly so it never traces
+// itself
+static inline u32 irqtrace_lock(void) {
+    uptr flags;
+    __asm__ volatile ("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void irqtrace_unlock(u32 flags) {
+    __asm__ volatile ("push %0; popf" : : "r"((uptr)flags) : "memory", "cc");
+}
+
+// Follow the saved frame pointers while they stay in mapped kernel memory
+// and move up the stack. A frame is the caller's frame pointer and the
+// return address, each a full register wide.
+static void irqtrace_backtrace(u32 frame, u32* backtrace) {
+    u32 depth = 0;
+    const uptr* fp = (const uptr*)(uptr)frame;
+    while (depth < IRQTRACE_DEPTH && (uptr)fp >= PAGE_SIZE &&
+           (uptr)fp < PAGING_IDENTITY_LIMIT - 2 * sizeof(uptr) && ((uptr)fp & (sizeof(uptr) - 1)) == 0) {
+        backtrace[depth++] = fp[1];
+        const uptr* next = (const uptr*)fp[0];
+        if (next <= fp) break;
+        fp = next;
+    }
+    while (depth < IRQTRACE_DEPTH) {
+        backtrace[depth++] = 0;
+    }
+}
+
+// Interrupts were just disabled at eip; frame is the frame pointer of the
+// code that disabled them. A window that is already open keeps its start.
+void irqtrace_off(u32 eip, u32 frame) {
+    if (irqtrace_active) {
+        return;
+    }
+    irqtrace_start = rdtsc();
+    irqtrace_active = true;
+    irqtrace_current.off_eip = eip;
+    irqtrace_backtrace(frame, irqtrace_current.backtrace);
+}
+
+// Interrupts are about to be enabled at eip: close the window
+void irqtrace_on(u32 eip) {
+    if (!irqtrace_active) {
+        return;
+    }
+    u64 now = rdtsc();
+    irqtrace_active = false;
+
+    struct irqtrace_record* record = &irqtrace_current;
+    record->cycles = now - irqtrace_start;
+    record->tsc = now;
+    record->on_eip = eip;
+
+    irqtrace_stats.windows++;
+    irqtrace_stats.total_cycles += record->cycles;
+    u32 bucket = 0;
+    for (u64 c = record->cycles; c > 1 && bucket < IRQTRACE_BUCKETS - 1; c >>= 1) {
+        bucket++;
+    }
+    irqtrace_stats.histogram[bucket]++;
+
+    // Insert into the longest windows, kept sorted
+    u32 position = irqtrace_longest_count;
+    while (position > 0 && irqtrace_longest[position - 1].cycles < record->cycles) {
+        position--;
+    }
+    if (position < IRQTRACE_TOP) {
+        u32 last = irqtrace_longest_count < IRQTRACE_TOP ? irqtrace_longest_count : IRQTRACE_TOP - 1;
+        for (u32 i = last; i > position; i--) {
+            irqtrace_longest[i] = irqtrace_longest[i - 1];
+        }
+        irqtrace_longest[position] = *record;
+        if (irqtrace_longest_count < IRQTRACE_TOP) {
+            irqtrace_longest_count++;
+        }
+    }
+
+    if (irqtrace_stats.threshold && record->cycles > irqtrace_stats.threshold) {
+        irqtrace_stats.violations++;
+        irqtrace_log[irqtrace_log_count % IRQTRACE_LOG_SIZE] = *record;
+        irqtrace_log_count++;
+    }
+}
+
+void irqtrace_enable(bool enable) {
+    u32 flags = irqtrace_lock();
+    irqtrace_enabled = enable;
+    irqtrace_active = false;
+    irqtrace_unlock(flags);
+}
+
+void irqtrace_reset(void) {
+    u32 flags = irqtrace_lock();
+    u64 threshold = irqtrace_stats.threshold;
+    memset(&irqtrace_stats, 0, sizeof(irqtrace_stats));
+    irqtrace_stats.threshold = threshold;
+    irqtrace_longest_count = 0;
+    irqtrace_log_count = 0;
+    irqtrace_unlock(flags);
+}
+
+void irqtrace_set_threshold(u64 cycles) {
+    irqtrace_stats.threshold = cycles;
+}
+
+const struct irqtrace_stats* irqtrace_get_stats(void) {
+    return &irqtrace_stats;
+}
+
+u32 irqtrace_get_longest(struct irqtrace_record* records, u32 max) {
+    u32 flags = irqtrace_lock();
+    u32 count = irqtrace_longest_count < max ? irqtrace_longest_count : max;
+    for (u32 i = 0; i < count; i++) {
+        records[i] = irqtrace_longest[i];
+    }
+    irqtrace_unlock(flags);
+    return count;
+}
+
+// Most recent violations, oldest first
+u32 irqtrace_get_violations(struct irqtrace_record* records, u32 max) {
+    u32 flags = irqtrace_lock();
+    u32 count = irqtrace_log_count < IRQTRACE_LOG_SIZE ? irqtrace_log_count : IRQTRACE_LOG_SIZE;
+    if (count > max) count = max;
+    u32 first = irqtrace_log_count - count;
+    for (u32 i = 0; i < count; i++) {
+        records[i] = irqtrace_log[(first + i) % IRQTRACE_LOG_SIZE];
+    }
+    irqtrace_unlock(flags);
+    return count;
+}
@@ -6,6 +6,30 @@
 #include "keyboard.h"
 #include "timer.h"
 #include "shell.h"
+#include "syscall.h"
+#include "multiboot.h"
+#include "pmm.h"
+#include "paging.h"
+#include "dma.h"
+#include "elf.h"
+#include "initramfs.h"
+#include "acpi.h"
+#include "apic.h"
+#include "pci.h"
+#include "ata.h"
+#include "virtio_blk.h"
+#include "block.h"
+#include "ramdisk.h"
+#include "ext2.h"
+#include "net.h"
+#include "e1000.h"
+#include "boot.h"
+#include "serial.h"
+#include "cpustat.h"
+#include "task.h"
+#include "virtio_console.h"
+#include "kprobe.h"
+#include "tunable.h"
 
 // Basic utility functions
 void* memset(void* dest, int c, size_t n) {
@@ -25,6 +49,17 @@ void* memcpy(void* dest, const void* src, size_t n) {
     return dest;
 }
 
+int memcmp(const void* s1, const void* s2, size_t n) {
+    const unsigned char* a = (const unsigned char*)s1;
+    const unsigned char* b = (const unsigned char*)s2;
+    for (size_t i = 0; i < n; i++) {
+        if (a[i] != b[i]) {
+            return a[i] - b[i];
+        }
+    }
+    return 0;
+}
+
 int strcmp(const char* s1, const char* s2) {
     while (*s1 && (*s1 == *s2)) {
         s1++;
@@ -33,6 +68,53 @@ int strcmp(const char* s1, const char* s2) {
     return *(unsigned char*)s1 - *(unsigned char*)s2;
 }
 
+int strncmp(const char* s1, const char* s2, size_t n) {
+    while (n && *s1 && (*s1 == *s2)) {
+        s1++;
+        s2++;
+        n--;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    return *(unsigned char*)s1 - *(unsigned char*)s2;
+}
+
+u32 strtoul(const char* str, char** endptr, int base) {
+    u32 value = 0;
+    
+    // Base 0 picks hexadecimal for a 0x prefix and decimal otherwise
+    if ((base == 0 || base == 16) && str[0] == '0' && (str[1] == 'x' || str[1] == 'X')) {
+        str += 2;
+        base = 16;
+    } else if (base == 0) {
+        base = 10;
+    }
+    
+    while (*str) {
+        int digit;
+        if (*str >= '0' && *str <= '9') {
+            digit = *str - '0';
+        } else if (*str >= 'a' && *str <= 'f') {
+            digit = *str - 'a' + 10;
+        } else if (*str >= 'A' && *str <= 'F') {
+            digit = *str - 'A' + 10;
+        } else {
+            break;
+        }
+        if (digit >= base) {
+            break;
+        }
+        value = value * base + digit;
+        str++;
+    }
+    
+    if (endptr) {
+        *endptr = (char*)str;
+    }
+    return value;
+}
+
 size_t strlen(const char* str) {
     size_t len = 0;
     while (str[len]) {
@@ -41,7 +123,23 @@ size_t strlen(const char* str) {
     return len;
 }
 
-void kernel_panic(const char* message) {
+// 64-bit by 32-bit division without libgcc, using two 64/32 divl steps
+u64 div_u64_rem(u64 dividend, u32 divisor, u32* remainder) {
+    u32 high = (u32)(dividend >> 32);
+    u32 low = (u32)dividend;
+    u32 quotient_high = high / divisor;
+    u32 rem = high % divisor;
+    u32 quotient_low;
+    
+    __asm__ ("divl %4" : "=a"(quotient_low), "=d"(rem) : "a"(low), "d"(rem), "rm"(divisor));
+    
+    if (remainder) {
+        *remainder = rem;
+    }
+    return ((u64)quotient_high << 32) | quotient_low;
+}
+
+__cold void kernel_panic(const char* message) {
     vga_setcolor(vga_entry_color(VGA_COLOR_WHITE, VGA_COLOR_RED));
     vga_writestring("\nKERNEL PANIC: ");
     vga_writestring(message);
@@ -49,10 +147,89 @@ void kernel_panic(const char* message) {
     __asm__ volatile ("cli; hlt");
 }
 
+// Deferred initcalls: hardware the prompt does not need is brought up
+// from the idle loop afterwards, or by the first command that uses it
+static bool kernel_init_platform(void) {
+    // Firmware tables and the local APIC for MSI delivery
+    acpi_initialize();
+    lapic_initialize();
+    return true;
+}
+
+static bool kernel_init_pci(void) {
+    pci_initialize();
+    return true;
+}
+
+static bool kernel_init_storage(void) {
+    // Storage drivers bind to the devices found by the scan and register
+    // them with the block layer, alongside the RAM disk module
+    block_initialize();
+    ata_initialize();
+    virtio_blk_initialize();
+    ramdisk_initialize();
+    return block_get_count() != 0;
+}
+
+static bool kernel_init_network(void) {
+    net_initialize();
+    e1000_initialize();
+    return e1000_present();
+}
+
+static bool kernel_init_vconsole(void) {
+    virtio_console_initialize();
+    return virtio_console_present();
+}
+
+static bool kernel_init_rootfs(void) {
+    // Mount the RAM disk's filesystem unless something is already mounted
+    if (ext2_get_device()) {
+        return true;
+    }
+    return ext2_mount(block_find(RAMDISK_NAME)) == EXT2_OK;
+}
+
+// Console output: the screen mirrored to COM1, or only one of them.
+// Serial-only output falls back to the screen when there is no COM1.
+#define KERNEL_CONSOLE_BOTH     0
+#define KERNEL_CONSOLE_VGA      1
+#define KERNEL_CONSOLE_SERIAL   2
+
+static const char* const kernel_console_modes[] = {"both", "vga", "serial", 0};
+
+static bool kernel_set_console(u32 mode) {
+    bool serial = serial_present();
+    vga_set_mirror(serial && mode != KERNEL_CONSOLE_VGA ? serial_putchar : 0);
+    vga_set_screen(!serial || mode != KERNEL_CONSOLE_SERIAL);
+    return true;
+}
+
+static struct tunable kernel_console_tunable = {
+    .name = "console",
+    .description = "Console output (both, vga or serial)",
+    .type = TUNABLE_CHOICE,
+    .fallback = KERNEL_CONSOLE_BOTH,
+    .max = KERNEL_CONSOLE_SERIAL,
+    .choices = kernel_console_modes,
+    .apply = kernel_set_console,
+};
+
 // Kernel main function - entry point from assembly
-void kernel_main(void) {
-    // Initialize VGA driver
+void kernel_main(u32 multiboot_magic, u32 multiboot_info) {
+    boot_start();
+    
+    // Initialize VGA driver, mirrored to COM1 for headless runs
     vga_initialize();
+    if (serial_initialize()) {
+        vga_set_mirror(serial_putchar);
+    }
+    
+    // Parse boot information before anything can overwrite it, then
+    // apply the console= tunable from its command line
+    bool multiboot_ok = multiboot_initialize(multiboot_magic, multiboot_info);
+    kernel_set_console(tunable_register(&kernel_console_tunable));
+    boot_mark("VGA and Multiboot2");
     
     // Display welcome message
     vga_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
@@ -65,22 +242,82 @@ void kernel_main(void) {
     // Initialize GDT
     gdt_initialize();
     vga_writestring("GDT: OK\n");
+    boot_mark("GDT");
     
     // Initialize IDT
     idt_initialize();
+    kprobe_initialize();
     vga_writestring("IDT: OK\n");
+    boot_mark("IDT");
     
     // Initialize IRQs
     irq_initialize();
     vga_writestring("IRQ: OK\n");
+    boot_mark("IRQ");
+    
+    // Initialize system call entry paths
+    syscall_initialize();
+    vga_writestring("Syscalls: OK\n");
+    boot_mark("Syscalls");
+    
+    // Initialize physical memory and paging
+    if (!multiboot_ok) {
+        vga_writestring("Multiboot2: no boot information, assuming 16 MiB\n");
+    }
+    pmm_initialize();
+    paging_initialize();
+    vga_writestring("Paging: OK\n");
+    
+    // Reserve the DMA pool before anything can fragment low memory
+    if (dma_initialize()) {
+        const struct dma_stats* dma = dma_get_stats();
+        vga_writestring("DMA pool: ");
+        vga_write_dec(dma->pages * (PAGE_SIZE / 1024));
+        vga_writestring(" KiB at ");
+        vga_write_hex(dma->base);
+        vga_putchar('\n');
+    } else {
+        vga_writestring("DMA pool: no memory below ");
+        vga_write_hex(dma_get_stats()->limit);
+        vga_putchar('\n');
+    }
+    boot_mark("Memory and paging");
+    
+    // Initialize the ELF loader's demand paging
+    elf_initialize();
+    vga_writestring("ELF loader: OK\n");
+    boot_mark("ELF loader");
+    
+    // Index the initramfs archive
+    u32 initramfs_files = initramfs_initialize();
+    vga_writestring("Initramfs: ");
+    vga_write_dec(initramfs_files);
+    vga_writestring(" entries\n");
+    boot_mark("Initramfs");
     
     // Initialize keyboard
     keyboard_initialize();
     vga_writestring("Keyboard: OK\n");
+    boot_mark("Keyboard");
     
-    // Initialize timer (100Hz)
-    timer_initialize(100);
+    // CPU accounting (its windows are counted in timer ticks) and the async
+    // task executor polled from the shell's idle loop
+    cpustat_initialize();
+    task_initialize();
+    
+    // Initialize timer (100Hz unless timer.hz says otherwise)
+    timer_initialize();
     vga_writestring("Timer: OK\n");
+    boot_mark("Timer");
+    
+    // Everything else waits until after the prompt; see boottime
+    boot_initcall("platform", kernel_init_platform, BOOT_INIT_DEFERRED);
+    boot_initcall("pci", kernel_init_pci, BOOT_INIT_DEFERRED);
+    boot_initcall("storage", kernel_init_storage, BOOT_INIT_DEFERRED);
+    boot_initcall("network", kernel_init_network, BOOT_INIT_DEFERRED);
+    boot_initcall("vconsole", kernel_init_vconsole, BOOT_INIT_DEFERRED);
+    boot_initcall("rootfs", kernel_init_rootfs, BOOT_INIT_LAZY);
+    vga_writestring("Deferred: ACPI, PCI, storage, network, root filesystem\n");
     
     vga_writestring("VGA text mode driver: OK\n");
     
@@ -89,5 +326,6 @@ void kernel_main(void) {
     
     // Initialize and run shell
     shell_initialize();
+    boot_mark("Shell prompt");
     shell_run();
-}
\ No newline at end of file
+}
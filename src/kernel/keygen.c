@@ -0,0 +1,281 @@
+#include "keygen.h"
+#include "keyboard.h"
+#include "timer.h"
+#include "irq.h"
+#include "apic.h"
+#include "cpu.h"
+#include "irqtrace.h"
+
+#define KEYGEN_SCANCODE_ESC     0x01    // Ends a recording, and is not recorded
+#define KEYGEN_RELEASE          0x80
+
+static u8 keygen_stream[KEYGEN_STREAM_MAX];
+static struct keygen_stats keygen;
+
+// Injection state, touched only with interrupts off: from the timer
+// interrupt, the self-IPI handler, or keygen_run/keygen_stop
+static u32 keygen_position = 0;
+static u32 keygen_pass = 0;
+static u32 keygen_credit = 0;           // Scancodes owed, times the timer rate
+static u32 keygen_pending = 0;          // Due but not yet injected by IPI
+static bool keygen_ipi_busy = false;    // A self-IPI is raised or running
+static bool keygen_hooked = false;
+static int keygen_vector = -1;
+
+static u32 keygen_dropped_base = 0;
+static u64 keygen_last_stamp = 0;
+
+// Inject the next scancode, ending the run after the last pass
+static void keygen_inject_next(void) {
+    keyboard_inject(keygen_stream[keygen_position]);
+    keygen.injected++;
+    if (++keygen_position == keygen.length) {
+        keygen_position = 0;
+        if (++keygen_pass == keygen.passes) {
+            keygen.running = false;
+        }
+    }
+}
+
+// Timer interrupt: work out how many scancodes the rate makes due this
+// tick and inject them as a burst, or start an IPI chain for them
+static void keygen_tick(struct interrupt_context* ctx) {
+    (void)ctx;
+    if (!keygen.running) {
+        return;
+    }
+    u32 hz = timer_get_frequency();
+    keygen_credit += keygen.rate;
+    u32 due = keygen_credit / hz;
+    keygen_credit -= due * hz;
+
+    if (keygen.mode == KEYGEN_TIMER) {
+        while (due-- && keygen.running) {
+            keygen_inject_next();
+        }
+        return;
+    }
+    keygen_pending += due;
+    if (keygen_pending && !keygen_ipi_busy) {
+        keygen_ipi_busy = true;
+        lapic_send_self(keygen_vector);
+    }
+}
+
+// One scancode per self-IPI. The next one is raised before this handler's
+// EOI and taken as soon as it returns, so a burst arrives back to back,
+// each through a full interrupt entry like a real IRQ 1.
+static void keygen_ipi(struct interrupt_context* ctx) {
+    (void)ctx;
+    keygen.ipis++;
+    if (keygen.running && keygen_pending) {
+        keygen_pending--;
+        keygen_inject_next();
+    }
+    if (keygen.running && keygen_pending) {
+        lapic_send_self(keygen_vector);
+    } else {
+        keygen_pending = 0;
+        keygen_ipi_busy = false;
+    }
+}
+
+// Keyboard monitor while recording
+static void keygen_capture(u8 scancode) {
+    if (scancode == KEYGEN_SCANCODE_ESC) {
+        keyboard_set_monitor(0);
+        keygen.recording = false;
+        return;
+    }
+    if ((scancode & ~KEYGEN_RELEASE) == KEYGEN_SCANCODE_ESC) {
+        return;
+    }
+    if (keygen.length < KEYGEN_STREAM_MAX) {
+        keygen_stream[keygen.length++] = scancode;
+    }
+}
+
+// Stream that types text: make and break codes, wrapped in left shift
+// where the character needs it
+int keygen_set_text(const char* text) {
+    if (keygen.running || keygen.recording) {
+        return KEYGEN_ERR_BUSY;
+    }
+    u32 length = 0;
+    for (const char* c = text; *c; c++) {
+        u8 scancode;
+        bool shift;
+        if (!keyboard_encode(*c, &scancode, &shift)) {
+            return KEYGEN_ERR_UNTYPABLE;
+        }
+        if (length + (shift ? 4 : 2) > KEYGEN_STREAM_MAX) {
+            return KEYGEN_ERR_TOO_LONG;
+        }
+        if (shift) keygen_stream[length++] = KEY_LSHIFT;
+        keygen_stream[length++] = scancode;
+        keygen_stream[length++] = scancode | KEYGEN_RELEASE;
+        if (shift) keygen_stream[length++] = KEY_LSHIFT | KEYGEN_RELEASE;
+    }
+    keygen.length = length;
+    return length ? KEYGEN_OK : KEYGEN_ERR_EMPTY;
+}
+
+// Stream of raw scancodes, e.g. a recording saved to the initramfs
+int keygen_set_scancodes(const u8* scancodes, u32 length) {
+    if (keygen.running || keygen.recording) {
+        return KEYGEN_ERR_BUSY;
+    }
+    if (length > KEYGEN_STREAM_MAX) {
+        return KEYGEN_ERR_TOO_LONG;
+    }
+    memcpy(keygen_stream, scancodes, length);
+    keygen.length = length;
+    return length ? KEYGEN_OK : KEYGEN_ERR_EMPTY;
+}
+
+// Record the controller's scancodes as the stream until Esc or keygen_stop
+int keygen_record(void) {
+    if (keygen.running || keygen.recording) {
+        return KEYGEN_ERR_BUSY;
+    }
+    u32 flags = irq_save();
+    keygen.length = 0;
+    keygen.recording = true;
+    keyboard_set_monitor(keygen_capture);
+    irq_restore(flags);
+    return KEYGEN_OK;
+}
+
+void keygen_stop(void) {
+    u32 flags = irq_save();
+    if (keygen.recording) {
+        keyboard_set_monitor(0);
+        keygen.recording = false;
+    }
+    keygen.running = false;
+    irq_restore(flags);
+}
+
+// Inject the stream passes times at rate scancodes per second. Returns at
+// once: the shell consumes the input as it arrives, like typed keys.
+int keygen_run(u32 rate, u32 passes, u32 mode) {
+    if (keygen.running || keygen.recording) {
+        return KEYGEN_ERR_BUSY;
+    }
+    if (keygen.length == 0) {
+        return KEYGEN_ERR_EMPTY;
+    }
+    if (rate == 0 || rate > KEYGEN_RATE_MAX || passes == 0 || mode > KEYGEN_IPI) {
+        return KEYGEN_ERR_INVALID;
+    }
+    if (mode == KEYGEN_IPI && keygen_vector < 0) {
+        if (!lapic_present() || (keygen_vector = irq_alloc_msi(keygen_ipi)) < 0) {
+            return KEYGEN_ERR_NO_IPI;
+        }
+    }
+    if (!keygen_hooked) {
+        keygen_hooked = irq_share_handler(0, keygen_tick);
+    }
+
+    u32 flags = irq_save();
+    keygen_reset();
+    keygen_position = 0;
+    keygen_pass = 0;
+    keygen_credit = 0;
+    keygen_pending = 0;
+    keygen.rate = rate;
+    keygen.passes = passes;
+    keygen.mode = mode;
+    keygen.running = true;
+    irq_restore(flags);
+    return KEYGEN_OK;
+}
+
+// Called by the shell right after it echoes a character. Only injected
+// characters carry a stamp.
+void keygen_echoed(void) {
+    u64 stamp = keyboard_get_stamp();
+    if (stamp == 0 || stamp == keygen_last_stamp) {
+        return;
+    }
+    keygen_last_stamp = stamp;
+    u64 now = rdtsc();
+    u64 latency = now - stamp;
+    keygen.echoed++;
+    keygen.last_echo = now;
+    keygen.latency_total += latency;
+    if (latency > keygen.latency_max) {
+        keygen.latency_max = latency;
+    }
+
+    // Bucket: the position of the top bit, then the next KEYGEN_SUB_BITS
+    u32 value = latency >> 32 ? 0xFFFFFFFF : (u32)latency;
+    u32 bucket = value;
+    if (value >= KEYGEN_SUB_BUCKETS) {
+        u32 top = 31 - __builtin_clz(value);
+        bucket = ((top - KEYGEN_SUB_BITS + 1) << KEYGEN_SUB_BITS) |
+                 ((value >> (top - KEYGEN_SUB_BITS)) & (KEYGEN_SUB_BUCKETS - 1));
+    }
+    keygen.histogram[bucket]++;
+}
+
+// Clear the counters, keeping the stream and any run in progress
+void keygen_reset(void) {
+    u32 flags = irq_save();
+    struct keygen_stats saved = keygen;
+    memset(&keygen, 0, sizeof(keygen));
+    keygen.running = saved.running;
+    keygen.recording = saved.recording;
+    keygen.mode = saved.mode;
+    keygen.rate = saved.rate;
+    keygen.length = saved.length;
+    keygen.passes = saved.passes;
+    keygen.start = rdtsc();
+    keygen_dropped_base = keyboard_get_dropped();
+    irq_restore(flags);
+}
+
+const struct keygen_stats* keygen_get_stats(void) {
+    keygen.dropped = keyboard_get_dropped() - keygen_dropped_base;
+    return &keygen;
+}
+
+// Upper bound of the bucket holding the given per-mille latency, in cycles
+u64 keygen_percentile(u32 permille) {
+    if (keygen.echoed == 0) {
+        return 0;
+    }
+    u64 target = div_u64_rem((u64)keygen.echoed * permille + 999, 1000, 0);
+    u64 seen = 0;
+    for (u32 bucket = 0; bucket < KEYGEN_BUCKETS; bucket++) {
+        seen += keygen.histogram[bucket];
+        if (seen < target) {
+            continue;
+        }
+        if (bucket < KEYGEN_SUB_BUCKETS) {
+            return bucket;
+        }
+        u32 top = (bucket >> KEYGEN_SUB_BITS) + KEYGEN_SUB_BITS - 1;
+        u64 low = (u64)((bucket & (KEYGEN_SUB_BUCKETS - 1)) | KEYGEN_SUB_BUCKETS) << (top - KEYGEN_SUB_BITS);
+        u64 high = low + (1ull << (top - KEYGEN_SUB_BITS)) - 1;
+        return high < keygen.latency_max ? high : keygen.latency_max;
+    }
+    return keygen.latency_max;
+}
+
+static const char* keygen_errors[] = {
+    "Success",
+    "Generator is running or recording",
+    "Stream is empty",
+    "Stream is too long",
+    "Character has no key",
+    "No local APIC for self-IPIs",
+    "Invalid rate, count or mode",
+};
+
+const char* keygen_strerror(int status) {
+    if (status < 0 || status > KEYGEN_ERR_INVALID) {
+        return "Unknown error";
+    }
+    return keygen_errors[status];
+}
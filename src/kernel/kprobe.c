@@ -0,0 +1,295 @@
+#include "kprobe.h"
+#include "ksyms.h"
+#include "idt.h"
+#include "cpu.h"
+#include "profile.h"
+
+#define EFLAGS_TF               0x100
+#define EFLAGS_IF               0x200
+#define DR6_BS                  0x4000  // Single-step trap
+
+// First bytes that need care when stepped with interrupts held off
+#define OPCODE_PUSHF            0x9C
+#define OPCODE_POPF             0x9D
+#define OPCODE_IRET             0xCF
+#define OPCODE_CLI              0xFA
+#define OPCODE_STI              0xFB
+
+static struct kprobe kprobes[KPROBE_MAX];
+
+// Probed calls in progress, innermost last. Each remembers the stack slot
+// whose return address was swapped so the trampoline can find its entry
+// even after an abandoned frame (a killed user program's system call).
+struct kprobe_call {
+    u32 slot;
+    u32 return_address;
+    u32 probe;
+    u32 address;                // Of the probe, in case the slot was reused
+    u64 start;
+};
+
+static struct kprobe_call kprobe_calls[KPROBE_DEPTH];
+static u32 kprobe_depth = 0;
+
+// The probe being single-stepped, and the call whose clock starts when
+// the step completes
+static struct kprobe* kprobe_stepping = 0;
+static struct kprobe_call* kprobe_step_call = 0;
+static u32 kprobe_step_flags = 0;
+
+// Functions the breakpoint path runs through cannot be probed themselves
+static const char* kprobe_refused[] = {
+    "interrupt_handler",
+    "isr_common_stub",
+    "isr1",
+    "isr3",
+    "kernel_panic",
+    0
+};
+
+// The probe path cannot use irq_save: the tracer hooks it calls may be
+// probed
+static inline u32 kprobe_irq_save(void) {
+    u32 flags;
+    __asm__ volatile ("pushf; pop %0; cli" : "=r"(flags) : : "memory");
+    return flags;
+}
+
+static inline void kprobe_irq_restore(u32 flags) {
+    __asm__ volatile ("push %0; popf" : : "r"(flags) : "memory", "cc");
+}
+
+// Kernel text is identity mapped and writable. The iret that leaves the
+// next trap serializes, so the CPU never runs a stale copy.
+static void kprobe_patch(u32 address, u8 value) {
+    *(volatile u8*)address = value;
+}
+
+static struct kprobe* kprobe_find_address(u32 address) {
+    for (u32 i = 0; i < KPROBE_MAX; i++) {
+        if (kprobes[i].active && kprobes[i].address == address) {
+            return &kprobes[i];
+        }
+    }
+    return 0;
+}
+
+// #BP: count the hit, swap the return address for the trampoline, put
+// the original byte back and single-step it with interrupts off
+static bool kprobe_breakpoint(struct interrupt_context* ctx) {
+    if (ctx->cs & 3) {
+        return false;
+    }
+    struct kprobe* probe = kprobe_find_address(ctx->eip - 1);
+    if (!probe) {
+        return false;
+    }
+    probe->hits++;
+
+    // Without a privilege change the CPU pushes no esp, so the
+    // interrupted stack starts where useresp would be: at the return
+    // address, since the probe sits on the function's first instruction
+    u32* slot = &ctx->useresp;
+    kprobe_step_call = 0;
+    if (kprobe_depth < KPROBE_DEPTH) {
+        struct kprobe_call* call = &kprobe_calls[kprobe_depth++];
+        call->slot = (u32)slot;
+        call->return_address = *slot;
+        call->probe = probe - kprobes;
+        call->address = probe->address;
+        call->start = 0;
+        *slot = (u32)kprobe_trampoline;
+        kprobe_step_call = call;
+    } else {
+        probe->missed++;
+    }
+
+    kprobe_patch(probe->address, probe->saved);
+    ctx->eip = probe->address;
+    kprobe_step_flags = ctx->eflags;
+    ctx->eflags = (ctx->eflags | EFLAGS_TF) & ~EFLAGS_IF;
+    kprobe_stepping = probe;
+    return true;
+}
+
+// #DB after the step: re-arm the probe, give back the interrupt flag the
+// function was entered with, and start the call's clock
+static bool kprobe_debug(struct interrupt_context* ctx) {
+    u32 dr6;
+    __asm__ volatile ("mov %%dr6, %0" : "=r"(dr6));
+    if (!kprobe_stepping || !(dr6 & DR6_BS)) {
+        return false;
+    }
+    __asm__ volatile ("mov %0, %%dr6" : : "r"(0));
+
+    struct kprobe* probe = kprobe_stepping;
+    kprobe_stepping = 0;
+    kprobe_patch(probe->address, KPROBE_INT3);
+
+    u32 flags = kprobe_step_flags & EFLAGS_IF;
+    if (probe->saved == OPCODE_CLI) {
+        flags = 0;
+    } else if (probe->saved == OPCODE_STI) {
+        flags = EFLAGS_IF;
+    } else if (probe->saved == OPCODE_PUSHF) {
+        // The image was pushed mid-step: drop TF, or the function's popf
+        // would trap with no probe stepping
+        u32* pushed = &ctx->useresp;
+        *pushed = (*pushed & ~(EFLAGS_TF | EFLAGS_IF)) | flags;
+    }
+    ctx->eflags = (ctx->eflags & ~(EFLAGS_TF | EFLAGS_IF)) | flags;
+
+    if (kprobe_step_call) {
+        kprobe_step_call->start = rdtsc();
+        kprobe_step_call = 0;
+    }
+    return true;
+}
+
+// The probed function returned into kprobe_trampoline. Entries above the
+// matching one belong to frames that never returned and are dropped.
+u32 kprobe_return(u32 slot) {
+    u64 now = rdtsc();
+    u32 flags = kprobe_irq_save();
+    u32 depth = kprobe_depth;
+    while (depth && kprobe_calls[depth - 1].slot != slot) {
+        depth--;
+    }
+    if (depth == 0) {
+        kernel_panic("kprobe: return address lost");
+    }
+
+    struct kprobe_call* call = &kprobe_calls[depth - 1];
+    struct kprobe* probe = &kprobes[call->probe];
+    if (probe->active && probe->address == call->address && call->start) {
+        u64 cycles = now - call->start;
+        probe->returns++;
+        probe->cycles += cycles;
+        if (cycles > probe->cycles_max) {
+            probe->cycles_max = cycles;
+        }
+    }
+    u32 return_address = call->return_address;
+    kprobe_depth = depth - 1;
+    kprobe_irq_restore(flags);
+    return return_address;
+}
+
+void kprobe_initialize(void) {
+    memset(kprobes, 0, sizeof(kprobes));
+    kprobe_depth = 0;
+    kprobe_stepping = 0;
+    idt_install_exception_handler(1, kprobe_debug);
+    idt_install_exception_handler(3, kprobe_breakpoint);
+}
+
+static bool kprobe_is_refused(const char* name) {
+    if (strncmp(name, "kprobe_", 7) == 0) {
+        return true;
+    }
+    for (u32 i = 0; kprobe_refused[i]; i++) {
+        if (strcmp(kprobe_refused[i], name) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int kprobe_add(const char* name) {
+    if (strlen(name) >= KPROBE_NAME_MAX || kprobe_is_refused(name)) {
+        return KPROBE_ERR_REFUSED;
+    }
+    u32 address = ksyms_lookup(name);
+    if (address < (u32)__text_start || address >= (u32)__text_end) {
+        return KPROBE_ERR_NO_SYMBOL;
+    }
+
+    u32 flags = kprobe_irq_save();
+    int status = KPROBE_OK;
+    struct kprobe* probe = 0;
+    u8 first = *(volatile u8*)address;
+    if (kprobe_find_address(address)) {
+        status = KPROBE_ERR_EXISTS;
+    } else if (first == KPROBE_INT3 || first == OPCODE_POPF || first == OPCODE_IRET) {
+        // popf and iret would clear the trap flag they are stepped with
+        status = KPROBE_ERR_REFUSED;
+    } else {
+        for (u32 i = 0; i < KPROBE_MAX && !probe; i++) {
+            if (!kprobes[i].active) {
+                probe = &kprobes[i];
+            }
+        }
+        if (!probe) {
+            status = KPROBE_ERR_FULL;
+        }
+    }
+    if (probe) {
+        memset(probe, 0, sizeof(*probe));
+        memcpy(probe->name, name, strlen(name) + 1);
+        probe->address = address;
+        probe->saved = first;
+        probe->active = true;
+        kprobe_patch(address, KPROBE_INT3);
+    }
+    kprobe_irq_restore(flags);
+    return status;
+}
+
+int kprobe_remove(const char* name) {
+    u32 flags = kprobe_irq_save();
+    int status = KPROBE_ERR_NOT_FOUND;
+    for (u32 i = 0; i < KPROBE_MAX; i++) {
+        if (kprobes[i].active && strcmp(kprobes[i].name, name) == 0) {
+            kprobe_patch(kprobes[i].address, kprobes[i].saved);
+            kprobes[i].active = false;
+            status = KPROBE_OK;
+        }
+    }
+    kprobe_irq_restore(flags);
+    return status;
+}
+
+// Put every patched byte back. Warm restarts call this first, since they
+// do not reload .text.
+void kprobe_remove_all(void) {
+    u32 flags = kprobe_irq_save();
+    for (u32 i = 0; i < KPROBE_MAX; i++) {
+        if (kprobes[i].active) {
+            kprobe_patch(kprobes[i].address, kprobes[i].saved);
+            kprobes[i].active = false;
+        }
+    }
+    kprobe_irq_restore(flags);
+}
+
+void kprobe_reset(void) {
+    u32 flags = kprobe_irq_save();
+    for (u32 i = 0; i < KPROBE_MAX; i++) {
+        kprobes[i].hits = 0;
+        kprobes[i].returns = 0;
+        kprobes[i].missed = 0;
+        kprobes[i].cycles = 0;
+        kprobes[i].cycles_max = 0;
+    }
+    kprobe_irq_restore(flags);
+}
+
+const struct kprobe* kprobe_get(u32 index) {
+    return index < KPROBE_MAX && kprobes[index].active ? &kprobes[index] : 0;
+}
+
+static const char* kprobe_errors[] = {
+    "Success",
+    "No such function",
+    "Already probed",
+    "Too many probes",
+    "Cannot probe this function",
+    "No such probe",
+};
+
+const char* kprobe_strerror(int status) {
+    if (status < 0 || status > KPROBE_ERR_NOT_FOUND) {
+        return "Unknown error";
+    }
+    return kprobe_errors[status];
+}
@@ -0,0 +1,34 @@
+#include "ksyms.h"
+
+// Address of the named function, or 0. Static functions with the same
+// name in several files resolve to the lowest address.
+u32 ksyms_lookup(const char* name) {
+    for (u32 i = 0; i < ksyms_count; i++) {
+        if (strcmp(ksyms_table[i].name, name) == 0) {
+            return ksyms_table[i].address;
+        }
+    }
+    return 0;
+}
+
+// Name of the function containing address and the offset into it, or 0
+// below the first symbol
+const char* ksyms_find(u32 address, u32* offset) {
+    u32 lo = 0;
+    u32 hi = ksyms_count;
+    while (lo < hi) {
+        u32 mid = (lo + hi) / 2;
+        if (ksyms_table[mid].address <= address) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == 0) {
+        return 0;
+    }
+    if (offset) {
+        *offset = address - ksyms_table[lo - 1].address;
+    }
+    return ksyms_table[lo - 1].name;
+}
@@ -0,0 +1,124 @@
+#include "multiboot.h"
+
+// Parsed boot information
+static bool multiboot_valid = false;
+static u32 multiboot_info_addr = 0;
+static u32 multiboot_info_size = 0;
+static const char* multiboot_cmdline = "";
+static const struct multiboot_tag_mmap* multiboot_mmap = 0;
+static u32 multiboot_mem_upper = 0;
+static const void* multiboot_acpi_rsdp = 0;
+static struct multiboot_module multiboot_modules[MULTIBOOT_MAX_MODULES];
+static u32 multiboot_module_count = 0;
+
+bool multiboot_initialize(u32 magic, u32 info_addr) {
+    multiboot_valid = false;
+    multiboot_module_count = 0;
+
+    if (magic != MULTIBOOT2_BOOTLOADER_MAGIC || info_addr == 0) {
+        return false;
+    }
+
+    const struct multiboot_info* info = (const struct multiboot_info*)(uptr)info_addr;
+    multiboot_info_addr = info_addr;
+    multiboot_info_size = info->total_size;
+
+    // Tags follow the fixed header and are padded to 8 bytes
+    u32 addr = info_addr + sizeof(struct multiboot_info);
+    u32 end = info_addr + info->total_size;
+    while (addr + sizeof(struct multiboot_tag) <= end) {
+        const struct multiboot_tag* tag = (const struct multiboot_tag*)(uptr)addr;
+        if (tag->type == MULTIBOOT_TAG_END) {
+            break;
+        }
+
+        switch (tag->type) {
+            case MULTIBOOT_TAG_CMDLINE:
+                multiboot_cmdline = ((const struct multiboot_tag_string*)tag)->string;
+                break;
+
+            case MULTIBOOT_TAG_MODULE:
+                if (multiboot_module_count < MULTIBOOT_MAX_MODULES) {
+                    const struct multiboot_tag_module* module = (const struct multiboot_tag_module*)tag;
+                    struct multiboot_module* entry = &multiboot_modules[multiboot_module_count++];
+                    entry->start = module->mod_start;
+                    entry->end = module->mod_end;
+                    entry->cmdline = module->cmdline;
+                }
+                break;
+
+            case MULTIBOOT_TAG_BASIC_MEMINFO:
+                multiboot_mem_upper = ((const struct multiboot_tag_basic_meminfo*)tag)->mem_upper;
+                break;
+
+            case MULTIBOOT_TAG_MMAP:
+                multiboot_mmap = (const struct multiboot_tag_mmap*)tag;
+                break;
+
+            case MULTIBOOT_TAG_ACPI_OLD:
+            case MULTIBOOT_TAG_ACPI_NEW:
+                // Prefer the ACPI 2.0 RSDP copy when both are present
+                if (!multiboot_acpi_rsdp || tag->type == MULTIBOOT_TAG_ACPI_NEW) {
+                    multiboot_acpi_rsdp = (const void*)(addr + sizeof(struct multiboot_tag));
+                }
+                break;
+        }
+
+        addr += (tag->size + 7) & ~7;
+    }
+
+    multiboot_valid = true;
+    return true;
+}
+
+bool multiboot_present(void) {
+    return multiboot_valid;
+}
+
+u32 multiboot_get_info_addr(void) {
+    return multiboot_info_addr;
+}
+
+u32 multiboot_get_info_size(void) {
+    return multiboot_info_size;
+}
+
+const char* multiboot_get_cmdline(void) {
+    return multiboot_cmdline;
+}
+
+const struct multiboot_tag_mmap* multiboot_get_mmap(void) {
+    return multiboot_mmap;
+}
+
+u32 multiboot_get_mem_upper(void) {
+    return multiboot_mem_upper;
+}
+
+// The RSDP copy embedded in the boot information, if the loader gave one
+const void* multiboot_get_acpi_rsdp(void) {
+    return multiboot_acpi_rsdp;
+}
+
+u32 multiboot_get_module_count(void) {
+    return multiboot_module_count;
+}
+
+const struct multiboot_module* multiboot_get_module(u32 index) {
+    if (index < multiboot_module_count) {
+        return &multiboot_modules[index];
+    }
+    return 0;
+}
+
+// Modules are named by the first word of their command line in grub.cfg
+const struct multiboot_module* multiboot_find_module(const char* name) {
+    size_t len = strlen(name);
+    for (u32 i = 0; i < multiboot_module_count; i++) {
+        const char* cmdline = multiboot_modules[i].cmdline;
+        if (strncmp(cmdline, name, len) == 0 && (cmdline[len] == '\0' || cmdline[len] == ' ')) {
+            return &multiboot_modules[i];
+        }
+    }
+    return 0;
+}
\ No newline at end of file
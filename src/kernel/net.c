@@ -0,0 +1,246 @@
+#include "net.h"
+#include "cpu.h"
+#include "irqtrace.h"
+#include "dma.h"
+
+// Registered interfaces
+static struct net_interface* net_interfaces[NET_MAX_INTERFACES];
+static u32 net_count = 0;
+
+// Packet buffers and their free list. Their data comes from the DMA
+// pool's largest size class, so NICs receive straight into them.
+static struct net_buffer net_buffers[NET_BUFFERS];
+static struct net_buffer* net_free_list = 0;
+static u32 net_free_count = 0;
+
+static const u8 net_broadcast[ETH_ALEN] = {0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF};
+
+void net_initialize(void) {
+    net_count = 0;
+    net_free_list = 0;
+    net_free_count = 0;
+    for (u32 i = 0; i < NET_BUFFERS; i++) {
+        if (!net_buffers[i].data) {
+            net_buffers[i].data = dma_alloc(NET_BUFFER_SIZE, 0);
+        }
+        if (!net_buffers[i].data) {
+            break;
+        }
+        net_buffer_free(&net_buffers[i]);
+    }
+}
+
+bool net_register(struct net_interface* iface) {
+    if (net_count == NET_MAX_INTERFACES) {
+        return false;
+    }
+    iface->address = NET_DEFAULT_ADDRESS;
+    iface->pending_count = 0;
+    net_reset_stats(iface);
+    net_interfaces[net_count++] = iface;
+    return true;
+}
+
+u32 net_get_count(void) {
+    return net_count;
+}
+
+struct net_interface* net_get(u32 index) {
+    if (index < net_count) {
+        return net_interfaces[index];
+    }
+    return 0;
+}
+
+struct net_buffer* net_buffer_alloc(void) {
+    u32 flags = irq_save();
+    struct net_buffer* buffer = net_free_list;
+    if (buffer) {
+        net_free_list = buffer->next;
+        net_free_count--;
+        buffer->next = 0;
+        buffer->length = 0;
+    }
+    irq_restore(flags);
+    return buffer;
+}
+
+void net_buffer_free(struct net_buffer* buffer) {
+    u32 flags = irq_save();
+    buffer->next = net_free_list;
+    net_free_list = buffer;
+    net_free_count++;
+    irq_restore(flags);
+}
+
+u32 net_buffer_available(void) {
+    return net_free_count;
+}
+
+// Internet checksum (RFC 1071)
+u16 net_checksum(const void* data, u32 length) {
+    const u8* bytes = (const u8*)data;
+    u32 sum = 0;
+    for (u32 i = 0; i + 1 < length; i += 2) {
+        sum += ((u32)bytes[i] << 8) | bytes[i + 1];
+    }
+    if (length & 1) {
+        sum += (u32)bytes[length - 1] << 8;
+    }
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return net_htons((u16)~sum);
+}
+
+// Turn the frame around in place: the reply leaves in the buffer the
+// request arrived in
+static void net_reply_ethernet(struct net_interface* iface, struct eth_header* eth) {
+    memcpy(eth->dest, eth->source, ETH_ALEN);
+    memcpy(eth->source, iface->mac, ETH_ALEN);
+}
+
+static bool net_handle_arp(struct net_interface* iface, struct net_buffer* buffer) {
+    struct eth_header* eth = (struct eth_header*)buffer->data;
+    struct arp_packet* arp = (struct arp_packet*)(buffer->data + ETH_HLEN);
+    if (buffer->length < ETH_HLEN + sizeof(struct arp_packet) ||
+        arp->htype != net_htons(ARP_HTYPE_ETHERNET) || arp->ptype != net_htons(ETH_TYPE_IPV4) ||
+        arp->op != net_htons(ARP_OP_REQUEST) || arp->tpa != net_htonl(iface->address)) {
+        return false;
+    }
+
+    arp->op = net_htons(ARP_OP_REPLY);
+    memcpy(arp->tha, arp->sha, ETH_ALEN);
+    arp->tpa = arp->spa;
+    memcpy(arp->sha, iface->mac, ETH_ALEN);
+    arp->spa = net_htonl(iface->address);
+    net_reply_ethernet(iface, eth);
+
+    if (net_transmit(iface, buffer) == NET_OK) {
+        iface->stats.arp_replies++;
+    }
+    return true;
+}
+
+// Swapping source and destination leaves the UDP checksum valid, since
+// the pseudo-header sum does not depend on their order
+static bool net_handle_ipv4(struct net_interface* iface, struct net_buffer* buffer) {
+    struct eth_header* eth = (struct eth_header*)buffer->data;
+    struct ipv4_header* ip = (struct ipv4_header*)(buffer->data + ETH_HLEN);
+    if (buffer->length < ETH_HLEN + sizeof(struct ipv4_header) + sizeof(struct udp_header) ||
+        ip->version_ihl != 0x45 || ip->protocol != IP_PROTO_UDP ||
+        (ip->fragment & net_htons(0x3FFF)) || ip->dest != net_htonl(iface->address) ||
+        (u32)net_ntohs(ip->length) + ETH_HLEN > buffer->length ||
+        net_checksum(ip, sizeof(*ip)) != 0) {
+        return false;
+    }
+
+    struct udp_header* udp = (struct udp_header*)(ip + 1);
+    if (udp->dest != net_htons(NET_ECHO_PORT)) {
+        return false;
+    }
+
+    u16 port = udp->source;
+    udp->source = udp->dest;
+    udp->dest = port;
+    ip->dest = ip->source;
+    ip->source = net_htonl(iface->address);
+    ip->ttl = IP_TTL_DEFAULT;
+    ip->checksum = 0;
+    ip->checksum = net_checksum(ip, sizeof(*ip));
+    net_reply_ethernet(iface, eth);
+    buffer->length = ETH_HLEN + net_ntohs(ip->length);
+    if (buffer->length < ETH_ZLEN) {
+        memset(buffer->data + buffer->length, 0, ETH_ZLEN - buffer->length);
+        buffer->length = ETH_ZLEN;
+    }
+
+    u64 stamp = buffer->timestamp;
+    if (net_transmit(iface, buffer) != NET_OK) {
+        return true;
+    }
+    iface->stats.udp_echoes++;
+    if (iface->pending_count < NET_LATENCY_BATCH) {
+        iface->pending_stamps[iface->pending_count++] = stamp;
+    }
+    return true;
+}
+
+// Called by drivers for each received frame, in interrupt context or from
+// a poll pass. The buffer belongs to the stack from here on.
+__hot void net_receive(struct net_interface* iface, struct net_buffer* buffer) {
+    struct eth_header* eth = (struct eth_header*)buffer->data;
+    iface->stats.rx_packets++;
+    iface->stats.rx_bytes += buffer->length;
+
+    bool handled = false;
+    if (buffer->length >= ETH_HLEN &&
+        (memcmp(eth->dest, iface->mac, ETH_ALEN) == 0 || memcmp(eth->dest, net_broadcast, ETH_ALEN) == 0)) {
+        if (eth->type == net_htons(ETH_TYPE_ARP)) {
+            handled = net_handle_arp(iface, buffer);
+        } else if (eth->type == net_htons(ETH_TYPE_IPV4)) {
+            handled = net_handle_ipv4(iface, buffer);
+        }
+    }
+    if (!handled) {
+        iface->stats.rx_dropped++;
+        net_buffer_free(buffer);
+    }
+}
+
+// Queue a frame; it is not sent until net_flush. The driver frees the
+// buffer once the NIC is done with it, or here if it cannot be queued.
+int net_transmit(struct net_interface* iface, struct net_buffer* buffer) {
+    if (buffer->length == 0 || buffer->length > NET_BUFFER_SIZE) {
+        net_buffer_free(buffer);
+        return NET_ERR_INVALID;
+    }
+    u32 length = buffer->length;
+    int status = iface->ops->transmit(iface, buffer);
+    if (status != NET_OK) {
+        iface->stats.tx_dropped++;
+        net_buffer_free(buffer);
+        return status;
+    }
+    iface->stats.tx_packets++;
+    iface->stats.tx_bytes += length;
+    return NET_OK;
+}
+
+void net_flush(struct net_interface* iface) {
+    u32 flags = irq_save();
+    iface->ops->flush(iface);
+    iface->stats.flushes++;
+
+    // Latency runs from the driver picking a request up to the doorbell
+    // that sends its reply
+    u64 now = rdtsc();
+    for (u32 i = 0; i < iface->pending_count; i++) {
+        u64 latency = now - iface->pending_stamps[i];
+        iface->stats.latency_total += latency;
+        iface->stats.latency_samples++;
+        if (latency < iface->stats.latency_min) iface->stats.latency_min = latency;
+        if (latency > iface->stats.latency_max) iface->stats.latency_max = latency;
+    }
+    iface->pending_count = 0;
+    irq_restore(flags);
+}
+
+// Service interfaces in polling mode; true while any still is
+bool net_poll(void) {
+    bool polling = false;
+    for (u32 i = 0; i < net_count; i++) {
+        struct net_interface* iface = net_interfaces[i];
+        if (iface->ops->poll && iface->ops->poll(iface, NET_POLL_BUDGET)) {
+            polling = true;
+        }
+    }
+    return polling;
+}
+
+void net_reset_stats(struct net_interface* iface) {
+    u32 flags = irq_save();
+    memset(&iface->stats, 0, sizeof(iface->stats));
+    iface->stats.latency_min = (u64)-1;
+    irq_restore(flags);
+}
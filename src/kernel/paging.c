@@ -0,0 +1,162 @@
+#include "paging.h"
+#include "pmm.h"
+#include "cpu.h"
+
+// Kernel page directory and the page table for the first 4 MiB
+static u32 page_directory[1024] __attribute__((aligned(PAGE_SIZE)));
+static u32 low_page_table[1024] __attribute__((aligned(PAGE_SIZE)));
+static bool paging_pse = false;
+
+// Linker symbols bounding code and data reachable from ring 3
+extern char __user_start[];
+extern char __user_end[];
+
+void paging_initialize(void) {
+    bool pse = cpu_has_feature_edx(CPUID_FEAT_EDX_PSE);
+    paging_pse = pse;
+
+    memset(page_directory, 0, sizeof(page_directory));
+
+    // The first 4 MiB uses 4 KiB pages so that page 0 stays unmapped to
+    // catch NULL dereferences and the .user section can be opened to ring 3
+    for (u32 i = 0; i < 1024; i++) {
+        u32 addr = i * PAGE_SIZE;
+        u32 flags = PAGE_PRESENT | PAGE_WRITE;
+        if (addr >= (u32)__user_start && addr < (u32)__user_end) {
+            flags |= PAGE_USER;
+        }
+        low_page_table[i] = i ? (addr | flags) : 0;
+    }
+    page_directory[0] = (u32)low_page_table | PAGE_PRESENT | PAGE_WRITE | PAGE_USER;
+
+    // The rest of the identity map uses 4 MiB pages when available
+    for (u32 pd = 1; pd < PAGING_IDENTITY_LIMIT / LARGE_PAGE_SIZE; pd++) {
+        u32 base = pd * LARGE_PAGE_SIZE;
+        if (pse) {
+            page_directory[pd] = base | PAGE_PRESENT | PAGE_WRITE | PAGE_LARGE;
+            continue;
+        }
+
+        u32 table = pmm_alloc_frame();
+        if (!table) {
+            kernel_panic("Out of memory for page tables");
+        }
+        u32* entries = (u32*)table;
+        for (u32 i = 0; i < 1024; i++) {
+            entries[i] = (base + i * PAGE_SIZE) | PAGE_PRESENT | PAGE_WRITE;
+        }
+        page_directory[pd] = table | PAGE_PRESENT | PAGE_WRITE;
+    }
+
+    if (pse) {
+        u32 cr4;
+        __asm__ volatile ("mov %%cr4, %0" : "=r"(cr4));
+        cr4 |= 0x10;    // PSE
+        __asm__ volatile ("mov %0, %%cr4" : : "r"(cr4));
+    }
+
+    __asm__ volatile ("mov %0, %%cr3" : : "r"(page_directory));
+
+    u32 cr0;
+    __asm__ volatile ("mov %%cr0, %0" : "=r"(cr0));
+    cr0 |= 0x80010000;  // PG and WP (read-only pages apply to ring 0 too)
+    __asm__ volatile ("mov %0, %%cr0" : : "r"(cr0));
+}
+
+bool paging_map_page(u32 virt, u32 phys, u32 flags) {
+    u32 pd = virt >> 22;
+    u32 pt = (virt >> 12) & 0x3FF;
+
+    if (!(page_directory[pd] & PAGE_PRESENT)) {
+        u32 table = pmm_alloc_frame();
+        if (!table) {
+            return false;
+        }
+        memset((void*)table, 0, PAGE_SIZE);
+        page_directory[pd] = table | PAGE_PRESENT | PAGE_WRITE | (flags & PAGE_USER);
+    } else if (page_directory[pd] & PAGE_LARGE) {
+        return false;
+    }
+
+    u32* table = (u32*)(page_directory[pd] & PAGE_MASK);
+    table[pt] = (phys & PAGE_MASK) | (flags & ~PAGE_MASK) | PAGE_PRESENT;
+    paging_invalidate(virt);
+    return true;
+}
+
+// Remove a 4 KiB mapping and return its previous entry
+u32 paging_unmap_page(u32 virt) {
+    u32 pde = page_directory[virt >> 22];
+    if (!(pde & PAGE_PRESENT) || (pde & PAGE_LARGE)) {
+        return 0;
+    }
+
+    u32* table = (u32*)(pde & PAGE_MASK);
+    u32 entry = table[(virt >> 12) & 0x3FF];
+    table[(virt >> 12) & 0x3FF] = 0;
+    paging_invalidate(virt);
+    return entry;
+}
+
+// Return the entry mapping virt (the directory entry for 4 MiB pages)
+u32 paging_get_entry(u32 virt) {
+    u32 pde = page_directory[virt >> 22];
+    if (!(pde & PAGE_PRESENT) || (pde & PAGE_LARGE)) {
+        return pde;
+    }
+    return ((u32*)(pde & PAGE_MASK))[(virt >> 12) & 0x3FF];
+}
+
+// Tear down the user address space, freeing frames owned by its mappings
+void paging_unmap_user(void) {
+    for (u32 pd = USER_SPACE_START >> 22; pd < USER_SPACE_END >> 22; pd++) {
+        if (!(page_directory[pd] & PAGE_PRESENT)) continue;
+
+        u32* table = (u32*)(page_directory[pd] & PAGE_MASK);
+        for (u32 i = 0; i < 1024; i++) {
+            if ((table[i] & PAGE_PRESENT) && (table[i] & PAGE_OWNED)) {
+                pmm_free_frame(table[i] & PAGE_MASK);
+            }
+        }
+        pmm_free_frame((u32)table);
+        page_directory[pd] = 0;
+    }
+
+    // Flush the whole TLB
+    __asm__ volatile ("mov %0, %%cr3" : : "r"(page_directory) : "memory");
+}
+
+// Identity map a device register range with caching disabled. Whole 4 MiB
+// blocks use large pages so big windows such as ECAM cost no page tables.
+bool paging_map_mmio(u32 phys, u32 size) {
+    u32 addr = PAGE_ALIGN_DOWN(phys);
+    u32 end = PAGE_ALIGN_UP(phys + size);
+    if (end == 0) end = 0xFFFFF000;     // Range reaching the top of memory
+
+    while (addr < end) {
+        u32 next = addr + PAGE_SIZE;
+        if (addr < PAGING_IDENTITY_LIMIT) {
+            addr = next;
+            continue;
+        }
+        if (addr >= USER_SPACE_START && addr < USER_SPACE_END) {
+            return false;   // Would collide with user mappings
+        }
+
+        u32 pd = addr >> 22;
+        if (paging_pse && (addr % LARGE_PAGE_SIZE) == 0 && end - addr >= LARGE_PAGE_SIZE &&
+            !(page_directory[pd] & PAGE_PRESENT)) {
+            page_directory[pd] = addr | PAGE_PRESENT | PAGE_WRITE | PAGE_LARGE |
+                                 PAGE_NOCACHE | PAGE_WRITETHROUGH;
+            next = addr + LARGE_PAGE_SIZE;
+        } else if (page_directory[pd] & PAGE_LARGE) {
+            next = (pd + 1) * LARGE_PAGE_SIZE;  // Already covered by a large page
+        } else if (!paging_map_page(addr, addr, PAGE_WRITE | PAGE_NOCACHE | PAGE_WRITETHROUGH)) {
+            return false;
+        }
+
+        if (next <= addr) break;    // Wrapped past 4 GiB
+        addr = next;
+    }
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,132 @@
+#include "pmm.h"
+#include "multiboot.h"
+
+// One bit per 4 KiB frame, set when the frame is in use
+static u32 pmm_bitmap[PMM_MAX_FRAMES / 32];
+static u32 pmm_total_frames = 0;
+static u32 pmm_free_count = 0;
+static u32 pmm_next_hint = 0;
+
+static inline bool pmm_test(u32 frame) {
+    return (pmm_bitmap[frame / 32] >> (frame % 32)) & 1;
+}
+
+static void pmm_mark_free(u32 frame) {
+    if (pmm_test(frame)) {
+        pmm_bitmap[frame / 32] &= ~(1u << (frame % 32));
+        pmm_free_count++;
+    }
+}
+
+static void pmm_mark_used(u32 frame) {
+    if (!pmm_test(frame)) {
+        pmm_bitmap[frame / 32] |= (1u << (frame % 32));
+        pmm_free_count--;
+    }
+}
+
+// Release the whole frames inside [start, end)
+static void pmm_release_range(u64 start, u64 end) {
+    if (start < 0x100000) start = 0x100000;     // Leave low memory alone
+    if (end > PAGING_IDENTITY_LIMIT) end = PAGING_IDENTITY_LIMIT;
+    if (start >= end) return;
+
+    u32 first = PAGE_ALIGN_UP((u32)start) / PAGE_SIZE;
+    u32 last = PAGE_ALIGN_DOWN((u32)end) / PAGE_SIZE;
+    for (u32 frame = first; frame < last; frame++) {
+        if (pmm_test(frame)) {
+            pmm_mark_free(frame);
+            pmm_total_frames++;
+        }
+    }
+}
+
+void pmm_initialize(void) {
+    memset(pmm_bitmap, 0xFF, sizeof(pmm_bitmap));
+    pmm_total_frames = 0;
+    pmm_free_count = 0;
+    pmm_next_hint = 0;
+
+    const struct multiboot_tag_mmap* mmap = multiboot_get_mmap();
+    if (mmap) {
+        u32 addr = (uptr)mmap->entries;
+        u32 end = (uptr)mmap + mmap->size;
+        for (; addr + mmap->entry_size <= end; addr += mmap->entry_size) {
+            const struct multiboot_mmap_entry* entry = (const struct multiboot_mmap_entry*)(uptr)addr;
+            if (entry->type == MULTIBOOT_MEMORY_AVAILABLE) {
+                pmm_release_range(entry->addr, entry->addr + entry->len);
+            }
+        }
+    } else if (multiboot_get_mem_upper()) {
+        pmm_release_range(0x100000, 0x100000 + (u64)multiboot_get_mem_upper() * 1024);
+    } else {
+        pmm_release_range(0x100000, 0x1000000);  // Assume 16 MiB
+    }
+
+    // Keep the kernel image, boot information and modules
+    pmm_reserve_range((uptr)__kernel_start, (uptr)__kernel_end);
+    if (multiboot_present()) {
+        u32 info = multiboot_get_info_addr();
+        pmm_reserve_range(info, info + multiboot_get_info_size());
+        for (u32 i = 0; i < multiboot_get_module_count(); i++) {
+            const struct multiboot_module* module = multiboot_get_module(i);
+            pmm_reserve_range(module->start, module->end);
+        }
+    }
+}
+
+u32 pmm_alloc_frame(void) {
+    const u32 words = PMM_MAX_FRAMES / 32;
+    for (u32 n = 0; n < words; n++) {
+        u32 word = (pmm_next_hint + n) % words;
+        if (pmm_bitmap[word] == 0xFFFFFFFF) continue;
+
+        u32 bit = __builtin_ctz(~pmm_bitmap[word]);
+        u32 frame = word * 32 + bit;
+        pmm_mark_used(frame);
+        pmm_next_hint = word;
+        return frame * PAGE_SIZE;
+    }
+    return 0;
+}
+
+// Allocate physically contiguous frames ending at or below limit,
+// lowest first. Returns the physical base, or 0 if no run is free.
+u32 pmm_alloc_range(u32 frames, u32 limit) {
+    if (limit > PAGING_IDENTITY_LIMIT) limit = PAGING_IDENTITY_LIMIT;
+    u32 end = limit / PAGE_SIZE;
+    u32 run = 0;
+    for (u32 frame = 0; frame < end && frames; frame++) {
+        run = pmm_test(frame) ? 0 : run + 1;
+        if (run == frames) {
+            u32 first = frame + 1 - frames;
+            for (u32 f = first; f <= frame; f++) {
+                pmm_mark_used(f);
+            }
+            return first * PAGE_SIZE;
+        }
+    }
+    return 0;
+}
+
+void pmm_free_frame(u32 frame) {
+    if (frame && frame < PAGING_IDENTITY_LIMIT) {
+        pmm_mark_free(frame / PAGE_SIZE);
+    }
+}
+
+// Mark every frame touching [start, end) as used
+void pmm_reserve_range(u32 start, u32 end) {
+    if (end > PAGING_IDENTITY_LIMIT) end = PAGING_IDENTITY_LIMIT;
+    for (u32 frame = start / PAGE_SIZE; frame < PAGE_ALIGN_UP(end) / PAGE_SIZE; frame++) {
+        pmm_mark_used(frame);
+    }
+}
+
+u32 pmm_get_total_frames(void) {
+    return pmm_total_frames;
+}
+
+u32 pmm_get_free_frames(void) {
+    return pmm_free_count;
+}
\ No newline at end of file
@@ -0,0 +1,114 @@
+#include "profile.h"
+#include "rtc.h"
+#include "irq.h"
+#include "irqtrace.h"
+#include "paging.h"
+
+// Open-addressed table of sampled EIPs, filled from the RTC interrupt
+static struct profile_entry profile_table[PROFILE_SLOTS];
+static struct profile_stats profile_stats;
+static u32 profile_saved_priority = IRQ_PRIORITY_DEFAULT;
+
+// Scratch bitmap of cache lines seen, for profile_get_footprint
+static u32 profile_lines[PROFILE_TEXT_MAX / PROFILE_LINE_SIZE / 32];
+
+static void profile_sample(struct interrupt_context* ctx) {
+    if (ctx->cs & 3) {
+        profile_stats.user++;
+        return;
+    }
+    u32 eip = interrupt_ip(ctx);
+    u32 slot = (eip * 2654435761u) >> (32 - PROFILE_SLOT_BITS);
+    for (u32 n = 0; n < PROFILE_PROBES; n++) {
+        struct profile_entry* entry = &profile_table[(slot + n) & (PROFILE_SLOTS - 1)];
+        if (entry->eip == eip || entry->eip == 0) {
+            if (entry->eip == 0) {
+                entry->eip = eip;
+                profile_stats.eips++;
+            }
+            entry->count++;
+            profile_stats.samples++;
+            return;
+        }
+    }
+    profile_stats.dropped++;
+}
+
+// Sample at hz (a power of two) until profile_stop. The RTC line is raised
+// to the timer's level meanwhile, so device handlers get sampled too.
+bool profile_start(u32 hz) {
+    if (profile_stats.running) {
+        return false;
+    }
+    profile_saved_priority = irq_get_priority(RTC_IRQ);
+    irq_set_priority(RTC_IRQ, 0);
+    if (!rtc_start_periodic(hz, profile_sample)) {
+        irq_set_priority(RTC_IRQ, profile_saved_priority);
+        return false;
+    }
+    profile_stats.running = true;
+    profile_stats.hz = hz;
+    return true;
+}
+
+void profile_stop(void) {
+    if (!profile_stats.running) {
+        return;
+    }
+    rtc_stop_periodic();
+    irq_set_priority(RTC_IRQ, profile_saved_priority);
+    profile_stats.running = false;
+}
+
+void profile_reset(void) {
+    u32 flags = irq_save();
+    memset(profile_table, 0, sizeof(profile_table));
+    profile_stats.samples = 0;
+    profile_stats.user = 0;
+    profile_stats.dropped = 0;
+    profile_stats.eips = 0;
+    irq_restore(flags);
+}
+
+const struct profile_stats* profile_get_stats(void) {
+    return &profile_stats;
+}
+
+const struct profile_entry* profile_get_entry(u32 slot) {
+    if (slot < PROFILE_SLOTS && profile_table[slot].eip) {
+        return &profile_table[slot];
+    }
+    return 0;
+}
+
+// Count the distinct lines and pages the samples fell on: the fewer, the
+// less of the i-cache and iTLB the profiled work needs
+void profile_get_footprint(struct profile_footprint* footprint) {
+    u32 text = (uptr)__text_start;
+    u32 text_size = (uptr)__text_end - text;
+    if (text_size > PROFILE_TEXT_MAX) text_size = PROFILE_TEXT_MAX;
+    u32 pages[PROFILE_TEXT_MAX / PAGE_SIZE / 32];
+    memset(profile_lines, 0, sizeof(profile_lines));
+    memset(pages, 0, sizeof(pages));
+    memset(footprint, 0, sizeof(*footprint));
+
+    for (u32 slot = 0; slot < PROFILE_SLOTS; slot++) {
+        const struct profile_entry* entry = &profile_table[slot];
+        if (!entry->eip || entry->eip < text || entry->eip - text >= text_size) {
+            continue;
+        }
+        if (entry->eip >= (uptr)__text_hot_start && entry->eip < (uptr)__text_hot_end) {
+            footprint->hot_samples += entry->count;
+        }
+        u32 line = (entry->eip - text) / PROFILE_LINE_SIZE;
+        u32 page = (entry->eip - text) / PAGE_SIZE;
+        if (!(profile_lines[line / 32] & (1u << (line % 32)))) {
+            profile_lines[line / 32] |= 1u << (line % 32);
+            footprint->lines++;
+        }
+        if (!(pages[page / 32] & (1u << (page % 32)))) {
+            pages[page / 32] |= 1u << (page % 32);
+            footprint->pages++;
+        }
+    }
+}
@@ -0,0 +1,113 @@
+#include "reboot.h"
+#include "acpi.h"
+#include "cpu.h"
+#include "idt.h"
+#include "irq.h"
+#include "keyboard.h"
+#include "kprobe.h"
+#include "paging.h"
+#include "pci.h"
+
+// Defined in boot.asm
+extern struct reboot_warm_info reboot_info;
+void reboot_warm_jump(void) __attribute__((noreturn));
+
+// Port I/O functions
+static inline void outb(u16 port, u8 val) {
+    __asm__ volatile ("outb %0, %1" : : "a"(val), "Nd"(port));
+}
+
+static inline u8 inb(u16 port) {
+    u8 ret;
+    __asm__ volatile ("inb %1, %0" : "=a"(ret) : "Nd"(port));
+    return ret;
+}
+
+// Give a reset request time to take effect before trying the next one
+static void reboot_delay(void) {
+    for (u32 i = 0; i < 50000; i++) {
+        inb(0x80);
+    }
+}
+
+// Write the FADT reset value to the reset register, if the firmware
+// describes one
+static void reboot_acpi(void) {
+    const struct acpi_fadt* fadt = (const struct acpi_fadt*)acpi_find_table("FACP");
+    if (!fadt || fadt->header.length < sizeof(struct acpi_fadt) ||
+        !(fadt->flags & ACPI_FADT_RESET_REG_SUP)) {
+        return;
+    }
+
+    const struct acpi_gas* reg = &fadt->reset_reg;
+    if (reg->space_id == ACPI_GAS_IO) {
+        outb((u16)reg->address, fadt->reset_value);
+    } else if (reg->space_id == ACPI_GAS_MEMORY && (reg->address >> 32) == 0 &&
+               paging_map_mmio((u32)reg->address, 1)) {
+        *(volatile u8*)(uptr)reg->address = fadt->reset_value;
+    } else if (reg->space_id == ACPI_GAS_PCI) {
+        // Bus 0; device, function and offset packed into the address
+        u8 slot = (u8)(reg->address >> 32);
+        u8 function = (u8)(reg->address >> 16);
+        u16 offset = (u16)reg->address;
+        u32 shift = (offset & 3) * 8;
+        u32 value = pci_config_read32(0, slot, function, offset & ~3);
+        value = (value & ~(0xFFu << shift)) | ((u32)fadt->reset_value << shift);
+        pci_config_write32(0, slot, function, offset & ~3, value);
+    }
+}
+
+// Pulse the CPU reset line through the 8042 controller
+static void reboot_keyboard(void) {
+    for (u32 i = 0; i < 0x10000 && (inb(KEYBOARD_STATUS_PORT) & 0x02); i++) {}
+    outb(KEYBOARD_COMMAND_PORT, 0xFE);
+}
+
+// With an empty IDT the breakpoint cannot be delivered, nor can the double
+// fault that follows, and the CPU shuts down and resets
+static void reboot_triple_fault(void) {
+    struct idt_ptr empty = {0, 0};
+    __asm__ volatile ("lidt %0; int3" : : "m"(empty));
+}
+
+void reboot_cold(u32 method) {
+    __asm__ volatile ("cli");
+    if (method == REBOOT_ANY || method == REBOOT_ACPI) {
+        reboot_acpi();
+        reboot_delay();
+    }
+    if (method == REBOOT_ANY || method == REBOOT_KEYBOARD) {
+        reboot_keyboard();
+        reboot_delay();
+    }
+    reboot_triple_fault();
+    for (;;) {
+        __asm__ volatile ("hlt");
+    }
+}
+
+// Restart the kernel from the pristine image kept at cold boot, skipping
+// firmware and the bootloader. Returns only if no snapshot was taken.
+bool reboot_warm(void) {
+    if (!reboot_info.snapshot) {
+        return false;
+    }
+    u64 now = rdtsc();
+
+    // Nothing may interrupt or DMA into memory while it is being reset
+    __asm__ volatile ("cli");
+    outb(PIC1_DATA, 0xFF);
+    outb(PIC2_DATA, 0xFF);
+    pci_quiesce();
+
+    // .text is not reloaded, so the int3 bytes would outlive the probes
+    kprobe_remove_all();
+
+    reboot_info.restarts++;
+    reboot_info.restart_tsc = now;
+    reboot_warm_jump();
+}
+
+const struct reboot_warm_info* reboot_get_warm_info(void) {
+    return &reboot_info;
+}
@@ -2,6 +2,34 @@
 #include "vga.h"
 #include "keyboard.h"
 #include "timer.h"
+#include "irq.h"
+#include "syscall.h"
+#include "elf.h"
+#include "multiboot.h"
+#include "pmm.h"
+#include "dma.h"
+#include "initramfs.h"
+#include "pci.h"
+#include "ata.h"
+#include "virtio_blk.h"
+#include "block.h"
+#include "ramdisk.h"
+#include "ext2.h"
+#include "net.h"
+#include "e1000.h"
+#include "cpu.h"
+#include "boot.h"
+#include "reboot.h"
+#include "cpustat.h"
+#include "irqtrace.h"
+#include "task.h"
+#include "rtc.h"
+#include "profile.h"
+#include "virtio_console.h"
+#include "kprobe.h"
+#include "ksyms.h"
+#include "tunable.h"
+#include "keygen.h"
 
 // Shell state
 static char shell_buffer[SHELL_BUFFER_SIZE];
@@ -14,10 +42,42 @@ static struct shell_command commands[] = {
     {"echo", "Print text to screen", cmd_echo},
     {"uptime", "Show system uptime", cmd_uptime},
     {"version", "Show kernel version", cmd_version},
-    {"reboot", "Restart the system", cmd_reboot},
+    {"reboot", "Restart the system, or warm restart the kernel", cmd_reboot},
     {"halt", "Halt the system", cmd_halt},
     {"cpuinfo", "Show CPU information", cmd_cpuinfo},
     {"meminfo", "Show memory information", cmd_meminfo},
+    {"dmastat", "Show DMA pool usage", cmd_dmastat},
+    {"irqstat", "Show interrupt and storm statistics", cmd_irqstat},
+    {"sysbench", "Measure null system call cost from ring 3", cmd_sysbench},
+    {"exec", "Run an ELF boot module in ring 3", cmd_exec},
+    {"modules", "List boot modules", cmd_modules},
+    {"ls", "List initramfs directory", cmd_ls},
+    {"cat", "Print initramfs file", cmd_cat},
+    {"stat", "Show initramfs file details", cmd_stat},
+    {"lspci", "List PCI devices (-v for BARs)", cmd_lspci},
+    {"disks", "List ATA drives and I/O statistics", cmd_disks},
+    {"diskbench", "Measure ATA DMA throughput and IOPS", cmd_diskbench},
+    {"vblkbench", "Measure virtio-blk throughput and IOPS", cmd_vblkbench},
+    {"bcache", "Show buffer cache statistics (sync to flush)", cmd_bcache},
+    {"blkread", "Read blocks through the buffer cache", cmd_blkread},
+    {"mount", "Mount an ext2 block device or show the mount", cmd_mount},
+    {"fsls", "List ext2 directory", cmd_fsls},
+    {"fscat", "Print ext2 file", cmd_fscat},
+    {"fsbench", "Measure ext2 path lookup and file read speed", cmd_fsbench},
+    {"ifconfig", "Show or set the network address", cmd_ifconfig},
+    {"boottime", "Show the boot phase timeline and initcalls", cmd_boottime},
+    {"netstat", "Sample packet rates and echo latency", cmd_netstat},
+    {"repeat", "Run a command N times", cmd_repeat},
+    {"time", "Report the cycles and wall time of a command", cmd_time},
+    {"top", "Show live CPU utilization by context and IRQ", cmd_top},
+    {"irqsoff", "Trace interrupts-off windows", cmd_irqsoff},
+    {"irqnest", "Show nested interrupt statistics and timer jitter", cmd_irqnest},
+    {"profile", "Sample kernel EIPs for code layout", cmd_profile},
+    {"vcon", "Stream output to virtio-console ports", cmd_vcon},
+    {"probe", "Count and time calls to kernel functions", cmd_probe},
+    {"sysctl", "Show or change boot tunables", cmd_sysctl},
+    {"keygen", "Inject keystrokes and measure echo latency", cmd_keygen},
+    {"taskbench", "Run concurrent async block reads as executor tasks", cmd_taskbench},
     {0, 0, 0}  // Terminator
 };
 
@@ -32,13 +92,47 @@ void shell_initialize(void) {
     shell_print_prompt();
 }
 
+// Run the boot script module, then any script on the kernel command line
+static void shell_run_boot_scripts(void) {
+    const struct multiboot_module* module = multiboot_find_module(SHELL_SCRIPT_MODULE);
+    if (module) {
+        shell_run_script((const char*)(uptr)module->start, module->end - module->start);
+    }
+    
+    const char* cmdline = multiboot_get_cmdline();
+    for (const char* p = cmdline; p && *p; p++) {
+        if ((p == cmdline || p[-1] == ' ') && strncmp(p, SHELL_SCRIPT_OPTION, strlen(SHELL_SCRIPT_OPTION)) == 0) {
+            p += strlen(SHELL_SCRIPT_OPTION);
+            shell_run_script(p, strlen(p));
+            break;
+        }
+    }
+}
+
 void shell_run(void) {
+    shell_run_boot_scripts();
+    
     while (1) {
         if (keyboard_haschar()) {
             char c = keyboard_getchar();
             shell_process_input(c);
         }
-        __asm__ volatile ("hlt");
+        // A NIC in polling mode needs servicing without waiting for an
+        // interrupt, ready tasks run every pass, and deferred initcalls run
+        // one per otherwise idle pass
+        u32 previous = cpustat_enter(CPUSTAT_DEFERRED);
+        bool busy = net_poll();
+        busy = task_run() || busy;
+        virtio_console_flush_all();
+        busy = busy || boot_run_deferred();
+        cpustat_enter(previous);
+        if (!busy) {
+            irq_disable();
+            if (!task_pending() && !keyboard_haschar()) {
+                cpustat_halt();
+            }
+            irq_enable();
+        }
     }
 }
 
@@ -46,6 +140,7 @@ void shell_process_input(char c) {
     if (c == '\n') {
         // Process command
         vga_putchar('\n');
+        keygen_echoed();
         shell_buffer[shell_buffer_pos] = '\0';
         
         if (shell_buffer_pos > 0) {
@@ -63,6 +158,7 @@ void shell_process_input(char c) {
             shell_buffer_pos--;
             shell_buffer[shell_buffer_pos] = '\0';
             vga_putchar('\b');
+            keygen_echoed();
         }
         
     } else if (c >= 32 && c <= 126) {
@@ -71,6 +167,7 @@ void shell_process_input(char c) {
             shell_buffer[shell_buffer_pos] = c;
             shell_buffer_pos++;
             vga_putchar(c);
+            keygen_echoed();
         }
     }
 }
@@ -122,6 +219,38 @@ void shell_execute_command(const char* command_line) {
     vga_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
 }
 
+// Execute each line (or ';'-separated command) as if typed at the prompt,
+// echoing it so a serial log reads like an interactive session. Blank
+// lines and lines starting with '#' are skipped.
+void shell_run_script(const char* script, size_t length) {
+    char line[SHELL_BUFFER_SIZE];
+    size_t pos = 0;
+    for (size_t i = 0; i <= length; i++) {
+        char c = i < length ? script[i] : '\n';
+        if (c == '\0') {
+            c = '\n';
+            length = i;
+        }
+        if (c != '\n' && c != ';') {
+            if (c == '\t' || c == '\r') c = ' ';
+            if (pos < SHELL_BUFFER_SIZE - 1 && (pos > 0 || c != ' ')) {
+                line[pos++] = c;
+            }
+            continue;
+        }
+        
+        while (pos > 0 && line[pos - 1] == ' ') pos--;
+        line[pos] = '\0';
+        if (pos > 0 && line[0] != '#') {
+            vga_writestring(line);
+            vga_putchar('\n');
+            shell_execute_command(line);
+            shell_print_prompt();
+        }
+        pos = 0;
+    }
+}
+
 void shell_print_prompt(void) {
     vga_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREEN, VGA_COLOR_BLACK));
     vga_writestring(SHELL_PROMPT);
@@ -129,7 +258,7 @@ void shell_print_prompt(void) {
 }
 
 // Built-in commands implementation
-void cmd_help(int argc, char* argv[]) {
+__cold void cmd_help(int argc, char* argv[]) {
     (void)argc; (void)argv;
     
     vga_setcolor(vga_entry_color(VGA_COLOR_LIGHT_CYAN, VGA_COLOR_BLACK));
@@ -199,10 +328,39 @@ void cmd_version(int argc, char* argv[]) {
 }
 
 void cmd_reboot(int argc, char* argv[]) {
-    (void)argc; (void)argv;
+    u32 method = REBOOT_ANY;
+    bool warm = false;
+    if (argc > 1) {
+        if (strcmp(argv[1], "warm") == 0) {
+            warm = true;
+        } else if (strcmp(argv[1], "acpi") == 0) {
+            method = REBOOT_ACPI;
+        } else if (strcmp(argv[1], "kbd") == 0) {
+            method = REBOOT_KEYBOARD;
+        } else if (strcmp(argv[1], "triple") == 0) {
+            method = REBOOT_TRIPLE_FAULT;
+        } else {
+            vga_writestring("Usage: reboot [warm|acpi|kbd|triple]\n");
+            return;
+        }
+    }
+    
+    // Dirty buffers would be lost either way
+    bcache_sync(0);
+    
+    if (warm) {
+        vga_writestring("Warm restart...\n");
+        reboot_warm();
+        vga_writestring("Warm restart unavailable: no boot snapshot was taken\n");
+        return;
+    }
+    
+    // The reset register is described by the FADT
+    if (method == REBOOT_ANY || method == REBOOT_ACPI) {
+        boot_require("platform");
+    }
     vga_writestring("Rebooting system...\n");
-    // TODO: Implement actual reboot
-    vga_writestring("Reboot not implemented yet.\n");
+    reboot_cold(method);
 }
 
 void cmd_halt(int argc, char* argv[]) {
@@ -213,15 +371,2026 @@ void cmd_halt(int argc, char* argv[]) {
 
 void cmd_cpuinfo(int argc, char* argv[]) {
     (void)argc; (void)argv;
-    vga_writestring("CPU: x86 (32-bit)\n");
-    vga_writestring("Architecture: i386\n");
-    vga_writestring("Mode: Protected Mode\n");
+    vga_writestring("CPU: x86 (");
+    vga_write_dec(sizeof(uptr) * 8);
+    vga_writestring("-bit)\n");
+    vga_writestring("Architecture: " KERNEL_ARCH "\n");
+    vga_writestring("Mode: " KERNEL_MODE "\n");
 }
 
 void cmd_meminfo(int argc, char* argv[]) {
     (void)argc; (void)argv;
+    u32 total = pmm_get_total_frames() * (PAGE_SIZE / 1024);
+    u32 free = pmm_get_free_frames() * (PAGE_SIZE / 1024);
+    
     vga_writestring("Memory information:\n");
-    vga_writestring("  Total RAM: Unknown (memory manager not implemented)\n");
-    vga_writestring("  Kernel memory: ~1MB\n");
-    vga_writestring("  Available: Unknown\n");
-}
\ No newline at end of file
+    vga_writestring("  Managed RAM: ");
+    vga_write_dec(total);
+    vga_writestring(" KiB\n");
+    vga_writestring("  Kernel image: ");
+    vga_write_dec(((uptr)__kernel_end - (uptr)__kernel_start) / 1024);
+    vga_writestring(" KiB\n");
+    vga_writestring("  Available: ");
+    vga_write_dec(free);
+    vga_writestring(" KiB\n");
+}
+
+void cmd_dmastat(int argc, char* argv[]) {
+    (void)argc; (void)argv;
+    const struct dma_stats* stats = dma_get_stats();
+    if (!stats->pages) {
+        vga_writestring("No DMA pool\n");
+        return;
+    }
+    
+    vga_writestring("Pool: ");
+    vga_write_dec(stats->pages * (PAGE_SIZE / 1024));
+    vga_writestring(" KiB at ");
+    vga_write_hex(stats->base);
+    vga_writestring(", limit ");
+    vga_write_hex(stats->limit);
+    vga_writestring("\nPages used: ");
+    vga_write_dec(stats->pages_used);
+    vga_writestring(" of ");
+    vga_write_dec(stats->pages);
+    vga_writestring(", peak ");
+    vga_write_dec(stats->pages_peak);
+    vga_writestring(", size classes ");
+    vga_write_dec(stats->class_pages);
+    vga_writestring("\nPage allocations: ");
+    vga_write_dec(stats->page_allocs);
+    vga_writestring(", frees: ");
+    vga_write_dec(stats->page_frees);
+    vga_writestring(", failures: ");
+    vga_write_dec(stats->failures);
+    vga_writestring("\n\nSize\tObjects\tIn use\tAllocs\tFrees\n");
+    for (u32 i = 0; i < DMA_CLASSES; i++) {
+        const struct dma_class_stats* cls = &stats->classes[i];
+        vga_write_dec(cls->size);
+        vga_putchar('\t');
+        vga_write_dec(cls->objects);
+        vga_putchar('\t');
+        vga_write_dec(cls->in_use);
+        vga_putchar('\t');
+        vga_write_dec(cls->allocs);
+        vga_putchar('\t');
+        vga_write_dec(cls->frees);
+        vga_putchar('\n');
+    }
+}
+
+void cmd_irqstat(int argc, char* argv[]) {
+    (void)argc; (void)argv;
+    u32 frequency = timer_get_frequency();
+    
+    vga_writestring("IRQ\tCount\t\tSpurious\tStorms\tMasked ms\tState\n");
+    for (int irq = 0; irq < 16; irq++) {
+        const struct irq_stats* stats = irq_get_stats(irq);
+        if (stats->count == 0 && stats->spurious == 0) continue;
+        
+        vga_write_dec(irq);
+        vga_putchar('\t');
+        vga_write_dec(stats->count);
+        vga_writestring("\t\t");
+        vga_write_dec(stats->spurious);
+        vga_writestring("\t\t");
+        vga_write_dec(stats->storms);
+        vga_putchar('\t');
+        vga_write_dec(frequency ? stats->masked_ticks * 1000 / frequency : 0);
+        vga_writestring("\t\t");
+        vga_writestring(stats->masked ? "polling" : "enabled");
+        vga_putchar('\n');
+    }
+    
+    struct irq_storm_event events[IRQ_STORM_LOG_SIZE];
+    u32 count = irq_get_storm_events(events, IRQ_STORM_LOG_SIZE);
+    if (count == 0) {
+        vga_writestring("No IRQ storms detected.\n");
+        return;
+    }
+    
+    vga_writestring("Recent storms:\n");
+    for (u32 i = 0; i < count; i++) {
+        vga_writestring("  tick ");
+        vga_write_dec(events[i].tick);
+        vga_writestring(": IRQ ");
+        vga_write_dec(events[i].irq);
+        vga_writestring(", ");
+        vga_write_dec(events[i].rate);
+        vga_writestring(" irqs/window, masked for ");
+        vga_write_dec(events[i].backoff);
+        vga_writestring(" ticks\n");
+    }
+}
+
+void cmd_sysbench(int argc, char* argv[]) {
+    (void)argc; (void)argv;
+    
+    memset(&user_bench_result, 0, sizeof(user_bench_result));
+    user_bench_result.sysenter_used = syscall_sysenter_supported();
+    user_run(user_syscall_bench);
+    
+    u32 iterations = user_bench_result.iterations;
+    if (iterations == 0) {
+        vga_writestring("Benchmark did not complete.\n");
+        return;
+    }
+    
+    vga_writestring("int 0x80:  ");
+    vga_write_dec(user_bench_result.int80_cycles / iterations);
+    vga_writestring(" cycles/call\n");
+    
+    vga_writestring("SYSENTER:  ");
+    if (user_bench_result.sysenter_used) {
+        vga_write_dec(user_bench_result.sysenter_cycles / iterations);
+        vga_writestring(" cycles/call\n");
+    } else {
+        vga_writestring("not supported by this CPU\n");
+    }
+}
+
+void cmd_exec(int argc, char* argv[]) {
+    if (argc < 2) {
+        vga_writestring("Usage: exec <module> [args...]\n");
+        return;
+    }
+    
+    u32 exit_code = 0;
+    int status = elf_exec(argv[1], argc - 1, &argv[1], &exit_code);
+    if (status != ELF_OK) {
+        vga_setcolor(vga_entry_color(VGA_COLOR_RED, VGA_COLOR_BLACK));
+        vga_writestring("exec: ");
+        vga_writestring(elf_strerror(status));
+        vga_putchar('\n');
+        vga_setcolor(vga_entry_color(VGA_COLOR_LIGHT_GREY, VGA_COLOR_BLACK));
+        return;
+    }
+    
+    const struct elf_exec_stats* stats = elf_get_stats();
+    vga_writestring("Exit code ");
+    vga_write_dec(exit_code);
+    vga_writestring(", file ");
+    vga_write_dec(stats->file_size / 1024);
+    vga_writestring(" KiB, mapped ");
+    vga_write_dec(stats->mapped_size / 1024);
+    vga_writestring(" KiB\n");
+    vga_writestring("Page faults: ");
+    vga_write_dec(stats->faults);
+    vga_writestring(" (");
+    vga_write_dec(stats->zero_copy_pages);
+    vga_writestring(" zero-copy, ");
+    vga_write_dec(stats->copied_pages);
+    vga_writestring(" copied, ");
+    vga_write_dec(stats->zero_pages);
+    vga_writestring(" zero-filled)\n");
+    vga_writestring("Startup: ");
+    vga_write_dec64(stats->startup_cycles);
+    vga_writestring(" cycles, run: ");
+    vga_write_dec64(stats->run_cycles);
+    vga_writestring(" cycles\n");
+}
+
+void cmd_modules(int argc, char* argv[]) {
+    (void)argc; (void)argv;
+    u32 count = multiboot_get_module_count();
+    
+    if (count == 0) {
+        vga_writestring("No boot modules loaded.\n");
+        return;
+    }
+    
+    for (u32 i = 0; i < count; i++) {
+        const struct multiboot_module* module = multiboot_get_module(i);
+        vga_write_hex(module->start);
+        vga_writestring("  ");
+        vga_write_dec(module->end - module->start);
+        vga_writestring(" bytes  ");
+        vga_writestring(module->cmdline);
+        vga_putchar('\n');
+    }
+}
+
+void cmd_ls(int argc, char* argv[]) {
+    const struct initramfs_file* dir = 0;
+    const char* path = "/";
+    
+    if (argc > 1 && strcmp(argv[1], "/") != 0) {
+        dir = initramfs_lookup(argv[1]);
+        if (!dir || !dir->is_dir) {
+            vga_writestring("ls: no such directory: ");
+            vga_writestring(argv[1]);
+            vga_putchar('\n');
+            return;
+        }
+        path = dir->path;
+    }
+    
+    // Children are entries whose path is the directory path plus one component
+    size_t prefix = dir ? strlen(path) : 0;
+    for (u32 i = 0; i < initramfs_get_count(); i++) {
+        const struct initramfs_file* file = initramfs_get(i);
+        if (strncmp(file->path, path, prefix) != 0 || file->path[prefix] != '/') continue;
+        
+        const char* name = &file->path[prefix + 1];
+        bool nested = false;
+        for (const char* c = name; *c; c++) {
+            if (*c == '/') nested = true;
+        }
+        if (nested) continue;
+        
+        vga_writestring(name);
+        if (file->is_dir) {
+            vga_writestring("/\n");
+        } else {
+            vga_writestring("\t");
+            vga_write_dec(file->size);
+            vga_writestring(" bytes\n");
+        }
+    }
+}
+
+void cmd_cat(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        const struct initramfs_file* file = initramfs_lookup(argv[i]);
+        if (!file || file->is_dir) {
+            vga_writestring("cat: no such file: ");
+            vga_writestring(argv[i]);
+            vga_putchar('\n');
+            continue;
+        }
+        vga_write((const char*)file->data, file->size);
+    }
+}
+
+void cmd_stat(int argc, char* argv[]) {
+    if (argc < 2) {
+        vga_writestring("Usage: stat <path>\n");
+        return;
+    }
+    
+    const struct initramfs_file* file = initramfs_lookup(argv[1]);
+    if (!file) {
+        vga_writestring("stat: no such file: ");
+        vga_writestring(argv[1]);
+        vga_putchar('\n');
+        return;
+    }
+    
+    vga_writestring("  Path: ");
+    vga_writestring(file->path);
+    vga_writestring("\n  Type: ");
+    vga_writestring(file->is_dir ? "directory" : "regular file");
+    vga_writestring("\n  Size: ");
+    vga_write_dec(file->size);
+    vga_writestring("\n  Mode: 0");
+    for (int shift = 9; shift >= 0; shift -= 3) {
+        vga_putchar('0' + ((file->mode >> shift) & 7));
+    }
+    vga_writestring("\n  Modified: ");
+    vga_write_dec(file->mtime);
+    vga_writestring("\n  Data: ");
+    vga_write_hex((uptr)file->data);
+    vga_writestring("\n  Hash: ");
+    vga_write_hex(file->hash);
+    vga_putchar('\n');
+}
+
+// Print a value as a fixed number of hex digits without a prefix
+static void shell_write_hex_digits(u32 value, int digits) {
+    const char* hex = "0123456789abcdef";
+    for (int shift = (digits - 1) * 4; shift >= 0; shift -= 4) {
+        vga_putchar(hex[(value >> shift) & 0xF]);
+    }
+}
+
+void cmd_lspci(int argc, char* argv[]) {
+    boot_require("pci");
+    bool verbose = argc > 1 && strcmp(argv[1], "-v") == 0;
+    u32 count = pci_get_device_count();
+    
+    if (count == 0) {
+        vga_writestring("No PCI devices found.\n");
+        return;
+    }
+    
+    for (u32 i = 0; i < count; i++) {
+        const struct pci_device* dev = pci_get_device(i);
+        shell_write_hex_digits(dev->bus, 2);
+        vga_putchar(':');
+        shell_write_hex_digits(dev->slot, 2);
+        vga_putchar('.');
+        shell_write_hex_digits(dev->function, 1);
+        vga_putchar(' ');
+        shell_write_hex_digits(dev->vendor_id, 4);
+        vga_putchar(':');
+        shell_write_hex_digits(dev->device_id, 4);
+        vga_putchar(' ');
+        vga_writestring(pci_class_name(dev->class_code, dev->subclass));
+        if (dev->driver) {
+            vga_writestring(" [");
+            vga_writestring(dev->driver->name);
+            vga_putchar(']');
+        }
+        vga_putchar('\n');
+        
+        if (!verbose) continue;
+        
+        vga_writestring("  Class ");
+        shell_write_hex_digits(dev->class_code, 2);
+        shell_write_hex_digits(dev->subclass, 2);
+        vga_writestring(" prog-if ");
+        shell_write_hex_digits(dev->prog_if, 2);
+        vga_writestring(" rev ");
+        shell_write_hex_digits(dev->revision, 2);
+        if (dev->msi_vector >= 0) {
+            vga_writestring(", MSI vector ");
+            vga_write_dec(dev->msi_vector);
+        } else if (dev->irq_pin) {
+            vga_writestring(", IRQ ");
+            vga_write_dec(dev->irq_line);
+        }
+        vga_putchar('\n');
+        
+        for (int bar = 0; bar < PCI_BAR_COUNT; bar++) {
+            const struct pci_bar* info = &dev->bars[bar];
+            if (!info->size) continue;
+            vga_writestring("  BAR");
+            vga_write_dec(bar);
+            vga_writestring(info->io ? ": I/O at " : ": Memory at ");
+            vga_write_hex((u32)info->base);
+            vga_writestring(" size ");
+            vga_write_dec(info->size);
+            if (info->is64) vga_writestring(" 64-bit");
+            if (info->prefetchable) vga_writestring(" prefetchable");
+            vga_putchar('\n');
+        }
+    }
+    
+    vga_writestring(pci_ecam_enabled() ? "Config access: ECAM\n" : "Config access: port I/O\n");
+}
+
+void cmd_disks(int argc, char* argv[]) {
+    boot_require("storage");
+    (void)argc; (void)argv;
+    bool any = false;
+    
+    for (u32 i = 0; i < VIRTIO_BLK_MAX_DEVICES; i++) {
+        if (!virtio_blk_present(i)) continue;
+        vga_writestring("vd");
+        vga_write_dec(i);
+        vga_writestring(": virtio-blk (");
+        vga_writestring(virtio_blk_is_modern(i) ? "modern" : "legacy");
+        vga_writestring("), ");
+        vga_write_dec((u32)(virtio_blk_get_capacity(i) >> 11));
+        vga_writestring(virtio_blk_is_readonly(i) ? " MiB, read-only\n" : " MiB\n");
+    }
+    
+    const struct virtio_blk_stats* vstats = virtio_blk_get_stats();
+    if (vstats->requests) {
+        vga_writestring("virtio-blk requests: ");
+        vga_write_dec(vstats->requests);
+        vga_writestring(", kicks: ");
+        vga_write_dec(vstats->kicks);
+        vga_writestring(", doorbells: ");
+        vga_write_dec(vstats->notifications);
+        vga_writestring("\nInterrupts: ");
+        vga_write_dec(vstats->interrupts);
+        vga_writestring(", IRQ completions: ");
+        vga_write_dec(vstats->irq_completions);
+        vga_writestring(", polled: ");
+        vga_write_dec(vstats->polled_completions);
+        vga_writestring(", errors: ");
+        vga_write_dec(vstats->errors);
+        vga_putchar('\n');
+    }
+    
+    for (u32 i = 0; i < ATA_MAX_DRIVES; i++) {
+        const struct ata_drive* drive = ata_get_drive(i);
+        if (!drive) continue;
+        any = true;
+        vga_writestring("hd");
+        vga_write_dec(i);
+        vga_writestring(": ");
+        vga_writestring(drive->model);
+        vga_writestring(", ");
+        vga_write_dec((u32)(drive->sectors >> 11));
+        vga_writestring(" MiB");
+        vga_writestring(drive->lba48 ? ", LBA48\n" : ", LBA28\n");
+    }
+    if (!any) {
+        if (!virtio_blk_present(0)) {
+            vga_writestring("No disks found.\n");
+        }
+        return;
+    }
+    
+    const struct ata_stats* stats = ata_get_stats();
+    vga_writestring("Requests: ");
+    vga_write_dec(stats->requests);
+    vga_writestring(", merged: ");
+    vga_write_dec(stats->merges);
+    vga_writestring(", DMA commands: ");
+    vga_write_dec(stats->commands);
+    vga_writestring("\nSectors: ");
+    vga_write_dec64(stats->sectors);
+    vga_writestring(", errors: ");
+    vga_write_dec(stats->errors);
+    vga_writestring(", timeouts: ");
+    vga_write_dec(stats->timeouts);
+    vga_putchar('\n');
+}
+
+// Print bytes moved in the given ticks as MB/s with one decimal
+static void shell_write_rate(u64 bytes, u32 ticks) {
+    u32 frequency = timer_get_frequency();
+    u32 tenths = 0;
+    if (ticks && frequency) {
+        u64 scaled = div_u64_rem(bytes * frequency * 10, ticks, 0);
+        tenths = (u32)div_u64_rem(scaled, 1000000, 0);
+    }
+    vga_write_dec(tenths / 10);
+    vga_putchar('.');
+    vga_write_dec(tenths % 10);
+    vga_writestring(" MB/s");
+}
+
+void cmd_diskbench(int argc, char* argv[]) {
+    boot_require("storage");
+    u32 drive = argc > 1 ? strtoul(argv[1], 0, 0) : 0;
+    static const u32 depths[] = {1, 4, 16, 32};
+    u32 frequency = timer_get_frequency();
+    
+    if (!ata_get_drive(drive)) {
+        vga_writestring("diskbench: no such drive\n");
+        return;
+    }
+    
+    vga_writestring("4 KiB reads, 1 s per run\n");
+    for (int pattern = 0; pattern < 2; pattern++) {
+        for (u32 i = 0; i < sizeof(depths) / sizeof(depths[0]); i++) {
+            struct ata_bench_result result;
+            int status = ata_bench(drive, pattern == 0, depths[i], 8, frequency, &result);
+            if (status != ATA_OK) {
+                vga_writestring("diskbench: ");
+                vga_writestring(ata_strerror(status));
+                vga_putchar('\n');
+                return;
+            }
+            
+            vga_writestring(pattern == 0 ? "  seq  qd " : "  rand qd ");
+            vga_write_dec(depths[i]);
+            vga_writestring(":\t");
+            shell_write_rate(result.bytes, result.ticks);
+            vga_writestring(", ");
+            vga_write_dec(result.ticks ? result.operations * frequency / result.ticks : 0);
+            vga_writestring(" IOPS, ");
+            vga_write_dec(result.commands);
+            vga_writestring(" cmds, ");
+            vga_write_dec(result.merges);
+            vga_writestring(" merged\n");
+        }
+    }
+}
+
+void cmd_vblkbench(int argc, char* argv[]) {
+    boot_require("storage");
+    u32 device = argc > 1 ? strtoul(argv[1], 0, 0) : 0;
+    static const u32 depths[] = {1, 4, 8, 16, 32};
+    u32 frequency = timer_get_frequency();
+    
+    if (!virtio_blk_present(device)) {
+        vga_writestring("vblkbench: no such device\n");
+        return;
+    }
+    
+    vga_writestring("4 KiB reads, 1 s per run, polling from queue depth ");
+    vga_write_dec(VIRTIO_BLK_POLL_DEPTH);
+    vga_putchar('\n');
+    for (int pattern = 0; pattern < 2; pattern++) {
+        for (u32 i = 0; i < sizeof(depths) / sizeof(depths[0]); i++) {
+            struct virtio_blk_bench_result result;
+            int status = virtio_blk_bench(device, pattern == 0, depths[i], 8, frequency, &result);
+            if (status != VIRTIO_BLK_OK) {
+                vga_writestring("vblkbench: ");
+                vga_writestring(virtio_blk_strerror(status));
+                vga_putchar('\n');
+                return;
+            }
+            
+            vga_writestring(pattern == 0 ? "  seq  qd " : "  rand qd ");
+            vga_write_dec(depths[i]);
+            vga_writestring(":\t");
+            shell_write_rate(result.bytes, result.ticks);
+            vga_writestring(", ");
+            vga_write_dec(result.ticks ? result.operations * frequency / result.ticks : 0);
+            vga_writestring(" IOPS, ");
+            vga_write_dec(result.notifications);
+            vga_writestring(" doorbells, ");
+            vga_write_dec(result.interrupts);
+            vga_writestring(" irqs, ");
+            vga_write_dec(result.polled);
+            vga_writestring(" polled\n");
+        }
+    }
+}
+
+void cmd_bcache(int argc, char* argv[]) {
+    boot_require("storage");
+    if (argc > 1 && strcmp(argv[1], "sync") == 0) {
+        int status = bcache_sync(0);
+        vga_writestring("bcache: ");
+        vga_writestring(block_strerror(status));
+        vga_putchar('\n');
+        return;
+    }
+    
+    for (u32 i = 0; i < block_get_count(); i++) {
+        const struct block_device* dev = block_get(i);
+        vga_writestring(dev->name);
+        vga_writestring(": ");
+        vga_write_dec((u32)(dev->sectors >> 11));
+        vga_writestring(" MiB, ");
+        vga_write_dec(dev->block_size);
+        vga_writestring("-byte blocks, read ");
+        vga_write_dec64(dev->sectors_read);
+        vga_writestring(", written ");
+        vga_write_dec64(dev->sectors_written);
+        vga_writestring(dev->readonly ? " sectors, read-only\n" : " sectors\n");
+    }
+    
+    const struct bcache_stats* stats = bcache_get_stats();
+    vga_writestring("Lookups: ");
+    vga_write_dec(stats->lookups);
+    vga_writestring(", hits: ");
+    vga_write_dec(stats->hits);
+    vga_writestring(" (");
+    vga_write_dec(stats->lookups ? (u32)div_u64_rem((u64)stats->hits * 100, stats->lookups, 0) : 0);
+    vga_writestring("%), misses: ");
+    vga_write_dec(stats->misses);
+    vga_writestring("\nEvictions: ");
+    vga_write_dec(stats->evictions);
+    vga_writestring(", write-backs: ");
+    vga_write_dec(stats->writebacks);
+    vga_writestring(", I/O errors: ");
+    vga_write_dec(stats->io_errors);
+    vga_writestring("\nRead-ahead issued: ");
+    vga_write_dec(stats->readahead_issued);
+    vga_writestring(", used: ");
+    vga_write_dec(stats->readahead_hits);
+    vga_writestring(", waited on: ");
+    vga_write_dec(stats->readahead_waits);
+    vga_writestring("\nBuffers: ");
+    vga_write_dec(BCACHE_BUFFERS);
+    vga_writestring(", valid: ");
+    vga_write_dec(bcache_count_buffers(BCACHE_VALID));
+    vga_writestring(", dirty: ");
+    vga_write_dec(bcache_count_buffers(BCACHE_DIRTY));
+    vga_putchar('\n');
+}
+
+void cmd_blkread(int argc, char* argv[]) {
+    boot_require("storage");
+    if (argc < 3) {
+        vga_writestring("Usage: blkread <device> <block> [count]\n");
+        return;
+    }
+    struct block_device* dev = block_find(argv[1]);
+    if (!dev) {
+        vga_writestring("blkread: no such device\n");
+        return;
+    }
+    
+    u32 first = strtoul(argv[2], 0, 0);
+    u32 count = argc > 3 ? strtoul(argv[3], 0, 0) : 1;
+    u64 before = dev->sectors_read;
+    u32 start = timer_get_ticks();
+    
+    for (u32 i = 0; i < count; i++) {
+        struct bcache_buffer* buffer = bcache_read(dev, first + i);
+        if (!buffer) {
+            vga_writestring("blkread: read failed at block ");
+            vga_write_dec(first + i);
+            vga_putchar('\n');
+            return;
+        }
+        bcache_release(buffer);
+    }
+    
+    vga_write_dec(count);
+    vga_writestring(" blocks, ");
+    vga_write_dec64(dev->sectors_read - before);
+    vga_writestring(" sectors from the device, ");
+    shell_write_rate((u64)count * dev->block_size, timer_get_ticks() - start);
+    vga_putchar('\n');
+}
+
+static void shell_write_percent(u32 part, u32 total) {
+    vga_write_dec(total ? (u32)div_u64_rem((u64)part * 100, total, 0) : 0);
+    vga_putchar('%');
+}
+
+static void shell_write_ext2_stats(void) {
+    const struct ext2_stats* stats = ext2_get_stats();
+    vga_writestring("Inode cache: ");
+    vga_write_dec(stats->inode_lookups);
+    vga_writestring(" lookups, ");
+    shell_write_percent(stats->inode_hits, stats->inode_lookups);
+    vga_writestring(" hits\nDentry cache: ");
+    vga_write_dec(stats->dentry_lookups);
+    vga_writestring(" lookups, ");
+    shell_write_percent(stats->dentry_hits + stats->dentry_negative_hits, stats->dentry_lookups);
+    vga_writestring(" hits (");
+    vga_write_dec(stats->dentry_negative_hits);
+    vga_writestring(" negative), ");
+    vga_write_dec(stats->dir_scans);
+    vga_writestring(" directory scans\nData: ");
+    vga_write_dec(stats->runs);
+    vga_writestring(" multi-block reads (");
+    vga_write_dec(stats->run_blocks);
+    vga_writestring(" blocks), ");
+    vga_write_dec(stats->cached_blocks);
+    vga_writestring(" blocks through the cache\n");
+}
+
+void cmd_mount(int argc, char* argv[]) {
+    boot_require(argc > 1 ? "storage" : "rootfs");
+    if (argc > 1) {
+        struct block_device* dev = block_find(argv[1]);
+        if (!dev) {
+            vga_writestring("mount: no such device\n");
+            return;
+        }
+        int status = ext2_mount(dev);
+        if (status != EXT2_OK) {
+            vga_writestring("mount: ");
+            vga_writestring(ext2_strerror(status));
+            vga_putchar('\n');
+            return;
+        }
+    }
+    
+    const struct ext2_superblock* super = ext2_get_superblock();
+    if (!super) {
+        vga_writestring("No filesystem mounted.\n");
+        return;
+    }
+    vga_writestring(ext2_get_device()->name);
+    vga_writestring(": ext2, ");
+    vga_write_dec(ext2_get_block_size());
+    vga_writestring("-byte blocks, ");
+    vga_write_dec(super->blocks_count - super->free_blocks_count);
+    vga_putchar('/');
+    vga_write_dec(super->blocks_count);
+    vga_writestring(" blocks, ");
+    vga_write_dec(super->inodes_count - super->free_inodes_count);
+    vga_putchar('/');
+    vga_write_dec(super->inodes_count);
+    vga_writestring(" inodes used\n");
+    shell_write_ext2_stats();
+}
+
+void cmd_fsls(int argc, char* argv[]) {
+    boot_require("rootfs");
+    const char* path = argc > 1 ? argv[1] : "/";
+    u32 ino;
+    int status = ext2_lookup(path, &ino);
+    
+    u32 cookie = 0;
+    struct ext2_dirent entry;
+    while (status == EXT2_OK && (status = ext2_readdir(ino, &cookie, &entry)) == EXT2_OK) {
+        struct ext2_inode inode;
+        if (ext2_get_inode(entry.ino, &inode) != EXT2_OK) continue;
+        vga_writestring(entry.name);
+        if ((inode.mode & EXT2_S_IFMT) == EXT2_S_IFDIR) {
+            vga_writestring("/\n");
+        } else {
+            vga_writestring("\t");
+            vga_write_dec(inode.size);
+            vga_writestring(" bytes\n");
+        }
+    }
+    if (status != EXT2_ERR_NOT_FOUND || cookie == 0) {
+        vga_writestring("fsls: ");
+        vga_writestring(ext2_strerror(status));
+        vga_putchar('\n');
+    }
+}
+
+static u8 shell_file_buffer[64 * 1024] __attribute__((aligned(4096)));
+
+void cmd_fscat(int argc, char* argv[]) {
+    boot_require("rootfs");
+    for (int i = 1; i < argc; i++) {
+        u32 ino;
+        u32 offset = 0;
+        u32 length;
+        int status = ext2_lookup(argv[i], &ino);
+        while (status == EXT2_OK) {
+            status = ext2_read(ino, offset, shell_file_buffer, sizeof(shell_file_buffer), &length);
+            if (status != EXT2_OK || length == 0) break;
+            vga_write((const char*)shell_file_buffer, length);
+            offset += length;
+        }
+        if (status != EXT2_OK) {
+            vga_writestring("fscat: ");
+            vga_writestring(argv[i]);
+            vga_writestring(": ");
+            vga_writestring(ext2_strerror(status));
+            vga_putchar('\n');
+        }
+    }
+}
+
+// Directory walk for fsbench: every entry is resolved again by full path,
+// the way a program opening files in a tree would
+static struct {
+    char path[EXT2_PATH_MAX];
+    struct ext2_dirent entry;
+    u32 entries;
+    u32 lookups;
+    u32 largest_size;
+    char largest[EXT2_PATH_MAX];
+} shell_walk;
+
+static int shell_walk_dir(u32 ino, u32 length, u32 depth) {
+    u32 cookie = 0;
+    int status;
+    while ((status = ext2_readdir(ino, &cookie, &shell_walk.entry)) == EXT2_OK) {
+        const char* name = shell_walk.entry.name;
+        if (name[0] == '.' && (!name[1] || (name[1] == '.' && !name[2]))) continue;
+        u32 name_length = strlen(name);
+        if (length + name_length + 2 > EXT2_PATH_MAX) continue;
+        
+        shell_walk.path[length] = '/';
+        memcpy(&shell_walk.path[length + 1], name, name_length + 1);
+        shell_walk.entries++;
+        
+        u32 child;
+        struct ext2_inode inode;
+        shell_walk.lookups++;
+        status = ext2_lookup(shell_walk.path, &child);
+        if (status == EXT2_OK) {
+            status = ext2_get_inode(child, &inode);
+        }
+        if (status != EXT2_OK) {
+            return status;
+        }
+        
+        if ((inode.mode & EXT2_S_IFMT) == EXT2_S_IFDIR) {
+            if (depth < 16) {
+                status = shell_walk_dir(child, length + 1 + name_length, depth + 1);
+                if (status != EXT2_OK) {
+                    return status;
+                }
+            }
+        } else if ((inode.mode & EXT2_S_IFMT) == EXT2_S_IFREG && inode.size > shell_walk.largest_size) {
+            shell_walk.largest_size = inode.size;
+            memcpy(shell_walk.largest, shell_walk.path, length + name_length + 2);
+        }
+        shell_walk.path[length] = '\0';
+    }
+    return status == EXT2_ERR_NOT_FOUND ? EXT2_OK : status;
+}
+
+void cmd_fsbench(int argc, char* argv[]) {
+    boot_require("rootfs");
+    u32 frequency = timer_get_frequency();
+    if (!ext2_get_device()) {
+        vga_writestring("fsbench: ");
+        vga_writestring(ext2_strerror(EXT2_ERR_NOT_MOUNTED));
+        vga_putchar('\n');
+        return;
+    }
+    
+    // Walk once with empty inode and dentry caches, then repeatedly for 1 s
+    ext2_drop_caches();
+    ext2_reset_stats();
+    memset(&shell_walk, 0, sizeof(shell_walk));
+    int status = shell_walk_dir(EXT2_ROOT_INO, 0, 0);
+    if (status != EXT2_OK) {
+        vga_writestring("fsbench: ");
+        vga_writestring(ext2_strerror(status));
+        vga_putchar('\n');
+        return;
+    }
+    vga_writestring("Cold walk: ");
+    vga_write_dec(shell_walk.entries);
+    vga_writestring(" entries, ");
+    vga_write_dec(ext2_get_stats()->dir_scans);
+    vga_writestring(" directory scans\n");
+    
+    ext2_reset_stats();
+    u32 passes = 0;
+    u32 start = timer_get_ticks();
+    u32 ticks;
+    shell_walk.lookups = 0;
+    do {
+        shell_walk.entries = 0;
+        shell_walk_dir(EXT2_ROOT_INO, 0, 0);
+        passes++;
+        ticks = timer_get_ticks() - start;
+    } while (ticks < frequency);
+    vga_writestring("Warm walk: ");
+    vga_write_dec(passes);
+    vga_writestring(" passes, ");
+    vga_write_dec(ticks ? (u32)div_u64_rem((u64)shell_walk.lookups * frequency, ticks, 0) : 0);
+    vga_writestring(" path lookups/s\n");
+    shell_write_ext2_stats();
+    
+    // Read the given file, or the largest one found, repeatedly for 1 s
+    const char* path = argc > 1 ? argv[1] : shell_walk.largest;
+    u32 ino;
+    if (!path[0] || ext2_lookup(path, &ino) != EXT2_OK) {
+        vga_writestring("fsbench: no file to read\n");
+        return;
+    }
+    ext2_reset_stats();
+    u64 bytes = 0;
+    start = timer_get_ticks();
+    do {
+        u32 offset = 0;
+        u32 length;
+        while ((status = ext2_read(ino, offset, shell_file_buffer, sizeof(shell_file_buffer), &length)) == EXT2_OK && length) {
+            offset += length;
+            bytes += length;
+        }
+        ticks = timer_get_ticks() - start;
+    } while (status == EXT2_OK && bytes && ticks < frequency);
+    if (status != EXT2_OK) {
+        vga_writestring("fsbench: ");
+        vga_writestring(ext2_strerror(status));
+        vga_putchar('\n');
+        return;
+    }
+    
+    vga_writestring("Read ");
+    vga_writestring(path);
+    vga_writestring(": ");
+    shell_write_rate(bytes, ticks);
+    vga_putchar('\n');
+    shell_write_ext2_stats();
+}
+
+static void shell_write_ipv4(u32 address) {
+    for (int shift = 24; shift >= 0; shift -= 8) {
+        vga_write_dec((address >> shift) & 0xFF);
+        if (shift) vga_putchar('.');
+    }
+}
+
+// Parse a dotted quad; false if it is not one
+static bool shell_parse_ipv4(const char* text, u32* address) {
+    u32 value = 0;
+    for (int part = 0; part < 4; part++) {
+        char* end;
+        u32 octet = strtoul(text, &end, 10);
+        if (end == text || octet > 255 || (part < 3 ? *end != '.' : *end != '\0')) {
+            return false;
+        }
+        value = (value << 8) | octet;
+        text = end + 1;
+    }
+    *address = value;
+    return true;
+}
+
+void cmd_ifconfig(int argc, char* argv[]) {
+    boot_require("network");
+    struct net_interface* iface = net_get(0);
+    if (!iface) {
+        vga_writestring("No network interfaces.\n");
+        return;
+    }
+    if (argc > 1 && !shell_parse_ipv4(argv[1], &iface->address)) {
+        vga_writestring("Usage: ifconfig [a.b.c.d]\n");
+        return;
+    }
+    
+    vga_writestring(iface->name);
+    vga_writestring(": ");
+    for (int i = 0; i < ETH_ALEN; i++) {
+        shell_write_hex_digits(iface->mac[i], 2);
+        if (i < ETH_ALEN - 1) vga_putchar(':');
+    }
+    vga_writestring(", inet ");
+    shell_write_ipv4(iface->address);
+    vga_writestring(iface->link_up ? ", link up\n" : ", link down\n");
+    vga_writestring("UDP echo on port ");
+    vga_write_dec(NET_ECHO_PORT);
+    vga_writestring(", interrupt throttle ");
+    vga_write_dec(e1000_get_itr() * 256);
+    vga_writestring(" ns, free buffers ");
+    vga_write_dec(net_buffer_available());
+    vga_putchar('\n');
+}
+
+// Reset the counters, keep servicing the NIC for the given number of
+// seconds and report rates over that window
+void cmd_netstat(int argc, char* argv[]) {
+    boot_require("network");
+    struct net_interface* iface = net_get(0);
+    u32 seconds = argc > 1 ? strtoul(argv[1], 0, 0) : 1;
+    u32 frequency = timer_get_frequency();
+    if (!iface) {
+        vga_writestring("No network interfaces.\n");
+        return;
+    }
+    if (seconds == 0) seconds = 1;
+    
+    net_reset_stats(iface);
+    e1000_reset_stats();
+    u32 start = timer_get_ticks();
+    u64 tsc_start = rdtsc();
+    while (timer_get_ticks() - start < seconds * frequency) {
+        if (!net_poll()) {
+            __asm__ volatile ("hlt");
+        }
+    }
+    u32 ticks = timer_get_ticks() - start;
+    u64 cycles = rdtsc() - tsc_start;
+    
+    // TSC rate measured over the same window converts cycles to time
+    u32 mhz = (u32)div_u64_rem(div_u64_rem(cycles * frequency, ticks, 0), 1000000, 0);
+    const struct net_stats* stats = &iface->stats;
+    const struct e1000_stats* nic = e1000_get_stats();
+    
+    vga_writestring("RX: ");
+    vga_write_dec(stats->rx_packets);
+    vga_writestring(" packets (");
+    vga_write_dec((u32)div_u64_rem((u64)stats->rx_packets * frequency, ticks, 0));
+    vga_writestring(" pps), ");
+    vga_write_dec(stats->rx_dropped);
+    vga_writestring(" dropped\nTX: ");
+    vga_write_dec(stats->tx_packets);
+    vga_writestring(" packets (");
+    vga_write_dec((u32)div_u64_rem((u64)stats->tx_packets * frequency, ticks, 0));
+    vga_writestring(" pps), ");
+    vga_write_dec(stats->tx_dropped);
+    vga_writestring(" dropped, ");
+    vga_write_dec(nic->tx_doorbells);
+    vga_writestring(" doorbells\nARP replies: ");
+    vga_write_dec(stats->arp_replies);
+    vga_writestring(", UDP echoes: ");
+    vga_write_dec(stats->udp_echoes);
+    vga_writestring("\nInterrupts: ");
+    vga_write_dec(nic->interrupts);
+    vga_writestring(" (");
+    vga_write_dec(nic->rx_interrupt_packets);
+    vga_writestring(" packets), polled: ");
+    vga_write_dec(nic->rx_polled_packets);
+    vga_writestring(" packets, ");
+    vga_write_dec(nic->poll_entries);
+    vga_writestring(" switches to polling\n");
+    
+    if (stats->latency_samples && mhz) {
+        u64 average = div_u64_rem(stats->latency_total, stats->latency_samples, 0);
+        vga_writestring("Echo latency (receive to doorbell): min ");
+        vga_write_dec((u32)div_u64_rem(stats->latency_min * 1000, mhz, 0));
+        vga_writestring(" ns, avg ");
+        vga_write_dec((u32)div_u64_rem(average * 1000, mhz, 0));
+        vga_writestring(" ns, max ");
+        vga_write_dec((u32)div_u64_rem(stats->latency_max * 1000, mhz, 0));
+        vga_writestring(" ns\n");
+    }
+}
+
+static void shell_write_padded(u32 value, u32 width) {
+    u32 digits = 1;
+    for (u32 v = value; v >= 10; v /= 10) digits++;
+    while (digits++ < width) vga_putchar(' ');
+    vga_write_dec(value);
+}
+
+void cmd_boottime(int argc, char* argv[]) {
+    (void)argc; (void)argv;
+    u64 start = boot_get_start();
+    u64 previous = start;
+    
+    vga_writestring("Boot timeline (TSC ");
+    vga_write_dec((u32)div_u64_rem(timer_get_tsc_hz(), 1000000, 0));
+    vga_writestring(" MHz), microseconds since kernel entry:\n");
+    for (u32 i = 0; i < boot_get_mark_count(); i++) {
+        const struct boot_mark* mark = boot_get_mark(i);
+        shell_write_padded((u32)timer_tsc_to_us(mark->tsc - start), 9);
+        vga_writestring("  +");
+        shell_write_padded((u32)timer_tsc_to_us(mark->tsc - previous), 7);
+        vga_writestring("  ");
+        vga_writestring(mark->name);
+        vga_putchar('\n');
+        previous = mark->tsc;
+    }
+    
+    vga_writestring("Initcalls:\n");
+    for (u32 i = 0; i < boot_get_initcall_count(); i++) {
+        const struct boot_initcall* call = boot_get_initcall(i);
+        static const char* states[] = {"pending", "running", "ok", "failed"};
+        vga_writestring("  ");
+        vga_writestring(call->name);
+        vga_writestring(call->level == BOOT_INIT_LAZY ? "\tlazy" : "\tdeferred");
+        vga_writestring("\t");
+        vga_writestring(states[call->state]);
+        if (call->state >= BOOT_INIT_DONE) {
+            vga_writestring(", at ");
+            vga_write_dec((u32)timer_tsc_to_us(call->start - start));
+            vga_writestring(" us, took ");
+            vga_write_dec((u32)timer_tsc_to_us(call->end - call->start));
+            vga_writestring(call->on_demand ? " us (on first use)" : " us");
+        }
+        vga_putchar('\n');
+    }
+    
+    // The last mark is the prompt. A warm restart keeps the TSC running, so
+    // its cost is measured from the reboot command; after a reset the TSC
+    // starts from zero and kernel entry shows firmware and bootloader time.
+    const struct reboot_warm_info* warm = reboot_get_warm_info();
+    u32 marks = boot_get_mark_count();
+    u64 prompt = marks ? boot_get_mark(marks - 1)->tsc : start;
+    if (warm->warm_entry) {
+        vga_writestring("Warm restart #");
+        vga_write_dec(warm->restarts);
+        vga_writestring(": kernel entry ");
+        vga_write_dec((u32)timer_tsc_to_us(start - warm->restart_tsc));
+        vga_writestring(" us, prompt ");
+        vga_write_dec((u32)timer_tsc_to_us(prompt - warm->restart_tsc));
+        vga_writestring(" us after the reboot command\n");
+    } else {
+        const struct boot_unpack* unpack = boot_get_unpack();
+        if (unpack) {
+            vga_writestring("Compressed image: ");
+            vga_write_dec(unpack->packed_size / 1024);
+            vga_writestring(" KiB unpacked to ");
+            vga_write_dec(unpack->unpacked_size / 1024);
+            vga_writestring(" KiB in ");
+            vga_write_dec((u32)timer_tsc_to_us(unpack->done_tsc - unpack->entry_tsc));
+            vga_writestring(" us, stub entered ");
+            vga_write_dec((u32)div_u64_rem(timer_tsc_to_us(unpack->entry_tsc), 1000, 0));
+            vga_writestring(" ms after CPU reset\n");
+        }
+        vga_writestring("Cold boot: kernel entry ");
+        vga_write_dec((u32)div_u64_rem(timer_tsc_to_us(start), 1000, 0));
+        vga_writestring(" ms, prompt ");
+        vga_write_dec((u32)div_u64_rem(timer_tsc_to_us(prompt), 1000, 0));
+        vga_writestring(" ms after CPU reset\n");
+    }
+}
+
+// Rebuild a command line from arguments; the caller's argv points into
+// the shared parse buffer, which the nested command will overwrite
+static void shell_join_args(int argc, char* argv[], char* line) {
+    size_t pos = 0;
+    for (int i = 0; i < argc; i++) {
+        size_t len = strlen(argv[i]);
+        if (pos + len + 1 >= SHELL_BUFFER_SIZE) break;
+        if (i > 0) line[pos++] = ' ';
+        memcpy(line + pos, argv[i], len);
+        pos += len;
+    }
+    line[pos] = '\0';
+}
+
+void cmd_repeat(int argc, char* argv[]) {
+    if (argc < 3) {
+        vga_writestring("Usage: repeat <count> <command> [args]\n");
+        return;
+    }
+    u32 count = strtoul(argv[1], 0, 0);
+    char line[SHELL_BUFFER_SIZE];
+    shell_join_args(argc - 2, argv + 2, line);
+    for (u32 i = 0; i < count; i++) {
+        shell_execute_command(line);
+    }
+}
+
+void cmd_time(int argc, char* argv[]) {
+    if (argc < 2) {
+        vga_writestring("Usage: time <command> [args]\n");
+        return;
+    }
+    char line[SHELL_BUFFER_SIZE];
+    shell_join_args(argc - 1, argv + 1, line);
+    
+    // Calibrate first so the first timed command does not pay for it
+    timer_get_tsc_hz();
+    u32 ticks = timer_get_ticks();
+    u64 start = rdtsc();
+    shell_execute_command(line);
+    u64 cycles = rdtsc() - start;
+    ticks = timer_get_ticks() - ticks;
+    
+    vga_writestring("time: ");
+    vga_write_dec64(cycles);
+    vga_writestring(" cycles, ");
+    vga_write_dec64(timer_tsc_to_us(cycles));
+    vga_writestring(" us (");
+    vga_write_dec(ticks);
+    vga_writestring(" timer ticks)\n");
+}
+
+// Share of a window as a right-aligned percentage with one decimal
+static void shell_write_share(u64 part, u64 total) {
+    while (total >> 32) {
+        total >>= 1;
+        part >>= 1;
+    }
+    u32 permille = total ? (u32)div_u64_rem(part * 1000, (u32)total, 0) : 0;
+    shell_write_padded(permille / 10, 4);
+    vga_putchar('.');
+    vga_write_dec(permille % 10);
+    vga_putchar('%');
+}
+
+// Sliding windows shown by top, in CPUSTAT_WINDOW_MS units
+#define TOP_SHORT_WINDOWS   10
+#define TOP_LONG_WINDOWS    50
+
+void cmd_top(int argc, char* argv[]) {
+    // Refresh until a key is pressed, or a fixed number of times (for scripts)
+    u32 refreshes = argc > 1 ? strtoul(argv[1], 0, 0) : 0;
+    u32 frequency = timer_get_frequency();
+    
+    for (u32 n = 0; refreshes == 0 || n < refreshes; n++) {
+        u32 until = timer_get_ticks() + frequency;
+        while ((i32)(timer_get_ticks() - until) < 0) {
+            if (keyboard_haschar()) {
+                keyboard_getchar();
+                return;
+            }
+            irq_disable();
+            cpustat_halt();
+            irq_enable();
+        }
+        
+        struct cpustat_usage recent, longer;
+        if (!cpustat_get_usage(TOP_SHORT_WINDOWS, &recent) || !cpustat_get_usage(TOP_LONG_WINDOWS, &longer)) {
+            continue;
+        }
+        if (refreshes == 0) {
+            vga_clear();
+        }
+        
+        vga_writestring("CPU            last ");
+        vga_write_dec(recent.windows * cpustat_window_ticks() * 1000 / frequency);
+        vga_writestring(" ms   last ");
+        vga_write_dec(longer.windows * cpustat_window_ticks() * 1000 / frequency);
+        vga_writestring(" ms\n");
+        for (u32 i = 0; i < CPUSTAT_CONTEXTS; i++) {
+            vga_writestring("  ");
+            vga_writestring(cpustat_context_name(i));
+            for (u32 pad = strlen(cpustat_context_name(i)); pad < 12; pad++) vga_putchar(' ');
+            shell_write_share(recent.contexts[i], recent.total);
+            vga_writestring("        ");
+            shell_write_share(longer.contexts[i], longer.total);
+            vga_putchar('\n');
+        }
+        
+        vga_writestring("IRQ share of CPU\n");
+        for (u32 i = 0; i < CPUSTAT_SOURCES; i++) {
+            if (longer.sources[i] == 0) continue;
+            vga_writestring(i < 16 ? "  IRQ " : "  MSI ");
+            shell_write_padded(i < 16 ? i : IRQ_MSI_BASE + i - 16, 2);
+            vga_writestring("      ");
+            shell_write_share(recent.sources[i], recent.total);
+            vga_writestring("        ");
+            shell_write_share(longer.sources[i], longer.total);
+            vga_putchar('\n');
+        }
+        if (refreshes == 0) {
+            vga_writestring("Press any key to stop.\n");
+        }
+    }
+}
+
+static u64 shell_cycles_to_ns(u64 cycles) {
+    u32 mhz = (u32)div_u64_rem(timer_get_tsc_hz(), 1000000, 0);
+    return mhz ? div_u64_rem(cycles * 1000, mhz, 0) : 0;
+}
+
+// Kernel address as function+offset when the symbol table knows it
+static void shell_write_symbol(u32 address) {
+    u32 offset;
+    const char* name = ksyms_find(address, &offset);
+    if (!name || address >= (uptr)__text_end) {
+        vga_write_hex(address);
+        return;
+    }
+    vga_writestring(name);
+    vga_putchar('+');
+    vga_write_dec(offset);
+}
+
+static void shell_write_irqtrace_record(const struct irqtrace_record* record) {
+    vga_writestring("  ");
+    vga_write_dec64(shell_cycles_to_ns(record->cycles));
+    vga_writestring(" ns  off ");
+    shell_write_symbol(record->off_eip);
+    vga_writestring(" on ");
+    shell_write_symbol(record->on_eip);
+    for (u32 i = 0; i < IRQTRACE_DEPTH && record->backtrace[i]; i++) {
+        vga_writestring(i == 0 ? " from " : " < ");
+        vga_write_hex(record->backtrace[i]);
+    }
+    vga_putchar('\n');
+}
+
+void cmd_irqsoff(int argc, char* argv[]) {
+    if (argc > 1) {
+        if (strcmp(argv[1], "on") == 0) {
+            irqtrace_enable(true);
+        } else if (strcmp(argv[1], "off") == 0) {
+            irqtrace_enable(false);
+        } else if (strcmp(argv[1], "reset") == 0) {
+            irqtrace_reset();
+        } else if (strcmp(argv[1], "max") == 0 && argc > 2) {
+            u32 mhz = (u32)div_u64_rem(timer_get_tsc_hz(), 1000000, 0);
+            irqtrace_set_threshold((u64)strtoul(argv[2], 0, 0) * mhz);
+        } else {
+            vga_writestring("Usage: irqsoff [on|off|reset|max <us>]\n");
+        }
+        return;
+    }
+    
+    const struct irqtrace_stats* stats = irqtrace_get_stats();
+    vga_writestring("Interrupts-off tracer ");
+    vga_writestring(irqtrace_enabled ? "on" : "off");
+    vga_writestring(", ");
+    vga_write_dec(stats->windows);
+    vga_writestring(" windows");
+    if (stats->windows) {
+        vga_writestring(", average ");
+        vga_write_dec64(shell_cycles_to_ns(div_u64_rem(stats->total_cycles, stats->windows, 0)));
+        vga_writestring(" ns");
+    }
+    vga_putchar('\n');
+    
+    vga_writestring("Histogram (ns):\n");
+    for (u32 i = 0; i < IRQTRACE_BUCKETS; i++) {
+        if (stats->histogram[i] == 0) continue;
+        vga_writestring("  ");
+        shell_write_padded((u32)shell_cycles_to_ns(1ull << i), 10);
+        vga_writestring(" - ");
+        shell_write_padded((u32)shell_cycles_to_ns((2ull << i) - 1), 10);
+        vga_writestring(": ");
+        vga_write_dec(stats->histogram[i]);
+        vga_putchar('\n');
+    }
+    
+    struct irqtrace_record records[IRQTRACE_TOP];
+    u32 count = irqtrace_get_longest(records, IRQTRACE_TOP);
+    if (count) {
+        vga_writestring("Longest windows:\n");
+        for (u32 i = 0; i < count; i++) {
+            shell_write_irqtrace_record(&records[i]);
+        }
+    }
+    
+    if (stats->threshold == 0) {
+        vga_writestring("No threshold set.\n");
+        return;
+    }
+    vga_writestring("Threshold ");
+    vga_write_dec64(div_u64_rem(shell_cycles_to_ns(stats->threshold), 1000, 0));
+    vga_writestring(" us, ");
+    vga_write_dec(stats->violations);
+    vga_writestring(" violations\n");
+    count = irqtrace_get_violations(records, IRQTRACE_LOG_SIZE);
+    for (u32 i = 0; i < count; i++) {
+        shell_write_irqtrace_record(&records[i]);
+    }
+}
+
+static void shell_write_jitter(const struct timer_jitter* jitter) {
+    if (jitter->samples == 0) {
+        vga_writestring("no ticks\n");
+        return;
+    }
+    vga_write_dec(jitter->samples);
+    vga_writestring(" ticks, interval ");
+    vga_write_dec64(timer_tsc_to_us(jitter->interval_min));
+    vga_writestring("-");
+    vga_write_dec64(timer_tsc_to_us(jitter->interval_max));
+    vga_writestring(" us");
+    if (jitter->period) {
+        vga_writestring(", deviation avg ");
+        vga_write_dec64(timer_tsc_to_us(div_u64_rem(jitter->deviation_total, jitter->samples, 0)));
+        vga_writestring(" max ");
+        vga_write_dec64(timer_tsc_to_us(jitter->deviation_max));
+        vga_writestring(" us");
+    }
+    vga_putchar('\n');
+}
+
+// irqnest bench: a slow handler on the RTC line spins while the timer
+// ticks, first with nesting off and then on
+#define IRQNEST_LOAD_HZ         64
+
+static u64 irqnest_load_cycles = 0;
+
+static void irqnest_load(struct interrupt_context* ctx) {
+    (void)ctx;
+    u64 start = rdtsc();
+    while (rdtsc() - start < irqnest_load_cycles) {
+        __asm__ volatile ("pause");
+    }
+}
+
+static void irqnest_bench(u32 spin_us, u32 seconds) {
+    u32 mhz = (u32)div_u64_rem(timer_get_tsc_hz(), 1000000, 0);
+    irqnest_load_cycles = (u64)spin_us * mhz;
+    bool nesting = irq_get_nesting();
+    if (!rtc_start_periodic(IRQNEST_LOAD_HZ, irqnest_load)) {
+        vga_writestring("irqnest: cannot start the RTC\n");
+        return;
+    }
+    
+    vga_writestring("RTC handler spinning ");
+    vga_write_dec(spin_us);
+    vga_writestring(" us at ");
+    vga_write_dec(IRQNEST_LOAD_HZ);
+    vga_writestring(" Hz\n");
+    for (u32 pass = 0; pass < 2; pass++) {
+        irq_set_nesting(pass == 1);
+        timer_reset_jitter();
+        u32 loads = rtc_get_periodic_count();
+        u32 until = timer_get_ticks() + seconds * timer_get_frequency();
+        while ((i32)(timer_get_ticks() - until) < 0) {
+            irq_disable();
+            cpustat_halt();
+            irq_enable();
+        }
+        struct timer_jitter jitter;
+        timer_get_jitter(&jitter);
+        vga_writestring(pass ? "Nesting on:  " : "Nesting off: ");
+        vga_write_dec(rtc_get_periodic_count() - loads);
+        vga_writestring(" loads, ");
+        shell_write_jitter(&jitter);
+    }
+    
+    rtc_stop_periodic();
+    irq_set_nesting(nesting);
+}
+
+void cmd_irqnest(int argc, char* argv[]) {
+    if (argc > 1) {
+        if (strcmp(argv[1], "on") == 0) {
+            irq_set_nesting(true);
+        } else if (strcmp(argv[1], "off") == 0) {
+            irq_set_nesting(false);
+        } else if (strcmp(argv[1], "reset") == 0) {
+            irq_reset_nest_stats();
+            timer_reset_jitter();
+        } else if (strcmp(argv[1], "prio") == 0 && argc > 3) {
+            if (!irq_set_priority(strtoul(argv[2], 0, 0), strtoul(argv[3], 0, 0))) {
+                vga_writestring("irqnest: invalid line or level\n");
+            }
+        } else if (strcmp(argv[1], "bench") == 0) {
+            u32 spin_us = argc > 2 ? strtoul(argv[2], 0, 0) : 2000;
+            u32 seconds = argc > 3 ? strtoul(argv[3], 0, 0) : 2;
+            irqnest_bench(spin_us, seconds ? seconds : 1);
+        } else {
+            vga_writestring("Usage: irqnest [on|off|reset|prio <irq> <level>|bench [spin-us] [seconds]]\n");
+        }
+        return;
+    }
+    
+    const struct irq_nest_stats* stats = irq_get_nest_stats();
+    vga_writestring("Nesting ");
+    vga_writestring(irq_get_nesting() ? "on" : "off");
+    vga_writestring(", ");
+    vga_write_dec(stats->entries);
+    vga_writestring(" handler entries, ");
+    vga_write_dec(stats->preemptions);
+    vga_writestring(" preemptions, max depth ");
+    vga_write_dec(stats->max_depth);
+    vga_writestring("\nBy depth:");
+    for (u32 i = 0; i < IRQ_NEST_DEPTHS && i < stats->max_depth; i++) {
+        vga_putchar(' ');
+        vga_write_dec(stats->depths[i]);
+    }
+    
+    vga_writestring("\n\nIRQ\tLevel\tCount\t\tPreempted\tPreempts\n");
+    for (int irq = 0; irq < 16; irq++) {
+        const struct irq_stats* line = irq_get_stats(irq);
+        if (line->count == 0) continue;
+        vga_write_dec(irq);
+        vga_putchar('\t');
+        vga_write_dec(irq_get_priority(irq));
+        vga_putchar('\t');
+        vga_write_dec(line->count);
+        vga_writestring("\t\t");
+        vga_write_dec(line->preempted);
+        vga_writestring("\t\t");
+        vga_write_dec(line->preemptions);
+        vga_putchar('\n');
+    }
+    
+    struct timer_jitter jitter;
+    timer_get_jitter(&jitter);
+    vga_writestring("\nTimer: ");
+    shell_write_jitter(&jitter);
+}
+
+// The dump lines ("P <eip> <count>") are what scripts/profile-order.sh
+// reads from a serial log to build the function ordering file
+void cmd_profile(int argc, char* argv[]) {
+    if (argc > 1) {
+        if (strcmp(argv[1], "start") == 0) {
+            u32 hz = argc > 2 ? strtoul(argv[2], 0, 0) : PROFILE_HZ_DEFAULT;
+            if (!profile_start(hz)) {
+                vga_writestring("profile: already running or bad rate (power of two, 2-8192 Hz)\n");
+            }
+        } else if (strcmp(argv[1], "stop") == 0) {
+            profile_stop();
+        } else if (strcmp(argv[1], "reset") == 0) {
+            profile_reset();
+        } else if (strcmp(argv[1], "dump") == 0) {
+            for (u32 slot = 0; slot < PROFILE_SLOTS; slot++) {
+                const struct profile_entry* entry = profile_get_entry(slot);
+                if (!entry) continue;
+                vga_writestring("P ");
+                vga_write_hex(entry->eip);
+                vga_putchar(' ');
+                vga_write_dec(entry->count);
+                vga_putchar('\n');
+            }
+        } else {
+            vga_writestring("Usage: profile [start [hz]|stop|reset|dump]\n");
+        }
+        return;
+    }
+    
+    const struct profile_stats* stats = profile_get_stats();
+    vga_writestring("Profiler ");
+    if (stats->running) {
+        vga_writestring("running at ");
+        vga_write_dec(stats->hz);
+        vga_writestring(" Hz");
+    } else {
+        vga_writestring("stopped");
+    }
+    vga_writestring(", ");
+    vga_write_dec(stats->samples);
+    vga_writestring(" kernel samples at ");
+    vga_write_dec(stats->eips);
+    vga_writestring(" EIPs, ");
+    vga_write_dec(stats->user);
+    vga_writestring(" user, ");
+    vga_write_dec(stats->dropped);
+    vga_writestring(" dropped\n");
+    
+    struct profile_footprint footprint;
+    profile_get_footprint(&footprint);
+    vga_writestring("Text ");
+    vga_write_dec(((uptr)__text_end - (uptr)__text_start) / 1024);
+    vga_writestring(" KiB, hot region ");
+    vga_write_dec((uptr)__text_hot_end - (uptr)__text_hot_start);
+    vga_writestring(" bytes with ");
+    shell_write_percent(footprint.hot_samples, stats->samples);
+    vga_writestring(" of samples\nFootprint: ");
+    vga_write_dec(footprint.lines);
+    vga_writestring(" cache lines, ");
+    vga_write_dec(footprint.pages);
+    vga_writestring(" pages\n");
+}
+
+// Port by number or by the name the host gave it
+static u32 shell_vcon_port(const char* arg) {
+    u32 port = (*arg >= '0' && *arg <= '9') ? strtoul(arg, 0, 0) : virtio_console_find(arg);
+    const struct virtio_console_port* info = virtio_console_get_port(port);
+    return info && info->present ? port : VIRTIO_CONSOLE_NO_PORT;
+}
+
+// Console output goes to the port as well, until the log is turned off
+static void shell_vcon_set_log(u32 port) {
+    virtio_console_set_log(port);
+    vga_set_tee(port == VIRTIO_CONSOLE_NO_PORT ? 0 : virtio_console_putchar);
+}
+
+void cmd_vcon(int argc, char* argv[]) {
+    boot_require("vconsole");
+    if (!virtio_console_present()) {
+        vga_writestring("vcon: no virtio-console device\n");
+        return;
+    }
+    
+    if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+        virtio_console_reset_stats();
+        return;
+    }
+    if (argc > 2 && strcmp(argv[1], "log") == 0) {
+        u32 port = strcmp(argv[2], "off") == 0 ? VIRTIO_CONSOLE_NO_PORT : shell_vcon_port(argv[2]);
+        if (port == VIRTIO_CONSOLE_NO_PORT && strcmp(argv[2], "off") != 0) {
+            vga_writestring("vcon: no such port\n");
+            return;
+        }
+        shell_vcon_set_log(port);
+        return;
+    }
+    if (argc > 3 && strcmp(argv[1], "run") == 0) {
+        u32 port = shell_vcon_port(argv[2]);
+        if (port == VIRTIO_CONSOLE_NO_PORT) {
+            vga_writestring("vcon: no such port\n");
+            return;
+        }
+        char line[SHELL_BUFFER_SIZE];
+        shell_join_args(argc - 3, argv + 3, line);
+        
+        u32 previous = virtio_console_get_log();
+        u64 bytes = virtio_console_get_port(port)->stats.bytes;
+        u32 ticks = timer_get_ticks();
+        shell_vcon_set_log(port);
+        shell_execute_command(line);
+        virtio_console_flush(port);
+        shell_vcon_set_log(previous);
+        ticks = timer_get_ticks() - ticks;
+        bytes = virtio_console_get_port(port)->stats.bytes - bytes;
+        
+        vga_writestring("vcon: ");
+        vga_write_dec64(bytes);
+        vga_writestring(" bytes to port ");
+        vga_write_dec(port);
+        vga_writestring(", ");
+        shell_write_rate(bytes, ticks);
+        vga_putchar('\n');
+        return;
+    }
+    if (argc > 2 && strcmp(argv[1], "bench") == 0) {
+        u32 port = shell_vcon_port(argv[2]);
+        u32 mib = argc > 3 ? strtoul(argv[3], 0, 0) : 64;
+        if (port == VIRTIO_CONSOLE_NO_PORT || mib == 0 || mib > 1024) {
+            vga_writestring("vcon: bench needs a port and 1-1024 MiB\n");
+            return;
+        }
+        struct virtio_console_bench_result result;
+        int status = virtio_console_bench(port, mib << 20, &result);
+        if (status != VIRTIO_CONSOLE_OK) {
+            vga_writestring("vcon: ");
+            vga_writestring(virtio_console_strerror(status));
+            vga_putchar('\n');
+            return;
+        }
+        vga_write_dec64(result.bytes >> 10);
+        vga_writestring(" KiB in ");
+        vga_write_dec(result.ticks);
+        vga_writestring(" ticks: ");
+        shell_write_rate(result.bytes, result.ticks);
+        vga_writestring(", ");
+        vga_write_dec(result.kicks);
+        vga_writestring(" kicks, ");
+        vga_write_dec(result.notifications);
+        vga_writestring(" doorbells, ");
+        vga_write_dec(result.waits);
+        vga_writestring(" waits for a buffer\n");
+        return;
+    }
+    if (argc > 1) {
+        vga_writestring("Usage: vcon [log <port>|off|run <port> <command>|bench <port> [MiB]|reset]\n");
+        return;
+    }
+    
+    vga_writestring("virtio-console (");
+    vga_writestring(virtio_console_is_modern() ? "modern" : "legacy");
+    vga_writestring(virtio_console_is_multiport() ? ", multiport), " : "), ");
+    vga_write_dec(virtio_console_get_port_count());
+    vga_writestring(" ports with queues\n");
+    for (u32 i = 0; i < virtio_console_get_port_count(); i++) {
+        const struct virtio_console_port* port = virtio_console_get_port(i);
+        if (!port->present) {
+            continue;
+        }
+        vga_writestring("  ");
+        vga_write_dec(i);
+        vga_writestring(" ");
+        vga_writestring(port->name[0] ? port->name : "(unnamed)");
+        vga_writestring(port->host_open ? "\topen" : "\tclosed");
+        if (port->console) vga_writestring(", console");
+        if (virtio_console_get_log() == i) vga_writestring(", log");
+        vga_writestring(": ");
+        vga_write_dec64(port->stats.bytes);
+        vga_writestring(" bytes in ");
+        vga_write_dec(port->stats.buffers);
+        vga_writestring(" buffers, ");
+        vga_write_dec(port->stats.kicks);
+        vga_writestring(" kicks, ");
+        vga_write_dec(port->stats.notifications);
+        vga_writestring(" doorbells, ");
+        vga_write_dec(port->stats.waits);
+        vga_writestring(" waits, ");
+        vga_write_dec64(port->stats.dropped);
+        vga_writestring(" dropped\n");
+    }
+}
+
+void cmd_probe(int argc, char* argv[]) {
+    int status = KPROBE_OK;
+    if (argc > 2 && strcmp(argv[1], "add") == 0) {
+        status = kprobe_add(argv[2]);
+    } else if (argc > 2 && strcmp(argv[1], "del") == 0) {
+        status = kprobe_remove(argv[2]);
+    } else if (argc > 1 && strcmp(argv[1], "all") == 0) {
+        kprobe_remove_all();
+    } else if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+        kprobe_reset();
+    } else if (argc > 1) {
+        vga_writestring("Usage: probe [add <function>|del <function>|all|reset]\n");
+        return;
+    }
+    if (status != KPROBE_OK) {
+        vga_writestring("probe: ");
+        vga_writestring(kprobe_strerror(status));
+        vga_putchar('\n');
+        return;
+    }
+    if (argc > 1) {
+        return;
+    }
+    
+    vga_writestring("Function                 Address         Hits   Returns  Missed  Avg ns  Max ns\n");
+    u32 count = 0;
+    for (u32 i = 0; i < KPROBE_MAX; i++) {
+        const struct kprobe* probe = kprobe_get(i);
+        if (!probe) {
+            continue;
+        }
+        count++;
+        vga_writestring(probe->name);
+        for (u32 pad = strlen(probe->name); pad < 24; pad++) {
+            vga_putchar(' ');
+        }
+        vga_putchar(' ');
+        vga_write_hex(probe->address);
+        shell_write_padded(probe->hits, 10);
+        shell_write_padded(probe->returns, 10);
+        shell_write_padded(probe->missed, 8);
+        u64 average = probe->returns ? div_u64_rem(probe->cycles, probe->returns, 0) : 0;
+        shell_write_padded((u32)shell_cycles_to_ns(average), 8);
+        shell_write_padded((u32)shell_cycles_to_ns(probe->cycles_max), 8);
+        vga_putchar('\n');
+    }
+    if (count == 0) {
+        vga_writestring("No probes.\n");
+    }
+}
+
+static const char* shell_tunable_sources[] = {"default", "cmdline", "sysctl"};
+
+static void shell_write_tunable(const struct tunable* tunable, bool verbose) {
+    vga_writestring(tunable->name);
+    vga_writestring(" = ");
+    if (tunable->type == TUNABLE_CHOICE) {
+        vga_writestring(tunable_value_name(tunable));
+    } else {
+        vga_write_dec(tunable->value);
+        if (tunable->unit) {
+            vga_putchar(' ');
+            vga_writestring(tunable->unit);
+        }
+    }
+    vga_writestring(" (");
+    vga_writestring(shell_tunable_sources[tunable->source]);
+    if (!tunable->apply) vga_writestring(", fixed at boot");
+    if (tunable->rejected) vga_writestring(", bad cmdline value ignored");
+    vga_writestring(")\n");
+    if (!verbose) {
+        return;
+    }
+    
+    vga_writestring("  ");
+    vga_writestring(tunable->description);
+    vga_writestring("\n  Values: ");
+    if (tunable->type == TUNABLE_CHOICE) {
+        for (u32 i = 0; i <= tunable->max && tunable->choices[i]; i++) {
+            if (i) vga_writestring(", ");
+            vga_writestring(tunable->choices[i]);
+        }
+    } else {
+        vga_write_dec(tunable->min);
+        vga_writestring(" - ");
+        vga_write_dec(tunable->max);
+        if (tunable->flags & TUNABLE_POWER_OF_TWO) vga_writestring(", power of two");
+    }
+    vga_writestring("; default ");
+    if (tunable->type == TUNABLE_CHOICE) {
+        vga_writestring(tunable->choices[tunable->fallback]);
+    } else {
+        vga_write_dec(tunable->fallback);
+    }
+    vga_putchar('\n');
+}
+
+// sysctl [name[=value]]: `name=value` changes a runtime tunable; boot-only
+// ones are set with the same syntax on the kernel command line
+void cmd_sysctl(int argc, char* argv[]) {
+    boot_require("storage");    // The block layer registers its tunables there
+    if (argc == 1) {
+        for (u32 i = 0; i < tunable_get_count(); i++) {
+            shell_write_tunable(tunable_get(i), false);
+        }
+        return;
+    }
+    
+    char* value = argv[1];
+    while (*value && *value != '=') value++;
+    if (*value == '=') {
+        *value++ = '\0';
+    } else if (argc > 2) {
+        value = argv[2];
+    } else {
+        value = 0;
+    }
+    
+    if (value) {
+        int status = tunable_set(argv[1], value);
+        if (status != TUNABLE_OK) {
+            vga_writestring("sysctl: ");
+            vga_writestring(argv[1]);
+            vga_writestring(": ");
+            vga_writestring(tunable_strerror(status));
+            vga_putchar('\n');
+            return;
+        }
+    }
+    const struct tunable* tunable = tunable_find(argv[1]);
+    if (!tunable) {
+        vga_writestring("sysctl: ");
+        vga_writestring(argv[1]);
+        vga_writestring(": ");
+        vga_writestring(tunable_strerror(TUNABLE_ERR_NOT_FOUND));
+        vga_putchar('\n');
+        return;
+    }
+    shell_write_tunable(tunable, !value);
+}
+
+static void shell_write_latency(const char* label, u64 cycles) {
+    vga_writestring(label);
+    vga_write_dec64(shell_cycles_to_ns(cycles));
+    vga_writestring(" ns");
+}
+
+// keygen: streams are set from text (Enter appended), an initramfs file of
+// raw scancodes, or a recording of the real keyboard ended by Esc
+void cmd_keygen(int argc, char* argv[]) {
+    int status = KEYGEN_OK;
+    if (argc > 2 && strcmp(argv[1], "text") == 0) {
+        char line[SHELL_BUFFER_SIZE];
+        shell_join_args(argc - 2, argv + 2, line);
+        size_t len = strlen(line);
+        line[len] = '\n';
+        line[len + 1] = '\0';
+        status = keygen_set_text(line);
+    } else if (argc > 2 && strcmp(argv[1], "load") == 0) {
+        const struct initramfs_file* file = initramfs_lookup(argv[2]);
+        if (!file || file->is_dir) {
+            vga_writestring("keygen: no such file: ");
+            vga_writestring(argv[2]);
+            vga_putchar('\n');
+            return;
+        }
+        status = keygen_set_scancodes(file->data, file->size);
+    } else if (argc > 1 && strcmp(argv[1], "record") == 0) {
+        status = keygen_record();
+        if (status == KEYGEN_OK) {
+            vga_writestring("Recording keystrokes; press Esc to stop.\n");
+        }
+    } else if (argc > 1 && strcmp(argv[1], "stop") == 0) {
+        keygen_stop();
+    } else if (argc > 2 && strcmp(argv[1], "run") == 0) {
+        u32 mode = KEYGEN_TIMER;
+        if (argc > 4 && strcmp(argv[4], "ipi") == 0) {
+            boot_require("platform");
+            mode = KEYGEN_IPI;
+        }
+        u32 passes = argc > 3 ? strtoul(argv[3], 0, 0) : 1;
+        status = keygen_run(strtoul(argv[2], 0, 0), passes, mode);
+    } else if (argc > 1 && strcmp(argv[1], "reset") == 0) {
+        keygen_reset();
+    } else if (argc > 1) {
+        vga_writestring("Usage: keygen [text <text>|load <file>|record|stop|run <rate> [passes] [ipi]|reset]\n");
+        return;
+    }
+    if (status != KEYGEN_OK) {
+        vga_writestring("keygen: ");
+        vga_writestring(keygen_strerror(status));
+        vga_putchar('\n');
+        return;
+    }
+    if (argc > 1) {
+        return;
+    }
+    
+    const struct keygen_stats* stats = keygen_get_stats();
+    vga_writestring("Stream: ");
+    vga_write_dec(stats->length);
+    vga_writestring(" scancodes");
+    if (stats->recording) {
+        vga_writestring(", recording");
+    } else if (stats->rate) {
+        vga_writestring(stats->running ? ", running at " : ", last run at ");
+        vga_write_dec(stats->rate);
+        vga_writestring(stats->mode == KEYGEN_IPI ? "/s by self-IPI, " : "/s from the timer, ");
+        vga_write_dec(stats->passes);
+        vga_writestring(" passes");
+    }
+    vga_writestring("\nInjected ");
+    vga_write_dec(stats->injected);
+    vga_writestring(" scancodes");
+    if (stats->ipis) {
+        vga_writestring(" in ");
+        vga_write_dec(stats->ipis);
+        vga_writestring(" IPIs");
+    }
+    vga_writestring(", echoed ");
+    vga_write_dec(stats->echoed);
+    vga_writestring(" characters, dropped ");
+    vga_write_dec(stats->dropped);
+    vga_putchar('\n');
+    if (stats->echoed == 0) {
+        return;
+    }
+    
+    u64 elapsed = shell_cycles_to_ns(stats->last_echo - stats->start);
+    if (elapsed) {
+        vga_writestring("Echo rate: ");
+        vga_write_dec64(div_u64_rem((u64)stats->echoed * 1000000000, elapsed, 0));
+        vga_writestring(" characters/s\n");
+    }
+    shell_write_latency("Scancode to echo: avg ", div_u64_rem(stats->latency_total, stats->echoed, 0));
+    shell_write_latency(", p50 ", keygen_percentile(500));
+    shell_write_latency(", p90 ", keygen_percentile(900));
+    vga_putchar('\n');
+    shell_write_latency("  p99 ", keygen_percentile(990));
+    shell_write_latency(", p99.9 ", keygen_percentile(999));
+    shell_write_latency(", max ", stats->latency_max);
+    vga_putchar('\n');
+}
+
+// taskbench: every task is a two-step state machine (submit a one-sector
+// read, then handle its completion) with no stack of its own
+#define TASKBENCH_MAX_TASKS     2048
+
+struct taskbench_task {
+    struct task task;
+    struct task_waker waker;
+    struct block_request request;
+    u32 index;
+    u32 remaining;
+};
+
+static struct {
+    struct block_device* dev;
+    u32 sectors;                // Addressed range, capped to 32 bits
+    struct task_queue slots;    // Tasks waiting for a free driver request
+    volatile u32 completions;   // Driver requests handed back so far
+    u32 reads;
+    u32 finished;
+    u32 retries;
+    u32 errors;
+} taskbench_state;
+
+static struct taskbench_task taskbench_tasks[TASKBENCH_MAX_TASKS];
+static u8 taskbench_buffer[8 * BLOCK_SECTOR_SIZE] __attribute__((aligned(4096)));
+
+// Completion, usually in interrupt context: wake the task and hand the
+// freed driver request to a waiting one
+static void taskbench_done(struct block_request* req, int status) {
+    struct taskbench_task* bench = (struct taskbench_task*)req->context;
+    task_waker_wake(&bench->waker, status);
+    taskbench_state.completions++;
+    task_queue_wake_one(&taskbench_state.slots);
+}
+
+static int taskbench_poll(struct task* task) {
+    struct taskbench_task* bench = (struct taskbench_task*)task->context;
+    while (1) {
+        if (task->step == 0) {
+            struct block_request* req = &bench->request;
+            req->sector = (bench->index * 8 + bench->remaining) % taskbench_state.sectors;
+            req->count = 1;
+            req->buffer = taskbench_buffer + (bench->index % 8) * BLOCK_SECTOR_SIZE;
+            req->done = taskbench_done;
+            req->context = bench;
+
+            // The completion may run before block_read_async returns
+            task->step = 1;
+            u32 completions = taskbench_state.completions;
+            int status = block_read_async(taskbench_state.dev, req);
+            if (status == BLOCK_ERR_NO_BUFFER) {
+                task->step = 0;
+                taskbench_state.retries++;
+                // A completion since the attempt freed a request but found
+                // no one parked to hand it to: retry instead of waiting
+                u32 flags = irq_save();
+                bool freed = taskbench_state.completions != completions;
+                if (!freed) {
+                    task_queue_wait(&taskbench_state.slots, task);
+                }
+                irq_restore(flags);
+                if (freed) {
+                    continue;
+                }
+                return TASK_PENDING;
+            }
+            if (status != BLOCK_OK) {
+                taskbench_state.errors++;
+                taskbench_state.finished++;
+                return TASK_DONE;
+            }
+            return TASK_PENDING;
+        }
+        
+        if (bench->waker.status != BLOCK_OK) {
+            taskbench_state.errors++;
+        }
+        taskbench_state.reads++;
+        if (--bench->remaining == 0) {
+            taskbench_state.finished++;
+            return TASK_DONE;
+        }
+        task->step = 0;
+    }
+}
+
+void cmd_taskbench(int argc, char* argv[]) {
+    if (!boot_require("storage")) {
+        vga_writestring("No block devices\n");
+        return;
+    }
+    struct block_device* dev = block_find(argc > 1 ? argv[1] : RAMDISK_NAME);
+    u32 count = argc > 2 ? strtoul(argv[2], 0, 0) : 1024;
+    u32 reads = argc > 3 ? strtoul(argv[3], 0, 0) : 4;
+    if (!dev || count == 0 || count > TASKBENCH_MAX_TASKS || reads == 0) {
+        vga_writestring("Usage: taskbench [device] [tasks <= 2048] [reads per task]\n");
+        return;
+    }
+    
+    memset(&taskbench_state, 0, sizeof(taskbench_state));
+    taskbench_state.dev = dev;
+    taskbench_state.sectors = dev->sectors > 0xFFFFFFFF ? 0xFFFFFFFF : (u32)dev->sectors;
+    task_queue_init(&taskbench_state.slots);
+    task_reset_stats();
+    timer_get_tsc_hz();
+    
+    u64 start = rdtsc();
+    for (u32 i = 0; i < count; i++) {
+        struct taskbench_task* bench = &taskbench_tasks[i];
+        task_init(&bench->task, "taskbench", taskbench_poll, bench);
+        task_waker_init(&bench->waker, &bench->task);
+        bench->index = i;
+        bench->remaining = reads;
+        task_spawn(&bench->task);
+    }
+    
+    // The command holds the CPU, so it drives the executor itself
+    while (taskbench_state.finished < count) {
+        if (!task_run()) {
+            irq_disable();
+            if (!task_pending() && taskbench_state.finished < count) {
+                cpustat_halt();
+            }
+            irq_enable();
+        }
+    }
+    u64 cycles = rdtsc() - start;
+    
+    const struct task_stats* stats = task_get_stats();
+    u64 us = timer_tsc_to_us(cycles);
+    vga_write_dec(count);
+    vga_writestring(" tasks (");
+    vga_write_dec(sizeof(struct taskbench_task));
+    vga_writestring(" bytes each, no stacks), ");
+    vga_write_dec(taskbench_state.reads);
+    vga_writestring(" reads from ");
+    vga_writestring(dev->name);
+    vga_writestring(" in ");
+    vga_write_dec64(us);
+    vga_writestring(" us, ");
+    vga_write_dec64(us ? div_u64_rem((u64)taskbench_state.reads * 1000000, (u32)us, 0) : 0);
+    vga_writestring(" reads/s\n");
+    vga_writestring("Polls ");
+    vga_write_dec(stats->polls);
+    vga_writestring(", wakes ");
+    vga_write_dec(stats->wakes);
+    vga_writestring(", waits for a driver request ");
+    vga_write_dec(taskbench_state.retries);
+    vga_writestring(", errors ");
+    vga_write_dec(taskbench_state.errors);
+    vga_putchar('\n');
+    if (stats->latency_samples) {
+        vga_writestring("Wake latency: avg ");
+        vga_write_dec64(shell_cycles_to_ns(div_u64_rem(stats->latency_total, stats->latency_samples, 0)));
+        vga_writestring(" ns, min ");
+        vga_write_dec64(shell_cycles_to_ns(stats->latency_min));
+        vga_writestring(" ns, max ");
+        vga_write_dec64(shell_cycles_to_ns(stats->latency_max));
+        vga_writestring(" ns\n");
+    }
+    if (stats->polls) {
+        vga_writestring("Executor overhead: ");
+        vga_write_dec64(div_u64_rem(stats->run_cycles - stats->poll_cycles, stats->polls, 0));
+        vga_writestring(" cycles per poll (");
+        vga_write_dec64(shell_cycles_to_ns(div_u64_rem(stats->run_cycles - stats->poll_cycles, stats->polls, 0)));
+        vga_writestring(" ns), ");
+        vga_write_dec64(shell_cycles_to_ns(stats->run_cycles - stats->poll_cycles));
+        vga_writestring(" ns total\n");
+    }
+}
@@ -0,0 +1,110 @@
+#include "syscall.h"
+#include "gdt.h"
+#include "idt.h"
+#include "cpu.h"
+#include "vga.h"
+#include "keyboard.h"
+#include "timer.h"
+#include "paging.h"
+
+// Ring 0 stack used whenever the CPU enters the kernel from ring 3
+static u8 syscall_stack[SYSCALL_STACK_SIZE] __attribute__((aligned(16)));
+
+// Ring 3 stack shared by built-in user programs
+static u8 user_stack[USER_STACK_SIZE] __attribute__((aligned(16))) __user_data;
+
+static bool sysenter_supported = false;
+
+// Built-in programs' .user section (see linker.ld)
+extern char __user_start[];
+extern char __user_end[];
+
+// Whether [buffer, buffer + length) is memory a ring 3 program may name:
+// the loaded ELF's address space or the built-in programs' section.
+// Anything else would fault in ring 0 or expose kernel memory.
+static bool syscall_user_range(u32 buffer, u32 length) {
+    u32 end = buffer + length;
+    if (end < buffer) {
+        return false;
+    }
+    if (buffer >= USER_SPACE_START && end <= USER_SPACE_END) {
+        return true;
+    }
+    return buffer >= (u32)__user_start && end <= (u32)__user_end;
+}
+
+// System call implementations
+static u32 sys_null(u32 arg1, u32 arg2, u32 arg3) {
+    (void)arg1; (void)arg2; (void)arg3;
+    return 0;
+}
+
+static u32 sys_exit(u32 code, u32 arg2, u32 arg3) {
+    (void)arg2; (void)arg3;
+    user_exit(code);
+    return 0;
+}
+
+static u32 sys_write(u32 buffer, u32 length, u32 arg3) {
+    (void)arg3;
+    if (!syscall_user_range(buffer, length)) {
+        return SYSCALL_ERROR;
+    }
+    vga_write((const char*)buffer, length);
+    return length;
+}
+
+static u32 sys_getticks(u32 arg1, u32 arg2, u32 arg3) {
+    (void)arg1; (void)arg2; (void)arg3;
+    return timer_get_ticks();
+}
+
+static u32 sys_getchar(u32 arg1, u32 arg2, u32 arg3) {
+    (void)arg1; (void)arg2; (void)arg3;
+    return (u8)keyboard_getchar();
+}
+
+// System call table
+static syscall_fn_t syscall_table[SYSCALL_COUNT] = {
+    [SYS_NULL] = sys_null,
+    [SYS_EXIT] = sys_exit,
+    [SYS_WRITE] = sys_write,
+    [SYS_GETTICKS] = sys_getticks,
+    [SYS_GETCHAR] = sys_getchar,
+};
+
+void syscall_initialize(void) {
+    u32 stack_top = (u32)&syscall_stack[SYSCALL_STACK_SIZE];
+
+    // Interrupts and exceptions taken in ring 3 switch to this stack
+    gdt_set_kernel_stack(stack_top);
+
+    // int 0x80 is always available as the compatible entry path
+    idt_set_gate(SYSCALL_VECTOR, (u32)syscall_int80_entry, GDT_KERNEL_CODE,
+                 IDT_FLAG_PRESENT | IDT_FLAG_RING3 | IDT_FLAG_GATE_32);
+
+    // SYSENTER derives SS, user CS and user SS from SYSENTER_CS, which
+    // matches the kernel code, kernel data, user code, user data GDT order
+    sysenter_supported = cpu_has_feature_edx(CPUID_FEAT_EDX_SEP) &&
+                         cpu_has_feature_edx(CPUID_FEAT_EDX_MSR);
+    if (sysenter_supported) {
+        wrmsr(MSR_SYSENTER_CS, GDT_KERNEL_CODE);
+        wrmsr(MSR_SYSENTER_ESP, stack_top);
+        wrmsr(MSR_SYSENTER_EIP, (u32)syscall_sysenter_entry);
+    }
+}
+
+bool syscall_sysenter_supported(void) {
+    return sysenter_supported;
+}
+
+u32 syscall_dispatch(u32 num, u32 arg1, u32 arg2, u32 arg3) {
+    if (num >= SYSCALL_COUNT || !syscall_table[num]) {
+        return SYSCALL_ERROR;
+    }
+    return syscall_table[num](arg1, arg2, arg3);
+}
+
+u32 user_run(void (*entry)(void)) {
+    return user_enter((u32)entry, (u32)&user_stack[USER_STACK_SIZE]);
+}
\ No newline at end of file
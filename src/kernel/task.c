@@ -0,0 +1,211 @@
+#include "task.h"
+#include "cpu.h"
+#include "irqtrace.h"
+
+// Ready queue; tasks are added from interrupt handlers, so it is only
+// touched with interrupts disabled
+static struct task* task_ready_head = 0;
+static struct task* task_ready_tail = 0;
+
+static struct task_stats task_stats;
+
+void task_initialize(void) {
+    task_ready_head = 0;
+    task_ready_tail = 0;
+    task_reset_stats();
+}
+
+void task_init(struct task* task, const char* name, task_poll_t poll, void* context) {
+    task->name = name;
+    task->poll = poll;
+    task->context = context;
+    task->step = 0;
+    task->flags = 0;
+    task->wake_tsc = 0;
+    task->next = 0;
+    task->wait_next = 0;
+    task->queue = 0;
+}
+
+static void task_enqueue(struct task* task) {
+    task->flags |= TASK_QUEUED;
+    task->next = 0;
+    if (task_ready_tail) {
+        task_ready_tail->next = task;
+    } else {
+        task_ready_head = task;
+    }
+    task_ready_tail = task;
+}
+
+static struct task* task_dequeue(void) {
+    struct task* task = task_ready_head;
+    if (task) {
+        task_ready_head = task->next;
+        if (!task_ready_head) {
+            task_ready_tail = 0;
+        }
+        task->next = 0;
+        task->flags = (task->flags & ~TASK_QUEUED) | TASK_RUNNING;
+    }
+    return task;
+}
+
+// Queue a new task for its first poll
+void task_spawn(struct task* task) {
+    u32 flags = irq_save();
+    task_stats.spawned++;
+    task_enqueue(task);
+    irq_restore(flags);
+}
+
+// Make a task runnable; safe from interrupt handlers. A task woken while
+// its poll is running is polled again once that returns.
+void task_wake(struct task* task) {
+    u32 flags = irq_save();
+    if (!(task->flags & (TASK_QUEUED | TASK_WOKEN | TASK_FINISHED))) {
+        task->wake_tsc = rdtsc();
+        task_stats.wakes++;
+        if (task->flags & TASK_RUNNING) {
+            task->flags |= TASK_WOKEN;
+        } else {
+            task_enqueue(task);
+        }
+    }
+    irq_restore(flags);
+}
+
+bool task_pending(void) {
+    return task_ready_head != 0;
+}
+
+// Poll ready tasks, at most TASK_RUN_BUDGET of them. Called from the idle
+// loop; returns whether anything ran.
+__hot bool task_run(void) {
+    if (!task_ready_head) {
+        return false;
+    }
+    u64 start = rdtsc();
+    u32 polled = 0;
+    while (polled < TASK_RUN_BUDGET) {
+        u32 flags = irq_save();
+        struct task* task = task_dequeue();
+        irq_restore(flags);
+        if (!task) {
+            break;
+        }
+
+        u64 begin = rdtsc();
+        if (task->wake_tsc) {
+            u64 latency = begin - task->wake_tsc;
+            task_stats.latency_total += latency;
+            task_stats.latency_samples++;
+            if (latency < task_stats.latency_min) task_stats.latency_min = latency;
+            if (latency > task_stats.latency_max) task_stats.latency_max = latency;
+            task->wake_tsc = 0;
+        }
+        int result = task->poll(task);
+        task_stats.poll_cycles += rdtsc() - begin;
+        task_stats.polls++;
+        polled++;
+
+        flags = irq_save();
+        if (result == TASK_DONE) {
+            task->flags = TASK_FINISHED;
+            task_stats.completed++;
+        } else if (task->flags & TASK_WOKEN) {
+            task->flags &= ~(TASK_RUNNING | TASK_WOKEN);
+            task_enqueue(task);
+        } else {
+            task->flags &= ~TASK_RUNNING;
+        }
+        irq_restore(flags);
+    }
+    task_stats.runs++;
+    task_stats.run_cycles += rdtsc() - start;
+    return true;
+}
+
+void task_waker_init(struct task_waker* waker, struct task* task) {
+    waker->task = task;
+    waker->status = 0;
+}
+
+void task_waker_wake(struct task_waker* waker, int status) {
+    waker->status = status;
+    task_wake(waker->task);
+}
+
+void task_queue_init(struct task_queue* queue) {
+    queue->head = 0;
+    queue->tail = 0;
+}
+
+// Take a parked task off its wait queue; interrupts must be off
+static void task_queue_unlink(struct task* task) {
+    struct task_queue* queue = task->queue;
+    struct task* previous = 0;
+    for (struct task* t = queue->head; t; previous = t, t = t->wait_next) {
+        if (t != task) continue;
+        if (previous) {
+            previous->wait_next = task->wait_next;
+        } else {
+            queue->head = task->wait_next;
+        }
+        if (queue->tail == task) {
+            queue->tail = previous;
+        }
+        break;
+    }
+    task->wait_next = 0;
+    task->queue = 0;
+}
+
+// Park the calling task until task_queue_wake_one reaches it. Called from
+// the task's own poll, which then returns TASK_PENDING. A task woken by
+// something else may park again; it keeps its place on the same queue.
+void task_queue_wait(struct task_queue* queue, struct task* task) {
+    u32 flags = irq_save();
+    if (task->queue == queue) {
+        irq_restore(flags);
+        return;
+    }
+    if (task->queue) {
+        task_queue_unlink(task);
+    }
+    task->queue = queue;
+    task->wait_next = 0;
+    if (queue->tail) {
+        queue->tail->wait_next = task;
+    } else {
+        queue->head = task;
+    }
+    queue->tail = task;
+    irq_restore(flags);
+}
+
+void task_queue_wake_one(struct task_queue* queue) {
+    u32 flags = irq_save();
+    struct task* task = queue->head;
+    if (task) {
+        queue->head = task->wait_next;
+        if (!queue->head) {
+            queue->tail = 0;
+        }
+        task->wait_next = 0;
+        task->queue = 0;
+        task_wake(task);
+    }
+    irq_restore(flags);
+}
+
+const struct task_stats* task_get_stats(void) {
+    return &task_stats;
+}
+
+void task_reset_stats(void) {
+    u32 flags = irq_save();
+    memset(&task_stats, 0, sizeof(task_stats));
+    task_stats.latency_min = (u64)-1;
+    irq_restore(flags);
+}
@@ -0,0 +1,144 @@
+#include "tunable.h"
+#include "multiboot.h"
+
+// Registered tunables in registration order. Warm restarts reset the
+// registry along with .bss, and every subsystem registers again.
+static struct tunable* tunables[TUNABLE_MAX];
+static u32 tunable_count = 0;
+
+// Parse the length characters at text as a value for tunable
+static int tunable_parse(const struct tunable* tunable, const char* text, u32 length, u32* value) {
+    if (length == 0) {
+        return TUNABLE_ERR_INVALID;
+    }
+    if (tunable->type == TUNABLE_CHOICE) {
+        for (u32 i = 0; i <= tunable->max && tunable->choices[i]; i++) {
+            if (strlen(tunable->choices[i]) == length && strncmp(tunable->choices[i], text, length) == 0) {
+                *value = i;
+                return TUNABLE_OK;
+            }
+        }
+        return TUNABLE_ERR_INVALID;
+    }
+
+    char* end;
+    u32 number = strtoul(text, &end, 0);
+    if (end != text + length) {
+        return TUNABLE_ERR_INVALID;
+    }
+    if (number < tunable->min || number > tunable->max) {
+        return TUNABLE_ERR_RANGE;
+    }
+    if ((tunable->flags & TUNABLE_POWER_OF_TWO) && (number & (number - 1))) {
+        return TUNABLE_ERR_RANGE;
+    }
+    *value = number;
+    return TUNABLE_OK;
+}
+
+// Value of `name=` on the kernel command line, up to the next space
+static const char* tunable_cmdline_value(const char* name, u32* length) {
+    const char* cmdline = multiboot_get_cmdline();
+    size_t len = strlen(name);
+    for (const char* p = cmdline; p && *p; p++) {
+        if ((p == cmdline || p[-1] == ' ') && strncmp(p, name, len) == 0 && p[len] == '=') {
+            const char* value = p + len + 1;
+            const char* end = value;
+            while (*end && *end != ' ') end++;
+            *length = end - value;
+            return value;
+        }
+    }
+    return 0;
+}
+
+// Add tunable to the registry and return its value: the command line's
+// when it gives a valid one, the compiled-in fallback otherwise. Registering
+// the same tunable again just returns its current value.
+u32 tunable_register(struct tunable* tunable) {
+    for (u32 i = 0; i < tunable_count; i++) {
+        if (tunables[i] == tunable) {
+            return tunable->value;
+        }
+    }
+
+    tunable->value = tunable->fallback;
+    tunable->source = TUNABLE_DEFAULT;
+    tunable->rejected = false;
+    u32 length;
+    const char* text = tunable_cmdline_value(tunable->name, &length);
+    if (text) {
+        u32 value;
+        if (tunable_parse(tunable, text, length, &value) == TUNABLE_OK) {
+            tunable->value = value;
+            tunable->source = TUNABLE_CMDLINE;
+        } else {
+            tunable->rejected = true;
+        }
+    }
+
+    // Past TUNABLE_MAX the value still applies but sysctl cannot see it
+    if (tunable_count < TUNABLE_MAX) {
+        tunables[tunable_count++] = tunable;
+    }
+    return tunable->value;
+}
+
+// Change a tunable at runtime through its apply function
+int tunable_set(const char* name, const char* value) {
+    struct tunable* tunable = (struct tunable*)tunable_find(name);
+    if (!tunable) {
+        return TUNABLE_ERR_NOT_FOUND;
+    }
+    if (!tunable->apply) {
+        return TUNABLE_ERR_READ_ONLY;
+    }
+    u32 parsed;
+    int status = tunable_parse(tunable, value, strlen(value), &parsed);
+    if (status != TUNABLE_OK) {
+        return status;
+    }
+    if (!tunable->apply(parsed)) {
+        return TUNABLE_ERR_INVALID;
+    }
+    tunable->value = parsed;
+    tunable->source = TUNABLE_SYSCTL;
+    return TUNABLE_OK;
+}
+
+const struct tunable* tunable_find(const char* name) {
+    for (u32 i = 0; i < tunable_count; i++) {
+        if (strcmp(tunables[i]->name, name) == 0) {
+            return tunables[i];
+        }
+    }
+    return 0;
+}
+
+u32 tunable_get_count(void) {
+    return tunable_count;
+}
+
+const struct tunable* tunable_get(u32 index) {
+    return index < tunable_count ? tunables[index] : 0;
+}
+
+// Name of a TUNABLE_CHOICE tunable's current value, 0 for numbers
+const char* tunable_value_name(const struct tunable* tunable) {
+    return tunable->type == TUNABLE_CHOICE ? tunable->choices[tunable->value] : 0;
+}
+
+static const char* tunable_errors[] = {
+    "Success",
+    "No such tunable",
+    "Invalid value",
+    "Value out of range",
+    "Fixed at boot; set it on the kernel command line",
+};
+
+const char* tunable_strerror(int status) {
+    if (status < 0 || status > TUNABLE_ERR_READ_ONLY) {
+        return "Unknown error";
+    }
+    return tunable_errors[status];
+}
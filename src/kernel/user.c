@@ -0,0 +1,62 @@
+#include "syscall.h"
+
+// Ring 3 programs linked into the kernel image. Everything here must live
+// in the .user_text/.user_data sections and may only reach the kernel
+// through system calls, so no kernel functions or .rodata strings are used.
+
+#define USER_BENCH_ITERATIONS 10000
+
+struct syscall_bench user_bench_result __user_data;
+
+static char user_banner[] __user_data = "Running null system call benchmark in ring 3...\n";
+
+static inline __attribute__((always_inline)) u32 user_rdtsc(void) {
+    u32 lo, hi;
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo;
+}
+
+static inline __attribute__((always_inline)) u32 user_int80(u32 num, u32 arg1, u32 arg2, u32 arg3) {
+    u32 ret;
+    __asm__ volatile ("int $0x80"
+                      : "=a"(ret)
+                      : "a"(num), "b"(arg1), "S"(arg2), "D"(arg3)
+                      : "ecx", "edx", "memory");
+    return ret;
+}
+
+static inline __attribute__((always_inline)) u32 user_sysenter(u32 num, u32 arg1, u32 arg2, u32 arg3) {
+    u32 ret;
+    __asm__ volatile ("movl %%esp, %%ecx\n\t"
+                      "movl $1f, %%edx\n\t"
+                      "sysenter\n"
+                      "1:"
+                      : "=a"(ret)
+                      : "a"(num), "b"(arg1), "S"(arg2), "D"(arg3)
+                      : "ecx", "edx", "memory");
+    return ret;
+}
+
+void __user_text user_syscall_bench(void) {
+    u32 iterations = USER_BENCH_ITERATIONS;
+    bool use_sysenter = user_bench_result.sysenter_used;
+
+    user_int80(SYS_WRITE, (u32)user_banner, sizeof(user_banner) - 1, 0);
+
+    u32 start = user_rdtsc();
+    for (u32 i = 0; i < iterations; i++) {
+        user_int80(SYS_NULL, 0, 0, 0);
+    }
+    user_bench_result.int80_cycles = user_rdtsc() - start;
+
+    if (use_sysenter) {
+        start = user_rdtsc();
+        for (u32 i = 0; i < iterations; i++) {
+            user_sysenter(SYS_NULL, 0, 0, 0);
+        }
+        user_bench_result.sysenter_cycles = user_rdtsc() - start;
+    }
+
+    user_bench_result.iterations = iterations;
+    user_int80(SYS_EXIT, 0, 0, 0);
+}
\ No newline at end of file
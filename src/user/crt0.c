@@ -0,0 +1,18 @@
+#include "user.h"
+
+// Program entry: the kernel leaves argc, argv[] and envp[] on the stack
+
+int main(int argc, char* argv[]);
+
+void user_start(int argc, char* argv[]) {
+    sys_exit(main(argc, argv));
+}
+
+__asm__ (".globl _start\n"
+         "_start:\n"
+         "    xorl %ebp, %ebp\n"
+         "    movl (%esp), %eax\n"
+         "    leal 4(%esp), %edx\n"
+         "    pushl %edx\n"
+         "    pushl %eax\n"
+         "    call user_start\n");
\ No newline at end of file
@@ -0,0 +1,23 @@
+#include "user.h"
+
+// Dies on an exception so the kernel's fault exit path gets exercised:
+// argv[1] picks a page fault (default), a general protection fault or a
+// divide error. The shell must carry on with interrupts enabled.
+
+int main(int argc, char* argv[]) {
+    const char* kind = argc > 1 ? argv[1] : "page";
+
+    print("Raising ");
+    print(kind);
+    print(" fault\n");
+    if (kind[0] == 'g') {
+        __asm__ volatile ("cli");               // Privileged at IOPL 0
+    } else if (kind[0] == 'd') {
+        volatile u32 zero = 0;
+        print_dec(1 / zero);
+    } else {
+        *(volatile u32*)0 = 1;                  // Below user space
+    }
+    print("Fault was not raised\n");
+    return 1;
+}
@@ -0,0 +1,13 @@
+#include "user.h"
+
+int main(int argc, char* argv[]) {
+    print("Hello from a ring 3 ELF module!\n");
+    for (int i = 0; i < argc; i++) {
+        print("  argv[");
+        print_dec(i);
+        print("] = ");
+        print(argv[i]);
+        print("\n");
+    }
+    return 0;
+}
\ No newline at end of file
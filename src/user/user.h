@@ -0,0 +1,58 @@
+#ifndef USER_H
+#define USER_H
+
+#include "kernel.h"
+#include "syscall.h"
+
+// System call wrappers for ring 3 programs loaded as boot modules
+
+static inline u32 user_syscall(u32 num, u32 arg1, u32 arg2, u32 arg3) {
+    u32 ret;
+    __asm__ volatile ("int $0x80"
+                      : "=a"(ret)
+                      : "a"(num), "b"(arg1), "S"(arg2), "D"(arg3)
+                      : "ecx", "edx", "memory");
+    return ret;
+}
+
+static inline void sys_exit(u32 code) {
+    user_syscall(SYS_EXIT, code, 0, 0);
+}
+
+static inline u32 sys_write(const char* buffer, u32 length) {
+    return user_syscall(SYS_WRITE, (u32)buffer, length, 0);
+}
+
+static inline u32 sys_getticks(void) {
+    return user_syscall(SYS_GETTICKS, 0, 0, 0);
+}
+
+static inline u32 str_length(const char* str) {
+    u32 len = 0;
+    while (str[len]) len++;
+    return len;
+}
+
+static inline void print(const char* str) {
+    sys_write(str, str_length(str));
+}
+
+static inline u32 parse_dec(const char* str) {
+    u32 value = 0;
+    while (*str >= '0' && *str <= '9') {
+        value = value * 10 + (*str++ - '0');
+    }
+    return value;
+}
+
+static inline void print_dec(u32 value) {
+    char digits[10];
+    int n = 0;
+    do {
+        digits[n++] = '0' + value % 10;
+        value /= 10;
+    } while (value);
+    while (n > 0) sys_write(&digits[--n], 1);
+}
+
+#endif
\ No newline at end of file
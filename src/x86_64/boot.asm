@@ -0,0 +1,278 @@
+; x86-64 entry. GRUB starts a Multiboot2 kernel in 32-bit protected mode
+; whatever its ELF class, so start is the i386 entry point up to the stack
+; setup; the trampoline after it identity maps the low 4 GiB with 2 MiB
+; pages, enables long mode and calls kernel_main in 64-bit code.
+
+; Multiboot2 header
+MAGIC    equ 0xe85250d6                ; multiboot2 magic number
+ARCH     equ 0                         ; protected mode i386 (entered in 32-bit mode)
+LENGTH   equ multiboot_end - multiboot_start
+CHECKSUM equ -(MAGIC + ARCH + LENGTH)  ; checksum
+
+section .multiboot
+align 8
+multiboot_start:
+    dd MAGIC
+    dd ARCH
+    dd LENGTH
+    dd CHECKSUM
+
+    ; Module alignment tag: load modules on page boundaries
+    dw 6    ; type
+    dw 0    ; flags
+    dd 8    ; size
+
+    ; End tag
+    dw 0    ; type
+    dw 0    ; flags
+    dd 8    ; size
+multiboot_end:
+
+; Warm restart: eax carries this instead of the Multiboot2 magic
+MB2_BOOTLOADER_MAGIC equ 0x36d76289
+WARM_MAGIC           equ 0x5741524D    ; "WARM"
+WARM_MBI_MAX         equ 16384         ; REBOOT_MBI_MAX in reboot.h
+
+; struct reboot_warm_info field offsets
+WARM_SNAPSHOT        equ 0
+WARM_ENTRY           equ 4
+
+; Long mode switch
+CR0_PG               equ 0x80000000
+CR4_PAE              equ 0x20
+MSR_EFER             equ 0xC0000080
+EFER_LME             equ 0x100
+CPUID_EXT_LM         equ 1 << 29       ; CPUID 0x80000001 EDX: long mode
+PAGE_PRESENT_WRITE   equ 0x003
+PAGE_LARGE           equ 0x080
+IDENTITY_DIRECTORIES equ 4             ; One per GiB mapped
+BOOT_CODE64          equ 0x08          ; Selectors in boot_gdt and gdt.c
+BOOT_DATA            equ 0x10
+GDT_KERNEL_CODE32    equ 0x18          ; In gdt.c only
+
+; Boot page tables: one PML4 entry, one PDPT entry per GiB and four page
+; directories of 2 MiB pages. paging.c splits the first 2 MiB later.
+section .bss align=4096
+global boot_pd
+boot_pml4:
+    resq 512
+boot_pdpt:
+    resq 512
+boot_pd:
+    resq 512 * IDENTITY_DIRECTORIES
+
+; Stack
+alignb 16
+stack_bottom:
+    resb 16384  ; 16 KiB stack
+stack_top:
+
+; Survives warm restarts (see linker.ld)
+section .warm nobits alloc write align=16
+global reboot_mbi
+global reboot_info
+reboot_mbi:
+    resb WARM_MBI_MAX
+reboot_info:
+    resb 32
+
+extern __data_start
+extern __data_end
+extern __bss_start
+extern __bss_end
+extern __warm_data
+
+; Code and data segments used until gdt_initialize replaces them
+section .rodata
+align 8
+boot_gdt:
+    dq 0
+    dq 0x00AF9A000000FFFF               ; 0x08: 64-bit kernel code
+    dq 0x00CF92000000FFFF               ; 0x10: kernel data
+boot_gdt_ptr:
+    dw boot_gdt_ptr - boot_gdt - 1
+    dq boot_gdt
+
+boot_no_long_mode:
+    db "This kernel needs a 64-bit CPU", 0
+
+; Entry point
+section .text
+bits 32
+global start
+start:
+    cld
+    cmp eax, WARM_MAGIC
+    je .warm
+
+    ; Cold boot: keep pristine copies of .data/.user and of the boot
+    ; information so a warm restart can start over from them
+    mov dword [reboot_info + WARM_ENTRY], 0
+    mov dword [reboot_info + WARM_SNAPSHOT], 0
+    cmp eax, MB2_BOOTLOADER_MAGIC
+    jne .boot
+    mov ecx, [ebx]
+    cmp ecx, WARM_MBI_MAX
+    ja .boot
+    mov esi, ebx
+    mov edi, reboot_mbi
+    rep movsb
+    mov esi, __data_start
+    mov edi, __warm_data
+    mov ecx, __data_end
+    sub ecx, esi
+    shr ecx, 2
+    rep movsd
+    mov dword [reboot_info + WARM_SNAPSHOT], 1
+    jmp .boot
+
+.warm:
+    ; Warm restart: put .data/.user back as loaded and clear .bss (which
+    ; holds the stack and page tables, so nothing here may push), then
+    ; boot from the copy of the boot information
+    mov esi, __warm_data
+    mov edi, __data_start
+    mov ecx, __data_end
+    sub ecx, edi
+    shr ecx, 2
+    rep movsd
+    mov edi, __bss_start
+    mov ecx, __bss_end
+    sub ecx, edi
+    shr ecx, 2
+    xor eax, eax
+    rep stosd
+    mov dword [reboot_info + WARM_ENTRY], 1
+    mov eax, MB2_BOOTLOADER_MAGIC
+    mov ebx, reboot_mbi
+
+.boot:
+    ; Set up stack
+    mov esp, stack_top
+
+    ; Reset EFLAGS
+    push 0
+    popf
+
+    ; The Multiboot2 magic and info pointer become kernel_main's arguments
+    mov edi, eax
+    mov esi, ebx
+
+    ; CPUID clobbers eax-edx, not the arguments
+    mov eax, 0x80000000
+    cpuid
+    cmp eax, 0x80000001
+    jb .no_long_mode
+    mov eax, 0x80000001
+    cpuid
+    test edx, CPUID_EXT_LM
+    jz .no_long_mode
+
+    ; Identity map the low 4 GiB: PML4[0] -> PDPT, PDPT[n] -> directory n
+    mov dword [boot_pml4], boot_pdpt + PAGE_PRESENT_WRITE
+    xor ecx, ecx
+.pdpt:
+    mov eax, ecx
+    shl eax, 12
+    add eax, boot_pd + PAGE_PRESENT_WRITE
+    mov [boot_pdpt + ecx * 8], eax
+    inc ecx
+    cmp ecx, IDENTITY_DIRECTORIES
+    jb .pdpt
+
+    xor ecx, ecx
+.pd:
+    mov eax, ecx
+    shl eax, 21
+    or eax, PAGE_PRESENT_WRITE | PAGE_LARGE
+    mov [boot_pd + ecx * 8], eax
+    inc ecx
+    cmp ecx, 512 * IDENTITY_DIRECTORIES
+    jb .pd
+
+    ; PAE paging with EFER.LME set is long mode
+    mov eax, boot_pml4
+    mov cr3, eax
+    mov eax, cr4
+    or eax, CR4_PAE
+    mov cr4, eax
+    mov ecx, MSR_EFER
+    rdmsr
+    or eax, EFER_LME
+    wrmsr
+    mov eax, cr0
+    or eax, CR0_PG
+    mov cr0, eax
+
+    lgdt [boot_gdt_ptr]
+    jmp BOOT_CODE64:.long_mode
+
+.no_long_mode:
+    ; Say why on the first screen line and stop
+    mov esi, boot_no_long_mode
+    mov edi, 0xB8000
+.message:
+    lodsb
+    test al, al
+    jz .stop
+    mov ah, 0x4F                        ; White on red
+    stosw
+    jmp .message
+.stop:
+    cli
+    hlt
+    jmp .stop
+
+bits 64
+.long_mode:
+    mov ax, BOOT_DATA
+    mov ds, ax
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    ; The upper halves of the registers are undefined after the switch.
+    ; Call kernel main with the Multiboot2 magic and info pointer; a null
+    ; frame pointer ends backtraces here
+    mov rsp, stack_top
+    mov edi, edi
+    mov esi, esi
+    xor ebp, ebp
+    extern kernel_main
+    call kernel_main
+
+    ; Hang if kernel returns
+    cli
+.hang:
+    hlt
+    jmp .hang
+
+; Re-enter start without going through firmware. Called with interrupts
+; off and devices quiesced. Long mode is left through a 32-bit code
+; segment: paging off ends it, then LME and PAE are cleared so the kernel
+; finds the CPU as the bootloader left it (the kernel is identity mapped).
+global reboot_warm_jump
+reboot_warm_jump:
+    cli
+    push GDT_KERNEL_CODE32
+    lea rax, [rel .compat]
+    push rax
+    retfq
+
+bits 32
+.compat:
+    mov eax, cr0
+    and eax, ~CR0_PG & 0xFFFFFFFF
+    mov cr0, eax
+    mov ecx, MSR_EFER
+    rdmsr
+    and eax, ~EFER_LME
+    wrmsr
+    mov eax, cr4
+    and eax, ~CR4_PAE
+    mov cr4, eax
+    xor eax, eax
+    mov cr3, eax
+    mov eax, WARM_MAGIC
+    jmp start
@@ -0,0 +1,51 @@
+#include "gdt.h"
+
+// GDT with 4 entries: null, kernel code (64-bit), kernel data and a 32-bit
+// kernel code segment for reboot_warm_jump. Without ring 3 there is no
+// user segment and no TSS.
+static struct gdt_entry gdt_entries[4];
+static struct gdt_ptr gdt_pointer;
+
+// Assembly function to flush GDT
+extern void gdt_flush_asm(const struct gdt_ptr* gdt_ptr);
+
+void gdt_initialize(void) {
+    gdt_pointer.limit = (sizeof(struct gdt_entry) * 4) - 1;
+    gdt_pointer.base = (uptr)&gdt_entries;
+
+    // NULL descriptor
+    gdt_set_gate(0, 0, 0, 0, 0);
+
+    // Kernel code segment: long mode ignores base and limit
+    gdt_set_gate(1, 0, 0xFFFFFFFF,
+                 GDT_ACCESS_PRESENT | GDT_ACCESS_RING0 | GDT_ACCESS_SEGMENT | GDT_ACCESS_EXEC | GDT_ACCESS_RW,
+                 GDT_GRAN_4K | GDT_GRAN_LONG | 0x0F);
+
+    // Kernel data segment
+    gdt_set_gate(2, 0, 0xFFFFFFFF,
+                 GDT_ACCESS_PRESENT | GDT_ACCESS_RING0 | GDT_ACCESS_SEGMENT | GDT_ACCESS_RW,
+                 GDT_GRAN_4K | GDT_GRAN_32BIT | 0x0F);
+
+    // 32-bit kernel code segment
+    gdt_set_gate(3, 0, 0xFFFFFFFF,
+                 GDT_ACCESS_PRESENT | GDT_ACCESS_RING0 | GDT_ACCESS_SEGMENT | GDT_ACCESS_EXEC | GDT_ACCESS_RW,
+                 GDT_GRAN_4K | GDT_GRAN_32BIT | 0x0F);
+
+    gdt_flush(&gdt_pointer);
+}
+
+void gdt_set_gate(int num, u32 base, u32 limit, u8 access, u8 gran) {
+    gdt_entries[num].base_low = (base & 0xFFFF);
+    gdt_entries[num].base_middle = (base >> 16) & 0xFF;
+    gdt_entries[num].base_high = (base >> 24) & 0xFF;
+
+    gdt_entries[num].limit_low = (limit & 0xFFFF);
+    gdt_entries[num].granularity = (limit >> 16) & 0x0F;
+
+    gdt_entries[num].granularity |= gran & 0xF0;
+    gdt_entries[num].access = access;
+}
+
+void gdt_flush(const struct gdt_ptr* gdt_ptr) {
+    gdt_flush_asm(gdt_ptr);
+}
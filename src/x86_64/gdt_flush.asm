@@ -0,0 +1,22 @@
+; GDT flush function (long mode)
+bits 64
+global gdt_flush_asm
+
+gdt_flush_asm:
+    lgdt [rdi]          ; Load GDT (pointer in the first argument register)
+
+    mov ax, 0x10        ; 0x10 is offset in GDT to data segment
+    mov ds, ax          ; Load all data segment selectors
+    mov es, ax
+    mov fs, ax
+    mov gs, ax
+    mov ss, ax
+
+    ; 0x08 is offset to code segment. Long mode has no far jump to an
+    ; immediate, so make a far return to .flush instead.
+    push 0x08
+    lea rax, [rel .flush]
+    push rax
+    retfq
+.flush:
+    ret
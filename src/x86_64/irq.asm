@@ -0,0 +1,108 @@
+; IRQ handling stubs, long mode
+bits 64
+extern irq_handler
+
+; IRQ macros
+%macro IRQ 2
+global irq%1
+irq%1:
+    cli
+    push byte 0     ; Push dummy error code
+    push byte %2    ; Push IRQ number
+    jmp irq_common_stub
+%endmacro
+
+; Define IRQs
+IRQ 0,  32    ; Timer
+IRQ 1,  33    ; Keyboard
+IRQ 2,  34    ; Cascade
+IRQ 3,  35    ; COM2
+IRQ 4,  36    ; COM1
+IRQ 5,  37    ; LPT2
+IRQ 6,  38    ; Floppy
+IRQ 7,  39    ; LPT1
+IRQ 8,  40    ; CMOS Real-time clock
+IRQ 9,  41    ; Free for peripherals
+IRQ 10, 42    ; Free for peripherals
+IRQ 11, 43    ; Free for peripherals
+IRQ 12, 44    ; PS2 Mouse
+IRQ 13, 45    ; FPU / Coprocessor / Inter-processor
+IRQ 14, 46    ; Primary ATA Hard Disk
+IRQ 15, 47    ; Secondary ATA Hard Disk
+
+; MSI vectors, delivered through the local APIC instead of the PICs
+%macro MSI 2
+global msi%1
+msi%1:
+    cli
+    push byte 0     ; Push dummy error code
+    push byte %2    ; Push vector number
+    jmp irq_common_stub
+%endmacro
+
+MSI 0,  48
+MSI 1,  49
+MSI 2,  50
+MSI 3,  51
+MSI 4,  52
+MSI 5,  53
+MSI 6,  54
+MSI 7,  55
+MSI 8,  56
+MSI 9,  57
+MSI 10, 58
+MSI 11, 59
+MSI 12, 60
+MSI 13, 61
+MSI 14, 62
+MSI 15, 63
+
+; Table of MSI stub addresses for the IDT setup
+global msi_stub_table
+msi_stub_table:
+    dq msi0, msi1, msi2, msi3, msi4, msi5, msi6, msi7
+    dq msi8, msi9, msi10, msi11, msi12, msi13, msi14, msi15
+
+; Local APIC spurious interrupt: no EOI must be sent
+global lapic_spurious_stub
+lapic_spurious_stub:
+    iretq
+
+; Common IRQ stub, the frame laid out as in isr_common_stub (isr.asm)
+irq_common_stub:
+    push rax
+    push rbx
+    push rcx
+    push rdx
+    push rsi
+    push rdi
+    push rbp
+    push r8
+    push r9
+    push r10
+    push r11
+    push r12
+    push r13
+    push r14
+    push r15
+
+    mov rdi, rsp        ; struct interrupt_context*
+    call irq_handler    ; Call C IRQ handler
+
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop r11
+    pop r10
+    pop r9
+    pop r8
+    pop rbp
+    pop rdi
+    pop rsi
+    pop rdx
+    pop rcx
+    pop rbx
+    pop rax
+    add rsp, 16     ; Clean up pushed error code and IRQ number
+    iretq           ; Return from interrupt
@@ -0,0 +1,101 @@
+; Interrupt Service Routines (ISRs), long mode
+; This file contains the assembly stubs for all CPU exceptions
+bits 64
+
+; Common interrupt handler
+extern interrupt_handler
+
+; ISR with no error code
+%macro ISR_NOERRCODE 1
+global isr%1
+isr%1:
+    cli
+    push byte 0     ; Push dummy error code
+    push byte %1    ; Push interrupt number
+    jmp isr_common_stub
+%endmacro
+
+; ISR with error code
+%macro ISR_ERRCODE 1
+global isr%1
+isr%1:
+    cli
+    push byte %1    ; Push interrupt number
+    jmp isr_common_stub
+%endmacro
+
+; Define ISRs for CPU exceptions
+ISR_NOERRCODE 0     ; Division By Zero Exception
+ISR_NOERRCODE 1     ; Debug Exception
+ISR_NOERRCODE 2     ; Non Maskable Interrupt Exception
+ISR_NOERRCODE 3     ; Breakpoint Exception
+ISR_NOERRCODE 4     ; Into Detected Overflow Exception
+ISR_NOERRCODE 5     ; Out of Bounds Exception
+ISR_NOERRCODE 6     ; Invalid Opcode Exception
+ISR_NOERRCODE 7     ; No Coprocessor Exception
+ISR_ERRCODE   8     ; Double Fault Exception
+ISR_NOERRCODE 9     ; Coprocessor Segment Overrun Exception
+ISR_ERRCODE   10    ; Bad TSS Exception
+ISR_ERRCODE   11    ; Segment Not Present Exception
+ISR_ERRCODE   12    ; Stack Fault Exception
+ISR_ERRCODE   13    ; General Protection Fault Exception
+ISR_ERRCODE   14    ; Page Fault Exception
+ISR_NOERRCODE 15    ; Unknown Interrupt Exception
+ISR_NOERRCODE 16    ; Coprocessor Fault Exception
+ISR_ERRCODE   17    ; Alignment Check Exception
+ISR_NOERRCODE 18    ; Machine Check Exception
+ISR_NOERRCODE 19    ; SIMD Floating-Point Exception
+ISR_NOERRCODE 20    ; Reserved
+ISR_NOERRCODE 21    ; Reserved
+ISR_NOERRCODE 22    ; Reserved
+ISR_NOERRCODE 23    ; Reserved
+ISR_NOERRCODE 24    ; Reserved
+ISR_NOERRCODE 25    ; Reserved
+ISR_NOERRCODE 26    ; Reserved
+ISR_NOERRCODE 27    ; Reserved
+ISR_NOERRCODE 28    ; Reserved
+ISR_NOERRCODE 29    ; Reserved
+ISR_NOERRCODE 30    ; Reserved
+ISR_NOERRCODE 31    ; Reserved
+
+; Common ISR stub. Long mode has no pusha, so the registers are pushed one
+; by one in struct interrupt_context order. The processor aligned the stack
+; to 16 bytes before pushing its 5-slot frame; with the 2 slots pushed
+; above and the 15 registers it is aligned again at the call.
+isr_common_stub:
+    push rax
+    push rbx
+    push rcx
+    push rdx
+    push rsi
+    push rdi
+    push rbp
+    push r8
+    push r9
+    push r10
+    push r11
+    push r12
+    push r13
+    push r14
+    push r15
+
+    mov rdi, rsp            ; struct interrupt_context*
+    call interrupt_handler  ; Call C interrupt handler
+
+    pop r15
+    pop r14
+    pop r13
+    pop r12
+    pop r11
+    pop r10
+    pop r9
+    pop r8
+    pop rbp
+    pop rdi
+    pop rsi
+    pop rdx
+    pop rcx
+    pop rbx
+    pop rax
+    add rsp, 16     ; Clean up pushed error code and ISR number
+    iretq           ; Return from interrupt
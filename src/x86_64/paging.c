@@ -0,0 +1,123 @@
+#include "paging.h"
+#include "pmm.h"
+
+// Long mode identity map of the low 4 GiB, built by the boot trampoline
+// (boot.asm): one page directory per GiB, all 2 MiB pages. Entries are
+// 64 bits wide; every address here is below 4 GiB, so the API keeps u32.
+#define PAGING_ENTRIES        512
+#define PAGING_DIRECTORIES    4
+#define PAGING_ADDRESS_MASK   0x000FFFFFFFFFF000ull
+
+extern u64 boot_pd[PAGING_DIRECTORIES * PAGING_ENTRIES];
+
+// Page table for the first 2 MiB
+static u64 low_page_table[PAGING_ENTRIES] __attribute__((aligned(PAGE_SIZE)));
+
+static void paging_flush(void) {
+    uptr cr3;
+    __asm__ volatile ("mov %%cr3, %0; mov %0, %%cr3" : "=r"(cr3) : : "memory");
+}
+
+void paging_initialize(void) {
+    // The first 2 MiB uses 4 KiB pages so that page 0 stays unmapped to
+    // catch NULL dereferences. There is no ring 3 on x86-64, so .user needs
+    // no opening.
+    for (u32 i = 0; i < PAGING_ENTRIES; i++) {
+        u32 addr = i * PAGE_SIZE;
+        low_page_table[i] = i ? (addr | PAGE_PRESENT | PAGE_WRITE) : 0;
+    }
+    boot_pd[0] = (uptr)low_page_table | PAGE_PRESENT | PAGE_WRITE;
+    paging_flush();
+
+    uptr cr0;
+    __asm__ volatile ("mov %%cr0, %0" : "=r"(cr0));
+    cr0 |= 0x10000;     // WP (read-only pages apply to ring 0 too)
+    __asm__ volatile ("mov %0, %%cr0" : : "r"(cr0));
+}
+
+// Page table behind the directory entry for virt, splitting a 2 MiB page
+// into 512 pages with the same flags when needed
+static u64* paging_get_table(u32 virt) {
+    u64* pde = &boot_pd[virt >> 21];
+    if (!(*pde & PAGE_PRESENT)) {
+        return 0;
+    }
+    if (*pde & PAGE_LARGE) {
+        u32 table = pmm_alloc_frame();
+        if (!table) {
+            return 0;
+        }
+        u64 base = *pde & PAGING_ADDRESS_MASK & ~(u64)(LARGE_PAGE_SIZE - 1);
+        u64 flags = *pde & ~PAGING_ADDRESS_MASK & ~(u64)PAGE_LARGE;
+        u64* entries = (u64*)(uptr)table;
+        for (u32 i = 0; i < PAGING_ENTRIES; i++) {
+            entries[i] = (base + i * PAGE_SIZE) | flags;
+        }
+        *pde = table | PAGE_PRESENT | PAGE_WRITE;
+        paging_flush();
+    }
+    return (u64*)(uptr)(*pde & PAGING_ADDRESS_MASK);
+}
+
+bool paging_map_page(u32 virt, u32 phys, u32 flags) {
+    u64* table = paging_get_table(virt);
+    if (!table) {
+        return false;
+    }
+    table[(virt >> 12) & 0x1FF] = (phys & PAGE_MASK) | (flags & ~PAGE_MASK) | PAGE_PRESENT;
+    paging_invalidate(virt);
+    return true;
+}
+
+// Remove a 4 KiB mapping and return its previous entry
+u32 paging_unmap_page(u32 virt) {
+    u64 pde = boot_pd[virt >> 21];
+    if (!(pde & PAGE_PRESENT) || (pde & PAGE_LARGE)) {
+        return 0;
+    }
+
+    u64* table = (u64*)(uptr)(pde & PAGING_ADDRESS_MASK);
+    u32 entry = table[(virt >> 12) & 0x1FF];
+    table[(virt >> 12) & 0x1FF] = 0;
+    paging_invalidate(virt);
+    return entry;
+}
+
+// Return the entry mapping virt (the directory entry for 2 MiB pages)
+u32 paging_get_entry(u32 virt) {
+    u64 pde = boot_pd[virt >> 21];
+    if (!(pde & PAGE_PRESENT) || (pde & PAGE_LARGE)) {
+        return pde;
+    }
+    return ((u64*)(uptr)(pde & PAGING_ADDRESS_MASK))[(virt >> 12) & 0x1FF];
+}
+
+// Make a device register range uncached. Everything below 4 GiB is
+// already mapped, so this only changes attributes: whole 2 MiB blocks in
+// their directory entry, partial ones after a split.
+bool paging_map_mmio(u32 phys, u32 size) {
+    u32 addr = PAGE_ALIGN_DOWN(phys);
+    u32 end = PAGE_ALIGN_UP(phys + size);
+    if (end == 0) end = 0xFFFFF000;     // Range reaching the top of memory
+
+    while (addr < end) {
+        u32 next = addr + PAGE_SIZE;
+        if (addr < PAGING_IDENTITY_LIMIT) {
+            addr = next;
+            continue;
+        }
+
+        u64* pde = &boot_pd[addr >> 21];
+        if ((*pde & PAGE_LARGE) && (addr % LARGE_PAGE_SIZE) == 0 && end - addr >= LARGE_PAGE_SIZE) {
+            *pde |= PAGE_NOCACHE | PAGE_WRITETHROUGH;
+            paging_invalidate(addr);
+            next = addr + LARGE_PAGE_SIZE;
+        } else if (!paging_map_page(addr, addr, PAGE_WRITE | PAGE_NOCACHE | PAGE_WRITETHROUGH)) {
+            return false;
+        }
+
+        if (next <= addr) break;    // Wrapped past 4 GiB
+        addr = next;
+    }
+    return true;
+}
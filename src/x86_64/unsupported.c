@@ -0,0 +1,79 @@
+#include "syscall.h"
+#include "elf.h"
+#include "kprobe.h"
+
+// Subsystems the x86-64 kernel leaves out, so the shared boot sequence and
+// shell link unchanged. Ring 3 (system calls, user programs and the ELF
+// loader) is built on i386 segments, the TSS, SYSENTER and ELF32 modules;
+// kprobes patch and single-step through the 32-bit interrupt frame.
+
+struct syscall_bench user_bench_result;
+
+static struct elf_exec_stats elf_stats;
+
+void syscall_initialize(void) {
+}
+
+bool syscall_sysenter_supported(void) {
+    return false;
+}
+
+u32 user_run(void (*entry)(void)) {
+    (void)entry;
+    return SYSCALL_ERROR;
+}
+
+void user_syscall_bench(void) {
+}
+
+// Only reached for a fault with a ring 3 selector, which cannot happen here
+void user_exit(u32 code) {
+    (void)code;
+    kernel_panic("No ring 3 on x86-64");
+}
+
+void elf_initialize(void) {
+}
+
+int elf_exec(const char* module_name, int argc, char* argv[], u32* exit_code) {
+    (void)module_name; (void)argc; (void)argv; (void)exit_code;
+    return ELF_ERR_FORMAT;
+}
+
+const struct elf_exec_stats* elf_get_stats(void) {
+    return &elf_stats;
+}
+
+const char* elf_strerror(int status) {
+    (void)status;
+    return "User programs need the i386 kernel";
+}
+
+void kprobe_initialize(void) {
+}
+
+int kprobe_add(const char* name) {
+    (void)name;
+    return KPROBE_ERR_REFUSED;
+}
+
+int kprobe_remove(const char* name) {
+    (void)name;
+    return KPROBE_ERR_NOT_FOUND;
+}
+
+void kprobe_remove_all(void) {
+}
+
+void kprobe_reset(void) {
+}
+
+const struct kprobe* kprobe_get(u32 index) {
+    (void)index;
+    return 0;
+}
+
+const char* kprobe_strerror(int status) {
+    (void)status;
+    return "Probes need the i386 kernel";
+}